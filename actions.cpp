@@ -6,9 +6,22 @@
 #include "peparser.h"
 #include "widestring.h"
 #include "resourcepath.h"
+#include "resourcebuilder.h"
+#include "resourcepatch.h"
+#include "resourcestore.h"
+#include "authenticode.h"
+#include "catalog.h"
+#include "certificatetable.h"
+#include "checksum.h"
+#include "signatureverifier.h"
+#include "versioninventory.h"
 #include "signer.h"
+#include "pkcs11signer.h"
+#include "remotesigning.h"
+#include "signingagent.h"
 #include "etoken.h"
 #include "dependencycheck.h"
+#include "threadpool.h"
 
 #pragma warning(push)
 #pragma warning(disable : 4996)
@@ -16,12 +29,19 @@
 #include <boost/algorithm/string/split.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/io/ios_state.hpp>
 #pragma warning(pop)
 
+#include <io.h>
+#include <fcntl.h>
+
 #include <iostream>
 #include <fstream>
+#include <iomanip>
 #include <vector>
 #include <string>
+#include <map>
+#include <algorithm>
 
 namespace po = boost::program_options;
 
@@ -100,7 +120,7 @@ namespace peparser
 		for (auto& input : inputs)
 		{
 			PEParser pe(input);
-			pe.Open();
+			pe.OpenMetadata();
 
 			if (!pe.IsValidPE() || pe.PDBPath().empty())
 				continue;
@@ -129,7 +149,7 @@ namespace peparser
 		auto inputs = variables["input"].as<std::vector<std::wstring>>();
 
 		PEParser pe(inputs[0]);
-		pe.Open();
+		pe.OpenMetadata();
 
 		if (!pe.IsValidPE())
 			return;
@@ -158,7 +178,7 @@ namespace peparser
 		auto inputs = variables["input"].as<std::vector<std::wstring>>();
 
 		PEParser pe(inputs[0]);
-		pe.Open();
+		pe.OpenMetadata();
 
 		if (!pe.IsValidPE())
 		{
@@ -166,12 +186,125 @@ namespace peparser
 			return;
 		}
 
+		if (variables["functions"].as<bool>())
+		{
+			pe.Imports().PrintInfo(*out);
+			return;
+		}
+
 		auto imports = pe.AllDllImports();
 
 		for (auto& import : imports)
 			*out << MultiByteToWideString(import) << L'\n';
 	}
 
+	void Exports(const po::variables_map& variables, int& retcode)
+	{
+		retcode = 1;
+
+		if (!variables.count("input"))
+		{
+			std::wcerr << L"Error parsing options: must have some input files." << std::endl;
+			return;
+		}
+
+		auto out = OpenOutput<wchar_t>(variables);
+		if (!out) 
+			return;
+
+		retcode = 0;
+
+		StringPoolPtr pool(new StringPool());
+
+		auto inputs = variables["input"].as<std::vector<std::wstring>>();
+		for (auto& input : inputs)
+		{
+			PEParser pe(input);
+			pe.SetStringPool(pool);
+			pe.OpenMetadata();
+
+			if (!pe.IsValidPE())
+			{
+				retcode = 1;
+				continue;
+			}
+
+			*out << input << L":\n";
+			pe.Exports().PrintInfo(*out);
+			*out << L'\n';
+		}
+
+		*out << std::flush;
+	}
+
+	void CheckImports(const po::variables_map& variables, int& retcode)
+	{
+		retcode = 1;
+
+		if (!variables.count("input"))
+		{
+			std::wcerr << L"Error parsing options: must have some input files." << std::endl;
+			return;
+		}
+
+		auto out = OpenOutput<wchar_t>(variables);
+		if (!out) 
+			return;
+
+		auto inputs = variables["input"].as<std::vector<std::wstring>>();
+
+		// one pool for all files, module and symbol names repeat a lot across a product
+		StringPoolPtr pool(new StringPool());
+		std::vector<std::shared_ptr<PEParser>> parsers;
+		ExportIndex index;
+
+		for (auto& input : inputs)
+		{
+			std::shared_ptr<PEParser> pe(new PEParser(input));
+			pe->SetStringPool(pool);
+			pe->OpenMetadata();
+
+			if (!pe->IsValidPE())
+			{
+				std::wcerr << L"Not a valid PE file: " << input << std::endl;
+				return;
+			}
+
+			index.Add(boost::filesystem::path(input).filename().wstring(), pe->Exports());
+			parsers.push_back(pe);
+		}
+
+		retcode = 0;
+
+		for (size_t file = 0; file < parsers.size(); ++file)
+		{
+			const ImportTable& imports = parsers[file]->Imports();
+
+			for (auto& module : imports.Modules())
+			{
+				// only dlls from the input set can be checked
+				std::string moduleName = imports.Name(module.name);
+				if (!index.Contains(moduleName))
+					continue;
+
+				for (DWORD i = module.firstFunction; i < module.firstFunction + module.functionCount; ++i)
+				{
+					const ImportedFunction& function = imports.Functions()[i];
+					std::string symbol = function.ByOrdinal() ? "#" + boost::lexical_cast<std::string>(function.ordinal) : imports.Name(function.name);
+
+					auto resolution = index.Resolve(moduleName, symbol);
+					if (resolution.IsResolved() || resolution.external)
+						continue;
+
+					*out << inputs[file] << L": " << MultiByteToWideString(moduleName) << L"!" << MultiByteToWideString(symbol) << L" is not exported\n";
+					retcode = 1;
+				}
+			}
+		}
+
+		*out << std::flush;
+	}
+
 	void Compare(const po::variables_map& variables, int& retcode)
 	{
 		retcode = 1;
@@ -249,7 +382,7 @@ namespace peparser
 		for (auto& input : inputs)
 		{
 			PEParser pe(input);
-			pe.Open();
+			pe.OpenMetadata();
 
 			if (!pe.IsSigned()) retcode = 1;
 
@@ -328,7 +461,7 @@ namespace peparser
 		ResourceEntryPtr target = res->AtPath(resource);
 
 		if (target && !target->IsData() && target->Entries().size() == 1)
-			target = target->Entries().begin()->second;
+			target = target->Entries().front();
 
 		if (!target)
 		{
@@ -341,188 +474,629 @@ namespace peparser
 		retcode = 0;
 	}
 
-	void DeleteResource(const boost::program_options::variables_map& variables, int& retcode)
+	// file names of the inputs, repeated names (case insensitive) get a counter
+	std::vector<std::wstring> UniqueFileNames(const std::vector<std::wstring>& inputs)
+	{
+		std::vector<std::wstring> result;
+		std::map<std::wstring, size_t> names;
+		for (auto& input : inputs)
+		{
+			std::wstring name = boost::filesystem::path(input).filename().wstring();
+			size_t count = names[boost::algorithm::to_lower_copy(name)]++;
+			if (count)
+				name += L"~" + std::to_wstring(count);
+
+			result.push_back(name);
+		}
+
+		return result;
+	}
+
+	void ExtractResources(const po::variables_map& variables, int& retcode)
 	{
+		namespace fs = boost::filesystem;
+
 		retcode = 1;
 
-		std::vector<std::wstring> inputs;
-		if (variables.count("input"))
-			inputs = variables["input"].as<std::vector<std::wstring>>();
-		if (inputs.size() != 1)
+		if (!variables.count("input"))
 		{
-			std::wcerr << L"Error parsing options: must have 1 input file." << std::endl;
+			std::wcerr << L"Error parsing options: must have some input files." << std::endl;
 			return;
 		}
 
-		auto binaryPath = inputs[0];
-
-		if (variables.count("resource") != 1)
+		if (!variables.count("to"))
 		{
-			std::wcerr << L"Error parsing options: must have valid resource path (type/name/lang)." << std::endl;
+			std::wcerr << L"Error parsing options: must have output directory (--to)." << std::endl;
 			return;
 		}
 
-		auto resource = variables["delete-resource"].as<std::wstring>();
-
-		retcode = 0;
+		auto out = OpenOutput<wchar_t>(variables);
+		if (!out) 
+			return;
 
-		std::vector<WORD> lang_ids;
-		bool allLanguages = true;
-		ResourcePath path;
+		ResourcePattern pattern(variables["extract-resources"].as<std::wstring>());
+		fs::path target = variables["to"].as<std::wstring>();
+		size_t threads = variables["threads"].as<size_t>();
+		auto inputs = variables["input"].as<std::vector<std::wstring>>();
 
-		if (!ParsePath(binaryPath, resource, path, lang_ids, allLanguages))
+		boost::system::error_code error;
+		if (!fs::is_directory(target, error) && !fs::create_directories(target, error))
 		{
-			retcode = 1;
+			std::wcerr << L"Failed to create path: " << target.wstring() << std::endl;
 			return;
 		}
 
-		HANDLE binaryHandle = BeginUpdateResource(binaryPath.c_str(), FALSE);
-		if (!binaryHandle)
+		// every input gets a directory named after the file
+		std::vector<fs::path> directories;
+		for (auto& name : UniqueFileNames(inputs))
+			directories.push_back(target / name);
+
+		struct Result
 		{
-			std::wcerr << L"File is missing, locked or has invalid format." << std::endl;
-			retcode = 1;
-			return;
-		}
+			size_t extracted = 0;
+			std::wstring error;
+		};
+		std::vector<Result> results(inputs.size());
+
+		ParallelForEach(inputs.size(), threads, [&](size_t i)
+		{
+			Result& result = results[i];
+
+			PEParser pe(inputs[i]);
+			pe.Open();
+			if (!pe.IsValidPE())
+			{
+				result.error = L"Can't open file for reading or invalid format.";
+				return;
+			}
+
+			std::vector<ResourceEntryPtr> entries;
+			pattern.Collect(pe.ResourceDirectory(), entries);
+
+			for (auto& entry : entries)
+			{
+				fs::path file = directories[i] / ResourceFilePath(entry->FullPath());
+
+				boost::system::error_code error;
+				fs::create_directories(file.parent_path(), error);
+
+				if (error)
+				{
+					result.error = L"Failed to create " + file.parent_path().wstring();
+					return;
+				}
+
+				if (!entry->SaveTo(pe, file.wstring()))
+				{
+					result.error = L"Resource data is outside of the file or failed to write " + file.wstring();
+					return;
+				}
+
+				++result.extracted;
+			}
+		});
+
+		retcode = 0;
 
-		for (auto lang : lang_ids)
+		// reported in input order once everything is done
+		for (size_t i = 0; i < inputs.size(); ++i)
 		{
-			if (!UpdateResource(binaryHandle, path.Type(), path.Name(), lang, NULL, 0))
+			if (!results[i].error.empty())
 			{
-				std::wcerr << L"Failed to update resource. Error: " << GetLastError() << std::endl;
+				std::wcerr << inputs[i] << L": " << results[i].error << std::endl;
 				retcode = 1;
-				break;
+				continue;
 			}
+
+			*out << inputs[i] << L": " << results[i].extracted << L" resources\n";
 		}
 
-		if (!EndUpdateResource(binaryHandle, retcode != 0))
-			retcode = 1;
+		*out << std::flush;
 	}
 
-	void DeleteSignature(const po::variables_map& variables, int& retcode)
+	void StoreResources(const po::variables_map& variables, int& retcode)
 	{
+		namespace fs = boost::filesystem;
+
 		retcode = 1;
+
 		if (!variables.count("input"))
 		{
-			std::wcerr << L"Error parsing options: must have some input files." << L'\n';
+			std::wcerr << L"Error parsing options: must have some input files." << std::endl;
 			return;
 		}
-		auto inputs = variables["input"].as<std::vector<std::wstring>>();
-
-		retcode = 0;
-		for (auto& input : inputs)
-		{
-			std::wcout << input << std::endl;
 
-			StripSignature(input, retcode);
-		}
-	}
+		auto out = OpenOutput<wchar_t>(variables);
+		if (!out)
+			return;
 
-	std::shared_ptr<BYTE> ProcessNode(HANDLE handle, ResourceEntryPtr node, const po::variables_map& variables)
-	{
-		VS_VersionInfo info(node->Address(), node->Size());
+		ResourceStore store(variables["store-resources"].as<std::wstring>());
+		fs::path indexes = (variables.count("to")) ? fs::path(variables["to"].as<std::wstring>()) : fs::path(variables["store-resources"].as<std::wstring>()) / L"index";
+		size_t threads = variables["threads"].as<size_t>();
+		auto inputs = variables["input"].as<std::vector<std::wstring>>();
 
-		if (variables.count("set-version"))
+		std::wstring storeError;
+		if (!store.Create(storeError))
 		{
-			VersionString version = variables["set-version"].as<std::wstring>();
-			info.SetField(StringTable::FileVersion, version);
-			info.SetField(StringTable::ProductVersion, version);
+			std::wcerr << storeError << std::endl;
+			return;
 		}
-		if (variables.count("set-file-version"))
+
+		boost::system::error_code error;
+		if (!fs::is_directory(indexes, error) && !fs::create_directories(indexes, error))
 		{
-			VersionString fileVersion = variables["set-file-version"].as<std::wstring>();
-			info.SetField(StringTable::FileVersion, fileVersion);
+			std::wcerr << L"Failed to create path: " << indexes.wstring() << std::endl;
+			return;
 		}
-		if (variables.count("set-product-version"))
+
+		// every input gets an index named after the file
+		std::vector<fs::path> indexPaths;
+		for (auto& name : UniqueFileNames(inputs))
+			indexPaths.push_back(indexes / (name + L".txt"));
+
+		struct Result
 		{
-			VersionString productVersion = variables["set-product-version"].as<std::wstring>();
-			info.SetField(StringTable::ProductVersion, productVersion);
-		}
-		if (variables.count("set-file-description"))
+			size_t stored = 0;
+			size_t added = 0;
+			std::wstring error;
+		};
+		std::vector<Result> results(inputs.size());
+
+		ParallelForEach(inputs.size(), threads, [&](size_t i)
 		{
-			info.SetField(StringTable::FileDescription, variables["set-file-description"].as<std::wstring>());
-		}
-		if (variables.count("set-internal-name"))
+			Result& result = results[i];
+
+			PEParser pe(inputs[i]);
+			pe.Open();
+			if (!pe.IsValidPE())
+			{
+				result.error = L"Can't open file for reading or invalid format.";
+				return;
+			}
+
+			std::string index;
+			if (!store.Add(pe, index, result.added, result.error))
+				return;
+
+			std::ofstream file(indexPaths[i].wstring().c_str(), std::ios_base::trunc | std::ios_base::binary);
+			if (!file.write(index.data(), index.size()) || !file.flush())
+			{
+				result.error = L"Failed to write " + indexPaths[i].wstring();
+				return;
+			}
+
+			result.stored = std::count(index.begin(), index.end(), '\n');
+		});
+
+		retcode = 0;
+
+		for (size_t i = 0; i < inputs.size(); ++i)
 		{
-			info.SetField(StringTable::InternalName, variables["set-internal-name"].as<std::wstring>());
+			if (!results[i].error.empty())
+			{
+				std::wcerr << inputs[i] << L": " << results[i].error << std::endl;
+				retcode = 1;
+				continue;
+			}
+
+			*out << inputs[i] << L": " << results[i].stored << L" resources, " << results[i].added << L" new\n";
 		}
-		if (variables.count("set-copyright"))
+
+		*out << std::flush;
+	}
+
+	void Inventory(const po::variables_map& variables, int& retcode)
+	{
+		retcode = 1;
+
+		if (!variables.count("input"))
 		{
-			info.SetField(StringTable::LegalCopyright, variables["set-copyright"].as<std::wstring>());
+			std::wcerr << L"Error parsing options: must have some input files." << std::endl;
+			return;
 		}
-		if (variables.count("set-original-name"))
+
+		auto out = OpenOutput<char>(variables);
+		if (!out) 
+			return;
+
+		// rows already end with "\r\n" as CSV wants, text mode console would turn that into "\r\r\n"
+		if (!variables.count("output"))
 		{
-			info.SetField(StringTable::OriginalFilename, variables["set-original-name"].as<std::wstring>());
+			std::cout.flush();
+			_setmode(_fileno(stdout), _O_BINARY);
 		}
-		if (variables.count("set-product-name"))
+
+		VersionInventory inventory(variables["json"].as<bool>() ? VersionInventory::JsonLines : VersionInventory::Csv);
+		size_t threads = variables["threads"].as<size_t>();
+		auto inputs = variables["input"].as<std::vector<std::wstring>>();
+
+		struct Result
 		{
-			info.SetField(StringTable::ProductName, variables["set-product-name"].as<std::wstring>());
-		}
+			std::string rows;
+			std::wstring error;
+		};
 
-		std::shared_ptr<BYTE> data = info.NewData();
+		retcode = 0;
+		*out << inventory.Header();
 
-		if (!UpdateResource(handle, MAKEINTRESOURCE(16), MAKEINTRESOURCE(1), (WORD)std::stoi(node->Name()), data.get(), (WORD)info.NewSize()))
+		OrderedParallelForEach<Result>(inputs.size(), threads, *out, [&](size_t i, Result& result)
 		{
-			std::wcerr << L"Failed to update resource. Error: " << GetLastError() << L" Path: 16/1/" << node->Name() << std::endl;
-			return std::shared_ptr<BYTE>();
-		}
+			inventory.Rows(inputs[i], result.rows, result.error);
+		},
+		[&](size_t i, const Result& result)
+		{
+			if (!result.error.empty())
+			{
+				std::wcerr << inputs[i] << L": " << result.error << std::endl;
+				retcode = 1;
+				return;
+			}
 
-		return data;
+			*out << result.rows;
+		});
 	}
 
-	void Edit(const po::variables_map& variables, int& retcode)
+	void AuthenticodeHash(const po::variables_map& variables, int& retcode)
 	{
 		retcode = 1;
+
 		if (!variables.count("input"))
 		{
-			std::wcerr << L"Error parsing options: must have some input files.\n";
+			std::wcerr << L"Error parsing options: must have some input files." << std::endl;
 			return;
 		}
 
-		auto inputs = variables["input"].as<std::vector<std::wstring>>();
-		bool noResourceRebuild = variables["no-resource-rebuild"].as<bool>();
-
-		retcode = 0;
-		for (auto& input : inputs)
+		std::vector<HashAlgorithm> algorithms;
+		std::vector<std::wstring> names;
+		boost::algorithm::split(names, variables["hash"].as<std::wstring>(), boost::algorithm::is_any_of(L","), boost::algorithm::token_compress_on);
+		for (auto& name : names)
 		{
-			StripSignature(input, retcode);
-
-			if (!noResourceRebuild)
+			HashAlgorithm algorithm;
+			if (!ParseHashAlgorithm(boost::algorithm::trim_copy(name), algorithm))
 			{
-				HANDLE binaryHandle = NULL;
-				{
-					PEParser pe(input);
-					pe.Open();
-					if (!pe.IsValidPE())
-					{
-						std::wcerr << L"Can't open file for reading or invalid format." << std::endl;
-						continue;
-					}
+				std::wcerr << L"Error parsing options: unknown hash algorithm: " << name << std::endl;
+				return;
+			}
 
-					std::vector<std::shared_ptr<BYTE>> data;
+			algorithms.push_back(algorithm);
+		}
 
-					binaryHandle = BeginUpdateResource(input.c_str(), FALSE);
-					if (!binaryHandle)
-					{
-						std::wcerr << L"Can't lock file for updating resources." << std::endl;
-						continue;
-					}
+		auto out = OpenOutput<wchar_t>(variables);
+		if (!out)
+			return;
 
-					ResourceEntryPtr node;
-					if (pe.ResourceDirectory())
-						node = pe.ResourceDirectory()->AtPath(L"16/1");
+		size_t threads = variables["threads"].as<size_t>();
+		auto inputs = variables["input"].as<std::vector<std::wstring>>();
 
-					if (!node) 
-						continue;
+		struct Result
+		{
+			std::vector<std::vector<BYTE>> digests;
+			std::wstring error;
+		};
 
-					bool success = true;
-					if (node->IsData())
-						data.push_back(ProcessNode(binaryHandle, node, variables));
-					else
-						for (auto& entry : node->Entries())
-							data.push_back(ProcessNode(binaryHandle, entry.second, variables));
+		retcode = 0;
+
+		OrderedParallelForEach<Result>(inputs.size(), threads, *out, [&](size_t i, Result& result)
+		{
+			AuthenticodeDigest(inputs[i], algorithms, result.digests, result.error);
+		},
+		[&](size_t i, const Result& result)
+		{
+			if (!result.error.empty())
+			{
+				std::wcerr << inputs[i] << L": " << result.error << std::endl;
+				retcode = 1;
+				return;
+			}
+
+			*out << inputs[i] << L":";
+			for (size_t k = 0; k < algorithms.size(); ++k)
+				*out << L" " << HashAlgorithmName(algorithms[k]) << L":" << Hash::ToHex(result.digests[k]);
+			*out << L"\n";
+		});
+	}
+
+	void VerifyChecksum(const po::variables_map& variables, int& retcode)
+	{
+		retcode = 1;
+
+		if (!variables.count("input"))
+		{
+			std::wcerr << L"Error parsing options: must have some input files." << std::endl;
+			return;
+		}
+
+		auto out = OpenOutput<wchar_t>(variables);
+		if (!out)
+			return;
+
+		size_t threads = variables["threads"].as<size_t>();
+		auto inputs = variables["input"].as<std::vector<std::wstring>>();
+
+		struct Result
+		{
+			DWORD stored = 0;
+			DWORD actual = 0;
+			std::wstring error;
+		};
+
+		retcode = 0;
+
+		OrderedParallelForEach<Result>(inputs.size(), threads, *out, [&](size_t i, Result& result)
+		{
+			// headers and a sequential read of the file, no mapping needed
+			HANDLE file = CreateFile(inputs[i].c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+			if (file == INVALID_HANDLE_VALUE)
+			{
+				result.error = L"Can't open file for reading.";
+				return;
+			}
+
+			CertificateTableInfo info;
+			if (!ReadCertificateTableInfo(file, info))
+				result.error = L"Invalid PE format.";
+			else if (!FileChecksum(file, info.fileSize, info.checksumOffset, result.actual))
+				result.error = L"Failed to read file.";
+
+			result.stored = info.checksum;
+			CloseHandle(file);
+		},
+		[&](size_t i, const Result& result)
+		{
+			if (!result.error.empty())
+			{
+				std::wcerr << inputs[i] << L": " << result.error << std::endl;
+				retcode = 1;
+				return;
+			}
+
+			boost::io::ios_flags_saver flags(*out);
+			*out << inputs[i] << L": " << std::hex << std::setfill(L'0');
+
+			// zero means the image has no checksum, only drivers and a few system dlls are required to have one
+			if (result.stored == 0)
+				*out << L"not set, actual 0x" << std::setw(8) << result.actual << L"\n";
+			else if (result.stored == result.actual)
+				*out << L"ok 0x" << std::setw(8) << result.actual << L"\n";
+			else
+			{
+				*out << L"mismatch, stored 0x" << std::setw(8) << result.stored << L" actual 0x" << std::setw(8) << result.actual << L"\n";
+				retcode = 1;
+			}
+		});
+	}
+
+	void VerifySignatures(const po::variables_map& variables, int& retcode)
+	{
+		retcode = 1;
+
+		if (!variables.count("input"))
+		{
+			std::wcerr << L"Error parsing options: must have some input files." << std::endl;
+			return;
+		}
+
+		std::vector<std::vector<BYTE>> trustedRoots;
+		if (variables.count("trust-bundle"))
+		{
+			auto bundle = variables["trust-bundle"].as<std::wstring>();
+			if (!ReadCertificateFile(bundle, trustedRoots) || trustedRoots.empty())
+			{
+				std::wcerr << L"Failed to read certificates from " << bundle << std::endl;
+				return;
+			}
+		}
+
+		SignatureVerifier verifier(trustedRoots);
+		if (!verifier.IsValid())
+		{
+			std::wcerr << L"Failed to set up certificate chain verification." << std::endl;
+			return;
+		}
+
+		auto out = OpenOutput<char>(variables);
+		if (!out)
+			return;
+
+		bool json = variables["json"].as<bool>();
+		size_t threads = variables["threads"].as<size_t>();
+		auto inputs = variables["input"].as<std::vector<std::wstring>>();
+
+		struct Result
+		{
+			FileSignatures signatures;
+			std::wstring error;
+		};
+
+		retcode = 0;
+
+		OrderedParallelForEach<Result>(inputs.size(), threads, *out, [&](size_t i, Result& result)
+		{
+			verifier.Verify(inputs[i], result.signatures, result.error);
+		},
+		[&](size_t i, const Result& result)
+		{
+			if (!result.error.empty())
+			{
+				std::wcerr << inputs[i] << L": " << result.error << std::endl;
+				retcode = 1;
+				return;
+			}
+
+			if (!result.signatures.IsValid())
+				retcode = 1;
+
+			*out << SignatureVerifier::Report(inputs[i], result.signatures, json);
+		});
+	}
+
+	void DeleteResource(const boost::program_options::variables_map& variables, int& retcode)
+	{
+		retcode = 1;
+
+		std::vector<std::wstring> inputs;
+		if (variables.count("input"))
+			inputs = variables["input"].as<std::vector<std::wstring>>();
+		if (inputs.size() != 1)
+		{
+			std::wcerr << L"Error parsing options: must have 1 input file." << std::endl;
+			return;
+		}
+
+		auto binaryPath = inputs[0];
+		auto resource = variables["delete-resource"].as<std::wstring>();
+
+		PEParser pe(binaryPath);
+		pe.Open();
+
+		ResourceSectionBuilder builder;
+		if (!builder.Load(pe))
+		{
+			std::wcerr << L"File is missing, locked, has invalid format or resource data outside of the file." << std::endl;
+			return;
+		}
+
+		// "type/name" removes all languages
+		if (!builder.Delete(resource))
+		{
+			std::wcerr << L"Error parsing options: must have valid resource path (type/name/lang) of an existing resource." << std::endl;
+			return;
+		}
+
+		if (builder.Commit(pe))
+			retcode = 0;
+	}
+
+	void DeleteSignature(const po::variables_map& variables, int& retcode)
+	{
+		retcode = 1;
+		if (!variables.count("input"))
+		{
+			std::wcerr << L"Error parsing options: must have some input files." << L'\n';
+			return;
+		}
+		auto inputs = variables["input"].as<std::vector<std::wstring>>();
+		size_t threads = variables["threads"].as<size_t>();
+
+		std::vector<std::wstring> errors(inputs.size());
+		ParallelForEach(inputs.size(), threads, [&](size_t i)
+		{
+			StripSignature(inputs[i], errors[i]);
+		});
+
+		retcode = 0;
+		for (size_t i = 0; i < inputs.size(); ++i)
+		{
+			std::wcout << inputs[i] << std::endl;
+
+			if (!errors[i].empty())
+			{
+				std::wcerr << errors[i] << std::endl;
+				retcode = 1;
+			}
+		}
+	}
+
+	void ApplyFields(VS_VersionInfo& info, const po::variables_map& variables)
+	{
+		if (variables.count("set-version"))
+		{
+			VersionString version = variables["set-version"].as<std::wstring>();
+			info.SetField(StringTable::FileVersion, version);
+			info.SetField(StringTable::ProductVersion, version);
+		}
+		if (variables.count("set-file-version"))
+		{
+			VersionString fileVersion = variables["set-file-version"].as<std::wstring>();
+			info.SetField(StringTable::FileVersion, fileVersion);
+		}
+		if (variables.count("set-product-version"))
+		{
+			VersionString productVersion = variables["set-product-version"].as<std::wstring>();
+			info.SetField(StringTable::ProductVersion, productVersion);
+		}
+		if (variables.count("set-file-description"))
+		{
+			info.SetField(StringTable::FileDescription, variables["set-file-description"].as<std::wstring>());
+		}
+		if (variables.count("set-internal-name"))
+		{
+			info.SetField(StringTable::InternalName, variables["set-internal-name"].as<std::wstring>());
+		}
+		if (variables.count("set-copyright"))
+		{
+			info.SetField(StringTable::LegalCopyright, variables["set-copyright"].as<std::wstring>());
+		}
+		if (variables.count("set-original-name"))
+		{
+			info.SetField(StringTable::OriginalFilename, variables["set-original-name"].as<std::wstring>());
+		}
+		if (variables.count("set-product-name"))
+		{
+			info.SetField(StringTable::ProductName, variables["set-product-name"].as<std::wstring>());
+		}
+	}
+
+	bool ProcessNode(ResourceSectionBuilder& builder, ResourceEntryPtr node, const po::variables_map& variables)
+	{
+		VS_VersionInfo info(node->Address(), node->Size());
+		ApplyFields(info, variables);
+
+		std::shared_ptr<BYTE> data = info.NewData();
+
+		if (!builder.Set(node->FullPath(), data.get(), info.NewSize()))
+		{
+			std::wcerr << L"Failed to update resource. Path: " << node->FullPath() << std::endl;
+			return false;
+		}
+
+		return true;
+	}
+
+	void Edit(const po::variables_map& variables, int& retcode)
+	{
+		retcode = 1;
+		if (!variables.count("input"))
+		{
+			std::wcerr << L"Error parsing options: must have some input files.\n";
+			return;
+		}
+
+		auto inputs = variables["input"].as<std::vector<std::wstring>>();
+		bool noResourceRebuild = variables["no-resource-rebuild"].as<bool>();
+		bool verbose = variables["verbose"].as<bool>();
+
+		retcode = 0;
+		for (auto& input : inputs)
+		{
+			if (!noResourceRebuild)
+			{
+				// all languages are updated in one rewrite, signature is dropped with it
+				PEParser pe(input);
+				pe.Open();
+				if (!pe.IsValidPE())
+				{
+					std::wcerr << L"Can't open file for reading or invalid format." << std::endl;
+					continue;
 				}
 
-				if (!EndUpdateResource(binaryHandle, false))
+				ResourceEntryPtr node;
+				if (pe.ResourceDirectory())
+					node = pe.ResourceDirectory()->AtPath(L"16/1");
+
+				if (!node) 
+					continue;
+
+				ResourceSectionBuilder builder;
+				bool success = builder.Load(pe);
+
+				if (node->IsData())
+					success = success && ProcessNode(builder, node, variables);
+				else
+					for (auto& entry : node->Entries())
+						success = success && ProcessNode(builder, entry, variables);
+
+				if (!success || !builder.Commit(pe))
 				{
 					std::wcerr << L"Failed to update resources" << std::endl;
 					retcode = 1;
@@ -531,65 +1105,249 @@ namespace peparser
 			else
 			{
 				PEParser pe(input);
-				pe.Open(true);
+				pe.Open();
 				if (!pe.IsValidPE())
 				{
 					std::wcerr << L"Can't open file for reading or invalid format." << std::endl;
 					continue;
 				}
 
-				VersionString version;
-				PEParser::VersionField versionField = PEParser::Both;
+				ResourceEntryPtr node;
+				if (pe.ResourceDirectory())
+					node = pe.ResourceDirectory()->AtPath(L"16/1");
 
-				if (variables.count("set-version"))
+				if (!node)
+					continue;
+
+				std::vector<ResourceEntryPtr> entries;
+				if (node->IsData())
+					entries.push_back(node);
+				else
+					entries = node->Entries();
+
+				// every language is planned before anything is written, signature included, so the file is left
+				// untouched if one doesn't fit
+				ResourcePatcher patcher(pe);
+				std::vector<std::shared_ptr<BYTE>> data;
+				std::vector<ResourcePatch> patches;
+				bool fits = true;
+
+				for (auto& entry : entries)
 				{
-					version = variables["set-version"].as<std::wstring>();
-					versionField = PEParser::Both;
+					VS_VersionInfo info(entry->Address(), entry->Size());
+					ApplyFields(info, variables);
+
+					data.push_back(info.NewData());
+					patches.push_back(patcher.Plan(entry, info.NewSize()));
+
+					if (verbose || !patches.back().fits)
+					{
+						std::wostream& out = (patches.back().fits) ? std::wcout : std::wcerr;
+						out << entry->FullPath() << L": ";
+						patches.back().PrintInfo(out);
+						out << std::endl;
+					}
+
+					fits = fits && patches.back().fits;
 				}
-				else if (variables.count("set-file-version"))
+
+				if (!fits)
 				{
-					version = variables["set-file-version"].as<std::wstring>();
-					versionField = PEParser::FileOnly;
+					std::wcerr << L"Can't update " << input << L" without rebuilding resources" << std::endl;
+					retcode = 1;
+					continue;
 				}
-				else if (variables.count("set-product-version"))
+
+				// stripping the certificate table doesn't move the resource section, the plan still holds
+				pe.Close();
+
+				std::wstring error;
+				if (!StripSignature(input, error))
 				{
-					version = variables["set-product-version"].as<std::wstring>();
-					versionField = PEParser::ProductOnly;
+					std::wcerr << error << std::endl;
+					retcode = 1;
+					continue;
 				}
 
-				if (!pe.SetVersion(version, versionField))
+				PEParser target(input);
+				target.Open(true);
+				if (!target.IsValidPE())
+				{
+					std::wcerr << L"Can't open file for writing or invalid format." << std::endl;
 					retcode = 1;
+					continue;
+				}
 
-				pe.Close();
+				for (size_t i = 0; i < patches.size(); ++i)
+				{
+					if (!patcher.Apply(target, patches[i], data[i].get()))
+					{
+						std::wcerr << L"Failed to update resource. Path: " << entries[i]->FullPath() << std::endl;
+						retcode = 1;
+					}
+				}
+
+				target.Close();
 			}
 		}
 	}
 
+	// Certificate/Details/Thumbprint, copy-through via plain-text editor to filter out non-alphanumeric fluff if any, leave spaces alone.
+	// For example: "01 32 45 67 78 90 ab cd ef 01 32 45 67 78 90 ab cd ef 01 32"
+	bool DecodeCertificateHash(const std::string& certHash, std::string& decodedHash)
+	{
+		if (certHash.size() != 59)
+		{
+			std::cerr << " Certificate hash seems to be malformed. The only supported format looks like this: \'01 32 45 67 78 90 ab cd ef 01 32 45 67 78 90 ab cd ef 01 32\'" << std::endl;
+			return false;
+		}
+
+		decodedHash.clear();
+		std::stringstream ss(certHash);
+		ss >> std::hex;
+		int c = 0;
+		while (ss >> c) decodedHash.push_back((unsigned char)c);
+
+		return true;
+	}
+
+	bool OpenPkcs11Signer(const po::variables_map& variables, Pkcs11Signer& signer)
+	{
+		std::string tokenLabel = variables.count("pkcs11-token") ? variables["pkcs11-token"].as<std::string>() : "";
+		std::string keyLabel = variables.count("pkcs11-key") ? variables["pkcs11-key"].as<std::string>() : "";
+		std::wstring chainFile = variables.count("cert-chain") ? variables["cert-chain"].as<std::wstring>() : L"";
+
+		return signer.Open(variables["pkcs11-module"].as<std::wstring>(), tokenLabel, variables["pkcs11-pin"].as<std::string>(), keyLabel, chainFile);
+	}
+
+	SigningPipeline::Options SigningOptions(const po::variables_map& variables)
+	{
+		SigningPipeline::Options options;
+		options.signThreads = variables["sign-threads"].as<size_t>();
+		options.window = variables["timestamp-window"].as<size_t>();
+		options.retries = variables["retries"].as<size_t>();
+		return options;
+	}
+
+	// drops inputs that are already signed with the --cert-hash certificate, inputs are checked in parallel
+	bool SkipSignedFiles(const po::variables_map& variables, std::vector<std::wstring>& inputs, bool timestampRequired)
+	{
+		if (!variables.count("cert-hash"))
+		{
+			std::wcerr << L"--skip-signed needs --cert-hash to tell which certificate files must be signed with." << std::endl;
+			return false;
+		}
+
+		std::string thumbprint;
+		if (!DecodeCertificateHash(variables["cert-hash"].as<std::string>(), thumbprint))
+			return false;
+
+		SignatureVerifier verifier((std::vector<std::vector<BYTE>>()));
+		if (!verifier.IsValid())
+		{
+			std::wcerr << L"Failed to set up certificate chain verification." << std::endl;
+			return false;
+		}
+
+		// not vector<bool>, elements are written from several threads
+		std::vector<char> skip(inputs.size());
+		ParallelForEach(inputs.size(), variables["threads"].as<size_t>(), [&](size_t i)
+		{
+			FileSignatures signatures;
+			std::wstring error;
+			skip[i] = verifier.Verify(inputs[i], signatures, error) && signatures.IsSignedWith(thumbprint, timestampRequired);
+		});
+
+		std::vector<std::wstring> remaining;
+		for (size_t i = 0; i < inputs.size(); ++i)
+		{
+			if (skip[i])
+				std::wcerr << L"Already signed: " << inputs[i] << std::endl;
+			else
+				remaining.push_back(inputs[i]);
+		}
+
+		inputs.swap(remaining);
+		return true;
+	}
+
 	void Sign(const boost::program_options::variables_map& variables, int& retcode)
 	{
 		retcode = 1;
 
-		std::string tokenPassword = variables["etoken-password"].as<std::string>();
 		std::vector<std::wstring> inputs = variables["input"].as<std::vector<std::wstring>>();
-		std::wstring certStore = variables["cert-store"].as<std::wstring>();
-		std::string certHash = variables["cert-hash"].as<std::string>();
 		std::vector<std::wstring> timestampUrls;
 		if (variables.count("timestamp"))
 			timestampUrls = variables["timestamp"].as<std::vector<std::wstring>>();
 
-		// Certificate/Details/Thumbprint, copy-through via plain-text editor to filter out non-alphanumeric fluff if any, leave spaces alone.
-		// For example: "01 32 45 67 78 90 ab cd ef 01 32 45 67 78 90 ab cd ef 01 32"
-		if (certHash.size() != 59)
+		SigningPipeline::Options options = SigningOptions(variables);
+
+		// the agent signs with the options it was started with, these would be silently ignored
+		if (variables["use-agent"].as<bool>())
 		{
-			std::cerr << " Certificate hash seems to be malformed. The only supported format looks like this: \'01 32 45 67 78 90 ab cd ef 01 32 45 67 78 90 ab cd ef 01 32\'" << std::endl;
+			for (auto name : { "timestamp", "timestamp-rfc3161", "timestamp-window", "sign-threads", "retries" })
+			{
+				if (variables.count(name) && !variables[name].defaulted())
+				{
+					std::wcerr << L"Error parsing options: --" << name << L" is set when the agent is started (--signing-agent), it can't be used with --use-agent." << std::endl;
+					return;
+				}
+			}
+		}
+
+		if (variables["skip-signed"].as<bool>())
+		{
+			if (!SkipSignedFiles(variables, inputs, !timestampUrls.empty()))
+				return;
+
+			if (inputs.empty())
+			{
+				retcode = 0;
+				return;
+			}
+		}
+
+		if (variables["use-agent"].as<bool>())
+		{
+			retcode = SubmitToSigningAgent(variables["agent-pipe"].as<std::wstring>(), inputs);
+			return;
+		}
+
+		if (variables.count("remote-signer"))
+		{
+			std::string secret = variables.count("agent-secret") ? variables["agent-secret"].as<std::string>() : "";
+
+			RemoteSigner signer(variables["remote-signer"].as<std::wstring>(), secret);
+			if (signer.SignFiles(inputs, timestampUrls, options))
+				retcode = 0;
+
+			return;
+		}
+
+		if (variables.count("pkcs11-module"))
+		{
+			Pkcs11Signer signer;
+			if (!OpenPkcs11Signer(variables, signer))
+				return;
+
+			if (signer.SignFiles(inputs, timestampUrls, options))
+				retcode = 0;
+
 			return;
 		}
 
+		if (!variables.count("cert-hash"))
+		{
+			std::wcerr << L"One of --cert-hash, --pkcs11-module or --remote-signer is required." << std::endl;
+			return;
+		}
+
+		std::string tokenPassword = variables["etoken-password"].as<std::string>();
+		std::wstring certStore = variables["cert-store"].as<std::wstring>();
+
 		std::string decodedHash;
-		std::stringstream ss(certHash);
-		ss >> std::hex;
-		int c = 0;
-		while (ss >> c) decodedHash.push_back((unsigned char)c);
+		if (!DecodeCertificateHash(variables["cert-hash"].as<std::string>(), decodedHash))
+			return;
 
 		SafeNetTokenLogin login(tokenPassword);
 
@@ -598,14 +1356,141 @@ namespace peparser
 		if (!signer.SelectCertificate(certStore, decodedHash))
 			return;
 
-		bool ret = true;
-		for (auto it = inputs.begin(); it != inputs.end(); ++it)
-			ret = signer.SignFile(*it, timestampUrls) && ret;
+		if (variables["timestamp-rfc3161"].as<bool>())
+			signer.UseRfc3161Timestamps();
 
-		if (ret)
+		if (signer.SignFiles(inputs, timestampUrls, options))
 			retcode = 0;
 	}
 
+	void SigningAgent(const po::variables_map& variables, int& retcode)
+	{
+		retcode = 1;
+
+		if (!variables.count("cert-hash"))
+		{
+			std::wcerr << L"Signing agent needs --cert-hash." << std::endl;
+			return;
+		}
+
+		std::string decodedHash;
+		if (!DecodeCertificateHash(variables["cert-hash"].as<std::string>(), decodedHash))
+			return;
+
+		std::vector<std::wstring> timestampUrls;
+		if (variables.count("timestamp"))
+			timestampUrls = variables["timestamp"].as<std::vector<std::wstring>>();
+
+		// token stays logged in and the certificate selected for as long as the agent runs
+		SafeNetTokenLogin login(variables["etoken-password"].as<std::string>());
+
+		Signer signer;
+		if (!signer.SelectCertificate(variables["cert-store"].as<std::wstring>(), decodedHash))
+			return;
+
+		if (variables["timestamp-rfc3161"].as<bool>())
+			signer.UseRfc3161Timestamps();
+
+		SigningAgentServer server(signer.SignStep(), signer.TimestampStep(), timestampUrls, SigningOptions(variables));
+		server.Serve(variables["agent-pipe"].as<std::wstring>());
+	}
+
+	void MakeCatalog(const po::variables_map& variables, int& retcode)
+	{
+		retcode = 1;
+
+		if (!variables.count("input"))
+		{
+			std::wcerr << L"Error parsing options: must have some input files." << std::endl;
+			return;
+		}
+
+		// Mssign32 signs catalogs through their SIP, native signing only knows PE files
+		if (variables.count("pkcs11-module") || variables.count("remote-signer"))
+		{
+			std::wcerr << L"Catalogs are signed with a certificate from a store, use --cert-hash." << std::endl;
+			return;
+		}
+
+		std::wstring catalog = variables["make-catalog"].as<std::wstring>();
+		if (!CreateCatalog(catalog, variables["input"].as<std::vector<std::wstring>>(), variables["threads"].as<size_t>()))
+			return;
+
+		// unsigned catalog is left to be signed elsewhere
+		if (!variables.count("cert-hash"))
+		{
+			retcode = 0;
+			return;
+		}
+
+		std::string decodedHash;
+		if (!DecodeCertificateHash(variables["cert-hash"].as<std::string>(), decodedHash))
+			return;
+
+		std::vector<std::wstring> timestampUrls;
+		if (variables.count("timestamp"))
+			timestampUrls = variables["timestamp"].as<std::vector<std::wstring>>();
+
+		SafeNetTokenLogin login(variables["etoken-password"].as<std::string>());
+
+		Signer signer;
+		if (!signer.SelectCertificate(variables["cert-store"].as<std::wstring>(), decodedHash))
+			return;
+
+		if (variables["timestamp-rfc3161"].as<bool>())
+			signer.UseRfc3161Timestamps();
+
+		if (signer.SignFiles(std::vector<std::wstring>{ catalog }, timestampUrls, SigningOptions(variables)))
+			retcode = 0;
+	}
+
+	void ServeSigning(const po::variables_map& variables, int& retcode)
+	{
+		retcode = 1;
+
+		std::string endpoint = variables["listen"].as<std::string>();
+		std::string secret = variables.count("agent-secret") ? variables["agent-secret"].as<std::string>() : "";
+
+		if (variables.count("pkcs11-module"))
+		{
+			Pkcs11Signer signer;
+			if (!OpenPkcs11Signer(variables, signer))
+				return;
+
+			RemoteSigningServer server([&signer](const std::vector<BYTE>& digest, std::vector<BYTE>& signedData, std::wstring& error)
+			{
+				return signer.SignDigest(digest, signedData, error);
+			}, secret);
+
+			server.Serve(endpoint);
+			return;
+		}
+
+		if (!variables.count("cert-hash"))
+		{
+			std::wcerr << L"Either --cert-hash or --pkcs11-module is required." << std::endl;
+			return;
+		}
+
+		std::string decodedHash;
+		if (!DecodeCertificateHash(variables["cert-hash"].as<std::string>(), decodedHash))
+			return;
+
+		// token stays logged in for as long as the agent runs
+		SafeNetTokenLogin login(variables["etoken-password"].as<std::string>());
+
+		Signer signer;
+		if (!signer.SelectCertificate(variables["cert-store"].as<std::wstring>(), decodedHash))
+			return;
+
+		RemoteSigningServer server([&signer](const std::vector<BYTE>& digest, std::vector<BYTE>& signedData, std::wstring& error)
+		{
+			return signer.SignDigest(digest, signedData, error);
+		}, secret);
+
+		server.Serve(endpoint);
+	}
+
 	void CheckDependencies(const po::variables_map& variables, int& retcode)
 	{
 		namespace fs = boost::filesystem;
@@ -619,6 +1504,7 @@ namespace peparser
 		bool batchDlls = variables["batch-dlls"].as<bool>();
 		auto peExtensions = variables["pe-extensions"].as<std::wstring>();
 		bool useSystemPath = variables["use-system-path"].as<bool>();
+		bool activationContext = variables["activation-context"].as<bool>();
 
 		if (inputs.size() == 0)
 		{
@@ -651,7 +1537,7 @@ namespace peparser
 		if (!batchDlls)
 		{
 			PEBinaryMap cache;
-			auto pe = CollectDependencies(inputs[0], cache);
+			auto pe = CollectDependencies(inputs[0], cache, activationContext);
 
 			if (pe && !pe->resolved)
 			{
@@ -690,7 +1576,7 @@ namespace peparser
 			PEBinaryMap peCache;
 			std::list<PEBinaryPtr> peBinaries;
 			for (auto& file : files)
-				peBinaries.push_back(CollectDependencies(file, peCache));
+				peBinaries.push_back(CollectDependencies(file, peCache, activationContext));
 
 			if (json)
 				jsonReport << PrintDependencyTreeJson(PEBinaryPtr(), peCache, !verbose);
@@ -14,9 +14,17 @@ namespace peparser
 	void Pdb(const boost::program_options::variables_map& variables, int& retcode);
 	void Version(const boost::program_options::variables_map& variables, int& retcode);
 	void Imports(const boost::program_options::variables_map& variables, int& retcode);
+	void Exports(const boost::program_options::variables_map& variables, int& retcode);
+	void CheckImports(const boost::program_options::variables_map& variables, int& retcode);
 	void Signature(const boost::program_options::variables_map& variables, int& retcode);
 	void DumpSection(const boost::program_options::variables_map& variables, int& retcode);
 	void DumpResource(const boost::program_options::variables_map& variables, int& retcode);
+	void ExtractResources(const boost::program_options::variables_map& variables, int& retcode);
+	void StoreResources(const boost::program_options::variables_map& variables, int& retcode);
+	void Inventory(const boost::program_options::variables_map& variables, int& retcode);
+	void AuthenticodeHash(const boost::program_options::variables_map& variables, int& retcode);
+	void VerifyChecksum(const boost::program_options::variables_map& variables, int& retcode);
+	void VerifySignatures(const boost::program_options::variables_map& variables, int& retcode);
 
 	void Compare(const boost::program_options::variables_map& variables, int& retcode);
 
@@ -25,6 +33,9 @@ namespace peparser
 	void Edit(const boost::program_options::variables_map& variables, int& retcode);
 
 	void Sign(const boost::program_options::variables_map& variables, int& retcode);
+	void ServeSigning(const boost::program_options::variables_map& variables, int& retcode);
+	void SigningAgent(const boost::program_options::variables_map& variables, int& retcode);
+	void MakeCatalog(const boost::program_options::variables_map& variables, int& retcode);
 
 	void CheckDependencies(const boost::program_options::variables_map& variables, int& retcode);
 }
\ No newline at end of file
@@ -0,0 +1,197 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "addressmap.h"
+
+#include <algorithm>
+
+namespace peparser
+{
+	AddressMap::AddressMap(PIMAGE_NT_HEADERS ntHeaders)
+	{
+		DWORD sizeOfHeaders = 0;
+		if (ntHeaders->OptionalHeader.Magic == IMAGE_NT_OPTIONAL_HDR64_MAGIC)
+		{
+			PIMAGE_OPTIONAL_HEADER64 header = (PIMAGE_OPTIONAL_HEADER64)&ntHeaders->OptionalHeader;
+			m_imageBase = header->ImageBase;
+			sizeOfHeaders = header->SizeOfHeaders;
+		}
+		else
+		{
+			PIMAGE_OPTIONAL_HEADER32 header = (PIMAGE_OPTIONAL_HEADER32)&ntHeaders->OptionalHeader;
+			m_imageBase = header->ImageBase;
+			sizeOfHeaders = header->SizeOfHeaders;
+		}
+
+		PIMAGE_SECTION_HEADER sectionHeader = IMAGE_FIRST_SECTION(ntHeaders);
+
+		for (int i = 0; i < ntHeaders->FileHeader.NumberOfSections; i++, sectionHeader++)
+		{
+			DWORD sectionSize = sectionHeader->Misc.VirtualSize;
+
+			if (sectionSize == 0) // compensate for Watcom linker strangeness, according to Matt Pietrek
+				sectionSize = sectionHeader->SizeOfRawData;
+
+			if (sectionSize == 0)
+				continue;
+
+			Range rva;
+			rva.start = sectionHeader->VirtualAddress;
+			rva.size = sectionSize;
+			rva.target = sectionHeader->PointerToRawData;
+			m_byRva.push_back(rva);
+
+			// only bytes actually present in the file can be translated back
+			Range raw;
+			raw.start = sectionHeader->PointerToRawData;
+			raw.size = min(sectionSize, sectionHeader->SizeOfRawData);
+			raw.target = sectionHeader->VirtualAddress;
+			if (raw.size != 0)
+				m_byFileOffset.push_back(raw);
+		}
+
+		std::sort(m_byRva.begin(), m_byRva.end());
+		std::sort(m_byFileOffset.begin(), m_byFileOffset.end());
+
+		// headers are mapped at image base as is
+		if (sizeOfHeaders != 0)
+		{
+			Range headers;
+			headers.start = 0;
+			headers.size = sizeOfHeaders;
+			headers.target = 0;
+
+			if (!m_byRva.empty())
+				headers.size = min(headers.size, m_byRva.front().start);
+			if (!m_byFileOffset.empty())
+				headers.size = min(headers.size, m_byFileOffset.front().start);
+
+			if (headers.size != 0)
+			{
+				m_byRva.insert(m_byRva.begin(), headers);
+				m_byFileOffset.insert(m_byFileOffset.begin(), headers);
+			}
+		}
+	}
+
+	bool AddressMap::Translate(const RangeList& ranges, size_t& lastHit, DWORD address, DWORD& result, DWORD* available)
+	{
+		if (ranges.empty())
+			return false;
+
+		// consecutive lookups tend to land in the same section
+		if (lastHit < ranges.size() && ranges[lastHit].Contains(address))
+		{
+			result = ranges[lastHit].target + (address - ranges[lastHit].start);
+			if (available)
+				*available = ranges[lastHit].size - (address - ranges[lastHit].start);
+			return true;
+		}
+
+		Range key;
+		key.start = address;
+
+		RangeList::const_iterator it = std::upper_bound(ranges.begin(), ranges.end(), key);
+		if (it == ranges.begin())
+			return false;
+		--it;
+
+		if (!it->Contains(address))
+			return false;
+
+		lastHit = it - ranges.begin();
+		result = it->target + (address - it->start);
+		if (available)
+			*available = it->size - (address - it->start);
+
+		return true;
+	}
+
+	size_t AddressMap::Translate(const RangeList& ranges, const DWORD* addresses, size_t count, DWORD* results)
+	{
+		size_t translated = 0;
+		size_t current = 0;
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			DWORD address = addresses[i];
+
+			while (current < ranges.size() && address - ranges[current].start >= ranges[current].size && address >= ranges[current].start)
+				++current;
+
+			if (current < ranges.size() && ranges[current].Contains(address))
+			{
+				results[i] = ranges[current].target + (address - ranges[current].start);
+				++translated;
+			}
+			else
+				results[i] = Invalid;
+		}
+
+		return translated;
+	}
+
+	bool AddressMap::RvaToFileOffset(DWORD rva, DWORD& fileOffset) const
+	{
+		return Translate(m_byRva, m_lastRva, rva, fileOffset);
+	}
+
+	bool AddressMap::RvaToFileOffset(DWORD rva, DWORD& fileOffset, DWORD& available) const
+	{
+		return Translate(m_byRva, m_lastRva, rva, fileOffset, &available);
+	}
+
+	bool AddressMap::FileOffsetToRva(DWORD fileOffset, DWORD& rva) const
+	{
+		return Translate(m_byFileOffset, m_lastFileOffset, fileOffset, rva);
+	}
+
+	bool AddressMap::RvaToVa(DWORD rva, ULONGLONG& va) const
+	{
+		DWORD fileOffset = 0;
+		if (!RvaToFileOffset(rva, fileOffset))
+			return false;
+
+		va = m_imageBase + rva;
+		return true;
+	}
+
+	bool AddressMap::VaToRva(ULONGLONG va, DWORD& rva) const
+	{
+		if (va < m_imageBase || va - m_imageBase > MAXDWORD)
+			return false;
+
+		DWORD fileOffset = 0;
+		if (!RvaToFileOffset((DWORD)(va - m_imageBase), fileOffset))
+			return false;
+
+		rva = (DWORD)(va - m_imageBase);
+		return true;
+	}
+
+	size_t AddressMap::RvaToFileOffset(const DWORD* rvas, size_t count, DWORD* fileOffsets) const
+	{
+		return Translate(m_byRva, rvas, count, fileOffsets);
+	}
+
+	size_t AddressMap::FileOffsetToRva(const DWORD* fileOffsets, size_t count, DWORD* rvas) const
+	{
+		return Translate(m_byFileOffset, fileOffsets, count, rvas);
+	}
+
+	size_t AddressMap::RvaToFileOffset(const std::vector<DWORD>& rvas, std::vector<DWORD>& fileOffsets) const
+	{
+		fileOffsets.resize(rvas.size());
+		if (rvas.empty())
+			return 0;
+		return RvaToFileOffset(&rvas[0], rvas.size(), &fileOffsets[0]);
+	}
+
+	size_t AddressMap::FileOffsetToRva(const std::vector<DWORD>& fileOffsets, std::vector<DWORD>& rvas) const
+	{
+		rvas.resize(fileOffsets.size());
+		if (fileOffsets.empty())
+			return 0;
+		return FileOffsetToRva(&fileOffsets[0], fileOffsets.size(), &rvas[0]);
+	}
+}
\ No newline at end of file
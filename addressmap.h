@@ -0,0 +1,67 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <windows.h>
+
+#include <vector>
+
+namespace peparser
+{
+	// translates addresses between the three spaces a PE image lives in:
+	// RVA (relative to image base), file offset and VA (absolute, assuming preferred image base)
+	// built once per file from the section table, lookups are binary searches with a last hit cache
+	// lookups are const but update the cache, so an instance should not be shared between threads
+	class AddressMap
+	{
+	public:
+		// returned in place of addresses that do not belong to any section
+		static const DWORD Invalid = 0xFFFFFFFF;
+
+		AddressMap() {}
+		explicit AddressMap(PIMAGE_NT_HEADERS ntHeaders);
+
+		bool IsEmpty() const { return m_byRva.empty(); }
+		ULONGLONG ImageBase() const { return m_imageBase; }
+
+		bool RvaToFileOffset(DWORD rva, DWORD& fileOffset) const;
+		// also returns how many bytes of the section are left starting at rva, to bound tables read from there
+		bool RvaToFileOffset(DWORD rva, DWORD& fileOffset, DWORD& available) const;
+		bool FileOffsetToRva(DWORD fileOffset, DWORD& rva) const;
+		bool RvaToVa(DWORD rva, ULONGLONG& va) const;
+		bool VaToRva(ULONGLONG va, DWORD& rva) const;
+
+		// batch conversions, input must be sorted in ascending order
+		// converts the whole array in one pass over the section list, unmapped entries are set to Invalid
+		// returns number of successfully converted addresses
+		size_t RvaToFileOffset(const DWORD* rvas, size_t count, DWORD* fileOffsets) const;
+		size_t FileOffsetToRva(const DWORD* fileOffsets, size_t count, DWORD* rvas) const;
+
+		size_t RvaToFileOffset(const std::vector<DWORD>& rvas, std::vector<DWORD>& fileOffsets) const;
+		size_t FileOffsetToRva(const std::vector<DWORD>& fileOffsets, std::vector<DWORD>& rvas) const;
+
+	private:
+		// maps [start, start + size) in one address space to [target, target + size) in another
+		struct Range
+		{
+			DWORD start = 0;
+			DWORD size = 0;
+			DWORD target = 0;
+
+			bool Contains(DWORD address) const { return address >= start && address - start < size; }
+			bool operator <(const Range& r) const { return start < r.start; }
+		};
+		typedef std::vector<Range> RangeList;
+
+		RangeList m_byRva;
+		RangeList m_byFileOffset;
+		ULONGLONG m_imageBase = 0;
+
+		mutable size_t m_lastRva = 0;
+		mutable size_t m_lastFileOffset = 0;
+
+		static bool Translate(const RangeList& ranges, size_t& lastHit, DWORD address, DWORD& result, DWORD* available = NULL);
+		static size_t Translate(const RangeList& ranges, const DWORD* addresses, size_t count, DWORD* results);
+	};
+}
\ No newline at end of file
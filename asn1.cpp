@@ -0,0 +1,194 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "asn1.h"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace peparser
+{
+	namespace asn1
+	{
+		bool Reader::Next(Element& element)
+		{
+			const BYTE* p = m_data;
+			if (m_end - p < 2)
+				return false;
+
+			element.begin = p;
+			element.tag = *p++;
+
+			// high tag numbers are not used by anything we read
+			if ((element.tag & 0x1f) == 0x1f)
+				return false;
+
+			size_t length = *p++;
+			if (length & 0x80)
+			{
+				size_t count = length & 0x7f;
+				if (count == 0 || count > sizeof(DWORD) || (size_t)(m_end - p) < count)
+					return false;
+
+				length = 0;
+				while (count--)
+					length = (length << 8) | *p++;
+			}
+
+			if ((size_t)(m_end - p) < length)
+				return false;
+
+			element.content = p;
+			element.size = length;
+			element.encodedSize = (p - element.begin) + length;
+
+			m_data = p + length;
+			return true;
+		}
+
+		Bytes Encode(BYTE tag, const Bytes& content)
+		{
+			Bytes result;
+			result.push_back(tag);
+
+			size_t length = content.size();
+			if (length < 0x80)
+				result.push_back((BYTE)length);
+			else
+			{
+				BYTE bytes[sizeof(size_t)];
+				size_t count = 0;
+				for (; length; length >>= 8)
+					bytes[count++] = (BYTE)length;
+
+				result.push_back((BYTE)(0x80 | count));
+				while (count)
+					result.push_back(bytes[--count]);
+			}
+
+			result.insert(result.end(), content.begin(), content.end());
+			return result;
+		}
+
+		Bytes Encode(BYTE tag, const std::vector<Bytes>& items)
+		{
+			Bytes content;
+			for (auto& item : items)
+				content.insert(content.end(), item.begin(), item.end());
+
+			return Encode(tag, content);
+		}
+
+		Bytes EncodeInteger(unsigned __int64 value)
+		{
+			Bytes magnitude;
+			for (; value; value >>= 8)
+				magnitude.insert(magnitude.begin(), (BYTE)value);
+
+			return EncodeInteger(magnitude);
+		}
+
+		Bytes EncodeInteger(const Bytes& magnitude)
+		{
+			auto first = magnitude.begin();
+			while (first != magnitude.end() && *first == 0)
+				++first;
+
+			Bytes content;
+			if (first == magnitude.end() || (*first & 0x80))
+				content.push_back(0);
+
+			content.insert(content.end(), first, magnitude.end());
+			return Encode(Integer, content);
+		}
+
+		Bytes EncodeBoolean(bool value)
+		{
+			return Encode(Boolean, Bytes(1, value ? 0xff : 0));
+		}
+
+		Bytes EncodeNull()
+		{
+			return Encode(Null, Bytes());
+		}
+
+		Bytes EncodeObjectId(const char* oid)
+		{
+			std::vector<unsigned __int64> arcs;
+			for (const char* p = oid; *p; )
+			{
+				char* end = nullptr;
+				arcs.push_back(strtoull(p, &end, 10));
+				p = (*end == '.') ? end + 1 : end;
+			}
+
+			Bytes content;
+			if (arcs.size() < 2)
+				return Encode(ObjectId, content);
+
+			// first two arcs share one subidentifier
+			arcs[1] += arcs[0] * 40;
+			for (size_t i = 1; i < arcs.size(); ++i)
+			{
+				BYTE bytes[10];
+				size_t count = 0;
+				unsigned __int64 arc = arcs[i];
+				do
+				{
+					bytes[count] = (BYTE)(arc & 0x7f) | (count ? 0x80 : 0);
+					++count;
+					arc >>= 7;
+				} while (arc);
+
+				while (count)
+					content.push_back(bytes[--count]);
+			}
+
+			return Encode(ObjectId, content);
+		}
+
+		Bytes IntegerMagnitude(const Element& element)
+		{
+			const BYTE* first = element.content;
+			const BYTE* end = element.content + element.size;
+			while (first != end && *first == 0)
+				++first;
+
+			return Bytes(first, end);
+		}
+
+		bool IsObjectId(const Element& element, const char* oid)
+		{
+			Bytes expected = EncodeObjectId(oid);
+			return element.tag == ObjectId && element.encodedSize == expected.size() && memcmp(element.begin, expected.data(), expected.size()) == 0;
+		}
+
+		std::string ObjectIdString(const Element& element)
+		{
+			if (element.tag != ObjectId || element.size == 0 || (element.content[element.size - 1] & 0x80))
+				return std::string();
+
+			std::string result;
+			unsigned __int64 arc = 0;
+			for (size_t i = 0; i < element.size; ++i)
+			{
+				arc = (arc << 7) | (element.content[i] & 0x7f);
+				if (element.content[i] & 0x80)
+					continue;
+
+				// first subidentifier holds two arcs
+				if (result.empty())
+				{
+					unsigned __int64 first = (arc < 80) ? arc / 40 : 2;
+					result = std::to_string(first) + "." + std::to_string(arc - first * 40);
+				}
+				else
+					result += "." + std::to_string(arc);
+
+				arc = 0;
+			}
+
+			return result;
+		}
+	}
+}
\ No newline at end of file
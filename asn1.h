@@ -0,0 +1,88 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <windows.h>
+
+#include <string>
+#include <vector>
+
+namespace peparser
+{
+	// minimal DER encoding and decoding, enough to build and pick apart small protocol messages
+	// (timestamp requests and replies) without going through CryptEncodeObject for every structure
+	namespace asn1
+	{
+		enum Tag : BYTE
+		{
+			  Boolean = 0x01
+			, Integer = 0x02
+			, BitString = 0x03
+			, OctetString = 0x04
+			, Null = 0x05
+			, ObjectId = 0x06
+			, Utf8String = 0x0c
+			, PrintableString = 0x13
+			, UtcTime = 0x17
+			, GeneralizedTime = 0x18
+			, Sequence = 0x30
+			, Set = 0x31
+			// [n] EXPLICIT and constructed [n] IMPLICIT
+			, ContextConstructed = 0xa0
+			// [n] IMPLICIT of a primitive type
+			, ContextPrimitive = 0x80
+		};
+
+		typedef std::vector<BYTE> Bytes;
+
+		struct Element
+		{
+			BYTE tag = 0;
+			// whole encoding and the content part of it
+			const BYTE* begin = nullptr;
+			size_t encodedSize = 0;
+			const BYTE* content = nullptr;
+			size_t size = 0;
+
+			Bytes Encoded() const { return Bytes(begin, begin + encodedSize); }
+			Bytes Content() const { return Bytes(content, content + size); }
+		};
+
+		// reads elements one after another, either from a buffer or from the content of a constructed element
+		// only definite lengths (as DER requires) are accepted, Next() returns false on malformed or truncated data
+		class Reader
+		{
+		public:
+			Reader(const BYTE* data, size_t size) : m_data(data), m_end(data + size) {}
+			explicit Reader(const Element& element) : m_data(element.content), m_end(element.content + element.size) {}
+
+			bool Next(Element& element);
+			// reads next element and checks its tag
+			bool Next(BYTE tag, Element& element) { return Next(element) && element.tag == tag; }
+			bool AtEnd() const { return m_data == m_end; }
+
+		private:
+			const BYTE* m_data;
+			const BYTE* m_end;
+		};
+
+		Bytes Encode(BYTE tag, const Bytes& content);
+		// content is concatenation of items, which must be encoded already
+		Bytes Encode(BYTE tag, const std::vector<Bytes>& items);
+
+		Bytes EncodeInteger(unsigned __int64 value);
+		// big endian magnitude of a non-negative number, leading zeros are dropped and a zero byte is added if the high bit is set
+		Bytes EncodeInteger(const Bytes& magnitude);
+		Bytes EncodeBoolean(bool value);
+		Bytes EncodeNull();
+		// dotted notation, e.g. "2.16.840.1.101.3.4.2.1"
+		Bytes EncodeObjectId(const char* oid);
+
+		// content of an INTEGER as big endian magnitude without sign padding
+		Bytes IntegerMagnitude(const Element& element);
+		bool IsObjectId(const Element& element, const char* oid);
+		// dotted notation of an OBJECT IDENTIFIER, empty if the element is not a well formed one
+		std::string ObjectIdString(const Element& element);
+	}
+}
\ No newline at end of file
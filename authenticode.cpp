@@ -0,0 +1,382 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "authenticode.h"
+#include "certificatetable.h"
+#include "asn1.h"
+
+#include <wincrypt.h>
+#include <wintrust.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <fstream>
+#include <iterator>
+#include <memory>
+
+#pragma comment(lib, "crypt32.lib")
+
+namespace peparser
+{
+	namespace
+	{
+		const char* Sha256Oid = "2.16.840.1.101.3.4.2.1";
+		const char* RsaOid = "1.2.840.113549.1.1.1";
+		const char* SignedDataOid = "1.2.840.113549.1.7.2";
+		const char* ContentTypeOid = "1.2.840.113549.1.9.3";
+		const char* MessageDigestOid = "1.2.840.113549.1.9.4";
+		const char* SpcIndirectDataOid = "1.3.6.1.4.1.311.2.1.4";
+		const char* SpcStatementTypeOid = "1.3.6.1.4.1.311.2.1.11";
+		const char* SpcSpOpusInfoOid = "1.3.6.1.4.1.311.2.1.12";
+		const char* SpcPeImageDataOid = "1.3.6.1.4.1.311.2.1.15";
+		const char* SpcIndividualCodeSigningOid = "1.3.6.1.4.1.311.2.1.21";
+
+		using namespace asn1;
+
+		Bytes Sha256Algorithm()
+		{
+			return Encode(Sequence, std::vector<Bytes>{ EncodeObjectId(Sha256Oid), EncodeNull() });
+		}
+
+		Bytes Attribute(const char* oid, const Bytes& value)
+		{
+			return Encode(Sequence, std::vector<Bytes>{ EncodeObjectId(oid), Encode(Set, value) });
+		}
+
+		Bytes Sha256(const Bytes& data)
+		{
+			Hash hash(HashAlgorithm::Sha256);
+			hash.Update(data.data(), data.size());
+			return hash.Finish();
+		}
+
+		// IssuerAndSerialNumber of a DER certificate: Certificate { TBSCertificate { [0] version?, serialNumber, signature, issuer ... } ... }
+		bool IssuerAndSerialNumber(const Bytes& certificate, Bytes& result)
+		{
+			Element cert, tbs, element, serial, algorithm, issuer;
+			if (!Reader(certificate.data(), certificate.size()).Next(Sequence, cert) || !Reader(cert).Next(Sequence, tbs))
+				return false;
+
+			Reader fields(tbs);
+			if (!fields.Next(element))
+				return false;
+
+			if (element.tag == (ContextConstructed | 0))
+			{
+				if (!fields.Next(Integer, serial))
+					return false;
+			}
+			else if (element.tag == Integer)
+				serial = element;
+			else
+				return false;
+
+			if (!fields.Next(Sequence, algorithm) || !fields.Next(Sequence, issuer))
+				return false;
+
+			result = Encode(Sequence, std::vector<Bytes>{ issuer.Encoded(), serial.Encoded() });
+			return true;
+		}
+	}
+
+	std::vector<Block> AuthenticodeRanges(const CertificateTableInfo& info)
+	{
+		std::vector<Block> excluded;
+		excluded.push_back(Block(L"CheckSum", info.checksumOffset, sizeof(DWORD)));
+
+		if (info.directoryOffset)
+			excluded.push_back(Block(L"Security directory", info.directoryOffset, sizeof(IMAGE_DATA_DIRECTORY)));
+
+		// a directory pointing outside of the file is corrupt, nothing to skip then
+		bool signedFile = info.IsPresent() && info.offset && (BlockOffset)info.offset + info.size <= info.fileSize;
+		if (signedFile)
+			excluded.push_back(Block(L"Certificate table", info.offset, info.size));
+
+		std::sort(excluded.begin(), excluded.end());
+
+		std::vector<Block> ranges;
+		BlockOffset position = 0;
+		for (auto& block : excluded)
+		{
+			if (block.offset > position)
+				ranges.push_back(Block(L"", position, block.offset - position));
+
+			position = max(position, block.offset + block.size);
+		}
+
+		if (position < info.fileSize)
+			ranges.push_back(Block(L"", position, info.fileSize - position));
+
+		if (!signedFile && info.fileSize % 8)
+			ranges.push_back(Block(L"Padding", info.fileSize, 8 - info.fileSize % 8));
+
+		return ranges;
+	}
+
+	bool AuthenticodeDigest(HANDLE file, const std::vector<HashAlgorithm>& algorithms, std::vector<std::vector<BYTE>>& digests, std::wstring& error)
+	{
+		digests.clear();
+
+		CertificateTableInfo info;
+		if (!ReadCertificateTableInfo(file, info))
+		{
+			error = L"Invalid PE format.";
+			return false;
+		}
+
+		std::vector<std::unique_ptr<Hash>> hashes;
+		for (auto algorithm : algorithms)
+		{
+			hashes.push_back(std::unique_ptr<Hash>(new Hash(algorithm)));
+			if (!hashes.back()->IsValid())
+			{
+				error = std::wstring(L"Failed to create hash: ") + HashAlgorithmName(algorithm);
+				return false;
+			}
+		}
+
+		// every chunk is read once and fed to all algorithms
+		const DWORD ChunkSize = 1024 * 1024;
+		std::vector<BYTE> buffer(ChunkSize);
+
+		for (auto& range : AuthenticodeRanges(info))
+		{
+			bool padding = range.offset >= info.fileSize;
+			if (padding)
+				std::fill(buffer.begin(), buffer.end(), 0);
+
+			LARGE_INTEGER position;
+			position.QuadPart = range.offset;
+			if (!padding && !SetFilePointerEx(file, position, NULL, FILE_BEGIN))
+			{
+				error = L"Failed to read file.";
+				return false;
+			}
+
+			for (BlockOffset remaining = range.size; remaining; )
+			{
+				DWORD chunk = (DWORD)min((BlockOffset)ChunkSize, remaining);
+
+				DWORD read = 0;
+				if (!padding && (!ReadFile(file, buffer.data(), chunk, &read, NULL) || read != chunk))
+				{
+					error = L"Failed to read file.";
+					return false;
+				}
+
+				for (auto& hash : hashes)
+				{
+					if (!hash->Update(buffer.data(), chunk))
+					{
+						error = L"Failed to hash file.";
+						return false;
+					}
+				}
+
+				remaining -= chunk;
+			}
+		}
+
+		for (auto& hash : hashes)
+		{
+			digests.push_back(hash->Finish());
+			if (digests.back().empty())
+			{
+				error = L"Failed to hash file.";
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	// SpcPeImageData { flags, file [0] SpcLink { file [2] SpcString { unicode [0] "<<<Obsolete>>>" } } }
+	std::vector<BYTE> SpcPeImageData()
+	{
+		using namespace asn1;
+
+		const wchar_t* obsolete = L"<<<Obsolete>>>";
+
+		Bytes name;
+		for (const wchar_t* c = obsolete; *c; ++c)
+		{
+			name.push_back((BYTE)(*c >> 8));
+			name.push_back((BYTE)*c);
+		}
+
+		Bytes file = Encode(ContextConstructed | 0, Encode(ContextConstructed | 2, Encode(ContextPrimitive | 0, name)));
+		return Encode(Sequence, std::vector<Bytes>{ Encode(BitString, Bytes(1, 0)), file });
+	}
+
+	bool AuthenticodeSignedData(const std::vector<BYTE>& digest, const std::vector<std::vector<BYTE>>& certificates, const RawSignFunction& sign, std::vector<BYTE>& signedData, std::wstring& error)
+	{
+		using namespace asn1;
+
+		signedData.clear();
+
+		Bytes issuerAndSerial;
+		if (certificates.empty() || !IssuerAndSerialNumber(certificates.front(), issuerAndSerial))
+		{
+			error = L"Invalid signer certificate.";
+			return false;
+		}
+
+		Bytes indirectData = Encode(Sequence, std::vector<Bytes>{
+			  Encode(Sequence, std::vector<Bytes>{ EncodeObjectId(SpcPeImageDataOid), SpcPeImageData() })
+			, Encode(Sequence, std::vector<Bytes>{ Sha256Algorithm(), Encode(OctetString, digest) }) });
+
+		// message digest covers content of SpcIndirectDataContent without its tag and length
+		Element indirect;
+		Reader(indirectData.data(), indirectData.size()).Next(indirect);
+
+		std::vector<Bytes> attributes;
+		attributes.push_back(Attribute(ContentTypeOid, EncodeObjectId(SpcIndirectDataOid)));
+		attributes.push_back(Attribute(SpcSpOpusInfoOid, Encode(Sequence, Bytes())));
+		attributes.push_back(Attribute(SpcStatementTypeOid, Encode(Sequence, EncodeObjectId(SpcIndividualCodeSigningOid))));
+		attributes.push_back(Attribute(MessageDigestOid, Encode(OctetString, Sha256(indirect.Content()))));
+
+		// SET OF is sorted in DER
+		std::sort(attributes.begin(), attributes.end());
+
+		// signature is over the attributes encoded as SET, they are stored as [0] IMPLICIT
+		Bytes digestInfo = Encode(Sequence, std::vector<Bytes>{ Sha256Algorithm(), Encode(OctetString, Sha256(Encode(Set, attributes))) });
+
+		Bytes signature;
+		if (!sign(digestInfo, signature, error))
+			return false;
+
+		Bytes signerInfo = Encode(Sequence, std::vector<Bytes>{
+			  EncodeInteger(1)
+			, issuerAndSerial
+			, Sha256Algorithm()
+			, Encode(ContextConstructed | 0, attributes)
+			, Encode(Sequence, std::vector<Bytes>{ EncodeObjectId(RsaOid), EncodeNull() })
+			, Encode(OctetString, signature) });
+
+		Bytes content = Encode(Sequence, std::vector<Bytes>{
+			  EncodeInteger(1)
+			, Encode(Set, Sha256Algorithm())
+			, Encode(Sequence, std::vector<Bytes>{ EncodeObjectId(SpcIndirectDataOid), Encode(ContextConstructed | 0, indirectData) })
+			, Encode(ContextConstructed | 0, certificates)
+			, Encode(Set, signerInfo) });
+
+		signedData = Encode(Sequence, std::vector<Bytes>{ EncodeObjectId(SignedDataOid), Encode(ContextConstructed | 0, content) });
+		return true;
+	}
+
+	std::vector<BYTE> CertificateTableEntry(const std::vector<BYTE>& signedData)
+	{
+		const DWORD headerSize = offsetof(WIN_CERTIFICATE, bCertificate);
+
+		std::vector<BYTE> entry(headerSize);
+		WIN_CERTIFICATE* header = (WIN_CERTIFICATE*)entry.data();
+		header->dwLength = headerSize + (DWORD)signedData.size();
+		header->wRevision = WIN_CERT_REVISION_2_0;
+		header->wCertificateType = WIN_CERT_TYPE_PKCS_SIGNED_DATA;
+
+		entry.insert(entry.end(), signedData.begin(), signedData.end());
+		entry.resize((entry.size() + 7) & ~7);
+		return entry;
+	}
+
+	bool SignPEFile(const std::wstring& path, const std::vector<std::vector<BYTE>>& certificates, const RawSignFunction& sign, std::wstring& error)
+	{
+		return SignPEFile(path, [&](const std::vector<BYTE>& digest, std::vector<BYTE>& signedData, std::wstring& signError)
+		{
+			return AuthenticodeSignedData(digest, certificates, sign, signedData, signError);
+		}, error);
+	}
+
+	bool SignPEFile(const std::wstring& path, const DigestSignFunction& sign, std::wstring& error)
+	{
+		HANDLE file = CreateFile(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			error = L"Failed to open file for writing.";
+			return false;
+		}
+
+		std::shared_ptr<void> doomOfFile(file, CloseHandle);
+
+		CertificateTableInfo info;
+		std::vector<std::vector<BYTE>> digests;
+		if (!ReadCertificateTableInfo(file, info))
+		{
+			error = L"Invalid PE format.";
+			return false;
+		}
+
+		if (!AuthenticodeDigest(file, std::vector<HashAlgorithm>{ HashAlgorithm::Sha256 }, digests, error))
+			return false;
+
+		std::vector<BYTE> signedData;
+		if (!sign(digests.front(), signedData, error))
+			return false;
+
+		return ReplaceCertificateTable(file, info, CertificateTableEntry(signedData), error);
+	}
+
+	bool ReadCertificateFile(const std::wstring& path, std::vector<std::vector<BYTE>>& certificates)
+	{
+		std::ifstream file(path, std::ios::binary);
+		if (!file)
+			return false;
+
+		std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+		const std::string begin = "-----BEGIN CERTIFICATE-----";
+		const std::string end = "-----END CERTIFICATE-----";
+
+		if (data.find(begin) != std::string::npos)
+		{
+			for (size_t start = data.find(begin); start != std::string::npos; start = data.find(begin, start))
+			{
+				size_t stop = data.find(end, start);
+				if (stop == std::string::npos)
+					return false;
+
+				std::string block = data.substr(start, stop + end.size() - start);
+				start = stop + end.size();
+
+				DWORD size = 0;
+				if (!CryptStringToBinaryA(block.c_str(), (DWORD)block.size(), CRYPT_STRING_BASE64HEADER, NULL, &size, NULL, NULL))
+					return false;
+
+				std::vector<BYTE> certificate(size);
+				if (!CryptStringToBinaryA(block.c_str(), (DWORD)block.size(), CRYPT_STRING_BASE64HEADER, certificate.data(), &size, NULL, NULL))
+					return false;
+
+				certificate.resize(size);
+				certificates.push_back(certificate);
+			}
+
+			return true;
+		}
+
+		asn1::Reader reader((const BYTE*)data.data(), data.size());
+		for (asn1::Element element; !reader.AtEnd(); )
+		{
+			if (!reader.Next(asn1::Sequence, element))
+				return false;
+
+			certificates.push_back(element.Encoded());
+		}
+
+		return true;
+	}
+
+	bool AuthenticodeDigest(const std::wstring& path, const std::vector<HashAlgorithm>& algorithms, std::vector<std::vector<BYTE>>& digests, std::wstring& error)
+	{
+		HANDLE file = CreateFile(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			error = L"Can't open file for reading.";
+			return false;
+		}
+
+		bool result = AuthenticodeDigest(file, algorithms, digests, error);
+
+		CloseHandle(file);
+		return result;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,58 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <windows.h>
+
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "block.h"
+#include "hash.h"
+
+namespace peparser
+{
+	struct CertificateTableInfo;
+
+	// parts of a PE file covered by its Authenticode digest, in file order: everything except CheckSum field,
+	// security directory entry and the certificate table itself
+	// an unsigned file is padded with zeros to a multiple of 8 bytes the same way signing tools do before they sign,
+	// padding is returned as a range past the end of the file
+	std::vector<Block> AuthenticodeRanges(const CertificateTableInfo& info);
+
+	// Authenticode digest of a PE file with every requested algorithm, computed in one sequential read of the file
+	// digests are in the same order as algorithms
+	// returns false and sets error if the file can't be read or is not a PE image
+	bool AuthenticodeDigest(const std::wstring& path, const std::vector<HashAlgorithm>& algorithms, std::vector<std::vector<BYTE>>& digests, std::wstring& error);
+	bool AuthenticodeDigest(HANDLE file, const std::vector<HashAlgorithm>& algorithms, std::vector<std::vector<BYTE>>& digests, std::wstring& error);
+
+	// SpcPeImageData value of SpcIndirectDataContent the way signing tools and MakeCat write it
+	std::vector<BYTE> SpcPeImageData();
+
+	// produces PKCS #1 v1.5 signature of a DER DigestInfo with the signing key, returns false and sets error on failure
+	typedef std::function<bool(const std::vector<BYTE>& digestInfo, std::vector<BYTE>& signature, std::wstring& error)> RawSignFunction;
+
+	// builds Authenticode PKCS #7 SignedData for a SHA-256 PE digest the way signtool does: SpcIndirectDataContent with
+	// SpcPeImageData, authenticated content type, opus info, statement type and message digest, RSA signer
+	// certificates are DER, the signer's first followed by the rest of the chain
+	bool AuthenticodeSignedData(const std::vector<BYTE>& digest, const std::vector<std::vector<BYTE>>& certificates, const RawSignFunction& sign, std::vector<BYTE>& signedData, std::wstring& error);
+
+	// builds PKCS #7 SignedData for a SHA-256 Authenticode digest (locally or by a remote signing agent),
+	// returns false and sets error on failure
+	typedef std::function<bool(const std::vector<BYTE>& digest, std::vector<BYTE>& signedData, std::wstring& error)> DigestSignFunction;
+
+	// WIN_CERTIFICATE entry with PKCS #7 SignedData, padded to a multiple of 8 bytes
+	std::vector<BYTE> CertificateTableEntry(const std::vector<BYTE>& signedData);
+
+	// signs a PE file without Mssign32 or a certificate store: digest is computed natively, signature is built by
+	// AuthenticodeSignedData and written as the certificate table (replacing a trailing one), checksum is updated
+	// file is held open exclusively, safe to call for different files in parallel
+	bool SignPEFile(const std::wstring& path, const std::vector<std::vector<BYTE>>& certificates, const RawSignFunction& sign, std::wstring& error);
+	// same with SignedData built by sign from the digest
+	bool SignPEFile(const std::wstring& path, const DigestSignFunction& sign, std::wstring& error);
+
+	// DER certificates from a file with one or more DER certificates or PEM blocks (a chain or a trust bundle)
+	bool ReadCertificateFile(const std::wstring& path, std::vector<std::vector<BYTE>>& certificates);
+}
\ No newline at end of file
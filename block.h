@@ -12,19 +12,23 @@
 
 namespace peparser
 {
+	// file offsets and sizes are 64 bit regardless of target platform, PE images are limited to 4 GB
+	// but installers and other files with overlays are not
+	typedef unsigned __int64 BlockOffset;
+
 	// describes a range of bytes in a file
 	class Block
 	{
 	public:
 		// file offset for start of the block in bytes
-		size_t offset = 0;
+		BlockOffset offset = 0;
 		// block size, bytes
-		size_t size = 0;
+		BlockOffset size = 0;
 		std::wstring description;
 		std::wstring data;
 
 		Block() {}
-		Block(const std::wstring& description, size_t offset, size_t size) : description(description), offset(offset), size(size) {}
+		Block(const std::wstring& description, BlockOffset offset, BlockOffset size) : description(description), offset(offset), size(size) {}
 
 		// true if b starts before this starts
 		bool operator <(const Block& b) const { return offset < b.offset; }
@@ -40,11 +44,11 @@ namespace peparser
 	class Block2 : public Block
 	{
 	public:
-		size_t offset2 = 0;
+		BlockOffset offset2 = 0;
 		std::wstring data2;
 
 		Block2() { }
-		Block2(const std::wstring& description, size_t offset1, size_t offset2, size_t size)
+		Block2(const std::wstring& description, BlockOffset offset1, BlockOffset offset2, BlockOffset size)
 			: Block(description, offset1, size)
 			, offset2(offset2)
 		{}
@@ -0,0 +1,153 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "catalog.h"
+#include "authenticode.h"
+#include "certificatetable.h"
+#include "hash.h"
+#include "threadpool.h"
+
+#include <windows.h>
+#include <wincrypt.h>
+#include <mscat.h>
+
+#include <algorithm>
+#include <cwctype>
+#include <iostream>
+#include <memory>
+#include <set>
+
+#pragma comment(lib, "wintrust.lib")
+
+#ifndef CRYPTCAT_VERSION_2
+#define CRYPTCAT_VERSION_2 0x200
+#endif
+
+namespace peparser
+{
+	namespace
+	{
+		// subject type of the PE image SIP
+		const GUID PeImageSubject = { 0xc689aab8, 0x8e78, 0x11d0, { 0x8c, 0x47, 0x00, 0xc0, 0x4f, 0xc2, 0x95, 0xee } };
+		const DWORD MemberCertVersion = 0x200;
+
+		const char* SpcPeImageDataOid = "1.3.6.1.4.1.311.2.1.15";
+		const char* Sha256Oid = "2.16.840.1.101.3.4.2.1";
+
+		std::wstring FileName(const std::wstring& path)
+		{
+			size_t slash = path.find_last_of(L"\\/");
+			return slash == std::wstring::npos ? path : path.substr(slash + 1);
+		}
+	}
+
+	bool CreateCatalog(const std::wstring& path, const std::vector<std::wstring>& inputs, size_t threads)
+	{
+		struct Member
+		{
+			std::vector<BYTE> digest;
+			bool notPe = false;
+			std::wstring error;
+		};
+
+		std::vector<Member> members(inputs.size());
+		ParallelForEach(inputs.size(), threads, [&](size_t i)
+		{
+			HANDLE file = CreateFile(inputs[i].c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+			if (file == INVALID_HANDLE_VALUE)
+			{
+				members[i].error = L"Can't open file for reading.";
+				return;
+			}
+
+			// only PE members are written (no flat file hashes), anything else is left out
+			CertificateTableInfo info;
+			std::vector<std::vector<BYTE>> digests;
+			if (!ReadCertificateTableInfo(file, info))
+				members[i].notPe = true;
+			else if (AuthenticodeDigest(file, std::vector<HashAlgorithm>{ HashAlgorithm::Sha256 }, digests, members[i].error))
+				members[i].digest = digests.front();
+
+			CloseHandle(file);
+		});
+
+		bool ok = true;
+		size_t listed = 0;
+		for (size_t i = 0; i < inputs.size(); ++i)
+		{
+			if (members[i].notPe)
+			{
+				std::wcerr << L"Not a PE file, left out of the catalog, File: " << inputs[i] << std::endl;
+				continue;
+			}
+
+			if (members[i].digest.empty())
+			{
+				std::wcerr << members[i].error << L", File: " << inputs[i] << std::endl;
+				ok = false;
+				continue;
+			}
+
+			++listed;
+		}
+
+		if (!ok)
+			return false;
+
+		if (!listed)
+		{
+			std::wcerr << L"No PE files to list in the catalog." << std::endl;
+			return false;
+		}
+
+		HANDLE catalog = CryptCATOpen((LPWSTR)path.c_str(), CRYPTCAT_OPEN_CREATENEW, NULL, CRYPTCAT_VERSION_2, 0);
+		if (catalog == INVALID_HANDLE_VALUE)
+		{
+			std::wcerr << L"Failed to create catalog. Error: " << GetLastError() << L", File: " << path << std::endl;
+			return false;
+		}
+
+		std::shared_ptr<void> doomOfCatalog(catalog, CryptCATClose);
+
+		std::vector<BYTE> peImageData = SpcPeImageData();
+		std::set<std::wstring> tags;
+
+		for (size_t i = 0; i < inputs.size(); ++i)
+		{
+			if (members[i].notPe)
+				continue;
+
+			std::wstring tag = Hash::ToHex(members[i].digest);
+			std::transform(tag.begin(), tag.end(), tag.begin(), std::towupper);
+
+			if (!tags.insert(tag).second)
+				continue;
+
+			SIP_INDIRECT_DATA indirect = {};
+			indirect.Data.pszObjId = (LPSTR)SpcPeImageDataOid;
+			indirect.Data.Value.cbData = (DWORD)peImageData.size();
+			indirect.Data.Value.pbData = peImageData.data();
+			indirect.DigestAlgorithm.pszObjId = (LPSTR)Sha256Oid;
+			indirect.Digest.cbData = (DWORD)members[i].digest.size();
+			indirect.Digest.pbData = members[i].digest.data();
+
+			CRYPTCATMEMBER* member = CryptCATPutMemberInfo(catalog, (LPWSTR)inputs[i].c_str(), (LPWSTR)tag.c_str(), (GUID*)&PeImageSubject, MemberCertVersion, sizeof(indirect), (BYTE*)&indirect);
+
+			std::wstring name = FileName(inputs[i]);
+			if (!member || !CryptCATPutAttrInfo(catalog, member, (LPWSTR)L"File", CRYPTCAT_ATTR_AUTHENTICATED | CRYPTCAT_ATTR_NAMEASCII | CRYPTCAT_ATTR_DATAASCII, (DWORD)((name.size() + 1) * sizeof(wchar_t)), (BYTE*)name.c_str()))
+			{
+				std::wcerr << L"Failed to add catalog member. Error: " << GetLastError() << L", File: " << inputs[i] << std::endl;
+				return false;
+			}
+		}
+
+		if (!CryptCATPersistStore(catalog))
+		{
+			std::wcerr << L"Failed to write catalog. Error: " << GetLastError() << L", File: " << path << std::endl;
+			return false;
+		}
+
+		std::wcerr << L"Catalog: " << path << L", members: " << tags.size() << std::endl;
+		return true;
+	}
+}
\ No newline at end of file
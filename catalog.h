@@ -0,0 +1,20 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace peparser
+{
+	// creates an unsigned catalog file (.cat) listing PE files by their SHA-256 Authenticode digests the way MakeCat does
+	// for a version 2 catalog: every member is tagged with the uppercase hex of its digest and carries SpcIndirectDataContent
+	// and member info, plus an authenticated "File" attribute with its file name
+	// digests are computed on up to 'threads' workers (0 is one per logical processor), files with identical contents
+	// share one member
+	// one signature of the catalog then covers all of its members, sign it as any other file
+	// only PE files are listed, other inputs are left out with a warning (no flat file hashes)
+	// returns false if an input can't be read, there is no PE file at all or the catalog could not be written, writes to std::wcerr
+	bool CreateCatalog(const std::wstring& path, const std::vector<std::wstring>& inputs, size_t threads);
+}
\ No newline at end of file
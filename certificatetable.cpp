@@ -0,0 +1,224 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "certificatetable.h"
+#include "checksum.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace peparser
+{
+	namespace
+	{
+		bool ReadAt(HANDLE file, BlockOffset offset, void* buffer, DWORD size)
+		{
+			LARGE_INTEGER position;
+			position.QuadPart = offset;
+
+			DWORD read = 0;
+			return SetFilePointerEx(file, position, NULL, FILE_BEGIN) && ReadFile(file, buffer, size, &read, NULL) && read == size;
+		}
+
+		bool WriteAt(HANDLE file, BlockOffset offset, const void* buffer, DWORD size)
+		{
+			LARGE_INTEGER position;
+			position.QuadPart = offset;
+
+			DWORD written = 0;
+			return SetFilePointerEx(file, position, NULL, FILE_BEGIN) && WriteFile(file, buffer, size, &written, NULL) && written == size;
+		}
+
+		template<class Headers>
+		bool ReadDirectory(const BYTE* buffer, size_t size, BlockOffset headersOffset, CertificateTableInfo& info)
+		{
+			if (size < sizeof(Headers))
+				return false;
+
+			const Headers* headers = (const Headers*)buffer;
+
+			info.checksumOffset = headersOffset + offsetof(Headers, OptionalHeader.CheckSum);
+			info.checksum = headers->OptionalHeader.CheckSum;
+
+			// directory doesn't exist at all
+			size_t directoryEnd = offsetof(Headers, OptionalHeader.DataDirectory) + (IMAGE_DIRECTORY_ENTRY_SECURITY + 1) * sizeof(IMAGE_DATA_DIRECTORY) - offsetof(Headers, OptionalHeader);
+			if (headers->OptionalHeader.NumberOfRvaAndSizes <= IMAGE_DIRECTORY_ENTRY_SECURITY || headers->FileHeader.SizeOfOptionalHeader < directoryEnd)
+				return true;
+
+			const IMAGE_DATA_DIRECTORY& directory = headers->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_SECURITY];
+
+			info.directoryOffset = headersOffset + offsetof(Headers, OptionalHeader.DataDirectory) + IMAGE_DIRECTORY_ENTRY_SECURITY * sizeof(IMAGE_DATA_DIRECTORY);
+			info.offset = directory.VirtualAddress;
+			info.size = directory.Size;
+
+			return true;
+		}
+
+		StripResult Strip(HANDLE file, std::wstring& error)
+		{
+			CertificateTableInfo info;
+			if (!ReadCertificateTableInfo(file, info))
+			{
+				error = L"Invalid PE format.";
+				return StripResult::Failed;
+			}
+
+			if (!info.IsPresent())
+				return StripResult::NotSigned;
+
+			if (!info.IsTrailing() || info.directoryOffset == 0)
+				return StripResult::NotTrailing;
+
+			// headers first, a failed write must not leave a directory entry pointing past the end of the file
+			const IMAGE_DATA_DIRECTORY empty = {};
+			if (!WriteAt(file, info.directoryOffset, &empty, sizeof(empty)))
+			{
+				error = L"Failed to update signature directory entry.";
+				return StripResult::Failed;
+			}
+
+			// recomputed rather than adjusted, a stored checksum that was already wrong would stay wrong
+			DWORD checksum = 0;
+			if (!FileChecksum(file, info.offset, info.checksumOffset, checksum) || !WriteAt(file, info.checksumOffset, &checksum, sizeof(checksum)))
+			{
+				error = L"Failed to update checksum.";
+				return StripResult::Failed;
+			}
+
+			LARGE_INTEGER end;
+			end.QuadPart = info.offset;
+			if (!SetFilePointerEx(file, end, NULL, FILE_BEGIN) || !SetEndOfFile(file))
+			{
+				error = L"Failed to truncate file.";
+				return StripResult::Failed;
+			}
+
+			return StripResult::Stripped;
+		}
+	}
+
+	bool CertificateTableInfo::IsTrailing() const
+	{
+		if (size == 0 || offset == 0 || (BlockOffset)offset + size > fileSize)
+			return false;
+
+		BlockOffset end = ((BlockOffset)offset + size + 7) & ~(BlockOffset)7;
+		return end >= fileSize;
+	}
+
+	bool ReadCertificateTableInfo(HANDLE file, CertificateTableInfo& info)
+	{
+		info = CertificateTableInfo();
+
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize))
+			return false;
+
+		info.fileSize = fileSize.QuadPart;
+
+		IMAGE_DOS_HEADER dos;
+		if (info.fileSize < sizeof(dos) || !ReadAt(file, 0, &dos, sizeof(dos)) || dos.e_magic != IMAGE_DOS_SIGNATURE || dos.e_lfanew <= 0)
+			return false;
+
+		BlockOffset headersOffset = (DWORD)dos.e_lfanew;
+		if (headersOffset >= info.fileSize)
+			return false;
+
+		// large enough for either flavour, short files are read as far as they go
+		BYTE buffer[sizeof(IMAGE_NT_HEADERS64)] = {};
+		DWORD size = (DWORD)min((BlockOffset)sizeof(buffer), info.fileSize - headersOffset);
+		if (!ReadAt(file, headersOffset, buffer, size))
+			return false;
+
+		const IMAGE_NT_HEADERS32* headers = (const IMAGE_NT_HEADERS32*)buffer;
+		if (size < offsetof(IMAGE_NT_HEADERS32, OptionalHeader.Magic) + sizeof(WORD) || headers->Signature != IMAGE_NT_SIGNATURE)
+			return false;
+
+		switch (headers->OptionalHeader.Magic)
+		{
+		case IMAGE_NT_OPTIONAL_HDR32_MAGIC:
+			return ReadDirectory<IMAGE_NT_HEADERS32>(buffer, size, headersOffset, info);
+		case IMAGE_NT_OPTIONAL_HDR64_MAGIC:
+			return ReadDirectory<IMAGE_NT_HEADERS64>(buffer, size, headersOffset, info);
+		default:
+			return false;
+		}
+	}
+
+	bool ReadCertificateTable(HANDLE file, const CertificateTableInfo& info, std::vector<BYTE>& table)
+	{
+		table.clear();
+		if (!info.IsPresent() || info.offset == 0 || (BlockOffset)info.offset + info.size > info.fileSize)
+			return false;
+
+		table.resize(info.size);
+		return ReadAt(file, info.offset, table.data(), info.size);
+	}
+
+	bool ReplaceCertificateTable(HANDLE file, const CertificateTableInfo& info, const std::vector<BYTE>& table, std::wstring& error)
+	{
+		if (info.directoryOffset == 0 || table.size() % 8)
+		{
+			error = L"PE file has no security directory.";
+			return false;
+		}
+
+		if (info.IsPresent() && !info.IsTrailing())
+		{
+			error = L"Certificate table is not at the end of the file.";
+			return false;
+		}
+
+		// an unsigned file is padded with zeros to 8 bytes first, Authenticode digest covers the padding
+		BlockOffset offset = info.IsPresent() ? info.offset : (info.fileSize + 7) & ~(BlockOffset)7;
+		if (offset + table.size() > MAXDWORD)
+		{
+			error = L"File is too large to be signed.";
+			return false;
+		}
+
+		const BYTE padding[8] = {};
+		DWORD paddingSize = (DWORD)(offset > info.fileSize ? offset - info.fileSize : 0);
+
+		LARGE_INTEGER end;
+		end.QuadPart = info.IsPresent() ? offset : info.fileSize;
+		if (!SetFilePointerEx(file, end, NULL, FILE_BEGIN) || !SetEndOfFile(file)
+			|| (paddingSize && !WriteAt(file, info.fileSize, padding, paddingSize))
+			|| !WriteAt(file, offset, table.data(), (DWORD)table.size()))
+		{
+			error = L"Failed to write certificate table.";
+			return false;
+		}
+
+		IMAGE_DATA_DIRECTORY directory = { (DWORD)offset, (DWORD)table.size() };
+		if (!WriteAt(file, info.directoryOffset, &directory, sizeof(directory)))
+		{
+			error = L"Failed to update signature directory entry.";
+			return false;
+		}
+
+		DWORD checksum = 0;
+		if (!FileChecksum(file, offset + table.size(), info.checksumOffset, checksum) || !WriteAt(file, info.checksumOffset, &checksum, sizeof(checksum)))
+		{
+			error = L"Failed to update checksum.";
+			return false;
+		}
+
+		return true;
+	}
+
+	StripResult StripTrailingCertificates(const std::wstring& path, std::wstring& error)
+	{
+		HANDLE file = CreateFile(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			error = L"Failed to open file for writing.";
+			return StripResult::Failed;
+		}
+
+		StripResult result = Strip(file, error);
+
+		CloseHandle(file);
+		return result;
+	}
+}
\ No newline at end of file
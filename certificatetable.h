@@ -0,0 +1,56 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <windows.h>
+
+#include <string>
+#include <vector>
+
+#include "block.h"
+
+namespace peparser
+{
+	// where the attribute certificate table (security directory) of a PE file is, read straight from the file headers
+	// unlike other directories its address is a file offset, the table is not mapped and normally sits at the end of the file
+	struct CertificateTableInfo
+	{
+		BlockOffset fileSize = 0;
+		// of OptionalHeader.CheckSum and of the security IMAGE_DATA_DIRECTORY entry
+		BlockOffset checksumOffset = 0;
+		BlockOffset directoryOffset = 0;
+
+		DWORD checksum = 0;
+		DWORD offset = 0;
+		DWORD size = 0;
+
+		bool IsPresent() const { return offset != 0 || size != 0; }
+		// table is the last thing in the file (entries are 8 byte aligned, so its end may be padded)
+		bool IsTrailing() const;
+	};
+
+	// reads DOS and NT headers only, returns false if the file is not a PE image
+	bool ReadCertificateTableInfo(HANDLE file, CertificateTableInfo& info);
+
+	// reads the whole table (WIN_CERTIFICATE entries with their padding), returns false if it is not inside the file
+	bool ReadCertificateTable(HANDLE file, const CertificateTableInfo& info, std::vector<BYTE>& table);
+
+	// replaces a trailing table with a new one (size must be a multiple of 8): the file is truncated at the start of the old
+	// table, new one is written there, directory entry is updated and checksum recomputed
+	// an unsigned file gets the table appended after padding it to a multiple of 8 bytes
+	bool ReplaceCertificateTable(HANDLE file, const CertificateTableInfo& info, const std::vector<BYTE>& table, std::wstring& error);
+
+	enum class StripResult
+	{
+		  Stripped
+		, NotSigned
+		// table is not at the end of the file or the directory entry points outside of it
+		, NotTrailing
+		, Failed
+	};
+
+	// removes the certificate table when it is at the end of the file: directory entry is zeroed, checksum is recomputed
+	// over the part that stays and the file is truncated at the start of the table, the table itself is never read
+	StripResult StripTrailingCertificates(const std::wstring& path, std::wstring& error);
+}
\ No newline at end of file
@@ -0,0 +1,129 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "checksum.h"
+
+#include <emmintrin.h>
+#include <vector>
+
+namespace peparser
+{
+	void PEChecksum::Update(const void* data, size_t size)
+	{
+		const BYTE* bytes = (const BYTE*)data;
+
+		// odd number of bytes so far, first byte completes the previous word
+		if (size && (m_length & 1))
+		{
+			m_sum += (unsigned __int64)*bytes << 8;
+			++bytes;
+			--size;
+			++m_length;
+		}
+
+		m_length += size;
+
+		// 8 words at a time, zero extended into two vectors of 32 bit lanes, 4 low words into sum1 and 4 high into sum2
+		// a lane gets 1 word per iteration, so after a block of 4096 iterations it holds less than 2^28 and can't overflow
+		// lanes are plain sums, carries out of 16 bits are folded back only in Sum()
+		const size_t BlockSize = 4096 * sizeof(__m128i);
+		const __m128i zero = _mm_setzero_si128();
+
+		while (size >= sizeof(__m128i))
+		{
+			size_t block = min(size - size % sizeof(__m128i), BlockSize);
+
+			__m128i sum1 = _mm_setzero_si128();
+			__m128i sum2 = _mm_setzero_si128();
+			for (size_t i = 0; i < block; i += sizeof(__m128i))
+			{
+				__m128i words = _mm_loadu_si128((const __m128i*)(bytes + i));
+				sum1 = _mm_add_epi32(sum1, _mm_unpacklo_epi16(words, zero));
+				sum2 = _mm_add_epi32(sum2, _mm_unpackhi_epi16(words, zero));
+			}
+
+			// lanes are added to the 64 bit accumulator separately, their sum can exceed 32 bits
+			__m128i wide = _mm_add_epi64(_mm_unpacklo_epi32(sum1, zero), _mm_unpackhi_epi32(sum1, zero));
+			wide = _mm_add_epi64(wide, _mm_unpacklo_epi32(sum2, zero));
+			wide = _mm_add_epi64(wide, _mm_unpackhi_epi32(sum2, zero));
+
+			unsigned __int64 lanes[2];
+			_mm_storeu_si128((__m128i*)lanes, wide);
+			m_sum += lanes[0] + lanes[1];
+
+			bytes += block;
+			size -= block;
+		}
+
+		// folding is deferred to Value(), 64 bit accumulator can't overflow on any real file
+		for (; size >= sizeof(WORD); bytes += sizeof(WORD), size -= sizeof(WORD))
+			m_sum += *(const WORD*)bytes;
+
+		if (size)
+			m_sum += *bytes;
+	}
+
+	DWORD PEChecksum::Value() const
+	{
+		return (DWORD)(Sum() + m_length);
+	}
+
+	DWORD PEChecksum::Sum() const
+	{
+		unsigned __int64 sum = m_sum;
+		while (sum >> 16)
+			sum = (sum & 0xFFFF) + (sum >> 16);
+
+		return (DWORD)sum;
+	}
+
+	DWORD ImageChecksum(const void* data, size_t size, size_t checksumOffset)
+	{
+		PEChecksum checksum;
+
+		if (checksumOffset + sizeof(DWORD) > size)
+		{
+			checksum.Update(data, size);
+			return checksum.Value();
+		}
+
+		const DWORD zero = 0;
+		checksum.Update(data, checksumOffset);
+		checksum.Update(&zero, sizeof(zero));
+		checksum.Update((const BYTE*)data + checksumOffset + sizeof(DWORD), size - checksumOffset - sizeof(DWORD));
+
+		return checksum.Value();
+	}
+
+	bool FileChecksum(HANDLE file, BlockOffset size, BlockOffset checksumOffset, DWORD& checksum)
+	{
+		const DWORD ChunkSize = 1024 * 1024;
+
+		LARGE_INTEGER start;
+		start.QuadPart = 0;
+		if (!SetFilePointerEx(file, start, NULL, FILE_BEGIN))
+			return false;
+
+		PEChecksum sum;
+		std::vector<BYTE> buffer(ChunkSize);
+
+		for (BlockOffset offset = 0; offset < size; )
+		{
+			DWORD chunk = (DWORD)min((BlockOffset)ChunkSize, size - offset);
+
+			DWORD read = 0;
+			if (!ReadFile(file, buffer.data(), chunk, &read, NULL) || read != chunk)
+				return false;
+
+			for (BlockOffset i = checksumOffset; i < checksumOffset + sizeof(DWORD); ++i)
+				if (i >= offset && i < offset + chunk)
+					buffer[(size_t)(i - offset)] = 0;
+
+			sum.Update(buffer.data(), chunk);
+			offset += chunk;
+		}
+
+		checksum = sum.Value();
+		return true;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,36 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <windows.h>
+
+#include "block.h"
+
+namespace peparser
+{
+	// PE image checksum (same value as CheckSumMappedFile() produces)
+	// 16 bit one's complement sum of the file plus file length, computed incrementally so it can be
+	// updated while the file is being written, the CheckSum field itself must be passed in as zeros
+	class PEChecksum
+	{
+	public:
+		void Update(const void* data, size_t size);
+		// checksum of everything passed to Update() so far
+		DWORD Value() const;
+		// folded 16 bit sum without the length
+		DWORD Sum() const;
+
+		BlockOffset Length() const { return m_length; }
+
+	private:
+		unsigned __int64 m_sum = 0;
+		BlockOffset m_length = 0;
+	};
+
+	// checksum of a whole image in memory, checksumOffset points at the CheckSum field which is treated as zero
+	DWORD ImageChecksum(const void* data, size_t size, size_t checksumOffset);
+
+	// checksum of the first size bytes of an open file, read sequentially, CheckSum field at checksumOffset is treated as zero
+	bool FileChecksum(HANDLE file, BlockOffset size, BlockOffset checksumOffset, DWORD& checksum);
+}
\ No newline at end of file
@@ -0,0 +1,197 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+// subset of PKCS #11 v2.40 (Cryptoki) definitions used to sign with keys on tokens and HSMs
+// names, values and layout follow the OASIS headers, so any compliant module can be loaded through C_GetFunctionList
+
+#ifdef _WIN32
+#pragma pack(push, cryptoki, 1)
+#endif
+
+typedef unsigned char CK_BYTE;
+typedef CK_BYTE CK_BBOOL;
+typedef CK_BYTE CK_UTF8CHAR;
+typedef unsigned long CK_ULONG;
+typedef CK_ULONG CK_FLAGS;
+typedef CK_ULONG CK_RV;
+typedef CK_ULONG CK_SLOT_ID;
+typedef CK_ULONG CK_SESSION_HANDLE;
+typedef CK_ULONG CK_OBJECT_HANDLE;
+typedef CK_ULONG CK_OBJECT_CLASS;
+typedef CK_ULONG CK_ATTRIBUTE_TYPE;
+typedef CK_ULONG CK_MECHANISM_TYPE;
+typedef CK_ULONG CK_USER_TYPE;
+typedef CK_ULONG CK_NOTIFICATION;
+typedef void* CK_VOID_PTR;
+
+#define CK_TRUE 1
+#define CK_FALSE 0
+#define CK_INVALID_HANDLE 0
+#define CK_UNAVAILABLE_INFORMATION (~0UL)
+
+#define CKR_OK 0x00000000UL
+#define CKR_USER_ALREADY_LOGGED_IN 0x00000100UL
+#define CKR_BUFFER_TOO_SMALL 0x00000150UL
+#define CKR_CRYPTOKI_ALREADY_INITIALIZED 0x00000191UL
+
+#define CKF_SERIAL_SESSION 0x00000004UL
+#define CKU_USER 1UL
+
+#define CKO_CERTIFICATE 0x00000001UL
+#define CKO_PRIVATE_KEY 0x00000003UL
+
+#define CKA_CLASS 0x00000000UL
+#define CKA_LABEL 0x00000003UL
+#define CKA_VALUE 0x00000011UL
+#define CKA_ID 0x00000102UL
+
+#define CKM_RSA_PKCS 0x00000001UL
+
+struct CK_VERSION
+{
+	CK_BYTE major;
+	CK_BYTE minor;
+};
+
+struct CK_TOKEN_INFO
+{
+	CK_UTF8CHAR label[32];
+	CK_UTF8CHAR manufacturerID[32];
+	CK_UTF8CHAR model[16];
+	CK_BYTE serialNumber[16];
+	CK_FLAGS flags;
+	CK_ULONG ulMaxSessionCount;
+	CK_ULONG ulSessionCount;
+	CK_ULONG ulMaxRwSessionCount;
+	CK_ULONG ulRwSessionCount;
+	CK_ULONG ulMaxPinLen;
+	CK_ULONG ulMinPinLen;
+	CK_ULONG ulTotalPublicMemory;
+	CK_ULONG ulFreePublicMemory;
+	CK_ULONG ulTotalPrivateMemory;
+	CK_ULONG ulFreePrivateMemory;
+	CK_VERSION hardwareVersion;
+	CK_VERSION firmwareVersion;
+	CK_BYTE utcTime[16];
+};
+
+struct CK_ATTRIBUTE
+{
+	CK_ATTRIBUTE_TYPE type;
+	CK_VOID_PTR pValue;
+	CK_ULONG ulValueLen;
+};
+
+struct CK_MECHANISM
+{
+	CK_MECHANISM_TYPE mechanism;
+	CK_VOID_PTR pParameter;
+	CK_ULONG ulParameterLen;
+};
+
+#ifdef _WIN32
+#define CK_CALL __cdecl
+#else
+#define CK_CALL
+#endif
+
+typedef CK_RV(CK_CALL *CK_NOTIFY)(CK_SESSION_HANDLE, CK_NOTIFICATION, CK_VOID_PTR);
+typedef CK_RV(CK_CALL *CK_ANY_FUNCTION)();
+
+struct CK_FUNCTION_LIST;
+
+typedef CK_RV(CK_CALL *CK_C_Initialize)(CK_VOID_PTR pInitArgs);
+typedef CK_RV(CK_CALL *CK_C_Finalize)(CK_VOID_PTR pReserved);
+typedef CK_RV(CK_CALL *CK_C_GetFunctionList)(CK_FUNCTION_LIST** ppFunctionList);
+typedef CK_RV(CK_CALL *CK_C_GetSlotList)(CK_BBOOL tokenPresent, CK_SLOT_ID* pSlotList, CK_ULONG* pulCount);
+typedef CK_RV(CK_CALL *CK_C_GetTokenInfo)(CK_SLOT_ID slotID, CK_TOKEN_INFO* pInfo);
+typedef CK_RV(CK_CALL *CK_C_OpenSession)(CK_SLOT_ID slotID, CK_FLAGS flags, CK_VOID_PTR pApplication, CK_NOTIFY Notify, CK_SESSION_HANDLE* phSession);
+typedef CK_RV(CK_CALL *CK_C_CloseSession)(CK_SESSION_HANDLE hSession);
+typedef CK_RV(CK_CALL *CK_C_Login)(CK_SESSION_HANDLE hSession, CK_USER_TYPE userType, CK_UTF8CHAR* pPin, CK_ULONG ulPinLen);
+typedef CK_RV(CK_CALL *CK_C_Logout)(CK_SESSION_HANDLE hSession);
+typedef CK_RV(CK_CALL *CK_C_GetAttributeValue)(CK_SESSION_HANDLE hSession, CK_OBJECT_HANDLE hObject, CK_ATTRIBUTE* pTemplate, CK_ULONG ulCount);
+typedef CK_RV(CK_CALL *CK_C_FindObjectsInit)(CK_SESSION_HANDLE hSession, CK_ATTRIBUTE* pTemplate, CK_ULONG ulCount);
+typedef CK_RV(CK_CALL *CK_C_FindObjects)(CK_SESSION_HANDLE hSession, CK_OBJECT_HANDLE* phObject, CK_ULONG ulMaxObjectCount, CK_ULONG* pulObjectCount);
+typedef CK_RV(CK_CALL *CK_C_FindObjectsFinal)(CK_SESSION_HANDLE hSession);
+typedef CK_RV(CK_CALL *CK_C_SignInit)(CK_SESSION_HANDLE hSession, CK_MECHANISM* pMechanism, CK_OBJECT_HANDLE hKey);
+typedef CK_RV(CK_CALL *CK_C_Sign)(CK_SESSION_HANDLE hSession, CK_BYTE* pData, CK_ULONG ulDataLen, CK_BYTE* pSignature, CK_ULONG* pulSignatureLen);
+
+// entries the signer doesn't call are kept as untyped pointers, only their position matters
+struct CK_FUNCTION_LIST
+{
+	CK_VERSION version;
+	CK_C_Initialize C_Initialize;
+	CK_C_Finalize C_Finalize;
+	CK_ANY_FUNCTION C_GetInfo;
+	CK_C_GetFunctionList C_GetFunctionList;
+	CK_C_GetSlotList C_GetSlotList;
+	CK_ANY_FUNCTION C_GetSlotInfo;
+	CK_C_GetTokenInfo C_GetTokenInfo;
+	CK_ANY_FUNCTION C_GetMechanismList;
+	CK_ANY_FUNCTION C_GetMechanismInfo;
+	CK_ANY_FUNCTION C_InitToken;
+	CK_ANY_FUNCTION C_InitPIN;
+	CK_ANY_FUNCTION C_SetPIN;
+	CK_C_OpenSession C_OpenSession;
+	CK_C_CloseSession C_CloseSession;
+	CK_ANY_FUNCTION C_CloseAllSessions;
+	CK_ANY_FUNCTION C_GetSessionInfo;
+	CK_ANY_FUNCTION C_GetOperationState;
+	CK_ANY_FUNCTION C_SetOperationState;
+	CK_C_Login C_Login;
+	CK_C_Logout C_Logout;
+	CK_ANY_FUNCTION C_CreateObject;
+	CK_ANY_FUNCTION C_CopyObject;
+	CK_ANY_FUNCTION C_DestroyObject;
+	CK_ANY_FUNCTION C_GetObjectSize;
+	CK_C_GetAttributeValue C_GetAttributeValue;
+	CK_ANY_FUNCTION C_SetAttributeValue;
+	CK_C_FindObjectsInit C_FindObjectsInit;
+	CK_C_FindObjects C_FindObjects;
+	CK_C_FindObjectsFinal C_FindObjectsFinal;
+	CK_ANY_FUNCTION C_EncryptInit;
+	CK_ANY_FUNCTION C_Encrypt;
+	CK_ANY_FUNCTION C_EncryptUpdate;
+	CK_ANY_FUNCTION C_EncryptFinal;
+	CK_ANY_FUNCTION C_DecryptInit;
+	CK_ANY_FUNCTION C_Decrypt;
+	CK_ANY_FUNCTION C_DecryptUpdate;
+	CK_ANY_FUNCTION C_DecryptFinal;
+	CK_ANY_FUNCTION C_DigestInit;
+	CK_ANY_FUNCTION C_Digest;
+	CK_ANY_FUNCTION C_DigestUpdate;
+	CK_ANY_FUNCTION C_DigestKey;
+	CK_ANY_FUNCTION C_DigestFinal;
+	CK_C_SignInit C_SignInit;
+	CK_C_Sign C_Sign;
+	CK_ANY_FUNCTION C_SignUpdate;
+	CK_ANY_FUNCTION C_SignFinal;
+	CK_ANY_FUNCTION C_SignRecoverInit;
+	CK_ANY_FUNCTION C_SignRecover;
+	CK_ANY_FUNCTION C_VerifyInit;
+	CK_ANY_FUNCTION C_Verify;
+	CK_ANY_FUNCTION C_VerifyUpdate;
+	CK_ANY_FUNCTION C_VerifyFinal;
+	CK_ANY_FUNCTION C_VerifyRecoverInit;
+	CK_ANY_FUNCTION C_VerifyRecover;
+	CK_ANY_FUNCTION C_DigestEncryptUpdate;
+	CK_ANY_FUNCTION C_DecryptDigestUpdate;
+	CK_ANY_FUNCTION C_SignEncryptUpdate;
+	CK_ANY_FUNCTION C_DecryptVerifyUpdate;
+	CK_ANY_FUNCTION C_GenerateKey;
+	CK_ANY_FUNCTION C_GenerateKeyPair;
+	CK_ANY_FUNCTION C_WrapKey;
+	CK_ANY_FUNCTION C_UnwrapKey;
+	CK_ANY_FUNCTION C_DeriveKey;
+	CK_ANY_FUNCTION C_SeedRandom;
+	CK_ANY_FUNCTION C_GenerateRandom;
+	CK_ANY_FUNCTION C_GetFunctionStatus;
+	CK_ANY_FUNCTION C_CancelFunction;
+	CK_ANY_FUNCTION C_WaitForSlotEvent;
+};
+
+#ifdef _WIN32
+#pragma pack(pop, cryptoki)
+#endif
\ No newline at end of file
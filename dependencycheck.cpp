@@ -3,6 +3,7 @@
 
 #include "dependencycheck.h"
 #include "activationcontext.h"
+#include "manifest.h"
 #include "peparser.h"
 #include "widestring.h"
 #include "json/json.h"
@@ -11,6 +12,7 @@
 #include <boost/filesystem.hpp>
 
 #include <set>
+#include <memory>
 
 namespace fs = boost::filesystem;
 
@@ -99,37 +101,53 @@ namespace peparser
 		return path;
 	}
 
-	PEBinaryPtr CollectDependencies(const boost::filesystem::path& path, PEBinaryMap& cache)
+	PEBinaryPtr CollectDependencies(const boost::filesystem::path& path, PEBinaryMap& cache, bool activationContext)
 	{
 		if (path.empty())
 			return PEBinaryPtr();
 
-		bool x64 = false;
-		if (!PEParser::IsPE(path.wstring(), x64))
-			return PEBinaryPtr();
+		// 24/1 for exe, 24/2 for dlls, same choice ActivationContextHandler makes
+		bool executable = boost::algorithm::iequals(path.extension().wstring(), L".exe");
+
+		std::vector<std::string> imports, delayedImports;
+		Manifest manifest;
+		bool manifestLoaded = false;
+		{
+			// one metadata pass both checks the format and reads imports, without mapping the whole binary
+			PEParser pe(path.wstring());
+			if (!pe.OpenMetadata() || !pe.IsValidPE())
+				return PEBinaryPtr();
 
 #ifdef _WIN64
-		if (!x64) 
-			return PEBinaryPtr();
+			if (!pe.Is64Bit()) 
+				return PEBinaryPtr();
 #else
-		if (x64) 
-			return PEBinaryPtr();
+			if (pe.Is64Bit()) 
+				return PEBinaryPtr();
 #endif
 
-		std::vector<std::string> imports, delayedImports;
-		{
-			PEParser pe(path.wstring());
-			pe.Open(false);
 			imports = pe.DllImports();
 			delayedImports = pe.DelayedDllImports();
+
+			manifestLoaded = manifest.Load(pe, (WORD)(executable ? 1 : 2));
 		}
 
-		ActivationContextHandler context(path.wstring(), true);
+		// stays active while imports are looked up below, binaries without dependent assemblies don't need one
+		// since nothing they import can come from WinSxS, which is what keeps the default check fast
+		std::unique_ptr<ActivationContextHandler> context;
+		if (activationContext || !manifest.Dependencies().empty())
+		{
+			context.reset(new ActivationContextHandler(path.wstring(), true));
+			manifestLoaded = context->IsActivated();
+		}
 
 		PEBinaryPtr peBinary(new PEBinary);
 		peBinary->path = path;
 		peBinary->resolved = true;
-		peBinary->manifestLoaded = context.IsActivated();
+		peBinary->manifestLoaded = manifestLoaded;
+		peBinary->executionLevel = manifest.ExecutionLevel();
+		for (auto& assembly : manifest.Dependencies())
+			peBinary->assemblies.push_back(assembly.ToString());
 		cache[boost::algorithm::to_lower_copy(path.wstring())] = peBinary;
 
 		auto processImports = [&](const std::vector<std::string>& imports, bool delayed)
@@ -147,7 +165,7 @@ namespace peparser
 				if (knownDll != cache.end())
 					dll->pe = knownDll->second;
 				else
-					dll->pe = CollectDependencies(loadedPath, cache);
+					dll->pe = CollectDependencies(loadedPath, cache, activationContext);
 
 				if (!dll->delayLoad && (!dll->pe || !dll->pe->resolved))
 					peBinary->resolved = false;
@@ -238,6 +256,14 @@ namespace peparser
 			object["resolved"] = pe.second->resolved;
 			object["manifest"] = pe.second->manifestLoaded;
 
+			if (!pe.second->executionLevel.empty())
+				object["executionLevel"] = WideStringToMultiByte(pe.second->executionLevel);
+
+			json::Array assemblies;
+			for (auto& assembly : pe.second->assemblies)
+				assemblies.push_back(WideStringToMultiByte(assembly));
+			object["assemblies"] = assemblies;
+
 			json::Array imports;
 			for (auto& import : pe.second->dependencies)
 			{
@@ -9,6 +9,7 @@
 #include <list>
 #include <map>
 #include <set>
+#include <vector>
 
 namespace peparser
 {
@@ -22,9 +23,13 @@ namespace peparser
 	{
 		boost::filesystem::path path;
 		bool resolved = false;
-		// false if ActivationContext couldn't be activated for that binary
-		// usually happens when SxS system couldn't resolve all assembly dependencies, but might also mean broken manifest
+		// true if embedded manifest was read, or with an activation context (dependent assemblies or --activation-context),
+		// if one could be activated for that binary
+		// activation usually fails when SxS system couldn't resolve all assembly dependencies, but might also mean broken manifest
 		bool manifestLoaded = false;
+		// from embedded manifest: dependentAssembly identities ("name version") and requestedExecutionLevel
+		std::vector<std::wstring> assemblies;
+		std::wstring executionLevel;
 		std::list<ImportPtr> dependencies;
 	};
 
@@ -44,7 +49,10 @@ namespace peparser
 	void LoadSystemPath();
 
 	// returns a recursive dependency tree for a given filePath, cache will contain entries for all encountered binaries
-	PEBinaryPtr CollectDependencies(const boost::filesystem::path& filePath, PEBinaryMap& cache);
+	// embedded manifests are parsed, an activation context is created and activated while imports are looked up for binaries
+	// whose manifest lists dependent assemblies (or for every binary if activationContext is set), so dlls from
+	// side-by-side assemblies are found the way the loader does
+	PEBinaryPtr CollectDependencies(const boost::filesystem::path& filePath, PEBinaryMap& cache, bool activationContext = false);
 
 	// writes plain text dependency tree of root binary
 	// pass missingOnly to filter out binaries with fully satisfied dependencies
@@ -0,0 +1,225 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "exporttable.h"
+#include "widestring.h"
+
+#include <boost/io/ios_state.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <iomanip>
+
+namespace peparser
+{
+	ExportTable::ExportTable(const StringPoolPtr& pool)
+		: m_strings(pool)
+	{
+		if (!m_strings)
+			m_strings.reset(new StringPool());
+	}
+
+	void ExportTable::Reset(const char* moduleName, size_t maxLength, DWORD base, DWORD timeDateStamp, size_t functionCount)
+	{
+		Clear();
+
+		m_module = m_strings->Add(moduleName, maxLength);
+		m_base = base;
+		m_timeDateStamp = timeDateStamp;
+
+		m_functions.resize(functionCount);
+		for (size_t i = 0; i < functionCount; ++i)
+			m_functions[i].ordinal = (WORD)(base + i);
+
+		size_t buckets = 16;
+		while (buckets < 2 * functionCount)
+			buckets *= 2;
+		m_names.resize(buckets);
+	}
+
+	void ExportTable::SetFunction(size_t index, DWORD rva, const char* forwarder, size_t maxLength)
+	{
+		if (index >= m_functions.size())
+			return;
+
+		m_functions[index].rva = rva;
+		if (forwarder)
+			m_functions[index].forwarder = m_strings->Add(forwarder, maxLength);
+	}
+
+	void ExportTable::AddName(const char* name, size_t maxLength, size_t index)
+	{
+		if (index >= m_functions.size())
+			return;
+
+		StringPool::Id id = m_strings->Add(name, maxLength);
+		if (m_functions[index].name == StringPool::None)
+			m_functions[index].name = id;
+
+		InsertName(id, (DWORD)index);
+	}
+
+	void ExportTable::InsertName(StringPool::Id name, DWORD index)
+	{
+		// names can outnumber functions when several names alias one entry
+		if (2 * (m_nameCount + 1) > m_names.size())
+		{
+			std::vector<NameSlot> names;
+			names.swap(m_names);
+			m_names.resize(2 * names.size());
+			m_nameCount = 0;
+
+			for (auto& slot : names)
+				if (slot.name != StringPool::None)
+					InsertName(slot.name, slot.index);
+		}
+
+		size_t mask = m_names.size() - 1;
+		size_t i = Slot(name) & mask;
+		for (; m_names[i].name != StringPool::None; i = (i + 1) & mask)
+			if (m_names[i].name == name)
+				return;
+
+		m_names[i].name = name;
+		m_names[i].index = index;
+		++m_nameCount;
+	}
+
+	const ExportedFunction* ExportTable::Find(const char* name, size_t length) const
+	{
+		if (m_names.empty())
+			return NULL;
+
+		// names are interned, so a name that is not in the pool is not exported by anyone
+		StringPool::Id id = m_strings->Find(name, length);
+		if (id == StringPool::None)
+			return NULL;
+
+		size_t mask = m_names.size() - 1;
+		for (size_t i = Slot(id) & mask; m_names[i].name != StringPool::None; i = (i + 1) & mask)
+			if (m_names[i].name == id)
+				return &m_functions[m_names[i].index];
+
+		return NULL;
+	}
+
+	const ExportedFunction* ExportTable::FindOrdinal(DWORD ordinal) const
+	{
+		if (ordinal < m_base || ordinal - m_base >= m_functions.size())
+			return NULL;
+
+		const ExportedFunction& function = m_functions[ordinal - m_base];
+		return function.IsUsed() ? &function : NULL;
+	}
+
+	void ExportTable::Clear()
+	{
+		m_module = StringPool::None;
+		m_base = 0;
+		m_timeDateStamp = 0;
+		m_functions.clear();
+		m_names.clear();
+		m_nameCount = 0;
+	}
+
+	void ExportTable::PrintInfo(std::wostream& out) const
+	{
+		boost::io::ios_base_all_saver ofs(out);
+
+		out << MultiByteToWideString(ModuleName()) << L'\n';
+
+		for (auto& function : m_functions)
+		{
+			if (!function.IsUsed())
+				continue;
+
+			out.setf(std::ios::dec, std::ios::basefield);
+			out << L"  " << std::right << std::setw(5) << function.ordinal;
+			out.setf(std::ios::hex, std::ios::basefield);
+			out << L" " << std::setw(8) << function.rva << L" " << std::left << std::setw(40) << MultiByteToWideString(Name(function.name));
+
+			if (function.IsForwarded())
+				out << L" -> " << MultiByteToWideString(Name(function.forwarder));
+
+			out << L'\n';
+		}
+	}
+
+	std::string ExportIndex::Key(const std::string& name)
+	{
+		std::string key = boost::algorithm::to_lower_copy(name);
+		if (boost::algorithm::ends_with(key, ".dll"))
+			key.resize(key.size() - 4);
+		return key;
+	}
+
+	void ExportIndex::Add(const std::wstring& fileName, const ExportTable& table)
+	{
+		ExportTablePtr module(new ExportTable(table));
+
+		m_modules[Key(WideStringToMultiByte(fileName))] = module;
+
+		std::string internalName = Key(table.ModuleName());
+		if (!internalName.empty())
+			m_modules.insert(std::make_pair(internalName, module));
+	}
+
+	ExportTablePtr ExportIndex::Module(const std::string& name) const
+	{
+		auto module = m_modules.find(Key(name));
+		if (module == m_modules.end())
+			return ExportTablePtr();
+		return module->second;
+	}
+
+	ExportIndex::Resolution ExportIndex::Resolve(const std::string& module, const std::string& symbol, size_t maxHops) const
+	{
+		Resolution result;
+
+		std::string moduleName = module;
+		std::string symbolName = symbol;
+
+		for (;;)
+		{
+			ExportTablePtr table = Module(moduleName);
+			if (!table)
+			{
+				result.external = true;
+				return result;
+			}
+
+			const ExportedFunction* function = NULL;
+			if (!symbolName.empty() && symbolName[0] == '#')
+			{
+				DWORD ordinal = 0;
+				if (!boost::conversion::try_lexical_convert(symbolName.substr(1), ordinal))
+					return result;
+				function = table->FindOrdinal(ordinal);
+			}
+			else
+				function = table->Find(symbolName);
+
+			if (!function)
+				return result;
+
+			if (!function->IsForwarded())
+			{
+				result.module = table;
+				result.function = function;
+				return result;
+			}
+
+			if (result.hops++ >= maxHops)
+				return result;
+
+			// forwarder format is MODULE.Symbol, module names may contain dots themselves (api-ms-win-core-1-1-0.Func)
+			std::string forwarder = table->Name(function->forwarder);
+			size_t dot = forwarder.rfind('.');
+			if (dot == std::string::npos)
+				return result;
+
+			moduleName = forwarder.substr(0, dot);
+			symbolName = forwarder.substr(dot + 1);
+		}
+	}
+}
\ No newline at end of file
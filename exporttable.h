@@ -0,0 +1,123 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <windows.h>
+
+#include "stringpool.h"
+
+#include <vector>
+#include <map>
+#include <string>
+#include <ostream>
+#include <memory>
+
+namespace peparser
+{
+	// single entry of export address table
+	struct ExportedFunction
+	{
+		// first name pointing to this entry, None if exported by ordinal only
+		StringPool::Id name = StringPool::None;
+		// "MODULE.Symbol" or "MODULE.#ordinal" for forwarded exports, None otherwise
+		StringPool::Id forwarder = StringPool::None;
+		DWORD rva = 0;
+		WORD ordinal = 0;
+
+		bool IsForwarded() const { return forwarder != StringPool::None; }
+		// export address table may contain holes
+		bool IsUsed() const { return rva != 0; }
+	};
+
+	// decoded export directory
+	// functions are stored in an array indexed by (ordinal - base), names are interned in a string pool
+	// and indexed with an open addressing table so both kinds of lookups are O(1)
+	class ExportTable
+	{
+	public:
+		explicit ExportTable(const StringPoolPtr& pool = StringPoolPtr());
+
+		const StringPool& Strings() const { return *m_strings; }
+		const StringPoolPtr& Pool() const { return m_strings; }
+		const char* Name(StringPool::Id id) const { return m_strings->Get(id); }
+
+		// name from export directory, may differ from actual file name
+		const char* ModuleName() const { return Name(m_module); }
+		DWORD OrdinalBase() const { return m_base; }
+		DWORD TimeDateStamp() const { return m_timeDateStamp; }
+		bool IsEmpty() const { return m_functions.empty(); }
+
+		const std::vector<ExportedFunction>& Functions() const { return m_functions; }
+
+		const ExportedFunction* Find(const char* name, size_t length) const;
+		const ExportedFunction* Find(const std::string& name) const { return Find(name.data(), name.size()); }
+		const ExportedFunction* FindOrdinal(DWORD ordinal) const;
+
+		// building the table, Reset() first, then functions, then names
+		void Reset(const char* moduleName, size_t maxLength, DWORD base, DWORD timeDateStamp, size_t functionCount);
+		void SetFunction(size_t index, DWORD rva, const char* forwarder, size_t maxLength);
+		void AddName(const char* name, size_t maxLength, size_t index);
+
+		void Clear();
+
+		// writes ordinal, rva, name and forwarder of each used entry, one per line
+		void PrintInfo(std::wostream& out) const;
+
+	private:
+		StringPoolPtr m_strings;
+		StringPool::Id m_module = StringPool::None;
+		DWORD m_base = 0;
+		DWORD m_timeDateStamp = 0;
+
+		std::vector<ExportedFunction> m_functions;
+
+		// open addressing table, maps name id to index in m_functions, size is a power of 2
+		struct NameSlot
+		{
+			StringPool::Id name = StringPool::None;
+			DWORD index = 0;
+		};
+		std::vector<NameSlot> m_names;
+		size_t m_nameCount = 0;
+
+		void InsertName(StringPool::Id name, DWORD index);
+		static size_t Slot(StringPool::Id name) { return (size_t)name * 2654435761u; }
+	};
+
+	typedef std::shared_ptr<const ExportTable> ExportTablePtr;
+
+	// export tables of many modules keyed by module name, used to follow forwarder chains across files
+	// (e.g. kernel32!HeapAlloc -> NTDLL.RtlAllocateHeap) and to check that imported symbols exist
+	class ExportIndex
+	{
+	public:
+		struct Resolution
+		{
+			// module and function that finally implement the symbol, both NULL if resolution failed
+			ExportTablePtr module;
+			const ExportedFunction* function = NULL;
+			// number of forwarders followed
+			size_t hops = 0;
+			// true if the chain left the set of indexed modules (e.g. into API set or system dlls)
+			bool external = false;
+
+			bool IsResolved() const { return function != NULL; }
+		};
+
+		// file name is used as module key, export directory name is registered too if it is different
+		void Add(const std::wstring& fileName, const ExportTable& table);
+
+		ExportTablePtr Module(const std::string& name) const;
+		bool Contains(const std::string& name) const { return !!Module(name); }
+
+		// resolves symbol by name or by ordinal ("#123"), following forwarders up to maxHops
+		Resolution Resolve(const std::string& module, const std::string& symbol, size_t maxHops = 16) const;
+
+	private:
+		std::map<std::string, ExportTablePtr> m_modules;
+
+		// lower case name without .dll extension, the form used in forwarder strings
+		static std::string Key(const std::string& name);
+	};
+}
\ No newline at end of file
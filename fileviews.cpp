@@ -0,0 +1,92 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "fileviews.h"
+
+#include <algorithm>
+
+namespace peparser
+{
+	void FileViews::Attach(HANDLE fileMap, BlockOffset fileSize, bool writable, size_t budget)
+	{
+		Reset();
+
+		m_fileMap = fileMap;
+		m_fileSize = fileSize;
+		m_access = (writable) ? FILE_MAP_WRITE : FILE_MAP_READ;
+		m_budget = budget;
+
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		m_granularity = info.dwAllocationGranularity;
+	}
+
+	void FileViews::Reset()
+	{
+		for (auto& view : m_views)
+			UnmapViewOfFile(view.data);
+
+		m_views.clear();
+		m_mapped = 0;
+	}
+
+	LPBYTE FileViews::Data(BlockOffset offset, size_t size)
+	{
+		if (!m_fileMap || offset > m_fileSize || m_fileSize - offset < size)
+			return NULL;
+
+		++m_clock;
+
+		for (auto& view : m_views)
+		{
+			if (!view.Contains(offset, size))
+				continue;
+
+			view.lastUse = m_clock;
+			return view.data + (size_t)(offset - view.offset);
+		}
+
+		BlockOffset start = offset - offset % m_granularity;
+		BlockOffset end = std::min<BlockOffset>(m_fileSize, std::max<BlockOffset>(offset + size, start + WindowSize));
+
+		if (end - start > (BlockOffset)(size_t)-1)
+			return NULL;
+
+		View view;
+		view.offset = start;
+		view.size = (size_t)(end - start);
+
+		Evict(view.size);
+
+		view.data = (LPBYTE)MapViewOfFile(m_fileMap, m_access, (DWORD)(start >> 32), (DWORD)start, view.size);
+		if (!view.data)
+		{
+			// address space might be fragmented, retry with everything else unmapped
+			Reset();
+			view.data = (LPBYTE)MapViewOfFile(m_fileMap, m_access, (DWORD)(start >> 32), (DWORD)start, view.size);
+			if (!view.data)
+				return NULL;
+		}
+
+		view.lastUse = m_clock;
+		m_views.push_back(view);
+		m_mapped += view.size;
+
+		return view.data + (size_t)(offset - start);
+	}
+
+	void FileViews::Evict(size_t required)
+	{
+		while (!m_views.empty() && m_mapped + required > m_budget)
+		{
+			auto oldest = std::min_element(m_views.begin(), m_views.end(), [](const View& v1, const View& v2)
+			{
+				return v1.lastUse < v2.lastUse;
+			});
+
+			UnmapViewOfFile(oldest->data);
+			m_mapped -= oldest->size;
+			m_views.erase(oldest);
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,61 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <windows.h>
+
+#include "block.h"
+
+#include <vector>
+
+namespace peparser
+{
+	// maps windows of a file mapping on demand, so files bigger than available address space can be read
+	// windows are aligned to allocation granularity, least recently used ones are unmapped when the total
+	// mapped size goes over the budget
+	// pointer returned by Data() stays valid until the next Data() call on the same instance
+	class FileViews
+	{
+	public:
+		static const size_t WindowSize = 4 * 1024 * 1024;
+		static const size_t DefaultBudget = 64 * 1024 * 1024;
+
+		FileViews() {}
+		~FileViews() { Reset(); }
+
+		void Attach(HANDLE fileMap, BlockOffset fileSize, bool writable, size_t budget = DefaultBudget);
+		void Reset();
+
+		// returns pointer to [offset, offset + size) or NULL if range is outside of the file or can't be mapped
+		LPBYTE Data(BlockOffset offset, size_t size);
+
+		size_t MappedSize() const { return m_mapped; }
+
+	private:
+		struct View
+		{
+			BlockOffset offset = 0;
+			size_t size = 0;
+			LPBYTE data = NULL;
+			ULONGLONG lastUse = 0;
+
+			bool Contains(BlockOffset start, size_t length) const { return start >= offset && start - offset + length <= size; }
+		};
+
+		HANDLE m_fileMap = NULL;
+		BlockOffset m_fileSize = 0;
+		DWORD m_access = FILE_MAP_READ;
+		DWORD m_granularity = 64 * 1024;
+		size_t m_budget = DefaultBudget;
+		size_t m_mapped = 0;
+		ULONGLONG m_clock = 0;
+
+		std::vector<View> m_views;
+
+		void Evict(size_t required);
+
+		FileViews(const FileViews&);
+		FileViews& operator=(const FileViews&);
+	};
+}
\ No newline at end of file
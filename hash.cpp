@@ -0,0 +1,188 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "hash.h"
+
+#include <bcrypt.h>
+
+#pragma comment(lib, "bcrypt.lib")
+
+namespace peparser
+{
+	namespace
+	{
+		// algorithm handles are thread safe and expensive to open, so they are opened on first use and kept until exit
+		class Provider
+		{
+		public:
+			explicit Provider(LPCWSTR algorithm)
+			{
+				if (!BCRYPT_SUCCESS(BCryptOpenAlgorithmProvider(&m_handle, algorithm, NULL, 0)))
+				{
+					m_handle = NULL;
+					return;
+				}
+
+				DWORD result = 0;
+				if (!BCRYPT_SUCCESS(BCryptGetProperty(m_handle, BCRYPT_OBJECT_LENGTH, (PUCHAR)&m_objectSize, sizeof(m_objectSize), &result, 0))
+					|| !BCRYPT_SUCCESS(BCryptGetProperty(m_handle, BCRYPT_HASH_LENGTH, (PUCHAR)&m_digestSize, sizeof(m_digestSize), &result, 0)))
+				{
+					BCryptCloseAlgorithmProvider(m_handle, 0);
+					m_handle = NULL;
+				}
+			}
+
+			~Provider()
+			{
+				if (m_handle)
+					BCryptCloseAlgorithmProvider(m_handle, 0);
+			}
+
+			BCRYPT_ALG_HANDLE Handle() const { return m_handle; }
+			DWORD ObjectSize() const { return m_objectSize; }
+			DWORD DigestSize() const { return m_digestSize; }
+
+		private:
+			BCRYPT_ALG_HANDLE m_handle = NULL;
+			DWORD m_objectSize = 0;
+			DWORD m_digestSize = 0;
+		};
+
+		const Provider& GetProvider(HashAlgorithm algorithm)
+		{
+			static const Provider sha1(BCRYPT_SHA1_ALGORITHM);
+			static const Provider sha256(BCRYPT_SHA256_ALGORITHM);
+			static const Provider sha384(BCRYPT_SHA384_ALGORITHM);
+
+			switch (algorithm)
+			{
+			case HashAlgorithm::Sha1: return sha1;
+			case HashAlgorithm::Sha384: return sha384;
+			default: return sha256;
+			}
+		}
+
+		const HashAlgorithm algorithms[] = { HashAlgorithm::Sha1, HashAlgorithm::Sha256, HashAlgorithm::Sha384 };
+	}
+
+	bool ParseHashAlgorithm(const std::wstring& name, HashAlgorithm& algorithm)
+	{
+		for (auto candidate : algorithms)
+		{
+			if (_wcsicmp(name.c_str(), HashAlgorithmName(candidate)) == 0)
+			{
+				algorithm = candidate;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	const wchar_t* HashAlgorithmName(HashAlgorithm algorithm)
+	{
+		switch (algorithm)
+		{
+		case HashAlgorithm::Sha1: return L"sha1";
+		case HashAlgorithm::Sha384: return L"sha384";
+		default: return L"sha256";
+		}
+	}
+
+	const char* HashAlgorithmOid(HashAlgorithm algorithm)
+	{
+		switch (algorithm)
+		{
+		case HashAlgorithm::Sha1: return "1.3.14.3.2.26";
+		case HashAlgorithm::Sha384: return "2.16.840.1.101.3.4.2.2";
+		default: return "2.16.840.1.101.3.4.2.1";
+		}
+	}
+
+	bool HashAlgorithmFromOid(const std::string& oid, HashAlgorithm& algorithm)
+	{
+		for (auto candidate : algorithms)
+		{
+			if (oid == HashAlgorithmOid(candidate))
+			{
+				algorithm = candidate;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	Hash::Hash(HashAlgorithm algorithm)
+	{
+		const Provider& provider = GetProvider(algorithm);
+		if (!provider.Handle())
+			return;
+
+		m_object.resize(provider.ObjectSize());
+		m_digestSize = provider.DigestSize();
+
+		BCRYPT_HASH_HANDLE hash = NULL;
+		if (BCRYPT_SUCCESS(BCryptCreateHash(provider.Handle(), &hash, m_object.data(), (ULONG)m_object.size(), NULL, 0, 0)))
+			m_hash = hash;
+	}
+
+	Hash::~Hash()
+	{
+		if (m_hash)
+			BCryptDestroyHash(m_hash);
+	}
+
+	bool Hash::Update(const void* data, size_t size)
+	{
+		if (!m_hash)
+			return false;
+
+		// BCryptHashData takes a ULONG length
+		const size_t ChunkSize = 0x40000000;
+
+		const BYTE* bytes = (const BYTE*)data;
+		while (size)
+		{
+			ULONG chunk = (ULONG)min(size, ChunkSize);
+			if (!BCRYPT_SUCCESS(BCryptHashData(m_hash, (PUCHAR)bytes, chunk, 0)))
+				return false;
+
+			bytes += chunk;
+			size -= chunk;
+		}
+
+		return true;
+	}
+
+	std::vector<BYTE> Hash::Finish()
+	{
+		std::vector<BYTE> digest;
+		if (!m_hash)
+			return digest;
+
+		digest.resize(m_digestSize);
+		if (!BCRYPT_SUCCESS(BCryptFinishHash(m_hash, digest.data(), (ULONG)digest.size(), 0)))
+			digest.clear();
+
+		BCryptDestroyHash(m_hash);
+		m_hash = NULL;
+
+		return digest;
+	}
+
+	std::wstring Hash::ToHex(const std::vector<BYTE>& digest)
+	{
+		static const wchar_t digits[] = L"0123456789abcdef";
+
+		std::wstring result;
+		result.reserve(digest.size() * 2);
+		for (BYTE b : digest)
+		{
+			result += digits[b >> 4];
+			result += digits[b & 0xF];
+		}
+
+		return result;
+	}
+}
\ No newline at end of file
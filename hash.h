@@ -0,0 +1,55 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <windows.h>
+
+#include <string>
+#include <vector>
+
+namespace peparser
+{
+	enum class HashAlgorithm
+	{
+		  Sha1
+		, Sha256
+		, Sha384
+	};
+
+	// "sha1", "sha256", "sha384" (case insensitive)
+	bool ParseHashAlgorithm(const std::wstring& name, HashAlgorithm& algorithm);
+	const wchar_t* HashAlgorithmName(HashAlgorithm algorithm);
+
+	// dotted object identifier of the algorithm, as used in AlgorithmIdentifier of signatures and timestamps
+	const char* HashAlgorithmOid(HashAlgorithm algorithm);
+	bool HashAlgorithmFromOid(const std::string& oid, HashAlgorithm& algorithm);
+
+	// incremental message digest on top of CNG (bcrypt)
+	// algorithm providers are opened once per process and shared, so creating a Hash is cheap
+	// a Hash is not thread safe, use one per thread
+	class Hash
+	{
+	public:
+		explicit Hash(HashAlgorithm algorithm);
+		~Hash();
+
+		Hash(const Hash&) = delete;
+		Hash& operator=(const Hash&) = delete;
+
+		// false if CNG could not create the hash object
+		bool IsValid() const { return m_hash != NULL; }
+
+		bool Update(const void* data, size_t size);
+		// digest of everything passed to Update() so far, the object can't be updated afterwards
+		std::vector<BYTE> Finish();
+
+		// lowercase hex string of a digest
+		static std::wstring ToHex(const std::vector<BYTE>& digest);
+
+	private:
+		void* m_hash = NULL;
+		std::vector<BYTE> m_object;
+		size_t m_digestSize = 0;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,113 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "importtable.h"
+#include "widestring.h"
+
+#include <boost/io/ios_state.hpp>
+
+#include <iomanip>
+
+namespace peparser
+{
+	ImportTable::ImportTable(const StringPoolPtr& pool)
+		: m_strings(pool)
+	{
+		if (!m_strings)
+			m_strings.reset(new StringPool());
+	}
+
+	void ImportTable::AddModule(const char* name, size_t maxLength, bool delayed, DWORD timeDateStamp)
+	{
+		ImportedModule module;
+		module.name = m_strings->Add(name, maxLength);
+		module.firstFunction = (DWORD)m_functions.size();
+		module.delayed = delayed;
+		module.timeDateStamp = timeDateStamp;
+
+		m_modules.push_back(module);
+	}
+
+	void ImportTable::AddFunction(const char* name, size_t maxLength, WORD hint, DWORD iatRva, DWORD intRva)
+	{
+		if (m_modules.empty())
+			return;
+
+		ImportedFunction function;
+		function.name = m_strings->Add(name, maxLength);
+		function.hint = hint;
+		function.module = (DWORD)m_modules.size() - 1;
+		function.iatRva = iatRva;
+		function.intRva = intRva;
+
+		m_functions.push_back(function);
+		++m_modules.back().functionCount;
+	}
+
+	void ImportTable::AddFunction(WORD ordinal, DWORD iatRva, DWORD intRva)
+	{
+		if (m_modules.empty())
+			return;
+
+		ImportedFunction function;
+		function.ordinal = ordinal;
+		function.module = (DWORD)m_modules.size() - 1;
+		function.iatRva = iatRva;
+		function.intRva = intRva;
+
+		m_functions.push_back(function);
+		++m_modules.back().functionCount;
+	}
+
+	void ImportTable::AddBoundImport(const char* name, size_t maxLength, DWORD timeDateStamp, bool forwarder)
+	{
+		BoundImport bound;
+		bound.name = m_strings->Add(name, maxLength);
+		bound.timeDateStamp = timeDateStamp;
+		bound.forwarder = forwarder;
+
+		m_bound.push_back(bound);
+	}
+
+	void ImportTable::Clear()
+	{
+		m_modules.clear();
+		m_functions.clear();
+		m_bound.clear();
+	}
+
+	void ImportTable::PrintInfo(std::wostream& out) const
+	{
+		boost::io::ios_base_all_saver ofs(out);
+
+		out.setf(std::ios::hex, std::ios::basefield);
+
+		for (auto& module : m_modules)
+		{
+			out << MultiByteToWideString(Name(module.name));
+			if (module.delayed)
+				out << L" (delayed)";
+			out << L'\n';
+
+			for (DWORD i = module.firstFunction; i < module.firstFunction + module.functionCount; ++i)
+			{
+				const ImportedFunction& function = m_functions[i];
+
+				out << L"  ";
+				if (function.ByOrdinal())
+					out << L"ordinal: " << std::left << std::setw(30) << function.ordinal;
+				else
+					out << std::left << std::setw(39) << MultiByteToWideString(Name(function.name));
+
+				out << L" hint: " << std::setw(6) << function.hint << L" iat: " << std::setw(8) << function.iatRva << L" int: " << function.intRva << L'\n';
+			}
+		}
+
+		if (m_bound.empty())
+			return;
+
+		out << L'\n' << L"Bound imports:" << L'\n';
+		for (auto& bound : m_bound)
+			out << ((bound.forwarder) ? L"    " : L"  ") << MultiByteToWideString(Name(bound.name)) << L" timestamp: " << bound.timeDateStamp << L'\n';
+	}
+}
\ No newline at end of file
@@ -0,0 +1,83 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <windows.h>
+
+#include "stringpool.h"
+
+#include <vector>
+#include <ostream>
+
+namespace peparser
+{
+	// describes a dll referenced from import, delay import or bound import directories
+	struct ImportedModule
+	{
+		StringPool::Id name = StringPool::None;
+		// range in ImportTable::Functions()
+		DWORD firstFunction = 0;
+		DWORD functionCount = 0;
+		DWORD timeDateStamp = 0;
+		bool delayed = false;
+	};
+
+	// describes a single imported symbol
+	struct ImportedFunction
+	{
+		// None when imported by ordinal
+		StringPool::Id name = StringPool::None;
+		WORD ordinal = 0;
+		WORD hint = 0;
+		// index in ImportTable::Modules()
+		DWORD module = 0;
+		// RVAs of the thunks in import address table and import name table (0 if there is no INT)
+		DWORD iatRva = 0;
+		DWORD intRva = 0;
+
+		bool ByOrdinal() const { return name == StringPool::None; }
+	};
+
+	// describes an entry in bound import directory
+	struct BoundImport
+	{
+		StringPool::Id name = StringPool::None;
+		DWORD timeDateStamp = 0;
+		// true for forwarder references of a preceding bound module
+		bool forwarder = false;
+	};
+
+	// flat representation of everything a PE binary imports
+	// names are interned in a string pool which can be shared between many tables
+	class ImportTable
+	{
+	public:
+		explicit ImportTable(const StringPoolPtr& pool = StringPoolPtr());
+
+		const StringPool& Strings() const { return *m_strings; }
+		const StringPoolPtr& Pool() const { return m_strings; }
+		const char* Name(StringPool::Id id) const { return m_strings->Get(id); }
+
+		const std::vector<ImportedModule>& Modules() const { return m_modules; }
+		const std::vector<ImportedFunction>& Functions() const { return m_functions; }
+		const std::vector<BoundImport>& BoundImports() const { return m_bound; }
+
+		// starts a new module, following AddFunction() calls are attributed to it
+		void AddModule(const char* name, size_t maxLength, bool delayed, DWORD timeDateStamp);
+		void AddFunction(const char* name, size_t maxLength, WORD hint, DWORD iatRva, DWORD intRva);
+		void AddFunction(WORD ordinal, DWORD iatRva, DWORD intRva);
+		void AddBoundImport(const char* name, size_t maxLength, DWORD timeDateStamp, bool forwarder);
+
+		void Clear();
+
+		// writes module list with all imported symbols, one per line
+		void PrintInfo(std::wostream& out) const;
+
+	private:
+		StringPoolPtr m_strings;
+		std::vector<ImportedModule> m_modules;
+		std::vector<ImportedFunction> m_functions;
+		std::vector<BoundImport> m_bound;
+	};
+}
\ No newline at end of file
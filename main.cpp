@@ -30,6 +30,7 @@ int wmain(int argc, wchar_t* argv[])
 			("verbose", po::value<bool>()->zero_tokens()->default_value(false), "Print dynamically ignored ranges and other info.")
 			("input", po::wvalue<std::vector<std::wstring>>()->composing(), "Input files.")
 			("output", po::wvalue<std::wstring>(), "Output file path, if omitted uses standard out.")
+			("threads", po::value<size_t>()->default_value(0), "Number of worker threads for modes that process inputs in parallel, 0 uses one per logical processor.")
 		;
 
 		options.push_back(po::options_description("Info"));
@@ -37,10 +38,22 @@ int wmain(int argc, wchar_t* argv[])
 			("info", po::value<bool>()->zero_tokens()->notifier(std::bind(&Info, std::ref(variables), std::ref(retcode))), "Print full file information. Returns 0 if all files are valid PE binaries.")
 			("pdb", po::value<bool>()->zero_tokens()->notifier(std::bind(&Pdb, std::ref(variables), std::ref(retcode))), "Print pdb path and guid. Returns 0 if all files have debug information.")
 			("imports", po::value<bool>()->zero_tokens()->notifier(std::bind(&Imports, std::ref(variables), std::ref(retcode))), "Print a list of imported dlls.")
+			("functions", po::value<bool>()->zero_tokens()->default_value(false), "With --imports, also print imported functions (name or ordinal, hint, IAT and INT RVAs) and bound imports.")
+			("exports", po::value<bool>()->zero_tokens()->notifier(std::bind(&Exports, std::ref(variables), std::ref(retcode))), "Print export table: ordinal, RVA, name and forwarder of every exported function.")
+			("check-imports", po::value<bool>()->zero_tokens()->notifier(std::bind(&CheckImports, std::ref(variables), std::ref(retcode))), "Check that every symbol imported by input files from other input files is exported there, following forwarders. Returns 0 if all imports resolve.")
 			("signature", po::value<bool>()->zero_tokens()->notifier(std::bind(&Signature, std::ref(variables), std::ref(retcode))), "Check if binary has a digital signature section (does not validate signature). Returns 0 if all files have a DS section.")
 			("version-info", po::value<bool>()->zero_tokens()->notifier(std::bind(&Version, std::ref(variables), std::ref(retcode))), "Print version.")
+			("version-inventory", po::value<bool>()->zero_tokens()->notifier(std::bind(&Inventory, std::ref(variables), std::ref(retcode))), "Print every version info field (all languages and string tables, plus VS_FIXEDFILEINFO versions and flags) of all input files as UTF-8 CSV rows: file,resource,table,field,value. Use --json for JSON Lines. Inputs are processed in parallel. Returns 0 if all files are valid PE binaries.")
+			("authenticode-hash", po::value<bool>()->zero_tokens()->notifier(std::bind(&AuthenticodeHash, std::ref(variables), std::ref(retcode))), "Print Authenticode digest of all input files (hash of the file without checksum, signature directory entry and certificate table, as signed and as listed in catalogs). Each file is read once for all algorithms in --hash. Inputs are processed in parallel. Returns 0 if all files are valid PE binaries.")
+			("hash", po::wvalue<std::wstring>()->default_value(L"sha256", "sha256"), "Comma separated digest algorithms for --authenticode-hash: sha1, sha256, sha384.")
+			("verify-checksum", po::value<bool>()->zero_tokens()->notifier(std::bind(&VerifyChecksum, std::ref(variables), std::ref(retcode))), "Check PE checksum of all input files against their contents. Files without a checksum are reported but do not fail. Inputs are processed in parallel. Returns 0 if all files are valid PE binaries with correct or no checksum.")
+			("verify-signatures", po::value<bool>()->zero_tokens()->notifier(std::bind(&VerifySignatures, std::ref(variables), std::ref(retcode))), "Verify Authenticode signatures of all input files offline: recompute the digest, check every signature (including nested ones), its certificate chain and timestamp. Revocation is not checked. Inputs are processed in parallel, use --json for JSON Lines. Returns 0 if all files have only valid signatures.")
+			("trust-bundle", po::wvalue<std::wstring>(), "DER or PEM file with certificates trusted by --verify-signatures. Default is the roots trusted by the system.")
 			("dump-section", po::wvalue<std::wstring>()->notifier(std::bind(&DumpSection, std::ref(variables), std::ref(retcode))), "Dump contents of a named PE section. Takes a single input file.")
 			("dump-resource", po::wvalue<std::wstring>()->notifier(std::bind(&DumpResource, std::ref(variables), std::ref(retcode))), "Extract a resource by path. See contents of .rsrc section in output of --info for available entries.")
+			("extract-resources", po::wvalue<std::wstring>()->notifier(std::bind(&ExtractResources, std::ref(variables), std::ref(retcode))), "Extract all resources matching a path pattern ('*' and '?' match within one component, e.g. 24/*/* or @TYPELIB/*) from all input files into --to directory, one subdirectory per input file. Inputs are processed in parallel.")
+			("store-resources", po::wvalue<std::wstring>()->notifier(std::bind(&StoreResources, std::ref(variables), std::ref(retcode))), "Add every resource of all input files to a content addressed store in given directory: data is written once as objects\\<SHA-256>, no matter how many files or builds share it. For each input writes an index (UTF-8 lines: hash, size, resource path) to --to directory, or to index subdirectory of the store. Inputs are processed in parallel.")
+			("to", po::wvalue<std::wstring>(), "Output directory for --extract-resources, index directory for --store-resources.")
 		;
 
 		options.push_back(po::options_description("Compare"));
@@ -49,7 +62,7 @@ int wmain(int argc, wchar_t* argv[])
 				, po::value<bool>()->zero_tokens()->notifier(std::bind(&Compare, std::ref(variables), std::ref(retcode)))
 				, "Compare 2 files disregarding linker timestamp, "
 				"debug info, digital signature, version info section in resources, "
-				//"MIDL vanity stub for embedded type libraries, "
+				"MIDL vanity stub for embedded type libraries, "
 				"__FILE__, __DATE__ and __TIME__ macros when they are used as literal strings.\n"
 				"  Turn off 'link time code generation' option when building binaries to compare and keep full build path length stable between builds. "
 				"If done right, rebuilds with the same source will be flagged as 'functionally equivalent'. \n"
@@ -67,7 +80,7 @@ int wmain(int argc, wchar_t* argv[])
 		options.push_back(po::options_description("Edit"));
 		options.back().add_options()
 			("delete-resource", po::wvalue<std::wstring>()->notifier(std::bind(&DeleteResource, std::ref(variables), std::ref(retcode))), "Delete resource by path.")
-			("delete-signature", po::value<bool>()->zero_tokens()->notifier(std::bind(&DeleteSignature, std::ref(variables), std::ref(retcode))), "Delete signature.\n")
+			("delete-signature", po::value<bool>()->zero_tokens()->notifier(std::bind(&DeleteSignature, std::ref(variables), std::ref(retcode))), "Delete signature. Signatures at the end of the file are removed by truncating it, with the checksum updated from the removed data. Inputs are processed in parallel.\n")
 			("edit-vsversion", po::wvalue<bool>()->zero_tokens()->notifier(std::bind(&Edit, std::ref(variables), std::ref(retcode))), "Modify VS_VERSIONINFO. Binary must already contain VS_VERSIONINFO resource.")
 			("set-version", po::wvalue<std::wstring>(), "Set new version (both file and product), file is modified in-place.")
 			("set-file-version", po::wvalue<std::wstring>(), "Set new file version.")
@@ -77,16 +90,34 @@ int wmain(int argc, wchar_t* argv[])
 			("set-copyright", po::wvalue<std::wstring>(), "Set copyright field.")
 			("set-original-name", po::wvalue<std::wstring>(), "Set original name field.")
 			("set-product-name", po::wvalue<std::wstring>(), "Set product name field.")
-			("no-resource-rebuild", po::wvalue<bool>()->zero_tokens()->default_value(false), "Avoid rebuilding resources, only works with set-version, set-file-version and set-product-version and only if there is enough space in string table to fit new version string.")
+			("no-resource-rebuild", po::wvalue<bool>()->zero_tokens()->default_value(false), "Avoid rebuilding resources, edits version info in place. Only works if the new version block fits into padding after it, gaps between resources or section alignment slack, use --verbose to see available space. PE checksum is updated.")
 		;
 
 		options.push_back(po::options_description("Sign"));
 		options.back().add_options()
 			("sign", po::value<bool>()->zero_tokens()->notifier(std::bind(&Sign, std::ref(variables), std::ref(retcode))), "Sign file.\n")
+			("make-catalog", po::wvalue<std::wstring>()->notifier(std::bind(&MakeCatalog, std::ref(variables), std::ref(retcode))), "Create a catalog file (.cat, version 2) listing SHA-256 Authenticode digests of all input files and sign it with the --cert-hash certificate (and timestamp it), so one signature covers all of them. Digests are computed in parallel. Only PE files are listed, other inputs are left out with a warning. Without --cert-hash the catalog is left unsigned.\n")
 			("cert-store", po::wvalue<std::wstring>()->default_value(L"MY", ""), "Certificate store. Default value is 'MY'.")
 			("cert-hash", po::value<std::string>(), "Certificate thumbprint (copy from Details/Thumbprint).")
-			("timestamp", po::wvalue<std::vector<std::wstring>>()->composing(), "URL to a timestamp server. Repeat for multiple URLs (to be tried if previous URL failed). For example\nhttp://timestamp.verisign.com/scripts/timstamp.dll")
+			("timestamp", po::wvalue<std::vector<std::wstring>>()->composing(), "URL to a timestamp server. Repeat for multiple URLs. Requests go to the fastest server that is working, servers that keep failing are skipped for a while. For example\nhttp://timestamp.verisign.com/scripts/timstamp.dll")
+			("timestamp-rfc3161", po::value<bool>()->zero_tokens()->default_value(false), "Request RFC 3161 timestamps (SHA-256) instead of legacy Authenticode ones. Requests are made natively, reusing connections to timestamp servers.")
+			("timestamp-window", po::value<size_t>()->default_value(4), "Maximum number of timestamp requests in flight per timestamp server. Files are timestamped as soon as they are signed, while the rest are still being signed.")
+			("sign-threads", po::value<size_t>()->default_value(1), "Number of files signed at the same time. Keep at 1 for hardware tokens that can't sign concurrently.")
+			("retries", po::value<size_t>()->default_value(2), "Number of times a file is retried after signing failed or all timestamp servers failed for it.")
+			("skip-signed", po::value<bool>()->zero_tokens()->default_value(false), "Leave out files that already have a signature made with the --cert-hash certificate that matches their current contents (and a valid timestamp if --timestamp is given). Files are checked offline and in parallel, also when signing with --pkcs11-module or --remote-signer.")
 			("etoken-password", po::value<std::string>()->default_value(""), "SafeNet etoken password. Set to avoid GUI password prompt if chosen certificate is on a token.")
+			("pkcs11-module", po::wvalue<std::wstring>(), "Sign with a key on a PKCS #11 token or HSM through this module (for example eTPKCS11.dll or softhsm2.dll) instead of a certificate store. Signature is built natively without Mssign32, timestamps are always RFC 3161.")
+			("pkcs11-token", po::value<std::string>(), "Label of the PKCS #11 token. Default is the first slot with a token present.")
+			("pkcs11-pin", po::value<std::string>()->default_value(""), "User PIN of the PKCS #11 token. Leave empty for tokens with a PIN pad.")
+			("pkcs11-key", po::value<std::string>(), "Label of the private key on the PKCS #11 token. Required if the token has more than one key.")
+			("cert-chain", po::wvalue<std::wstring>(), "DER or PEM file with certificates to include in PKCS #11 signatures. The first one is the signer certificate if the token has none for the key.")
+			("signing-agent", po::value<bool>()->zero_tokens()->notifier(std::bind(&SigningAgent, std::ref(variables), std::ref(retcode))), "Run a signing agent that selects the --cert-hash certificate and logs in to the token once, then signs and timestamps files submitted with --sign --use-agent by processes on this machine, with the signing and timestamp options it was started with. Runs until stopped.")
+			("use-agent", po::value<bool>()->zero_tokens()->default_value(false), "With --sign, hand input files to a running --signing-agent and wait for them. Exit code is the same as if they were signed here. Timestamp and signing thread options are the agent's, passing them here is an error.")
+			("agent-pipe", po::wvalue<std::wstring>()->default_value(L"peparser-signing-agent", "peparser-signing-agent"), "Name of the pipe the signing agent listens on.")
+			("remote-signer", po::wvalue<std::wstring>(), "URL of a signing agent started with --serve-signing. Authenticode digests are computed here and only digests are sent to the agent, signatures it returns are embedded here. Timestamps are requested from here and are always RFC 3161.")
+			("serve-signing", po::value<bool>()->zero_tokens()->notifier(std::bind(&ServeSigning, std::ref(variables), std::ref(retcode))), "Run a signing agent for --remote-signer clients with the key chosen by --cert-hash or --pkcs11-module. Runs until stopped.")
+			("listen", po::value<std::string>()->default_value("127.0.0.1:8731"), "Address and port the signing agent listens on. A port alone listens on loopback only.")
+			("agent-secret", po::value<std::string>(), "Shared secret a signing agent requires from its clients, sent as a bearer token. Required when --listen is not a loopback address. The token is sent in clear text, so put TLS in front of the agent or keep it on a trusted network.")
 		;
 
 		options.push_back(po::options_description("Dependency check"));
@@ -98,11 +129,12 @@ int wmain(int argc, wchar_t* argv[])
 				  "Returns 2 if a dependency is missing, 1 on any other error and 0 on success. "
 				  "Architecture of this executable (x86/x64) must match architectures of checked binaries."
 			)
-			("json", po::value<bool>()->zero_tokens()->default_value(false), "Output in json.")
+			("json", po::value<bool>()->zero_tokens()->default_value(false), "Output in json (JSON Lines for --version-inventory and --verify-signatures).")
 			("batch-dlls", po::value<bool>()->zero_tokens()->default_value(false), "Check dependency on all non executables in folders. Executables can't be batched and must be checked one by one in order to set up default activation context. The tool loads dlls in the process, so use matching architecture.")
 			("reports-dir", po::wvalue<std::wstring>()->default_value(L".", ""), "directory to dump dependency reports to, creates missing.txt, report.txt (when --verbose is specified), and json.txt (when --json is specified)")
 			("pe-extensions", po::wvalue<std::wstring>()->default_value(L"", ""), "A semi-colon separated list of file extension to check when batching dlls. For example 'dll;cpl;sys'. Omit to test all files except executables.")
 			("use-system-path", po::value<bool>()->zero_tokens()->default_value(false), "Load system PATH instead of using PATH from current environment.")
+			("activation-context", po::value<bool>()->zero_tokens()->default_value(false), "Create and activate an activation context for every checked binary. Much slower, by default one is only activated for binaries whose manifest lists dependent assemblies, so dlls from side-by-side assemblies are still resolved the way the loader does.")
 		;
 
 		po::options_description cmdLine;
@@ -0,0 +1,376 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "manifest.h"
+#include "peparser.h"
+
+#include <cwctype>
+
+namespace peparser
+{
+	namespace
+	{
+		// pull tokenizer for the subset of XML manifests use: start tags with attributes and end tags are returned,
+		// text, comments, processing instructions, CDATA and doctype are skipped
+		class XmlTokenizer
+		{
+		public:
+			enum Token
+			{
+				  StartTag
+				, EndTag
+				, End
+				, Error
+			};
+
+			explicit XmlTokenizer(const std::wstring& text) : m_text(text) {}
+
+			Token Next();
+
+			// element name without namespace prefix
+			const std::wstring& Name() const { return m_name; }
+			bool IsSelfClosing() const { return m_selfClosing; }
+			// value of an attribute of current start tag (matched without namespace prefix), empty if missing
+			std::wstring Attribute(const wchar_t* name) const;
+
+		private:
+			const std::wstring& m_text;
+			size_t m_position = 0;
+
+			std::wstring m_name;
+			bool m_selfClosing = false;
+			std::vector<std::pair<std::wstring, std::wstring>> m_attributes;
+
+			bool StartsWith(const wchar_t* prefix) const { return m_text.compare(m_position, wcslen(prefix), prefix) == 0; }
+			bool SkipPast(const wchar_t* terminator);
+			void SkipSpaces();
+			std::wstring ReadName();
+		};
+
+		std::wstring LocalName(const std::wstring& name)
+		{
+			size_t colon = name.find(L':');
+			return (colon == std::wstring::npos) ? name : name.substr(colon + 1);
+		}
+
+		// predefined entities and character references
+		std::wstring DecodeEntities(const std::wstring& value)
+		{
+			if (value.find(L'&') == std::wstring::npos)
+				return value;
+
+			static const struct { const wchar_t* name; wchar_t c; } entities[] =
+			{
+				  { L"amp;", L'&' }
+				, { L"lt;", L'<' }
+				, { L"gt;", L'>' }
+				, { L"quot;", L'"' }
+				, { L"apos;", L'\'' }
+			};
+
+			std::wstring result;
+			for (size_t i = 0; i < value.size(); ++i)
+			{
+				if (value[i] != L'&')
+				{
+					result += value[i];
+					continue;
+				}
+
+				size_t semicolon = value.find(L';', i);
+				if (semicolon == std::wstring::npos)
+				{
+					result += value[i];
+					continue;
+				}
+
+				if (value[i + 1] == L'#')
+				{
+					bool hex = (value[i + 2] == L'x' || value[i + 2] == L'X');
+					result += (wchar_t)wcstoul(value.c_str() + i + (hex ? 3 : 2), NULL, hex ? 16 : 10);
+					i = semicolon;
+					continue;
+				}
+
+				bool known = false;
+				for (auto& entity : entities)
+				{
+					if (value.compare(i + 1, semicolon - i, entity.name) != 0)
+						continue;
+
+					result += entity.c;
+					i = semicolon;
+					known = true;
+					break;
+				}
+
+				if (!known)
+					result += value[i];
+			}
+
+			return result;
+		}
+
+		XmlTokenizer::Token XmlTokenizer::Next()
+		{
+			for (;;)
+			{
+				size_t open = m_text.find(L'<', m_position);
+				if (open == std::wstring::npos)
+					return End;
+
+				m_position = open + 1;
+
+				if (StartsWith(L"!--"))
+				{
+					if (!SkipPast(L"-->"))
+						return Error;
+					continue;
+				}
+
+				if (StartsWith(L"![CDATA["))
+				{
+					if (!SkipPast(L"]]>"))
+						return Error;
+					continue;
+				}
+
+				// xml declaration, processing instructions, doctype (internal subsets are not expected in manifests)
+				if (StartsWith(L"?") || StartsWith(L"!"))
+				{
+					if (!SkipPast(L">"))
+						return Error;
+					continue;
+				}
+
+				bool endTag = StartsWith(L"/");
+				if (endTag)
+					++m_position;
+
+				m_name = LocalName(ReadName());
+				m_selfClosing = false;
+				m_attributes.clear();
+
+				if (m_name.empty())
+					return Error;
+
+				for (;;)
+				{
+					SkipSpaces();
+
+					if (m_position >= m_text.size())
+						return Error;
+
+					if (StartsWith(L">"))
+					{
+						++m_position;
+						return (endTag) ? EndTag : StartTag;
+					}
+
+					if (StartsWith(L"/>"))
+					{
+						if (endTag)
+							return Error;
+
+						m_position += 2;
+						m_selfClosing = true;
+						return StartTag;
+					}
+
+					if (endTag)
+						return Error;
+
+					std::wstring name = ReadName();
+					SkipSpaces();
+
+					if (name.empty() || !StartsWith(L"="))
+						return Error;
+
+					++m_position;
+					SkipSpaces();
+
+					if (!StartsWith(L"\"") && !StartsWith(L"'"))
+						return Error;
+
+					wchar_t quote = m_text[m_position++];
+					size_t close = m_text.find(quote, m_position);
+					if (close == std::wstring::npos)
+						return Error;
+
+					m_attributes.push_back(std::make_pair(LocalName(name), DecodeEntities(m_text.substr(m_position, close - m_position))));
+					m_position = close + 1;
+				}
+			}
+		}
+
+		std::wstring XmlTokenizer::Attribute(const wchar_t* name) const
+		{
+			for (auto& attribute : m_attributes)
+				if (attribute.first == name)
+					return attribute.second;
+
+			return std::wstring();
+		}
+
+		bool XmlTokenizer::SkipPast(const wchar_t* terminator)
+		{
+			size_t position = m_text.find(terminator, m_position);
+			if (position == std::wstring::npos)
+				return false;
+
+			m_position = position + wcslen(terminator);
+			return true;
+		}
+
+		void XmlTokenizer::SkipSpaces()
+		{
+			while (m_position < m_text.size() && iswspace(m_text[m_position]))
+				++m_position;
+		}
+
+		std::wstring XmlTokenizer::ReadName()
+		{
+			size_t start = m_position;
+			while (m_position < m_text.size() && !iswspace(m_text[m_position]) && wcschr(L"=/>\"'<", m_text[m_position]) == NULL)
+				++m_position;
+
+			return m_text.substr(start, m_position - start);
+		}
+
+		std::wstring DecodeText(const void* data, size_t size)
+		{
+			const BYTE* bytes = (const BYTE*)data;
+
+			if (size >= 2 && bytes[0] == 0xFF && bytes[1] == 0xFE)
+				return std::wstring((const wchar_t*)(bytes + 2), (size - 2) / sizeof(wchar_t));
+
+			if (size >= 2 && bytes[0] == 0xFE && bytes[1] == 0xFF)
+			{
+				std::wstring text;
+				for (size_t i = 2; i + 1 < size; i += 2)
+					text += (wchar_t)((bytes[i] << 8) | bytes[i + 1]);
+				return text;
+			}
+
+			// no BOM, '<' followed by a zero byte means UTF-16
+			if (size >= 2 && bytes[1] == 0)
+				return std::wstring((const wchar_t*)bytes, size / sizeof(wchar_t));
+
+			if (size >= 3 && bytes[0] == 0xEF && bytes[1] == 0xBB && bytes[2] == 0xBF)
+			{
+				bytes += 3;
+				size -= 3;
+			}
+
+			if (size == 0)
+				return std::wstring();
+
+			int length = MultiByteToWideChar(CP_UTF8, 0, (const char*)bytes, (int)size, NULL, 0);
+			if (length <= 0)
+				return std::wstring();
+
+			std::wstring text(length, 0);
+			MultiByteToWideChar(CP_UTF8, 0, (const char*)bytes, (int)size, &text[0], length);
+
+			return text;
+		}
+
+		AssemblyIdentity ReadIdentity(const XmlTokenizer& tokenizer)
+		{
+			AssemblyIdentity identity;
+			identity.name = tokenizer.Attribute(L"name");
+			identity.version = tokenizer.Attribute(L"version");
+			identity.type = tokenizer.Attribute(L"type");
+			identity.processorArchitecture = tokenizer.Attribute(L"processorArchitecture");
+			identity.publicKeyToken = tokenizer.Attribute(L"publicKeyToken");
+			identity.language = tokenizer.Attribute(L"language");
+
+			return identity;
+		}
+	}
+
+	std::wstring AssemblyIdentity::ToString() const
+	{
+		return (version.empty()) ? name : name + L" " + version;
+	}
+
+	bool Manifest::Load(const PEParser& pe, WORD id)
+	{
+		ResourceEntryPtr root = pe.ResourceDirectory();
+		if (!root)
+			return false;
+
+		ResourceEntryPtr node = root->AtPath(L"24/" + std::to_wstring(id));
+		if (node && !node->IsData())
+			node = (node->Entries().empty()) ? ResourceEntryPtr() : node->Entries().front();
+
+		if (!node || !node->IsData())
+			return false;
+
+		LPBYTE data = pe.Data(node->FileOffset(), node->Size());
+		if (!data)
+			return false;
+
+		return Parse(data, node->Size());
+	}
+
+	bool Manifest::Parse(const void* data, size_t size)
+	{
+		*this = Manifest();
+
+		std::wstring text = DecodeText(data, size);
+		XmlTokenizer tokenizer(text);
+
+		std::vector<std::wstring> elements;
+		bool root = false;
+
+		for (;;)
+		{
+			switch (tokenizer.Next())
+			{
+			case XmlTokenizer::StartTag:
+			{
+				const std::wstring& name = tokenizer.Name();
+				std::wstring parent = (elements.empty()) ? std::wstring() : elements.back();
+
+				if (elements.empty())
+				{
+					// one root element only
+					if (root || name != L"assembly")
+						return false;
+					root = true;
+				}
+
+				if (name == L"assemblyIdentity" && parent == L"dependentAssembly")
+					m_dependencies.push_back(ReadIdentity(tokenizer));
+				else if (name == L"assemblyIdentity" && parent == L"assembly")
+					m_identity = ReadIdentity(tokenizer);
+				else if (name == L"file" && parent == L"assembly")
+					m_files.push_back(tokenizer.Attribute(L"name"));
+				else if (name == L"requestedExecutionLevel")
+				{
+					m_executionLevel = tokenizer.Attribute(L"level");
+					m_uiAccess = _wcsicmp(tokenizer.Attribute(L"uiAccess").c_str(), L"true") == 0;
+				}
+
+				if (!tokenizer.IsSelfClosing())
+					elements.push_back(name);
+				break;
+			}
+
+			case XmlTokenizer::EndTag:
+				if (elements.empty() || elements.back() != tokenizer.Name())
+					return false;
+
+				elements.pop_back();
+				break;
+
+			case XmlTokenizer::End:
+				return root && elements.empty();
+
+			case XmlTokenizer::Error:
+				return false;
+			}
+		}
+	}
+}
\ No newline at end of file
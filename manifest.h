@@ -0,0 +1,57 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <windows.h>
+
+#include <string>
+#include <vector>
+
+namespace peparser
+{
+	class PEParser;
+
+	// attributes of assemblyIdentity element
+	struct AssemblyIdentity
+	{
+		std::wstring name;
+		std::wstring version;
+		std::wstring type;
+		std::wstring processorArchitecture;
+		std::wstring publicKeyToken;
+		std::wstring language;
+
+		// "name version" for reports
+		std::wstring ToString() const;
+	};
+
+	// side-by-side manifest embedded in a binary (24/1 for executables, 24/2 for dlls)
+	// reads only what dependency checks need, with a small streaming tokenizer instead of an activation context
+	// (CreateActCtx() resolves every dependent assembly through the SxS store, which is what makes it slow)
+	class Manifest
+	{
+	public:
+		// reads manifest resource with given id (CREATEPROCESS_MANIFEST_RESOURCE_ID or ISOLATIONAWARE_MANIFEST_RESOURCE_ID)
+		// returns false if there is none or it is not well formed XML
+		bool Load(const PEParser& pe, WORD id);
+		// parses manifest text, UTF-8 or UTF-16 (detected by BOM or by zero bytes)
+		bool Parse(const void* data, size_t size);
+
+		const AssemblyIdentity& Identity() const { return m_identity; }
+		// dependency/dependentAssembly/assemblyIdentity elements
+		const std::vector<AssemblyIdentity>& Dependencies() const { return m_dependencies; }
+		// name attributes of file elements
+		const std::vector<std::wstring>& Files() const { return m_files; }
+		// level attribute of requestedExecutionLevel, empty if not specified
+		const std::wstring& ExecutionLevel() const { return m_executionLevel; }
+		bool UiAccess() const { return m_uiAccess; }
+
+	private:
+		AssemblyIdentity m_identity;
+		std::vector<AssemblyIdentity> m_dependencies;
+		std::vector<std::wstring> m_files;
+		std::wstring m_executionLevel;
+		bool m_uiAccess = false;
+	};
+}
\ No newline at end of file
@@ -45,10 +45,12 @@ namespace peparser
 	template<> inline DWORD PEDirInfo<IMAGE_IMPORT_DESCRIPTOR>::Index() const { return IMAGE_DIRECTORY_ENTRY_IMPORT; }
 	template<> inline DWORD PEDirInfo<IMAGE_EXPORT_DIRECTORY>::Index() const { return IMAGE_DIRECTORY_ENTRY_EXPORT; }
 	template<> inline DWORD PEDirInfo<ImgDelayDescr>::Index() const { return IMAGE_DIRECTORY_ENTRY_DELAY_IMPORT; }
+	template<> inline DWORD PEDirInfo<IMAGE_BOUND_IMPORT_DESCRIPTOR>::Index() const { return IMAGE_DIRECTORY_ENTRY_BOUND_IMPORT; }
 
 	template<> inline size_t PEDirInfo<IMAGE_DEBUG_DIRECTORY>::Count() const { return Size() / sizeof(IMAGE_DEBUG_DIRECTORY); }
 	template<> inline size_t PEDirInfo<IMAGE_RESOURCE_DIRECTORY>::Count() const { return m_directory->NumberOfIdEntries + m_directory->NumberOfNamedEntries; }
 	template<> inline size_t PEDirInfo<IMAGE_IMPORT_DESCRIPTOR>::Count() const { return 1; }
 	template<> inline size_t PEDirInfo<IMAGE_EXPORT_DIRECTORY>::Count() const { return 1; }
 	template<> inline size_t PEDirInfo<ImgDelayDescr>::Count() const { return 1; }
+	template<> inline size_t PEDirInfo<IMAGE_BOUND_IMPORT_DESCRIPTOR>::Count() const { return 1; }
 }
\ No newline at end of file
@@ -6,6 +6,8 @@
 #include "versionstring.h"
 
 #include "debugdirectory.h"
+#include "typelibrary.h"
+#include "checksum.h"
 
 #include <boost/io/ios_state.hpp>
 
@@ -119,32 +121,28 @@ namespace peparser
 
 	bool PEParser::IsPE(const std::wstring& path, bool& x64)
 	{
-		// not sure if this is actually faster than mapping whole file into memory...
-
-		std::ifstream file(path.c_str(), std::ios_base::binary | std::ios_base::in);
-
-		if(!file.is_open())
+		HANDLE file = CreateFile(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if(file == INVALID_HANDLE_VALUE)
 			return false;
 
-		std::string buffer;
-		buffer.resize(sizeof(IMAGE_DOS_HEADER));
+		// headers nearly always fit in the first page, so a single read is enough
+		std::vector<BYTE> buffer(RangeReader::PageSize);
+		DWORD read = 0;
+		BOOL result = ReadFile(file, &buffer[0], (DWORD)buffer.size(), &read, NULL);
+		CloseHandle(file);
 
-		if(!file.read(&buffer[0], sizeof(IMAGE_DOS_HEADER)))
+		if(!result || read < sizeof(IMAGE_DOS_HEADER))
 			return false;
 
 		PIMAGE_DOS_HEADER dosHeader = (PIMAGE_DOS_HEADER)&buffer[0];
 
-		if(dosHeader->e_magic != IMAGE_DOS_SIGNATURE)
+		if(dosHeader->e_magic != IMAGE_DOS_SIGNATURE || dosHeader->e_lfanew < 0)
 			return false;
 
-		file.seekg(dosHeader->e_lfanew);
-
-		std::string ntHeaderBuffer;
-		ntHeaderBuffer.resize(sizeof(IMAGE_NT_HEADERS));
-		if(!file.read(&ntHeaderBuffer[0], sizeof(IMAGE_NT_HEADERS)))
+		if((size_t)dosHeader->e_lfanew + sizeof(IMAGE_NT_HEADERS) > read)
 			return false;
 
-		PIMAGE_NT_HEADERS ntHeaders = (PIMAGE_NT_HEADERS)&ntHeaderBuffer[0];
+		PIMAGE_NT_HEADERS ntHeaders = MAKE_PTR(PIMAGE_NT_HEADERS, dosHeader, dosHeader->e_lfanew);
 	
 		x64 = ntHeaders->OptionalHeader.Magic == IMAGE_NT_OPTIONAL_HDR64_MAGIC;
 
@@ -152,6 +150,66 @@ namespace peparser
 	}
 
 	bool PEParser::Open(bool rw)
+	{
+		if(!QueryFileSize())
+			return false;
+
+		if(rw)
+			return OpenRW();
+		else
+			return OpenReadOnly();
+	}
+
+	bool PEParser::OpenMetadata()
+	{
+		if(!QueryFileSize())
+			return false;
+
+		m_file = CreateFile(m_path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+
+		if(m_file == INVALID_HANDLE_VALUE)
+		{
+			std::wcerr << L"Failed to open file. " << GetLastError() << std::endl;
+			return false;
+		}
+
+		m_reader.Attach(m_file, m_fileSize);
+
+		// reserving address space is cheap, only pages that are actually read get committed
+		if(!m_reader.Reserve((size_t)min(m_fileSize, WholeViewLimit)))
+		{
+			std::wcerr << L"Failed to reserve memory. " << GetLastError() << std::endl;
+			return false;
+		}
+
+		if(m_fileSize > WholeViewLimit)
+		{
+			size_t probeSize = (size_t)min(m_fileSize, (BlockOffset)RangeReader::MinRead);
+			if(!m_reader.Ensure((BlockOffset)0, probeSize))
+			{
+				std::wcerr << L"Failed to read file. " << GetLastError() << std::endl;
+				return false;
+			}
+
+			size_t extent = ImageExtent(m_reader.Base(), probeSize, m_fileSize);
+			if(extent > m_reader.Size() && !m_reader.Reserve(extent))
+			{
+				std::wcerr << L"Failed to reserve memory. " << GetLastError() << std::endl;
+				return false;
+			}
+		}
+
+		m_view = m_reader.Base();
+		m_viewSize = m_reader.Size();
+
+		m_open = true;
+		m_openForWrite = false;
+		m_metadataOnly = true;
+
+		return Initialize();
+	}
+
+	bool PEParser::QueryFileSize()
 	{
 		WIN32_FILE_ATTRIBUTE_DATA fileInfo;
 		ZeroMemory(&fileInfo, sizeof(fileInfo));
@@ -167,12 +225,9 @@ namespace peparser
 			return false;
 		}
 
-		m_fileSize = fileInfo.nFileSizeLow;
+		m_fileSize = ((BlockOffset)fileInfo.nFileSizeHigh << 32) | fileInfo.nFileSizeLow;
 
-		if(rw)
-			return OpenRW();
-		else
-			return OpenReadOnly();
+		return true;
 	}
 
 	bool PEParser::OpenReadOnly()
@@ -192,22 +247,8 @@ namespace peparser
 			return false;
 		}
 
-		m_view = MapViewOfFile(m_fileMap, FILE_MAP_READ, 0, 0, 0); 
-		if(!m_view)
-		{
-			std::wcerr << L"Failed to open view. " << GetLastError() << std::endl;
-			return false;
-		}
-
-		MEMORY_BASIC_INFORMATION memInfo;
-		ZeroMemory(&memInfo, sizeof(memInfo));
-		if(VirtualQuery(m_view, &memInfo, sizeof(memInfo)) == 0)
-		{
-			std::wcerr << L"Failed to query view. " << GetLastError() << std::endl;
+		if(!MapView(false))
 			return false;
-		}
-
-		m_viewSize = memInfo.RegionSize;
 
 		m_open = true;
 		m_openForWrite = false;
@@ -232,33 +273,147 @@ namespace peparser
 			return false;
 		}
 
-		m_view = MapViewOfFile(m_fileMap, FILE_MAP_WRITE, 0, 0, 0); 
+		if(!MapView(true))
+			return false;
+
+		m_open = true;
+		m_openForWrite = true;
+
+		return Initialize();
+	}
+
+	bool PEParser::MapView(bool write)
+	{
+		m_views.Attach(m_fileMap, m_fileSize, write);
+
+		// small files are mapped whole, big ones only up to the end of the last section
+		// overlays (installer payloads, signatures) are then reachable through windows from Data()
+		m_viewSize = (size_t)m_fileSize;
+		if(m_fileSize > WholeViewLimit)
+		{
+			// headers are probed through a temporary window
+			size_t probeSize = (size_t)min(m_fileSize, (BlockOffset)FileViews::WindowSize);
+			m_viewSize = ImageExtent(m_views.Data(0, probeSize), probeSize, m_fileSize);
+			m_views.Reset();
+		}
+
+		m_view = MapViewOfFile(m_fileMap, (write) ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, m_viewSize); 
 		if(!m_view)
 		{
 			std::wcerr << L"Failed to open view. " << GetLastError() << std::endl;
 			return false;
 		}
 
-		MEMORY_BASIC_INFORMATION memInfo;
-		ZeroMemory(&memInfo, sizeof(memInfo));
-		if(VirtualQuery(m_view, &memInfo, sizeof(memInfo)) == 0)
+		return true;
+	}
+
+	size_t PEParser::ImageExtent(LPBYTE probe, size_t probeSize, BlockOffset fileSize)
+	{
+		// the result is never smaller than the probe and never bigger than the file
+		size_t extent = probeSize;
+
+		if(!probe || probeSize < sizeof(IMAGE_NT_HEADERS))
+			return extent;
+
+		PIMAGE_DOS_HEADER dosHeader = (PIMAGE_DOS_HEADER)probe;
+		if(dosHeader->e_magic != IMAGE_DOS_SIGNATURE || dosHeader->e_lfanew < 0 || (size_t)dosHeader->e_lfanew > probeSize - sizeof(IMAGE_NT_HEADERS))
+			return extent;
+
+		PIMAGE_NT_HEADERS ntHeaders = MAKE_PTR(PIMAGE_NT_HEADERS, dosHeader, dosHeader->e_lfanew);
+		PIMAGE_SECTION_HEADER sectionHeader = IMAGE_FIRST_SECTION(ntHeaders);
+		if(ntHeaders->Signature != IMAGE_NT_SIGNATURE || (LPBYTE)(sectionHeader + ntHeaders->FileHeader.NumberOfSections) > probe + probeSize)
+			return extent;
+
+		// SizeOfHeaders is at the same offset in 32 and 64 bit optional headers
+		BlockOffset end = ntHeaders->OptionalHeader.SizeOfHeaders;
+		for(WORD i = 0; i < ntHeaders->FileHeader.NumberOfSections; ++i, ++sectionHeader)
+			end = max(end, (BlockOffset)sectionHeader->PointerToRawData + sectionHeader->SizeOfRawData);
+
+		return (size_t)min(fileSize, max(end, (BlockOffset)extent));
+	}
+
+	LPBYTE PEParser::Data(BlockOffset offset, size_t size) const
+	{
+		if(offset > m_fileSize || m_fileSize - offset < size)
+			return NULL;
+
+		if(offset + size <= m_viewSize)
 		{
-			std::wcerr << L"Failed to query view. " << GetLastError() << std::endl;
-			return false;
+			if(!Ensure((LPBYTE)m_view + (size_t)offset, size))
+				return NULL;
+			return (LPBYTE)m_view + (size_t)offset;
 		}
 
-		m_viewSize = memInfo.RegionSize;
+		if(!m_metadataOnly)
+			return m_views.Data(offset, size);
 
-		m_open = true;
-		m_openForWrite = true;
+		m_scratch.resize(size);
+		if(size && !m_reader.Read(offset, &m_scratch[0], size))
+			return NULL;
+		return (size) ? &m_scratch[0] : (LPBYTE)m_view;
+	}
 
-		return Initialize();
+	bool PEParser::Ensure(const void* address, size_t size) const
+	{
+		if(!m_metadataOnly)
+			return true;
+
+		return m_reader.Ensure(address, size);
+	}
+
+	void PEParser::PlanDirectories(PIMAGE_NT_HEADERS ntHeaders)
+	{
+		if(!m_metadataOnly)
+			return;
+
+		PIMAGE_DATA_DIRECTORY directories = (m_pe32Plus)
+			? ((PIMAGE_OPTIONAL_HEADER64)&ntHeaders->OptionalHeader)->DataDirectory
+			: ((PIMAGE_OPTIONAL_HEADER32)&ntHeaders->OptionalHeader)->DataDirectory;
+		DWORD count = (m_pe32Plus)
+			? ((PIMAGE_OPTIONAL_HEADER64)&ntHeaders->OptionalHeader)->NumberOfRvaAndSizes
+			: ((PIMAGE_OPTIONAL_HEADER32)&ntHeaders->OptionalHeader)->NumberOfRvaAndSizes;
+
+		const DWORD used[] = 
+		{
+			  IMAGE_DIRECTORY_ENTRY_IMPORT
+			, IMAGE_DIRECTORY_ENTRY_EXPORT
+			, IMAGE_DIRECTORY_ENTRY_RESOURCE
+			, IMAGE_DIRECTORY_ENTRY_DEBUG
+			, IMAGE_DIRECTORY_ENTRY_DELAY_IMPORT
+			, IMAGE_DIRECTORY_ENTRY_BOUND_IMPORT
+		};
+
+		std::vector<RangeReader::Range> ranges;
+		for(auto index : used)
+		{
+			if(index >= count || directories[index].Size == 0)
+				continue;
+
+			DWORD fileOffset = 0;
+			if(!m_addresses.RvaToFileOffset(directories[index].VirtualAddress, fileOffset))
+				continue;
+
+			// resource directory size covers all resource data, the tree itself is loaded as it is walked
+			DWORD size = directories[index].Size;
+			if(index == IMAGE_DIRECTORY_ENTRY_RESOURCE)
+				size = min(size, (DWORD)RangeReader::PageSize);
+
+			ranges.push_back(RangeReader::Range(fileOffset, size));
+		}
+
+		m_reader.Plan(ranges);
 	}
 
 	void PEParser::Close()
 	{
-		if(m_view)
+		if(m_openForWrite && m_modified && m_view)
+			UpdateChecksum();
+		m_modified = false;
+
+		m_views.Reset();
+		if(m_view && !m_metadataOnly)
 			UnmapViewOfFile(m_view);
+		m_reader.Reset();
 		if(m_fileMap)
 			CloseHandle(m_fileMap);
 		if(m_file && m_file != INVALID_HANDLE_VALUE)
@@ -267,6 +422,13 @@ namespace peparser
 				FlushFileBuffers(m_file);
 			CloseHandle(m_file);
 		}
+
+		// can be closed early (to replace the file), destructor calls this again
+		m_view = NULL;
+		m_viewSize = 0;
+		m_fileMap = NULL;
+		m_file = INVALID_HANDLE_VALUE;
+		m_open = false;
 	}
 
 	bool PEParser::Initialize()
@@ -276,7 +438,7 @@ namespace peparser
 
 		PIMAGE_DOS_HEADER dosHeader = (PIMAGE_DOS_HEADER)m_view;
 
-		if(IsBadReadPtr(dosHeader, sizeof(IMAGE_DOS_HEADER)))
+		if(!Ensure(dosHeader, min(m_viewSize, (size_t)RangeReader::PageSize)) || IsBadReadPtr(dosHeader, sizeof(IMAGE_DOS_HEADER)))
 			return false;
 
 		if(dosHeader->e_magic != IMAGE_DOS_SIGNATURE)
@@ -289,7 +451,7 @@ namespace peparser
 		if(!ntHeaders)
 			return false;
 
-		if(IsBadReadPtr(ntHeaders, sizeof(ntHeaders->Signature)))
+		if(!Ensure(ntHeaders, sizeof(IMAGE_NT_HEADERS)) || IsBadReadPtr(ntHeaders, sizeof(ntHeaders->Signature)))
 			return false;
 
 		if(ntHeaders->Signature != IMAGE_NT_SIGNATURE)
@@ -305,7 +467,7 @@ namespace peparser
 
 		PIMAGE_SECTION_HEADER sectionHeaders = IMAGE_FIRST_SECTION(ntHeaders); 
 
-		if(IsBadReadPtr(sectionHeaders, ntHeaders->FileHeader.NumberOfSections * sizeof(IMAGE_SECTION_HEADER)))
+		if(!Ensure(sectionHeaders, ntHeaders->FileHeader.NumberOfSections * sizeof(IMAGE_SECTION_HEADER)) || IsBadReadPtr(sectionHeaders, ntHeaders->FileHeader.NumberOfSections * sizeof(IMAGE_SECTION_HEADER)))
 			return false;
 
 		if(ntHeaders->OptionalHeader.Magic == IMAGE_NT_OPTIONAL_HDR32_MAGIC)
@@ -317,13 +479,19 @@ namespace peparser
 				return false;
 		m_validPE = true;
 
+		m_addresses = AddressMap(ntHeaders);
+
 		// Ignoring linker timestamp in PE header
 		m_ignored.push_back(Block(L"PE timestamp", FileOffset(&(ntHeaders->FileHeader.TimeDateStamp)), sizeof(ntHeaders->FileHeader.TimeDateStamp)));
 		// Ignoring linker checksum in PE header
-		m_ignored.push_back(Block(L"PE checksum", FileOffset(&(ntHeaders->OptionalHeader.CheckSum)), sizeof(ntHeaders->OptionalHeader.CheckSum)));
+		m_checksumOffset = FileOffset(&(ntHeaders->OptionalHeader.CheckSum));
+		m_ignored.push_back(Block(L"PE checksum", m_checksumOffset, sizeof(ntHeaders->OptionalHeader.CheckSum)));
 
 		ReadSections(ntHeaders);
+		PlanDirectories(ntHeaders);
 		ReadImportsDirectory(ntHeaders);
+		ReadDelayImportsDirectory(ntHeaders);
+		ReadBoundImportsDirectory(ntHeaders);
 		ReadExportsDirectory(ntHeaders);
 		ReadDebugDirectory(ntHeaders);
 		ReadDigitalSignatureDirectory(ntHeaders);
@@ -368,65 +536,160 @@ namespace peparser
 		if(block == m_sections.end())
 			return "";
 
-		return std::string((const char*)((LPBYTE)m_view + block->offset), block->size);
+		LPBYTE data = Data(block->offset, (size_t)block->size);
+		if(!data)
+			return "";
+
+		return std::string((const char*)data, (size_t)block->size);
 	}
 
-	bool PEParser::FindFileOffsetFromRva(PIMAGE_NT_HEADERS ntHeaders, DWORD rva, DWORD& fileOffset)
+	bool PEParser::ReadImportsDirectory(PIMAGE_NT_HEADERS ntHeaders)
 	{
-		// file offset
-		PIMAGE_SECTION_HEADER sectionHeader = IMAGE_FIRST_SECTION(ntHeaders); 
+		PEDirInfo<IMAGE_IMPORT_DESCRIPTOR> info;
+		if(!DirectoryInfo(ntHeaders, info))
+			return false;
 
-		bool found = false;
-		for(int i = 0; i < ntHeaders->FileHeader.NumberOfSections; i++, sectionHeader++)
+		// bounded by the directory size, the list normally ends with a zeroed descriptor before that
+		size_t count = info.Size() / sizeof(IMAGE_IMPORT_DESCRIPTOR);
+		for(size_t i = 0; i < count; ++i)
 		{
-			DWORD sectionSize = sectionHeader->Misc.VirtualSize;
+			IMAGE_IMPORT_DESCRIPTOR* descriptor = (IMAGE_IMPORT_DESCRIPTOR*)PointerFromRva(info.Rva() + (DWORD)(i * sizeof(IMAGE_IMPORT_DESCRIPTOR)), sizeof(IMAGE_IMPORT_DESCRIPTOR));
+			if(!descriptor || !descriptor->Name)
+				break;
 
-			if(sectionSize == 0) // compensate for Watcom linker strangeness, according to Matt Pietrek 
-				sectionSize = sectionHeader->SizeOfRawData; 
+			size_t length = 0;
+			const char* name = StringFromRva(descriptor->Name, length);
+			if(!name)
+				break;
 
-			if((rva >= sectionHeader->VirtualAddress) && (rva < sectionHeader->VirtualAddress + sectionSize) )
-			{
-				found = true;
+			m_dllImports.push_back(std::string(name, strnlen(name, length)));
+			m_imports.AddModule(name, length, false, descriptor->TimeDateStamp);
+
+			// bound imports without a name table have resolved addresses in IAT, nothing to decode there
+			if(descriptor->OriginalFirstThunk || !descriptor->TimeDateStamp)
+				ReadImportThunks(descriptor->OriginalFirstThunk, descriptor->FirstThunk, false);
+		}
+
+		return true;
+	}
+
+	bool PEParser::ReadDelayImportsDirectory(PIMAGE_NT_HEADERS ntHeaders)
+	{
+		PEDirInfo<ImgDelayDescr> delayLoadInfo;
+		if(!DirectoryInfo(ntHeaders, delayLoadInfo))
+			return false;
+
+		size_t count = delayLoadInfo.Size() / sizeof(ImgDelayDescr);
+		for(size_t i = 0; i < count; ++i)
+		{
+			ImgDelayDescr* delayLoadDescriptor = (ImgDelayDescr*)PointerFromRva(delayLoadInfo.Rva() + (DWORD)(i * sizeof(ImgDelayDescr)), sizeof(ImgDelayDescr));
+			if(!delayLoadDescriptor || !delayLoadDescriptor->rvaDLLName)
 				break;
+
+			// pre VC7 descriptors contain virtual addresses instead of RVAs
+			bool vaThunks = (delayLoadDescriptor->grAttrs & dlattrRva) == 0;
+
+			DWORD nameRva = delayLoadDescriptor->rvaDLLName;
+			DWORD intRva = delayLoadDescriptor->rvaINT;
+			DWORD iatRva = delayLoadDescriptor->rvaIAT;
+			if(vaThunks)
+			{
+				if(!m_addresses.VaToRva(delayLoadDescriptor->rvaDLLName, nameRva))
+					break;
+				if(!intRva || !m_addresses.VaToRva(delayLoadDescriptor->rvaINT, intRva))
+					intRva = 0;
+				if(!iatRva || !m_addresses.VaToRva(delayLoadDescriptor->rvaIAT, iatRva))
+					iatRva = 0;
 			}
-		}
 
-		if(found) 
-			fileOffset = rva + (int)sectionHeader->PointerToRawData - sectionHeader->VirtualAddress;
+			size_t length = 0;
+			const char* name = StringFromRva(nameRva, length);
+			if(name)
+			{
+				m_dllDelayedImports.push_back(std::string(name, strnlen(name, length)));
+				m_imports.AddModule(name, length, true, delayLoadDescriptor->dwTimeStamp);
+
+				if(intRva)
+					ReadImportThunks(intRva, iatRva, vaThunks);
+			}
+		}
 
-		return found;
+		return true;
 	}
 
-	bool PEParser::ReadImportsDirectory(PIMAGE_NT_HEADERS ntHeaders)
+	bool PEParser::ReadBoundImportsDirectory(PIMAGE_NT_HEADERS ntHeaders)
 	{
-		PEDirInfo<IMAGE_IMPORT_DESCRIPTOR> info;
+		// bound import directory lives in PE headers, its address is a file offset (same as RVA there)
+		// and names are addressed relative to the start of the directory
+		PEDirInfo<IMAGE_BOUND_IMPORT_DESCRIPTOR> info;
 		if(!DirectoryInfo(ntHeaders, info))
 			return false;
 
-		IMAGE_IMPORT_DESCRIPTOR* descriptor = info[0];
-		while(descriptor->Characteristics)
+		LPBYTE directory = (LPBYTE)info[0];
+		size_t offset = 0;
+
+		while(offset + sizeof(IMAGE_BOUND_IMPORT_DESCRIPTOR) <= info.Size())
 		{
-			DWORD fileOffset = descriptor->Name + info.SectionOffset();
+			PIMAGE_BOUND_IMPORT_DESCRIPTOR descriptor = (PIMAGE_BOUND_IMPORT_DESCRIPTOR)(directory + offset);
+			if(descriptor->OffsetModuleName == 0 || descriptor->OffsetModuleName >= info.Size())
+				break;
 
-			m_dllImports.push_back((char*)((LPBYTE)m_view + fileOffset));
+			m_imports.AddBoundImport((const char*)directory + descriptor->OffsetModuleName, info.Size() - descriptor->OffsetModuleName, descriptor->TimeDateStamp, false);
+			offset += sizeof(IMAGE_BOUND_IMPORT_DESCRIPTOR);
+
+			for(WORD i = 0; i < descriptor->NumberOfModuleForwarderRefs && offset + sizeof(IMAGE_BOUND_FORWARDER_REF) <= info.Size(); ++i)
+			{
+				PIMAGE_BOUND_FORWARDER_REF forwarder = (PIMAGE_BOUND_FORWARDER_REF)(directory + offset);
+				if(forwarder->OffsetModuleName < info.Size())
+					m_imports.AddBoundImport((const char*)directory + forwarder->OffsetModuleName, info.Size() - forwarder->OffsetModuleName, forwarder->TimeDateStamp, true);
 
-			++descriptor;
+				offset += sizeof(IMAGE_BOUND_FORWARDER_REF);
+			}
 		}
 
-		PEDirInfo<ImgDelayDescr> delayLoadInfo;
-		if(!DirectoryInfo(ntHeaders, delayLoadInfo))
-			return true;
+		return true;
+	}
+
+	void PEParser::ReadImportThunks(DWORD intRva, DWORD iatRva, bool vaThunks)
+	{
+		// name table if present, otherwise IAT holds the same data until the binary is bound
+		DWORD lookupRva = (intRva) ? intRva : iatRva;
+		if(!lookupRva)
+			return;
 
-		ImgDelayDescr* delayLoadDescriptor = delayLoadInfo[0];
-		while(delayLoadDescriptor->grAttrs == dlattrRva && delayLoadDescriptor->rvaDLLName)
+		const DWORD thunkSize = (m_pe32Plus) ? sizeof(ULONGLONG) : sizeof(DWORD);
+
+		for(DWORD i = 0; ; ++i)
 		{
-			DWORD fileOffset = 0;
-			if(FindFileOffsetFromRva(ntHeaders, delayLoadDescriptor->rvaDLLName, fileOffset))
-				m_dllDelayedImports.push_back((char*)((LPBYTE)m_view + fileOffset));
-			++delayLoadDescriptor;
+			LPBYTE thunk = PointerFromRva(lookupRva + i * thunkSize, thunkSize);
+			if(!thunk)
+				break;
+
+			ULONGLONG value = (m_pe32Plus) ? *(ULONGLONG*)thunk : *(DWORD*)thunk;
+			if(value == 0)
+				break;
+
+			DWORD thunkIat = (iatRva) ? iatRva + i * thunkSize : 0;
+			DWORD thunkInt = (intRva) ? intRva + i * thunkSize : 0;
+
+			bool byOrdinal = (m_pe32Plus) ? IMAGE_SNAP_BY_ORDINAL64(value) : IMAGE_SNAP_BY_ORDINAL32((DWORD)value);
+			if(byOrdinal)
+			{
+				m_imports.AddFunction((WORD)(value & 0xFFFF), thunkIat, thunkInt);
+				continue;
+			}
+
+			DWORD nameRva = (DWORD)value;
+			if(vaThunks && !m_addresses.VaToRva(value, nameRva))
+				break;
+
+			size_t length = 0;
+			PIMAGE_IMPORT_BY_NAME byName = (PIMAGE_IMPORT_BY_NAME)StringFromRva(nameRva, length);
+			if(!byName || length <= sizeof(WORD))
+				break;
+
+			m_imports.AddFunction((const char*)byName->Name, length - sizeof(WORD), byName->Hint, thunkIat, thunkInt);
 		}
-	
-		return true;
 	}
 
 	bool PEParser::ReadExportsDirectory(PIMAGE_NT_HEADERS ntHeaders)
@@ -435,7 +698,43 @@ namespace peparser
 		if(!DirectoryInfo(ntHeaders, info))
 			return false;
 
-		m_ignored.push_back(Block(L"Export table timestamp", FileOffset(&info[0]->TimeDateStamp), sizeof(info[0]->TimeDateStamp)));
+		PIMAGE_EXPORT_DIRECTORY directory = info[0];
+		m_ignored.push_back(Block(L"Export table timestamp", FileOffset(&directory->TimeDateStamp), sizeof(directory->TimeDateStamp)));
+
+		size_t length = 0;
+		const char* name = StringFromRva(directory->Name, length);
+
+		// ordinals are 16 bit, anything bigger is a corrupted directory
+		if(directory->NumberOfFunctions > MAXWORD + 1)
+			return false;
+
+		LPDWORD functions = (LPDWORD)ArrayFromRva(directory->AddressOfFunctions, directory->NumberOfFunctions, sizeof(DWORD));
+		if(!functions)
+			return false;
+
+		m_exports.Reset(name ? name : "", name ? length : 0, directory->Base, directory->TimeDateStamp, directory->NumberOfFunctions);
+
+		for(DWORD i = 0; i < directory->NumberOfFunctions; ++i)
+		{
+			// function RVAs pointing back into export directory are forwarder strings
+			const char* forwarder = NULL;
+			if(functions[i] >= info.Rva() && functions[i] - info.Rva() < info.Size())
+				forwarder = StringFromRva(functions[i], length);
+
+			m_exports.SetFunction(i, functions[i], forwarder, length);
+		}
+
+		LPDWORD names = (LPDWORD)ArrayFromRva(directory->AddressOfNames, directory->NumberOfNames, sizeof(DWORD));
+		LPWORD ordinals = (LPWORD)ArrayFromRva(directory->AddressOfNameOrdinals, directory->NumberOfNames, sizeof(WORD));
+		if(!names || !ordinals)
+			return true;
+
+		for(DWORD i = 0; i < directory->NumberOfNames; ++i)
+		{
+			name = StringFromRva(names[i], length);
+			if(name)
+				m_exports.AddName(name, length, ordinals[i]);
+		}
 
 		return true;
 	}
@@ -512,7 +811,7 @@ namespace peparser
 		if(!DirectoryInfo(ntHeaders, info))
 			return false;
 
-		ResourceDirectoryTable table(m_view, info, m_resourceBlocks);
+		ResourceDirectoryTable table(m_view, info, m_resourceBlocks, (m_metadataOnly) ? &m_reader : NULL);
 
 		std::sort(m_resourceBlocks.begin(), m_resourceBlocks.end());
 		m_resources = table.Root();
@@ -533,7 +832,7 @@ namespace peparser
 
 		bool ret = true;
 		for(auto& entry : node->Entries())
-			ret = ReadTypeLibrary(entry.second) && ret;
+			ret = ReadTypeLibrary(entry) && ret;
 		return ret;
 	}
 
@@ -542,9 +841,21 @@ namespace peparser
 		if(!data) 
 			return false;
 
-		return false;
-	
-		// disabled because of dependency on GPL'ed code
+		// only header and custom data tables are read, not the whole library
+		std::vector<TypeLibrarySegment> segments;
+		if(!FindMidlSegments((const BYTE*)data, size, [this](const void* address, size_t size) { return Ensure(address, size); }, segments))
+			return false;
+
+		for(auto& segment : segments)
+		{
+			Block block(L"TLB: " + segment.description, FileOffset((LPBYTE)data + segment.offset), segment.size);
+
+			m_ignored.push_back(block);
+			if(segment.vanityString)
+				m_useful.insert(std::make_pair(MidlTimestampSegment, block));
+		}
+
+		return true;
 	}
 
 	bool PEParser::ReadVsVersionInfo(ResourceEntryPtr node)
@@ -557,13 +868,13 @@ namespace peparser
 
 		bool ret = true;
 		for(auto& entry : node->Entries())
-			ret = ReadVsVersionInfo(entry.second) && ret;
+			ret = ReadVsVersionInfo(entry) && ret;
 		return ret;
 	}
 
 	bool PEParser::ReadVsVersionInfo(LPVOID data, size_t size)
 	{
-		if(!data) 
+		if(!data || !Ensure(data, size)) 
 			return false;
 
 		VS_VersionInfo info(data, size);
@@ -692,8 +1003,11 @@ namespace peparser
 				continue;
 			case IMAGE_DEBUG_TYPE_CODEVIEW:
 				{
+					if(info[i]->PointerToRawData > m_viewSize || m_viewSize - info[i]->PointerToRawData < info[i]->SizeOfData)
+						return false;
+
 					LPBYTE debugInfo = (LPBYTE)m_view + info[i]->PointerToRawData;
-					if(IsBadReadPtr(debugInfo, info[i]->SizeOfData))
+					if(!Ensure(debugInfo, info[i]->SizeOfData) || IsBadReadPtr(debugInfo, info[i]->SizeOfData))
 						return false;
 
 					if(info[i]->SizeOfData < sizeof(DWORD))				
@@ -754,7 +1068,11 @@ namespace peparser
 			return false;
 
 		DWORD fileOffset = 0;
-		if(!FindFileOffsetFromRva(ntHeaders, dir.Rva(), fileOffset))
+		if(!m_addresses.RvaToFileOffset(dir.Rva(), fileOffset))
+			return false;
+
+		// directories always live in headers or sections, so they are inside the main view
+		if(fileOffset > m_viewSize || m_viewSize - fileOffset < dir.Size())
 			return false;
 
 		dir.SetFileOffset(fileOffset);
@@ -762,7 +1080,10 @@ namespace peparser
 
 		// directory
 		T* directory = MAKE_PTR(T*, m_view, dir.FileOffset());
-		if(IsBadReadPtr(directory, dir.Size()))
+
+		// resource tree is walked (and loaded) entry by entry, its directory size covers all the resource data too
+		size_t size = (dir.Index() == IMAGE_DIRECTORY_ENTRY_RESOURCE) ? sizeof(T) : dir.Size();
+		if(!Ensure(directory, size) || IsBadReadPtr(directory, size))
 			return false;
 
 		dir.SetDirectory(directory);
@@ -770,23 +1091,71 @@ namespace peparser
 		return true;
 	}
 
+	LPBYTE PEParser::PointerFromRva(DWORD rva, size_t size) const
+	{
+		DWORD fileOffset = 0;
+		if(!m_addresses.RvaToFileOffset(rva, fileOffset))
+			return NULL;
+
+		if(fileOffset > m_viewSize || m_viewSize - fileOffset < size)
+			return NULL;
+
+		if(!Ensure((LPBYTE)m_view + fileOffset, size))
+			return NULL;
+
+		return (LPBYTE)m_view + fileOffset;
+	}
+
+	LPBYTE PEParser::ArrayFromRva(DWORD rva, DWORD count, size_t elementSize) const
+	{
+		DWORD fileOffset = 0;
+		DWORD available = 0;
+		if(!m_addresses.RvaToFileOffset(rva, fileOffset, available))
+			return NULL;
+
+		// count comes from the file, multiplying first could wrap around in 32 bit builds
+		if(count > available / elementSize)
+			return NULL;
+
+		return PointerFromRva(rva, count * elementSize);
+	}
+
+	const char* PEParser::StringFromRva(DWORD rva, size_t& maxLength) const
+	{
+		LPBYTE pointer = PointerFromRva(rva, 1);
+		if(!pointer)
+			return NULL;
+
+		maxLength = m_viewSize - FileOffset(pointer);
+
+		// names are short, no reason to load everything up to the end of the file
+		if(m_metadataOnly)
+		{
+			maxLength = min(maxLength, (size_t)RangeReader::PageSize);
+			if(!Ensure(pointer, maxLength))
+				return NULL;
+		}
+
+		return (const char*)pointer;
+	}
+
 	size_t PEParser::FileOffset(void* pointer) const
 	{
 		return (size_t)pointer - (size_t)m_view;
 	}
 
-	size_t PEParser::TotalIgnoredSize() const
+	BlockOffset PEParser::TotalIgnoredSize() const
 	{
-		size_t size = 0;
+		BlockOffset size = 0;
 		for(size_t i = 0; i < m_ignored.size(); i++)
 			size += m_ignored[i].size;
 		return size;
 	}
 
-	size_t PEParser::NextOffset(size_t currentOffset, size_t& sizeOfBlock, size_t maxSize) const
+	BlockOffset PEParser::NextOffset(BlockOffset currentOffset, BlockOffset& sizeOfBlock, BlockOffset maxSize) const
 	{
-		size_t endOfBlock = maxSize;
-		size_t newOffset = currentOffset;
+		BlockOffset endOfBlock = maxSize;
+		BlockOffset newOffset = currentOffset;
 
 		for(size_t i = 0; i < m_ignored.size(); i++)
 		{
@@ -816,6 +1185,69 @@ namespace peparser
 		return newOffset;
 	}
 
+	namespace
+	{
+		// sequential access to file contents for comparison
+		// keeps the current window so that byte by byte walk does not look up a view for every byte
+		class DataCursor
+		{
+		public:
+			static const size_t ChunkSize = 1024 * 1024;
+
+			explicit DataCursor(const PEParser& pe) : m_pe(pe) {}
+
+			// returns pointer to the byte at offset and number of bytes readable from there, NULL if offset can't be read
+			const BYTE* At(BlockOffset offset, size_t& available)
+			{
+				if(!m_data || offset < m_start || offset - m_start >= m_size)
+				{
+					m_start = offset - offset % ChunkSize;
+					m_size = (m_start < m_pe.FileSize()) ? (size_t)min(m_pe.FileSize() - m_start, (BlockOffset)ChunkSize) : 0;
+					m_data = (m_size) ? m_pe.Data(m_start, m_size) : NULL;
+
+					if(!m_data)
+					{
+						available = 0;
+						return NULL;
+					}
+				}
+
+				available = m_size - (size_t)(offset - m_start);
+				return m_data + (size_t)(offset - m_start);
+			}
+
+			bool Equal(BlockOffset offset, DataCursor& other, BlockOffset otherOffset, BlockOffset size)
+			{
+				while(size)
+				{
+					size_t available = 0;
+					size_t otherAvailable = 0;
+
+					const BYTE* data = At(offset, available);
+					const BYTE* otherData = other.At(otherOffset, otherAvailable);
+					if(!data || !otherData)
+						return false;
+
+					size_t chunk = (size_t)min(size, (BlockOffset)min(available, otherAvailable));
+					if(0 != memcmp(data, otherData, chunk))
+						return false;
+
+					offset += chunk;
+					otherOffset += chunk;
+					size -= chunk;
+				}
+
+				return true;
+			}
+
+		private:
+			const PEParser& m_pe;
+			BlockOffset m_start = 0;
+			size_t m_size = 0;
+			const BYTE* m_data = NULL;
+		};
+	}
+
 	CompareResult PEParser::Compare(const PEParser& p1, const PEParser& p2, bool fast, bool noHeuristics, bool verbose, bool tlbCmpExpr)
 	{
 		CompareResult result;
@@ -844,8 +1276,11 @@ namespace peparser
 		result.m_differentPath = lstrcmpi(p1.PDBPath().c_str(), p2.PDBPath().c_str()) != 0;
 		result.m_differentPathLength = p1.PDBPath().size() != p1.PDBPath().size();
 
+		DataCursor cursor1(p1);
+		DataCursor cursor2(p2);
+
 		// Comparing for identical
-		if(p1.FileSize() == p2.FileSize() && 0 == memcmp(p1.m_view, p2.m_view, p1.FileSize()))
+		if(p1.FileSize() == p2.FileSize() && cursor1.Equal(0, cursor2, 0, p1.FileSize()))
 		{
 			result.m_identical = true;
 			result.m_equivalent = true;
@@ -859,27 +1294,24 @@ namespace peparser
 			result.m_fast = true;
 			if(!result.m_identical && !result.m_differentSize)
 			{ 
-				LPBYTE index1 = (LPBYTE)p1.m_view;
-				LPBYTE index2 = (LPBYTE)p2.m_view;
-
-				size_t offset1 = 0;
-				size_t offset2 = 0;
+				BlockOffset offset1 = 0;
+				BlockOffset offset2 = 0;
 
 				result.m_equivalent = true;
 				while(true)
 				{
-					size_t size1 = 0;
-					size_t size2 = 0;
+					BlockOffset size1 = 0;
+					BlockOffset size2 = 0;
 
 					offset1 = p1.NextOffset(offset1, size1, p1.FileSize());
 					offset2 = p2.NextOffset(offset2, size2, p2.FileSize());
 
-					size_t currentBlockSize = min(size1, size2);
+					BlockOffset currentBlockSize = min(size1, size2);
 
 					if(currentBlockSize == 0)
 						break;
 
-					if(0 != memcmp(index1 + offset1, index2 + offset2, currentBlockSize))
+					if(!cursor1.Equal(offset1, cursor2, offset2, currentBlockSize))
 					{
 						result.m_interesting.push_back(Block2(L"First different block (1)", offset1, offset2, currentBlockSize));
 						result.m_equivalent = false;
@@ -895,17 +1327,14 @@ namespace peparser
 		{
 			result.m_fast = false;
 
-			LPBYTE start1 = (LPBYTE)p1.m_view;
-			LPBYTE start2 = (LPBYTE)p2.m_view;
+			BlockOffset index = 0;
+			BlockOffset offset1 = 0;
+			BlockOffset offset2 = 0;
+			BlockOffset currentBlockSize = 0;
 
-			size_t index = 0;
-			size_t offset1 = 0;
-			size_t offset2 = 0;
-			size_t currentBlockSize = 0;
-
-			size_t diffStart1 = 0;
-			size_t diffStart2 = 0;
-			size_t diffSize = 0;
+			BlockOffset diffStart1 = 0;
+			BlockOffset diffStart2 = 0;
+			BlockOffset diffSize = 0;
 			size_t diffShift = 0;
 			bool diff = false;
 
@@ -925,8 +1354,8 @@ namespace peparser
 				{
 				case NEXT_BLOCK:
 					{
-						size_t size1 = 0;
-						size_t size2 = 0;
+						BlockOffset size1 = 0;
+						BlockOffset size2 = 0;
 
 						offset1 = p1.NextOffset(offset1, size1, p1.FileSize());
 						offset2 = p2.NextOffset(offset2, size2, p2.FileSize());
@@ -935,9 +1364,9 @@ namespace peparser
 
 						if(currentBlockSize == 0)
 							if(size1 == 0)
-								result.m_different += p2.FileSize() - offset2;
+								result.m_different += (__int64)(p2.FileSize() - offset2);
 							else
-								result.m_different += p1.FileSize() - offset1;
+								result.m_different += (__int64)(p1.FileSize() - offset1);
 
 						index = 0;
 
@@ -969,7 +1398,10 @@ namespace peparser
 
 						if(diffSize == 0) break; // one file ended before another one
 
-						if(!noHeuristics && FilterDifference(result, p1, p2, diffStart1, diffStart2, diffSize, diffShift, tlbCmpExpr))
+						// heuristics look around the difference through the main view, overlays are compared as is
+						bool inView = diffStart1 + diffSize <= p1.m_viewSize && diffStart2 + diffSize <= p2.m_viewSize;
+
+						if(!noHeuristics && inView && FilterDifference(result, p1, p2, (size_t)diffStart1, (size_t)diffStart2, (size_t)diffSize, diffShift, tlbCmpExpr))
 						{
 							result.m_same += diffSize;
 							index += diffShift;
@@ -999,7 +1431,17 @@ namespace peparser
 							break;
 						}
 
-						if(*(LPBYTE)(start1 + offset1 + index) == *(LPBYTE)(start2 + offset2 + index))
+						size_t available1 = 0;
+						size_t available2 = 0;
+						const BYTE* byte1 = cursor1.At(offset1 + index, available1);
+						const BYTE* byte2 = cursor2.At(offset2 + index, available2);
+						if(!byte1 || !byte2)
+						{
+							result.m_error = true;
+							return result;
+						}
+
+						if(*byte1 == *byte2)
 						{
 							++result.m_same;
 							if(diff) step = DIFF_END;
@@ -1346,15 +1788,15 @@ namespace peparser
 			if (marker.offset == 0)
 				return false;
 
-			const char* sectionStart = (char*)((LPBYTE)m_view + marker.offset);
+			const char* sectionStart = (char*)((LPBYTE)m_view + (size_t)marker.offset);
 
 			std::string magic = "Created by MIDL version";
-			const char* stringStart = FindStringEntry<char, None>(sectionStart, magic, magic.size(), marker.size);
+			const char* stringStart = FindStringEntry<char, None>(sectionStart, magic, magic.size(), (size_t)marker.size);
 
 			if (stringStart == NULL)
 				return false;
 
-			diffShift = marker.size - diffStart + marker.offset;
+			diffShift = (size_t)(marker.size - diffStart + marker.offset);
 			return true;
 		}
 		else
@@ -1368,7 +1810,7 @@ namespace peparser
 			{
 				const std::string magic = "Created by MIDL version";
 
-				const char* stringStart = FindStringEntry< char, None >((char*)m_view + it->offset, magic, magic.size(), it->size);
+				const char* stringStart = FindStringEntry< char, None >((char*)m_view + (size_t)it->offset, magic, magic.size(), (size_t)it->size);
 
 				if (stringStart == nullptr)
 					return false;
@@ -1409,13 +1851,34 @@ namespace peparser
 		if(!version.IsValid()) 
 			return false;
 
+		auto isBinary = [field](ModifiableBlocks block)
+		{
+			return (block == ModifiableBlocks::FileVersion && field != ProductOnly) || (block == ModifiableBlocks::ProductVersion && field != FileOnly);
+		};
+		auto isString = [field](ModifiableBlocks block)
+		{
+			return (block == ModifiableBlocks::FileVersionString && field != ProductOnly) || (block == ModifiableBlocks::ProductVersionString && field != FileOnly);
+		};
+
+		std::wstring newVer = version.FullFormatted();
+
+		// everything is checked before the first write, so a failure leaves the file as it was
 		for (auto& entry : m_modifiable)
 		{
-			if((entry.first == ModifiableBlocks::FileVersion && field != ProductOnly) || (entry.first == ModifiableBlocks::ProductVersion && field != FileOnly))
+			if(isBinary(entry.first) && entry.second.size != 2*sizeof(DWORD))
+				return false;
+
+			if(isString(entry.first) && size_t(entry.second.size) < sizeof(wchar_t) * (newVer.size() + 1))
 			{
-				if(entry.second.size != 2*sizeof(DWORD))
-					return false;
+				std::wcerr << L"New version won't fit. Rebuilding resource table not implemented" << std::endl;
+				return false;
+			}
+		}
 
+		for (auto& entry : m_modifiable)
+		{
+			if(isBinary(entry.first))
+			{
 				DWORD lower = (WORD)version.Major();
 				lower = (lower << 8*sizeof(WORD)) + (WORD)version.Minor();
 				DWORD higher = (WORD)version.Build();
@@ -1427,33 +1890,29 @@ namespace peparser
 				continue;
 			}
 
-			if((entry.first == ModifiableBlocks::FileVersionString && field != ProductOnly) || (entry.first == ModifiableBlocks::ProductVersionString && field != FileOnly))
+			if(isString(entry.first))
 			{
-				std::wstring newVer = version.FullFormatted();
-
-				if(size_t(entry.second.size) < sizeof(wchar_t) * (newVer.size() + 1))
-				{
-					std::wcerr << L"New version won't fit. Rebuilding resource table not implemented" << std::endl;
-					return false;
-				}
-
+				std::wstring padded = newVer;
 				if(size_t(entry.second.size) > sizeof(wchar_t) * (newVer.size() + 1))
 				{
-					std::wstring padding((entry.second.size/sizeof(wchar_t)) - newVer.size() - 1, L' ');
-					newVer = newVer + padding;
+					std::wstring padding((size_t)(entry.second.size/sizeof(wchar_t)) - newVer.size() - 1, L' ');
+					padded = newVer + padding;
 				}
 
 				memcpy_s(
 					  ((LPBYTE)m_view + (DWORD)entry.second.offset)
-					, entry.second.size
-					, newVer.c_str()
-					, sizeof(wchar_t) * newVer.size()
+					, (size_t)entry.second.size
+					, padded.c_str()
+					, sizeof(wchar_t) * padded.size()
 				);
 
 				continue;
 			}
 		}
 
+		// checksum is only recomputed on Close() for files that were actually written
+		SetModified();
+
 		return true;
 	}
 
@@ -1463,7 +1922,63 @@ namespace peparser
 		if(it == m_modifiable.end()) 
 			return;
 	
-		memset((LPBYTE)m_view + (DWORD)it->second.offset, 0, it->second.size);
+		memset((LPBYTE)m_view + (DWORD)it->second.offset, 0, (size_t)it->second.size);
+		SetModified();
+	}
+
+	DWORD PEParser::Checksum() const
+	{
+		if(!m_validPE || !Ensure((LPBYTE)m_view + m_checksumOffset, sizeof(DWORD)))
+			return 0;
+
+		return *(DWORD*)((LPBYTE)m_view + m_checksumOffset);
+	}
+
+	bool PEParser::ComputeChecksum(DWORD& checksum) const
+	{
+		if(!m_validPE)
+			return false;
+
+		PEChecksum sum;
+		const DWORD zero = 0;
+
+		// view in one go, the rest of big files window by window
+		for(BlockOffset offset = 0; offset < m_fileSize; )
+		{
+			size_t size = (offset < m_viewSize) ? m_viewSize - (size_t)offset : (size_t)min((BlockOffset)FileViews::WindowSize, m_fileSize - offset);
+
+			LPBYTE data = Data(offset, size);
+			if(!data)
+				return false;
+
+			if(m_checksumOffset >= offset && m_checksumOffset + sizeof(DWORD) <= offset + size)
+			{
+				size_t before = m_checksumOffset - (size_t)offset;
+				sum.Update(data, before);
+				sum.Update(&zero, sizeof(zero));
+				sum.Update(data + before + sizeof(DWORD), size - before - sizeof(DWORD));
+			}
+			else
+				sum.Update(data, size);
+
+			offset += size;
+		}
+
+		checksum = sum.Value();
+		return true;
+	}
+
+	bool PEParser::UpdateChecksum() const
+	{
+		if(!m_openForWrite || !m_validPE)
+			return false;
+
+		DWORD checksum = 0;
+		if(!ComputeChecksum(checksum))
+			return false;
+
+		*(DWORD*)((LPBYTE)m_view + m_checksumOffset) = checksum;
+		return true;
 	}
 // ================================================================================================
 }
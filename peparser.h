@@ -6,8 +6,13 @@
 #include <windows.h>
 
 #include "block.h"
+#include "fileviews.h"
+#include "rangereader.h"
 #include "resourcetable.h"
 #include "pedirinfo.h"
+#include "addressmap.h"
+#include "importtable.h"
+#include "exporttable.h"
 
 #include <vector>
 #include <map>
@@ -36,6 +41,9 @@ namespace peparser
 	typedef std::multimap<UsefulBlocks, Block> UsefulBlockMap;
 	typedef std::pair<UsefulBlockMap::const_iterator, UsefulBlockMap::const_iterator> UsefulBlockMapRange;
 
+	// files up to this size are mapped in one view, bigger ones are mapped in windows
+	const BlockOffset WholeViewLimit = (sizeof(void*) > 4) ? 0x40000000 : 0x10000000;
+
 	// describes PE comparison result 
 	class CompareResult
 	{
@@ -93,20 +101,35 @@ namespace peparser
 		virtual ~PEParser();
 
 		bool Open(bool readWrite = false);
+		// reads only headers and the structures parsing needs instead of mapping the file,
+		// meant for metadata queries (pdb, version, imports, signature) on files living on network shares
+		// Compare() is not available on parsers opened this way
+		bool OpenMetadata();
+		// unmaps the file, resource entries and other pointers into the file are not valid after this
+		// recomputes checksum first if the file was modified in place
 		void Close();
 
 		static bool IsPE(const std::wstring& path, bool& x64);
 
+		const std::wstring& FilePath() const { return m_path; }
 		bool IsOpen() const { return m_open; }
+		bool IsOpenForWrite() const { return m_openForWrite; }
+		bool IsMetadataOnly() const { return m_metadataOnly; }
 		bool IsValidPE() const { return m_validPE; }
 		bool IsCorrupted() const { return m_corrupted; }
 		bool Is64Bit() const { return m_pe32Plus; }
 		bool IsSigned() const { return m_signed; }
-		size_t FileSize() const { return m_fileSize; }
+		BlockOffset FileSize() const { return m_fileSize; }
 		std::wstring PDBPath() const { return m_pdbPath; }
 		std::wstring PDBGUID() const { return m_pdbGuid; }
 		std::wstring FileVersion() const { return m_fileVersion; }
 		ResourceEntryPtr ResourceDirectory() const { return m_resources; }
+		// RVA/file offset/VA translation for this file, empty if headers could not be read
+		const AddressMap& Addresses() const { return m_addresses; }
+
+		// returns pointer to [offset, offset + size) of the file, NULL if the range is outside of the file
+		// ranges past the end of the last section are mapped on demand, such pointer is only valid until the next call
+		LPBYTE Data(BlockOffset offset, size_t size) const;
 
 		// returns raw contents of a PE section
 		// can be used to look at contents of custom sections (#pragma section) among other things
@@ -115,6 +138,13 @@ namespace peparser
 		const std::vector<std::string>& DllImports() const { return m_dllImports; }
 		const std::vector<std::string>& DelayedDllImports() const { return m_dllDelayedImports; }
 
+		// every imported symbol from import, delay import and bound import directories
+		const ImportTable& Imports() const { return m_imports; }
+		// export directory with name and ordinal lookups
+		const ExportTable& Exports() const { return m_exports; }
+		// makes import and export tables intern names into a pool shared with other parsers, call before Open()
+		void SetStringPool(const StringPoolPtr& pool) { m_imports = ImportTable(pool); m_exports = ExportTable(pool); }
+
 		std::vector<std::string> AllDllImports() const
 		{
 			std::vector<std::string> imports = m_dllImports;
@@ -147,6 +177,16 @@ namespace peparser
 		// EndUpdateResources() strips signature without wiping appropriate directory entry. This call "fixes" that.
 		void EraseSignatureDirectory() const;
 
+		// CheckSum field of the optional header
+		DWORD Checksum() const;
+		// checksum of the file as it is now, false if part of the file can't be read
+		bool ComputeChecksum(DWORD& checksum) const;
+		// recomputes and stores checksum, file has to be open for writing
+		bool UpdateChecksum() const;
+		// edits made through Data() have to call this, checksum is then updated on Close()
+		// SetVersion() and EraseSignatureDirectory() do it themselves
+		void SetModified() const { m_modified = true; }
+
 	private:
 		std::wstring m_path;
 
@@ -154,11 +194,20 @@ namespace peparser
 		HANDLE m_fileMap = NULL;
 		LPVOID m_view = NULL;
 
+		// number of bytes of the file covered by m_view, either whole file or headers and sections of big files
 		size_t m_viewSize = 0;
-		size_t m_fileSize = 0;
+		BlockOffset m_fileSize = 0;
+		size_t m_checksumOffset = 0;
+		// windows for the rest of big files
+		mutable FileViews m_views;
+		// replaces file mapping in metadata mode, m_view then points to its reserved range
+		mutable RangeReader m_reader;
+		mutable std::vector<BYTE> m_scratch;
 
 		bool m_open = false;
 		bool m_openForWrite = false;
+		mutable bool m_modified = false;
+		bool m_metadataOnly = false;
 		bool m_validPE = false;
 		bool m_corrupted = false;
 		bool m_pe32Plus = false;
@@ -167,6 +216,9 @@ namespace peparser
 		std::wstring m_pdbGuid;
 		std::wstring m_fileVersion;
 		ResourceEntryPtr m_resources;
+		AddressMap m_addresses;
+		ImportTable m_imports;
+		ExportTable m_exports;
 		std::vector<std::string> m_dllImports;
 		std::vector<std::string> m_dllDelayedImports;
 
@@ -177,8 +229,16 @@ namespace peparser
 		ModifiableBlockMap m_modifiable;
 		UsefulBlockMap m_useful;
 
+		bool QueryFileSize();
 		bool OpenReadOnly();
 		bool OpenRW();
+		bool MapView(bool write);
+		// end of headers and raw data of all sections according to headers at the start of probe
+		static size_t ImageExtent(LPBYTE probe, size_t probeSize, BlockOffset fileSize);
+		// makes sure memory at address is readable, loads it in metadata mode
+		bool Ensure(const void* address, size_t size) const;
+		// loads data directories in one go in metadata mode
+		void PlanDirectories(PIMAGE_NT_HEADERS ntHeaders);
 
 		bool Initialize();
 
@@ -186,6 +246,9 @@ namespace peparser
 
 		bool ReadSections(PIMAGE_NT_HEADERS ntHeaders);
 		bool ReadImportsDirectory(PIMAGE_NT_HEADERS ntHeaders);
+		bool ReadDelayImportsDirectory(PIMAGE_NT_HEADERS ntHeaders);
+		bool ReadBoundImportsDirectory(PIMAGE_NT_HEADERS ntHeaders);
+		void ReadImportThunks(DWORD intRva, DWORD iatRva, bool vaThunks);
 		bool ReadExportsDirectory(PIMAGE_NT_HEADERS ntHeaders);
 		bool ReadDebugDirectory(PIMAGE_NT_HEADERS ntHeaders);
 		bool ReadDigitalSignatureDirectory(PIMAGE_NT_HEADERS ntHeaders);
@@ -195,13 +258,17 @@ namespace peparser
 		bool ReadVsVersionInfo(ResourceEntryPtr node);
 		bool ReadVsVersionInfo(LPVOID data, size_t size);
 
-		bool FindFileOffsetFromRva(PIMAGE_NT_HEADERS ntHeaders, DWORD rva, DWORD& fileOffset);
-
 		template <class T> bool DirectoryInfo(PIMAGE_NT_HEADERS ntHeaders, PEDirInfo<T>& dir);
+		// returns pointer into the view if rva is mapped and size bytes are available there, NULL otherwise
+		LPBYTE PointerFromRva(DWORD rva, size_t size) const;
+		// same for a table of count elements, count is checked against the section before the size is computed
+		LPBYTE ArrayFromRva(DWORD rva, DWORD count, size_t elementSize) const;
+		// returns pointer to a string at rva and number of bytes available for it until the end of file
+		const char* StringFromRva(DWORD rva, size_t& maxLength) const;
 		size_t FileOffset(void* pointer) const;
 
-		size_t TotalIgnoredSize() const;
-		size_t NextOffset(size_t currentOffset, size_t& sizeOfBlock, size_t maxSize) const;
+		BlockOffset TotalIgnoredSize() const;
+		BlockOffset NextOffset(BlockOffset currentOffset, BlockOffset& sizeOfBlock, BlockOffset maxSize) const;
 
 		static bool FilterDifference(CompareResult& result, const PEParser& p1, const PEParser& p2, size_t start1, size_t start2, size_t size, size_t& diffShift, bool tlbCmpExpr);
 
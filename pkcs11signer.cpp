@@ -0,0 +1,297 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "pkcs11signer.h"
+#include "authenticode.h"
+#include "rfc3161.h"
+#include "timestampclient.h"
+#include "cryptoki.h"
+
+#include <windows.h>
+
+#include <iostream>
+#include <mutex>
+#include <sstream>
+
+namespace peparser
+{
+	namespace
+	{
+		std::wstring Pkcs11Error(const wchar_t* call, CK_RV rv)
+		{
+			std::wostringstream out;
+			out << call << L" failed. Error: 0x" << std::hex << rv;
+			return out.str();
+		}
+
+		std::string Trim(const CK_UTF8CHAR* text, size_t size)
+		{
+			std::string result((const char*)text, size);
+			result.erase(result.find_last_not_of(' ') + 1);
+			return result;
+		}
+	}
+
+	class Pkcs11Signer_pimpl
+	{
+	public:
+		~Pkcs11Signer_pimpl()
+		{
+			if (functions)
+			{
+				if (session != CK_INVALID_HANDLE)
+				{
+					functions->C_Logout(session);
+					functions->C_CloseSession(session);
+				}
+
+				if (initialized)
+					functions->C_Finalize(NULL);
+			}
+
+			if (module)
+				FreeLibrary(module);
+		}
+
+		bool Open(const std::wstring& modulePath, const std::string& tokenLabel, const std::string& pin, const std::string& keyLabel, const std::wstring& chainFile)
+		{
+			module = LoadLibrary(modulePath.c_str());
+			if (!module)
+			{
+				std::wcerr << L"Failed to load PKCS #11 module. Error: " << GetLastError() << L", Module: " << modulePath << std::endl;
+				return false;
+			}
+
+			CK_C_GetFunctionList getFunctionList = (CK_C_GetFunctionList)GetProcAddress(module, "C_GetFunctionList");
+			if (!getFunctionList || getFunctionList(&functions) != CKR_OK || !functions)
+			{
+				functions = nullptr;
+				std::wcerr << L"Not a PKCS #11 module: " << modulePath << std::endl;
+				return false;
+			}
+
+			// someone else in the process may have done it already, then it is theirs to finalize
+			CK_RV rv = functions->C_Initialize(NULL);
+			if (rv != CKR_OK && rv != CKR_CRYPTOKI_ALREADY_INITIALIZED)
+				return Fail(Pkcs11Error(L"C_Initialize", rv));
+
+			initialized = rv == CKR_OK;
+
+			CK_SLOT_ID slot = 0;
+			if (!FindSlot(tokenLabel, slot))
+				return false;
+
+			rv = functions->C_OpenSession(slot, CKF_SERIAL_SESSION, NULL, NULL, &session);
+			if (rv != CKR_OK)
+			{
+				session = CK_INVALID_HANDLE;
+				return Fail(Pkcs11Error(L"C_OpenSession", rv));
+			}
+
+			// empty pin leaves it to the token's PIN pad
+			rv = functions->C_Login(session, CKU_USER, pin.empty() ? NULL : (CK_UTF8CHAR*)pin.data(), (CK_ULONG)pin.size());
+			if (rv != CKR_OK && rv != CKR_USER_ALREADY_LOGGED_IN)
+				return Fail(Pkcs11Error(L"C_Login", rv));
+
+			CK_OBJECT_CLASS keyClass = CKO_PRIVATE_KEY;
+			std::vector<CK_ATTRIBUTE> keyTemplate = { { CKA_CLASS, &keyClass, sizeof(keyClass) } };
+			if (!keyLabel.empty())
+				keyTemplate.push_back(CK_ATTRIBUTE{ CKA_LABEL, (CK_VOID_PTR)keyLabel.data(), (CK_ULONG)keyLabel.size() });
+
+			std::vector<CK_OBJECT_HANDLE> keys;
+			if (!FindObjects(keyTemplate, keys))
+				return false;
+
+			if (keys.size() != 1)
+				return Fail(keys.empty() ? L"Private key not found on the token." : L"Token has several private keys, choose one with --pkcs11-key.");
+
+			key = keys.front();
+
+			// certificate on the token has the same CKA_ID as its key
+			std::vector<BYTE> id;
+			std::vector<CK_OBJECT_HANDLE> tokenCertificates;
+			CK_OBJECT_CLASS certificateClass = CKO_CERTIFICATE;
+			if (GetAttribute(key, CKA_ID, id) && !id.empty())
+			{
+				std::vector<CK_ATTRIBUTE> certificateTemplate = { { CKA_CLASS, &certificateClass, sizeof(certificateClass) }, { CKA_ID, id.data(), (CK_ULONG)id.size() } };
+				if (!FindObjects(certificateTemplate, tokenCertificates))
+					return false;
+			}
+
+			std::vector<BYTE> certificate;
+			if (!tokenCertificates.empty() && GetAttribute(tokenCertificates.front(), CKA_VALUE, certificate) && !certificate.empty())
+				certificates.push_back(certificate);
+
+			if (!chainFile.empty() && !ReadCertificateFile(chainFile, certificates))
+			{
+				std::wcerr << L"Failed to read certificates from " << chainFile << std::endl;
+				return false;
+			}
+
+			if (certificates.empty())
+				return Fail(L"Signer certificate is neither on the token nor in --cert-chain.");
+
+			return true;
+		}
+
+		// PKCS #1 v1.5 signature of a DigestInfo, one operation at a time in the session
+		bool Sign(const std::vector<BYTE>& digestInfo, std::vector<BYTE>& signature, std::wstring& error)
+		{
+			std::lock_guard<std::mutex> guard(lock);
+
+			CK_MECHANISM mechanism = { CKM_RSA_PKCS, NULL, 0 };
+			CK_RV rv = functions->C_SignInit(session, &mechanism, key);
+			if (rv != CKR_OK)
+			{
+				error = Pkcs11Error(L"C_SignInit", rv);
+				return false;
+			}
+
+			CK_ULONG size = 0;
+			rv = functions->C_Sign(session, (CK_BYTE*)digestInfo.data(), (CK_ULONG)digestInfo.size(), NULL, &size);
+			if (rv == CKR_OK)
+			{
+				signature.resize(size);
+				rv = functions->C_Sign(session, (CK_BYTE*)digestInfo.data(), (CK_ULONG)digestInfo.size(), signature.data(), &size);
+				signature.resize(size);
+			}
+
+			if (rv != CKR_OK)
+			{
+				error = Pkcs11Error(L"C_Sign", rv);
+				return false;
+			}
+
+			return true;
+		}
+
+		bool SignFile(const std::wstring& path, std::wstring& error)
+		{
+			return SignPEFile(path, [this](const std::vector<BYTE>& digest, std::vector<BYTE>& signedData, std::wstring& signError)
+			{
+				return SignDigest(digest, signedData, signError);
+			}, error);
+		}
+
+		bool SignDigest(const std::vector<BYTE>& digest, std::vector<BYTE>& signedData, std::wstring& error)
+		{
+			return AuthenticodeSignedData(digest, certificates, [this](const std::vector<BYTE>& digestInfo, std::vector<BYTE>& signature, std::wstring& signError)
+			{
+				return Sign(digestInfo, signature, signError);
+			}, signedData, error);
+		}
+
+		// shared by timestamp requests of all files
+		TimestampClient client;
+
+	private:
+		bool Fail(const std::wstring& error)
+		{
+			std::wcerr << error << std::endl;
+			return false;
+		}
+
+		bool FindSlot(const std::string& tokenLabel, CK_SLOT_ID& slot)
+		{
+			CK_ULONG count = 0;
+			CK_RV rv = functions->C_GetSlotList(CK_TRUE, NULL, &count);
+			std::vector<CK_SLOT_ID> slots(count);
+			if (rv == CKR_OK && count)
+				rv = functions->C_GetSlotList(CK_TRUE, slots.data(), &count);
+
+			if (rv != CKR_OK)
+				return Fail(Pkcs11Error(L"C_GetSlotList", rv));
+
+			slots.resize(count);
+			for (auto candidate : slots)
+			{
+				CK_TOKEN_INFO info;
+				if (!tokenLabel.empty() && (functions->C_GetTokenInfo(candidate, &info) != CKR_OK || Trim(info.label, sizeof(info.label)) != tokenLabel))
+					continue;
+
+				slot = candidate;
+				return true;
+			}
+
+			return Fail(tokenLabel.empty() ? L"No token present." : L"Token not found.");
+		}
+
+		bool FindObjects(std::vector<CK_ATTRIBUTE>& attributes, std::vector<CK_OBJECT_HANDLE>& objects)
+		{
+			objects.clear();
+
+			CK_RV rv = functions->C_FindObjectsInit(session, attributes.data(), (CK_ULONG)attributes.size());
+			if (rv != CKR_OK)
+				return Fail(Pkcs11Error(L"C_FindObjectsInit", rv));
+
+			CK_OBJECT_HANDLE found[16];
+			CK_ULONG count = 0;
+			while ((rv = functions->C_FindObjects(session, found, _countof(found), &count)) == CKR_OK && count)
+				objects.insert(objects.end(), found, found + count);
+
+			functions->C_FindObjectsFinal(session);
+
+			if (rv != CKR_OK)
+				return Fail(Pkcs11Error(L"C_FindObjects", rv));
+
+			return true;
+		}
+
+		bool GetAttribute(CK_OBJECT_HANDLE object, CK_ATTRIBUTE_TYPE type, std::vector<BYTE>& value)
+		{
+			CK_ATTRIBUTE attribute = { type, NULL, 0 };
+			if (functions->C_GetAttributeValue(session, object, &attribute, 1) != CKR_OK || attribute.ulValueLen == CK_UNAVAILABLE_INFORMATION)
+				return false;
+
+			value.resize(attribute.ulValueLen);
+			attribute.pValue = value.data();
+			return functions->C_GetAttributeValue(session, object, &attribute, 1) == CKR_OK;
+		}
+
+		HMODULE module = nullptr;
+		CK_FUNCTION_LIST* functions = nullptr;
+		bool initialized = false;
+		CK_SESSION_HANDLE session = CK_INVALID_HANDLE;
+		CK_OBJECT_HANDLE key = CK_INVALID_HANDLE;
+
+		std::vector<std::vector<BYTE>> certificates;
+		std::mutex lock;
+	};
+
+	// ==========================================================================================================
+
+	Pkcs11Signer::Pkcs11Signer()
+	{
+		_m = new Pkcs11Signer_pimpl();
+	}
+
+	Pkcs11Signer::~Pkcs11Signer()
+	{
+		delete _m;
+	}
+
+	bool Pkcs11Signer::Open(const std::wstring& module, const std::string& tokenLabel, const std::string& pin, const std::string& keyLabel, const std::wstring& chainFile)
+	{
+		return _m->Open(module, tokenLabel, pin, keyLabel, chainFile);
+	}
+
+	bool Pkcs11Signer::SignFile(const std::wstring& path, std::wstring& error)
+	{
+		return _m->SignFile(path, error);
+	}
+
+	bool Pkcs11Signer::SignDigest(const std::vector<BYTE>& digest, std::vector<BYTE>& signedData, std::wstring& error)
+	{
+		return _m->SignDigest(digest, signedData, error);
+	}
+
+	bool Pkcs11Signer::SignFiles(const std::vector<std::wstring>& paths, const std::vector<std::wstring>& timestampUrls, const SigningPipeline::Options& options)
+	{
+		SigningPipeline pipeline(
+			  [this](const std::wstring& path, std::wstring& error) { return _m->SignFile(path, error); }
+			, [this](const std::wstring& path, const std::wstring& url, std::wstring& error) { return TimestampFile(_m->client, path, url, error); }
+			, timestampUrls, options);
+
+		return pipeline.RunAndReport(paths);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,43 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <windows.h>
+
+#include <string>
+#include <vector>
+
+#include "signingpipeline.h"
+
+namespace peparser
+{
+	// signs binaries with an RSA key on a PKCS #11 token or HSM (SafeNet eTPKCS11, YubiKey, SoftHSM for tests, ...)
+	// Authenticode signature is built natively (see SignPEFile), so only the module is needed: no Mssign32,
+	// certificate store or CSP, timestamps are RFC 3161 requests made natively too
+	class Pkcs11Signer
+	{
+	public:
+		Pkcs11Signer();
+		~Pkcs11Signer();
+
+		// loads module, logs in to the token with a given label (first token present if empty) and finds the private key
+		// with a given label (the only one on the token if empty) and the certificate with the same CKA_ID
+		// certificates in chainFile (DER or PEM) are added after it, the first one is the signer's if the token has none
+		// pin may be empty for tokens with a PIN pad
+		// writes to std::cerr
+		bool Open(const std::wstring& module, const std::string& tokenLabel, const std::string& pin, const std::string& keyLabel, const std::wstring& chainFile);
+
+		// signs binary, safe to call from several threads (only token operations are serialized)
+		bool SignFile(const std::wstring& path, std::wstring& error);
+
+		// builds Authenticode SignedData for a SHA-256 digest, for a remote signing agent, thread safe as SignFile
+		bool SignDigest(const std::vector<BYTE>& digest, std::vector<BYTE>& signedData, std::wstring& error);
+
+		// signs and timestamps many binaries through SigningPipeline, see Signer::SignFiles
+		bool SignFiles(const std::vector<std::wstring>& paths, const std::vector<std::wstring>& timestampUrls, const SigningPipeline::Options& options);
+
+	private:
+		class Pkcs11Signer_pimpl* _m = nullptr;
+	};
+}
\ No newline at end of file
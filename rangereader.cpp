@@ -0,0 +1,157 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "rangereader.h"
+
+#include <algorithm>
+
+namespace peparser
+{
+	void RangeReader::Attach(HANDLE file, BlockOffset fileSize)
+	{
+		Reset();
+
+		m_file = file;
+		m_fileSize = fileSize;
+	}
+
+	bool RangeReader::Reserve(size_t size)
+	{
+		if (m_base)
+			VirtualFree(m_base, 0, MEM_RELEASE);
+
+		m_base = NULL;
+		m_size = 0;
+		m_loaded.clear();
+
+		if (size == 0)
+			return false;
+
+		m_base = (LPBYTE)VirtualAlloc(NULL, size, MEM_RESERVE, PAGE_NOACCESS);
+		if (!m_base)
+			return false;
+
+		m_size = size;
+		m_loaded.assign((size + PageSize - 1) / PageSize, false);
+
+		return true;
+	}
+
+	void RangeReader::Reset()
+	{
+		if (m_base)
+			VirtualFree(m_base, 0, MEM_RELEASE);
+
+		m_base = NULL;
+		m_size = 0;
+		m_file = INVALID_HANDLE_VALUE;
+		m_loaded.clear();
+	}
+
+	bool RangeReader::Ensure(const void* address, size_t size)
+	{
+		if (!m_base || (LPBYTE)address < m_base)
+			return false;
+
+		return Ensure((BlockOffset)((LPBYTE)address - m_base), size);
+	}
+
+	bool RangeReader::Ensure(BlockOffset offset, size_t size)
+	{
+		if (!m_base || offset > m_size || m_size - offset < size)
+			return false;
+
+		if (size == 0)
+			return true;
+
+		size_t firstPage = (size_t)offset / PageSize;
+		size_t lastPage = ((size_t)offset + size - 1) / PageSize;
+
+		for (size_t page = firstPage; page <= lastPage; ++page)
+		{
+			if (m_loaded[page])
+				continue;
+
+			// extending the read forward over pages that are not loaded yet
+			size_t end = page;
+			while (end + 1 < m_loaded.size() && !m_loaded[end + 1] && (end < lastPage || (end + 1 - page) * PageSize < MinRead))
+				++end;
+
+			if (!Load(page, end))
+				return false;
+
+			page = end;
+		}
+
+		return true;
+	}
+
+	bool RangeReader::Plan(std::vector<Range> ranges)
+	{
+		std::sort(ranges.begin(), ranges.end());
+
+		bool result = true;
+		for (size_t i = 0; i < ranges.size();)
+		{
+			BlockOffset start = ranges[i].offset;
+			BlockOffset end = start + ranges[i].size;
+
+			for (++i; i < ranges.size() && ranges[i].offset <= end + CoalesceGap; ++i)
+				end = std::max<BlockOffset>(end, ranges[i].offset + ranges[i].size);
+
+			end = std::min<BlockOffset>(end, m_size);
+			if (start >= end)
+				continue;
+
+			result = Ensure(start, (size_t)(end - start)) && result;
+		}
+
+		return result;
+	}
+
+	bool RangeReader::Load(size_t firstPage, size_t lastPage)
+	{
+		size_t offset = firstPage * PageSize;
+		size_t size = std::min<size_t>((lastPage + 1) * PageSize, m_size) - offset;
+
+		if (!VirtualAlloc(m_base + offset, size, MEM_COMMIT, PAGE_READWRITE))
+			return false;
+
+		// part of the reserved range might be past the end of file, it stays zeroed
+		size_t available = (offset < m_fileSize) ? (size_t)std::min<BlockOffset>(size, m_fileSize - offset) : 0;
+		if (available && !Read(offset, m_base + offset, available))
+			return false;
+
+		for (size_t page = firstPage; page <= lastPage; ++page)
+			m_loaded[page] = true;
+
+		return true;
+	}
+
+	bool RangeReader::Read(BlockOffset offset, void* buffer, size_t size) const
+	{
+		LPBYTE target = (LPBYTE)buffer;
+
+		while (size)
+		{
+			OVERLAPPED overlapped;
+			ZeroMemory(&overlapped, sizeof(overlapped));
+			overlapped.Offset = (DWORD)offset;
+			overlapped.OffsetHigh = (DWORD)(offset >> 32);
+
+			DWORD chunk = (DWORD)std::min<size_t>(size, 0x10000000);
+			DWORD read = 0;
+			if (!ReadFile(m_file, target, chunk, &read, &overlapped) || read == 0)
+				return false;
+
+			++m_requests;
+			m_bytesRead += read;
+
+			offset += read;
+			target += read;
+			size -= read;
+		}
+
+		return true;
+	}
+}
\ No newline at end of file
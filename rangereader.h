@@ -0,0 +1,82 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <windows.h>
+
+#include "block.h"
+
+#include <vector>
+
+namespace peparser
+{
+	// reads parts of a file into a reserved address range, so parsing code can use plain pointers
+	// without transferring the whole file (useful for network shares)
+	// pages are committed and filled on demand by Ensure(), nearby requests are coalesced into one read
+	// and every read is positioned (ReadFile with an offset), all through a single handle
+	class RangeReader
+	{
+	public:
+		static const size_t PageSize = 4096;
+		// requests closer than this are merged into one read
+		static const size_t CoalesceGap = 64 * 1024;
+		// every read is extended to at least this size, names and thunks are usually close to their directories
+		static const size_t MinRead = 64 * 1024;
+
+		struct Range
+		{
+			BlockOffset offset = 0;
+			size_t size = 0;
+
+			Range() {}
+			Range(BlockOffset offset, size_t size) : offset(offset), size(size) {}
+
+			bool operator <(const Range& r) const { return offset < r.offset; }
+		};
+
+		RangeReader() {}
+		~RangeReader() { Reset(); }
+
+		// file handle is not owned, Read() can be used right after attaching
+		void Attach(HANDLE file, BlockOffset fileSize);
+		// reserves address space for the first size bytes of the file, previously loaded data is discarded
+		bool Reserve(size_t size);
+		void Reset();
+
+		// base of the reserved range, file offset 0
+		LPBYTE Base() const { return m_base; }
+		size_t Size() const { return m_size; }
+
+		// makes [offset, offset + size) readable through Base(), false if range is outside of reserved area or reading failed
+		bool Ensure(BlockOffset offset, size_t size);
+		bool Ensure(const void* address, size_t size);
+
+		// loads all ranges at once, coalescing neighbours into as few reads as possible
+		bool Plan(std::vector<Range> ranges);
+
+		// reads a range of any size into caller's buffer, bypassing reserved area
+		bool Read(BlockOffset offset, void* buffer, size_t size) const;
+
+		// statistics
+		BlockOffset BytesRead() const { return m_bytesRead; }
+		size_t Requests() const { return m_requests; }
+
+	private:
+		HANDLE m_file = INVALID_HANDLE_VALUE;
+		BlockOffset m_fileSize = 0;
+		LPBYTE m_base = NULL;
+		size_t m_size = 0;
+
+		// one flag per page of the reserved range
+		std::vector<bool> m_loaded;
+
+		mutable BlockOffset m_bytesRead = 0;
+		mutable size_t m_requests = 0;
+
+		bool Load(size_t firstPage, size_t lastPage);
+
+		RangeReader(const RangeReader&);
+		RangeReader& operator=(const RangeReader&);
+	};
+}
\ No newline at end of file
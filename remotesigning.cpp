@@ -0,0 +1,476 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+// winsock2.h has to come before windows.h, which includes the old winsock.h otherwise
+#include <winsock2.h>
+#include <ws2tcpip.h>
+
+#include "remotesigning.h"
+#include "asn1.h"
+#include "hash.h"
+#include "rfc3161.h"
+#include "widestring.h"
+
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#pragma comment(lib, "ws2_32.lib")
+
+namespace peparser
+{
+	namespace
+	{
+		const wchar_t* RequestContentType = L"application/x-authenticode-digest";
+
+		// requests are a few hundred bytes, anything much bigger is not a signing request
+		const size_t MaxHeaderSize = 16 * 1024;
+		const size_t MaxBodySize = 64 * 1024;
+		// idle keep-alive connections are dropped after this many milliseconds
+		const DWORD ReceiveTimeout = 120000;
+		// connections served at once, more wait in the listen backlog
+		const size_t MaxConnections = 64;
+
+		std::mutex logLock;
+
+		std::wstring FileName(const std::wstring& path)
+		{
+			size_t slash = path.find_last_of(L"\\/");
+			return slash == std::wstring::npos ? path : path.substr(slash + 1);
+		}
+
+		std::string Lower(std::string text)
+		{
+			std::transform(text.begin(), text.end(), text.begin(), [](char c) { return (char)std::tolower((unsigned char)c); });
+			return text;
+		}
+
+		std::string Trim(const std::string& text)
+		{
+			size_t begin = text.find_first_not_of(" \t");
+			if (begin == std::string::npos)
+				return std::string();
+
+			return text.substr(begin, text.find_last_not_of(" \t") - begin + 1);
+		}
+
+		bool IsLoopback(const sockaddr* address)
+		{
+			if (address->sa_family == AF_INET)
+				return (ntohl(((const sockaddr_in*)address)->sin_addr.s_addr) >> 24) == 127;
+			if (address->sa_family == AF_INET6)
+				return IN6_IS_ADDR_LOOPBACK(&((const sockaddr_in6*)address)->sin6_addr) != 0;
+			return false;
+		}
+
+		// doesn't stop at the first difference, so the time taken doesn't tell how much of a secret was right
+		bool ConstantTimeEquals(const std::string& value, const std::string& expected)
+		{
+			unsigned char difference = (value.size() != expected.size()) ? 1 : 0;
+			for (size_t i = 0; i < expected.size(); ++i)
+				difference |= (unsigned char)expected[i] ^ (unsigned char)((i < value.size()) ? value[i] : 0);
+
+			return difference == 0;
+		}
+
+		const char* Reason(int status)
+		{
+			switch (status)
+			{
+			case 200: return "OK";
+			case 400: return "Bad Request";
+			case 401: return "Unauthorized";
+			case 405: return "Method Not Allowed";
+			case 413: return "Payload Too Large";
+			default: return "Internal Server Error";
+			}
+		}
+
+		bool SendAll(SOCKET connection, const std::string& data)
+		{
+			for (size_t sent = 0; sent < data.size(); )
+			{
+				int result = send(connection, data.data() + sent, (int)std::min<size_t>(data.size() - sent, INT_MAX), 0);
+				if (result <= 0)
+					return false;
+
+				sent += result;
+			}
+
+			return true;
+		}
+
+		// HTTP/1.1 request with a Content-Length body (or none)
+		struct HttpRequest
+		{
+			std::string method;
+			std::string authorization;
+			bool close = false;
+			std::vector<BYTE> body;
+		};
+
+		// buffered holds whatever was read past the previous request on the connection
+		// returns false when the connection is closed or broken, status is set for requests that are refused
+		bool ReadRequest(SOCKET connection, std::string& buffered, HttpRequest& request, int& status)
+		{
+			status = 0;
+
+			size_t headerEnd;
+			while ((headerEnd = buffered.find("\r\n\r\n")) == std::string::npos)
+			{
+				if (buffered.size() > MaxHeaderSize)
+				{
+					status = 413;
+					return false;
+				}
+
+				char chunk[4096];
+				int received = recv(connection, chunk, sizeof(chunk), 0);
+				if (received <= 0)
+					return false;
+
+				buffered.append(chunk, received);
+			}
+
+			std::istringstream headers(buffered.substr(0, headerEnd));
+			buffered.erase(0, headerEnd + 4);
+
+			std::string line;
+			std::getline(headers, line);
+			request.method = line.substr(0, line.find(' '));
+			request.close = line.find("HTTP/1.0") != std::string::npos;
+
+			size_t contentLength = 0;
+			while (std::getline(headers, line))
+			{
+				size_t colon = line.find(':');
+				if (colon == std::string::npos)
+					continue;
+
+				std::string name = Lower(Trim(line.substr(0, colon)));
+				std::string value = Trim(line.substr(colon + 1));
+				if (!value.empty() && value.back() == '\r')
+					value = Trim(value.substr(0, value.size() - 1));
+
+				if (name == "content-length")
+					contentLength = strtoul(value.c_str(), NULL, 10);
+				else if (name == "authorization")
+					request.authorization = value;
+				else if (name == "connection")
+					request.close = Lower(value) == "close";
+				else if (name == "transfer-encoding")
+				{
+					status = 400;
+					return false;
+				}
+			}
+
+			if (contentLength > MaxBodySize)
+			{
+				status = 413;
+				return false;
+			}
+
+			while (buffered.size() < contentLength)
+			{
+				char chunk[4096];
+				int received = recv(connection, chunk, sizeof(chunk), 0);
+				if (received <= 0)
+					return false;
+
+				buffered.append(chunk, received);
+			}
+
+			request.body.assign(buffered.begin(), buffered.begin() + contentLength);
+			buffered.erase(0, contentLength);
+			return true;
+		}
+
+		bool SendReply(SOCKET connection, int status, const std::string& contentType, const std::vector<BYTE>& body, bool close)
+		{
+			std::ostringstream reply;
+			reply << "HTTP/1.1 " << status << " " << Reason(status) << "\r\n"
+				<< "Content-Type: " << contentType << "\r\n"
+				<< "Content-Length: " << body.size() << "\r\n";
+
+			if (status == 401)
+				reply << "WWW-Authenticate: Bearer\r\n";
+			if (close)
+				reply << "Connection: close\r\n";
+
+			reply << "\r\n";
+			reply.write((const char*)body.data(), body.size());
+
+			return SendAll(connection, reply.str());
+		}
+
+		std::vector<BYTE> Text(const std::wstring& message)
+		{
+			std::string text = WideStringToUtf8(message);
+			return std::vector<BYTE>(text.begin(), text.end());
+		}
+	}
+
+	std::vector<BYTE> SigningRequest(const std::vector<BYTE>& digest, const std::wstring& fileName)
+	{
+		using namespace asn1;
+
+		std::string name = WideStringToUtf8(fileName);
+
+		return Encode(Sequence, std::vector<Bytes>{
+			  Encode(Sequence, std::vector<Bytes>{ EncodeObjectId(HashAlgorithmOid(HashAlgorithm::Sha256)), EncodeNull() })
+			, Encode(OctetString, digest)
+			, Encode(Utf8String, Bytes(name.begin(), name.end())) });
+	}
+
+	bool ParseSigningRequest(const std::vector<BYTE>& request, std::vector<BYTE>& digest, std::wstring& fileName, std::wstring& error)
+	{
+		using namespace asn1;
+
+		Element sequence, algorithm, oid, value, name;
+		Reader reader(request.data(), request.size());
+		if (!reader.Next(Sequence, sequence) || !reader.AtEnd())
+		{
+			error = L"Malformed signing request.";
+			return false;
+		}
+
+		Reader fields(sequence);
+		if (!fields.Next(Sequence, algorithm) || !fields.Next(OctetString, value) || (!fields.AtEnd() && !fields.Next(Utf8String, name)))
+		{
+			error = L"Malformed signing request.";
+			return false;
+		}
+
+		HashAlgorithm hashAlgorithm;
+		Reader algorithmFields(algorithm);
+		if (!algorithmFields.Next(ObjectId, oid) || !HashAlgorithmFromOid(ObjectIdString(oid), hashAlgorithm) || hashAlgorithm != HashAlgorithm::Sha256 || value.size != 32)
+		{
+			error = L"Only SHA-256 digests are supported.";
+			return false;
+		}
+
+		digest = value.Content();
+		fileName = name.content ? Utf8ToWideString(std::string((const char*)name.content, name.size)) : std::wstring();
+		return true;
+	}
+
+	// ==========================================================================================================
+
+	RemoteSigner::RemoteSigner(const std::wstring& url, const std::string& secret)
+		: m_url(url)
+		, m_secret(secret)
+	{
+	}
+
+	bool RemoteSigner::SignFile(const std::wstring& path, std::wstring& error)
+	{
+		std::wstring headers;
+		if (!m_secret.empty())
+			headers = L"Authorization: Bearer " + Utf8ToWideString(m_secret) + L"\r\n";
+
+		return SignPEFile(path, [&](const std::vector<BYTE>& digest, std::vector<BYTE>& signedData, std::wstring& signError)
+		{
+			std::vector<BYTE> reply;
+			if (!m_client.Post(m_url, RequestContentType, SigningRequest(digest, FileName(path)), reply, signError, headers))
+			{
+				// agent explains refusals in the body
+				if (!reply.empty() && reply.size() < 1024)
+					signError += L" " + Utf8ToWideString(std::string(reply.begin(), reply.end()));
+				return false;
+			}
+
+			asn1::Element element;
+			asn1::Reader reader(reply.data(), reply.size());
+			if (!reader.Next(asn1::Sequence, element) || !reader.AtEnd())
+			{
+				signError = L"Signing agent replied with malformed signature.";
+				return false;
+			}
+
+			signedData.swap(reply);
+			return true;
+		}, error);
+	}
+
+	bool RemoteSigner::SignFiles(const std::vector<std::wstring>& paths, const std::vector<std::wstring>& timestampUrls, const SigningPipeline::Options& options)
+	{
+		SigningPipeline pipeline(
+			  [this](const std::wstring& path, std::wstring& error) { return SignFile(path, error); }
+			, [this](const std::wstring& path, const std::wstring& url, std::wstring& error) { return TimestampFile(m_client, path, url, error); }
+			, timestampUrls, options);
+
+		return pipeline.RunAndReport(paths);
+	}
+
+	// ==========================================================================================================
+
+	RemoteSigningServer::RemoteSigningServer(const DigestSignFunction& sign, const std::string& secret)
+		: m_sign(sign)
+		, m_secret(secret)
+	{
+	}
+
+	bool RemoteSigningServer::Serve(const std::string& endpoint)
+	{
+		WSADATA data;
+		if (WSAStartup(MAKEWORD(2, 2), &data) != 0)
+		{
+			std::wcerr << L"Failed to initialize Winsock." << std::endl;
+			return false;
+		}
+
+		size_t colon = endpoint.rfind(':');
+		std::string host = (colon == std::string::npos) ? "127.0.0.1" : endpoint.substr(0, colon);
+		std::string port = (colon == std::string::npos) ? endpoint : endpoint.substr(colon + 1);
+
+		// [::1]:port
+		if (host.size() > 1 && host.front() == '[' && host.back() == ']')
+			host = host.substr(1, host.size() - 2);
+
+		addrinfo hints = {};
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_protocol = IPPROTO_TCP;
+		hints.ai_flags = AI_PASSIVE;
+
+		addrinfo* address = NULL;
+		if (getaddrinfo(host.c_str(), port.c_str(), &hints, &address) != 0 || !address)
+		{
+			std::wcerr << L"Invalid listen address: " << MultiByteToWideString(endpoint) << std::endl;
+			return false;
+		}
+
+		// anyone who can reach the agent can have any digest signed
+		if (m_secret.empty() && !IsLoopback(address->ai_addr))
+		{
+			std::wcerr << L"Signing agent reachable from other machines requires a secret: " << MultiByteToWideString(endpoint) << std::endl;
+			freeaddrinfo(address);
+			return false;
+		}
+
+		SOCKET listener = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+		bool ok = listener != INVALID_SOCKET
+			&& bind(listener, address->ai_addr, (int)address->ai_addrlen) == 0
+			&& listen(listener, SOMAXCONN) == 0;
+
+		freeaddrinfo(address);
+
+		if (!ok)
+		{
+			std::wcerr << L"Failed to listen on " << MultiByteToWideString(endpoint) << L". Error: " << WSAGetLastError() << std::endl;
+			if (listener != INVALID_SOCKET)
+				closesocket(listener);
+			return false;
+		}
+
+		std::wcerr << L"Signing agent listening on " << MultiByteToWideString(endpoint) << std::endl;
+
+		for (;;)
+		{
+			{
+				std::unique_lock<std::mutex> lock(m_lock);
+				m_released.wait(lock, [this]() { return m_connections < MaxConnections; });
+			}
+
+			SOCKET connection = accept(listener, NULL, NULL);
+			if (connection == INVALID_SOCKET)
+				continue;
+
+			DWORD timeout = ReceiveTimeout;
+			setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+
+			{
+				std::lock_guard<std::mutex> guard(m_lock);
+				++m_connections;
+			}
+
+			std::thread([this, connection]()
+			{
+				ServeConnection(connection);
+
+				{
+					std::lock_guard<std::mutex> guard(m_lock);
+					--m_connections;
+				}
+				m_released.notify_one();
+			}).detach();
+		}
+	}
+
+	void RemoteSigningServer::ServeConnection(UINT_PTR connection)
+	{
+		SOCKET client = (SOCKET)connection;
+		std::string buffered;
+
+		for (;;)
+		{
+			HttpRequest request;
+			int status = 0;
+			if (!ReadRequest(client, buffered, request, status))
+			{
+				if (status)
+					SendReply(client, status, "text/plain; charset=utf-8", Text(L"Malformed or oversized request."), true);
+				break;
+			}
+
+			std::vector<BYTE> reply;
+			std::string contentType = "text/plain; charset=utf-8";
+
+			if (request.method != "POST")
+			{
+				status = 405;
+				reply = Text(L"Signing requests are POSTed.");
+			}
+			else if (!m_secret.empty() && !ConstantTimeEquals(request.authorization, "Bearer " + m_secret))
+			{
+				status = 401;
+				reply = Text(L"Signing agent refused the secret.");
+			}
+			else
+				status = Handle(request.body, reply, contentType);
+
+			if (!SendReply(client, status, contentType, reply, request.close) || request.close)
+				break;
+		}
+
+		closesocket(client);
+	}
+
+	int RemoteSigningServer::Handle(const std::vector<BYTE>& body, std::vector<BYTE>& reply, std::string& contentType)
+	{
+		std::vector<BYTE> digest;
+		std::wstring fileName;
+		std::wstring error;
+		if (!ParseSigningRequest(body, digest, fileName, error))
+		{
+			reply = Text(error);
+			return 400;
+		}
+
+		std::vector<BYTE> signedData;
+		bool ok = m_sign(digest, signedData, error);
+
+		{
+			std::lock_guard<std::mutex> guard(logLock);
+			if (ok)
+				std::wcerr << L"Signed: " << fileName << std::endl;
+			else
+				std::wcerr << error << L", File: " << fileName << std::endl;
+		}
+
+		if (!ok)
+		{
+			reply = Text(error);
+			return 500;
+		}
+
+		reply.swap(signedData);
+		contentType = "application/pkcs7-signature";
+		return 200;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,79 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <windows.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "authenticode.h"
+#include "signingpipeline.h"
+#include "timestampclient.h"
+
+namespace peparser
+{
+	// digest-only signing: a client computes the Authenticode digest of a file locally and sends just the digest to a
+	// signing agent next to the key, the agent returns PKCS #7 SignedData for it and the client embeds it in the file,
+	// so a few hundred bytes travel instead of the binary
+	//
+	// protocol is HTTP POST of a DER encoded request
+	//     SigningRequest ::= SEQUENCE { digestAlgorithm AlgorithmIdentifier, digest OCTET STRING, fileName UTF8String OPTIONAL }
+	// answered with 200 and application/pkcs7-signature SignedData, or an error status with a text/plain UTF-8 message
+	// fileName is only logged by the agent, authenticated attributes are the fixed set AuthenticodeSignedData builds
+	// an optional shared secret is sent as "Authorization: Bearer <secret>", in clear text over plain HTTP, so an agent
+	// reachable from other machines needs TLS in front of it (or a trusted network) for the secret to mean anything
+
+	std::vector<BYTE> SigningRequest(const std::vector<BYTE>& digest, const std::wstring& fileName);
+	// only SHA-256 digests are accepted
+	bool ParseSigningRequest(const std::vector<BYTE>& request, std::vector<BYTE>& digest, std::wstring& fileName, std::wstring& error);
+
+	// client side: signs files through an agent, safe to use from several threads (connections are kept alive per agent)
+	class RemoteSigner
+	{
+	public:
+		RemoteSigner(const std::wstring& url, const std::string& secret);
+
+		RemoteSigner(const RemoteSigner&) = delete;
+		RemoteSigner& operator=(const RemoteSigner&) = delete;
+
+		// file is held open exclusively from hashing until the signature is embedded
+		bool SignFile(const std::wstring& path, std::wstring& error);
+
+		// signs and timestamps (RFC 3161, requested locally) many binaries through SigningPipeline, see Signer::SignFiles
+		bool SignFiles(const std::vector<std::wstring>& paths, const std::vector<std::wstring>& timestampUrls, const SigningPipeline::Options& options);
+
+	private:
+		std::wstring m_url;
+		std::string m_secret;
+		TimestampClient m_client;
+	};
+
+	// agent side: minimal HTTP/1.1 server (keep-alive, Content-Length bodies only) answering SigningRequests with sign
+	// every connection is served on its own thread, up to a fixed number of connections at once, sign must be thread safe
+	class RemoteSigningServer
+	{
+	public:
+		RemoteSigningServer(const DigestSignFunction& sign, const std::string& secret);
+
+		// listens on "address:port" or "port" (loopback only) and serves until the process ends
+		// a non-loopback address is refused without a secret
+		// returns false only if it could not start listening, writes to std::wcerr
+		bool Serve(const std::string& endpoint);
+
+	private:
+		void ServeConnection(UINT_PTR connection);
+		// status and content type of the reply to one request body
+		int Handle(const std::vector<BYTE>& body, std::vector<BYTE>& reply, std::string& contentType);
+
+		DigestSignFunction m_sign;
+		std::string m_secret;
+
+		std::mutex m_lock;
+		std::condition_variable m_released;
+		size_t m_connections = 0;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,743 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "resourcebuilder.h"
+#include "peparser.h"
+#include "checksum.h"
+
+#pragma warning(push)
+#pragma warning(disable : 4996)
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string.hpp>
+#pragma warning(pop)
+
+#include <iostream>
+#include <algorithm>
+#include <cwctype>
+
+namespace peparser
+{
+	namespace
+	{
+		// alignment of data blobs inside the section, same as cvtres uses
+		const DWORD DataAlignment = 8;
+
+		DWORD Align(DWORD value, DWORD alignment)
+		{
+			return (alignment) ? (value + alignment - 1) / alignment * alignment : value;
+		}
+
+		DWORD VirtualSize(const IMAGE_SECTION_HEADER& section)
+		{
+			// some linkers leave virtual size empty
+			return (section.Misc.VirtualSize) ? section.Misc.VirtualSize : section.SizeOfRawData;
+		}
+
+		bool SectionContains(const IMAGE_SECTION_HEADER& section, DWORD rva)
+		{
+			return rva >= section.VirtualAddress && rva - section.VirtualAddress < max(VirtualSize(section), section.SizeOfRawData);
+		}
+
+		// makes room for one more section header at the end of the section table
+		// bound imports are usually stored right there, they are dropped (the loader binds imports itself without them),
+		// anything else there is left alone and the header is refused
+		bool ClaimSectionHeaderSlot(std::vector<BYTE>& headers, size_t slot, PIMAGE_DATA_DIRECTORY directories, DWORD directoryCount)
+		{
+			size_t slotEnd = slot + sizeof(IMAGE_SECTION_HEADER);
+			if (slotEnd > headers.size())
+				return false;
+
+			if (directoryCount > IMAGE_DIRECTORY_ENTRY_BOUND_IMPORT)
+			{
+				// unlike other directories this one is addressed by file offset
+				IMAGE_DATA_DIRECTORY& bound = directories[IMAGE_DIRECTORY_ENTRY_BOUND_IMPORT];
+				if (bound.Size && bound.VirtualAddress < slotEnd && bound.VirtualAddress + bound.Size > slot)
+				{
+					size_t start = max((size_t)bound.VirtualAddress, slot);
+					size_t end = min((size_t)bound.VirtualAddress + bound.Size, headers.size());
+					if (start < end)
+						memset(&headers[start], 0, end - start);
+
+					bound.VirtualAddress = 0;
+					bound.Size = 0;
+				}
+			}
+
+			return std::all_of(headers.begin() + slot, headers.begin() + slotEnd, [](BYTE b) { return b == 0; });
+		}
+
+		// sequential output with running checksum
+		class ImageWriter
+		{
+		public:
+			explicit ImageWriter(const std::wstring& path)
+			{
+				m_file = CreateFile(path.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+			}
+
+			~ImageWriter()
+			{
+				if (IsOpen())
+					CloseHandle(m_file);
+			}
+
+			bool IsOpen() const { return m_file != INVALID_HANDLE_VALUE; }
+			BlockOffset Position() const { return m_checksum.Length(); }
+
+			bool Write(const void* data, size_t size)
+			{
+				const size_t ChunkSize = 16 * 1024 * 1024;
+
+				m_checksum.Update(data, size);
+
+				const BYTE* bytes = (const BYTE*)data;
+				while (size)
+				{
+					DWORD chunk = (DWORD)min(size, ChunkSize);
+					DWORD written = 0;
+					if (!WriteFile(m_file, bytes, chunk, &written, NULL) || written != chunk)
+						return false;
+
+					bytes += chunk;
+					size -= chunk;
+				}
+
+				return true;
+			}
+
+			// zero fill up to offset
+			bool Pad(BlockOffset offset)
+			{
+				static const BYTE zeros[4096] = {};
+
+				while (Position() < offset)
+					if (!Write(zeros, (size_t)min(offset - Position(), (BlockOffset)sizeof(zeros))))
+						return false;
+
+				return Position() == offset;
+			}
+
+			// copies a range of the original file
+			bool Copy(const PEParser& pe, BlockOffset offset, BlockOffset size)
+			{
+				const size_t ChunkSize = 1024 * 1024;
+
+				while (size)
+				{
+					size_t chunk = (size_t)min(size, (BlockOffset)ChunkSize);
+					LPBYTE data = pe.Data(offset, chunk);
+					if (!data || !Write(data, chunk))
+						return false;
+
+					offset += chunk;
+					size -= chunk;
+				}
+
+				return true;
+			}
+
+			// stores checksum of everything written so far at given offset, has to be the last call
+			bool Finish(size_t checksumOffset)
+			{
+				DWORD value = m_checksum.Value();
+
+				LARGE_INTEGER position;
+				position.QuadPart = checksumOffset;
+
+				DWORD written = 0;
+				return SetFilePointerEx(m_file, position, NULL, FILE_BEGIN) && WriteFile(m_file, &value, sizeof(value), &written, NULL) && written == sizeof(value);
+			}
+
+		private:
+			HANDLE m_file = INVALID_HANDLE_VALUE;
+			PEChecksum m_checksum;
+		};
+	}
+
+	bool ResourceKey::Parse(const std::wstring& component, ResourceKey& key)
+	{
+		if (component.empty())
+			return false;
+
+		if (component[0] == L'@')
+		{
+			if (component.size() == 1 || component.size() > MAXWORD)
+				return false;
+
+			key = ResourceKey(component.substr(1));
+			return true;
+		}
+
+		if (component.size() > 5 || component.find_first_not_of(L"0123456789") != std::wstring::npos)
+			return false;
+
+		unsigned long id = std::stoul(component);
+		if (id > MAXWORD)
+			return false;
+
+		key = ResourceKey((WORD)id);
+		return true;
+	}
+
+	bool ResourceKey::operator <(const ResourceKey& k) const
+	{
+		if (IsNamed() != k.IsNamed())
+			return IsNamed();
+
+		if (!IsNamed())
+			return id < k.id;
+
+		return std::lexicographical_compare(name.begin(), name.end(), k.name.begin(), k.name.end(), [](wchar_t c1, wchar_t c2)
+		{
+			return towupper(c1) < towupper(c2);
+		});
+	}
+
+	bool ResourceSectionBuilder::Load(const PEParser& pe)
+	{
+		m_root = Node();
+
+		if (!pe.IsValidPE())
+			return false;
+
+		if (pe.ResourceDirectory())
+			return Load(pe, pe.ResourceDirectory(), m_root);
+
+		return true;
+	}
+
+	bool ResourceSectionBuilder::Load(const PEParser& pe, const ResourceEntryPtr& entry, Node& node)
+	{
+		for (auto& child : entry->Entries())
+		{
+			ResourceKey key;
+			if (!ResourceKey::Parse(child->Name(), key))
+				continue;
+
+			Node& target = node.children[key];
+
+			if (child->IsData())
+			{
+				target.isData = true;
+				target.codePage = child->CodePage();
+
+				// data that doesn't fit in the file can't be carried over into the new section
+				LPBYTE data = pe.Data(child->FileOffset(), child->Size());
+				if (!data)
+					return false;
+
+				target.data.assign(data, data + child->Size());
+			}
+			else if (!Load(pe, child, target))
+				return false;
+		}
+
+		return true;
+	}
+
+	bool ResourceSectionBuilder::SplitPath(const std::wstring& path, std::vector<ResourceKey>& keys)
+	{
+		std::vector<std::wstring> components;
+		boost::split(components, path, boost::is_any_of(L"/"));
+
+		for (auto& component : components)
+		{
+			if (component.empty())
+				continue;
+
+			ResourceKey key;
+			if (!ResourceKey::Parse(component, key))
+				return false;
+
+			keys.push_back(key);
+		}
+
+		return !keys.empty();
+	}
+
+	bool ResourceSectionBuilder::Set(const std::wstring& path, const void* data, size_t size)
+	{
+		std::vector<ResourceKey> keys;
+		if (!SplitPath(path, keys) || size > MAXDWORD)
+			return false;
+
+		Node* node = &m_root;
+		for (auto& key : keys)
+		{
+			if (node->isData)
+				return false;
+
+			node = &node->children[key];
+		}
+
+		if (!node->children.empty())
+			return false;
+
+		node->isData = true;
+		node->data.assign((const BYTE*)data, (const BYTE*)data + size);
+
+		return true;
+	}
+
+	bool ResourceSectionBuilder::Delete(const std::wstring& path)
+	{
+		std::vector<ResourceKey> keys;
+		if (!SplitPath(path, keys))
+			return false;
+
+		return Delete(m_root, keys, 0);
+	}
+
+	bool ResourceSectionBuilder::Delete(Node& node, const std::vector<ResourceKey>& keys, size_t depth)
+	{
+		auto child = node.children.find(keys[depth]);
+		if (child == node.children.end())
+			return false;
+
+		if (depth + 1 < keys.size())
+		{
+			if (!Delete(child->second, keys, depth + 1))
+				return false;
+
+			// directories left without entries are dropped as well
+			if (!child->second.children.empty() || child->second.isData)
+				return true;
+		}
+
+		node.children.erase(child);
+		return true;
+	}
+
+	bool ResourceSectionBuilder::Contains(const std::wstring& path) const
+	{
+		std::vector<ResourceKey> keys;
+		if (!SplitPath(path, keys))
+			return false;
+
+		const Node* node = &m_root;
+		for (auto& key : keys)
+		{
+			auto child = node->children.find(key);
+			if (child == node->children.end())
+				return false;
+
+			node = &child->second;
+		}
+
+		return true;
+	}
+
+	ResourceSectionBuilder::Layout ResourceSectionBuilder::Measure() const
+	{
+		Layout layout;
+
+		std::vector<const Node*> pending(1, &m_root);
+		while (!pending.empty())
+		{
+			const Node* node = pending.back();
+			pending.pop_back();
+
+			layout.directories += sizeof(IMAGE_RESOURCE_DIRECTORY) + (DWORD)node->children.size() * sizeof(IMAGE_RESOURCE_DIRECTORY_ENTRY);
+
+			for (auto& child : node->children)
+			{
+				if (child.first.IsNamed())
+					layout.names += sizeof(WORD) + (DWORD)child.first.name.size() * sizeof(WORD);
+
+				if (child.second.isData)
+				{
+					layout.dataEntries += sizeof(IMAGE_RESOURCE_DATA_ENTRY);
+					layout.data += Align((DWORD)child.second.data.size(), DataAlignment);
+				}
+				else
+					pending.push_back(&child.second);
+			}
+		}
+
+		layout.names = Align(layout.names, DataAlignment);
+
+		return layout;
+	}
+
+	size_t ResourceSectionBuilder::SerializedSize() const
+	{
+		return Measure().Total();
+	}
+
+	std::vector<BYTE> ResourceSectionBuilder::Serialize(DWORD sectionRva) const
+	{
+		// directories (breadth first), then data entries, then names, then data, the order linker uses
+		Layout layout = Measure();
+		std::vector<BYTE> section(layout.Total(), 0);
+
+		DWORD nextDirectory = sizeof(IMAGE_RESOURCE_DIRECTORY) + (DWORD)m_root.children.size() * sizeof(IMAGE_RESOURCE_DIRECTORY_ENTRY);
+		DWORD nextDataEntry = layout.directories;
+		DWORD nextName = layout.directories + layout.dataEntries;
+		DWORD nextData = nextName + layout.names;
+
+		std::vector<std::pair<const Node*, DWORD>> queue(1, std::make_pair(&m_root, (DWORD)0));
+		for (size_t i = 0; i < queue.size(); ++i)
+		{
+			const Node& node = *queue[i].first;
+
+			PIMAGE_RESOURCE_DIRECTORY directory = (PIMAGE_RESOURCE_DIRECTORY)&section[queue[i].second];
+			// entries are written as raw name/offset pairs, the header's bitfield layout doesn't matter then
+			DWORD* entry = (DWORD*)(directory + 1);
+
+			for (auto& child : node.children)
+			{
+				if (child.first.IsNamed())
+				{
+					++directory->NumberOfNamedEntries;
+
+					// length followed by UTF-16 characters, written one by one so wchar_t size doesn't matter
+					WORD* name = (WORD*)&section[nextName];
+					*name = (WORD)child.first.name.size();
+					for (size_t c = 0; c < child.first.name.size(); ++c)
+						name[c + 1] = (WORD)child.first.name[c];
+
+					entry[0] = IMAGE_RESOURCE_NAME_IS_STRING | nextName;
+					nextName += sizeof(WORD) + (DWORD)child.first.name.size() * sizeof(WORD);
+				}
+				else
+				{
+					++directory->NumberOfIdEntries;
+					entry[0] = child.first.id;
+				}
+
+				if (child.second.isData)
+				{
+					PIMAGE_RESOURCE_DATA_ENTRY data = (PIMAGE_RESOURCE_DATA_ENTRY)&section[nextDataEntry];
+					data->OffsetToData = sectionRva + nextData;
+					data->Size = (DWORD)child.second.data.size();
+					data->CodePage = child.second.codePage;
+
+					if (!child.second.data.empty())
+						memcpy(&section[nextData], &child.second.data[0], child.second.data.size());
+
+					entry[1] = nextDataEntry;
+					nextDataEntry += sizeof(IMAGE_RESOURCE_DATA_ENTRY);
+					nextData += Align(data->Size, DataAlignment);
+				}
+				else
+				{
+					queue.push_back(std::make_pair(&child.second, nextDirectory));
+
+					entry[1] = IMAGE_RESOURCE_DATA_IS_DIRECTORY | nextDirectory;
+					nextDirectory += sizeof(IMAGE_RESOURCE_DIRECTORY) + (DWORD)child.second.children.size() * sizeof(IMAGE_RESOURCE_DIRECTORY_ENTRY);
+				}
+
+				entry += 2;
+			}
+		}
+
+		return section;
+	}
+
+	bool ResourceSectionBuilder::Write(const PEParser& pe, const std::wstring& output) const
+	{
+		if (!pe.IsValidPE())
+			return false;
+
+		// headers are modified in memory and written first
+		LPBYTE dosHeader = pe.Data(0, sizeof(IMAGE_DOS_HEADER));
+		if (!dosHeader)
+			return false;
+
+		LONG ntOffset = ((PIMAGE_DOS_HEADER)dosHeader)->e_lfanew;
+		LPBYTE ntProbe = (ntOffset >= 0) ? pe.Data(ntOffset, sizeof(IMAGE_NT_HEADERS)) : NULL;
+		if (!ntProbe)
+			return false;
+
+		DWORD sizeOfHeaders = ((PIMAGE_NT_HEADERS)ntProbe)->OptionalHeader.SizeOfHeaders;
+		LPBYTE source = pe.Data(0, sizeOfHeaders);
+		if (!source || (size_t)ntOffset + sizeof(IMAGE_NT_HEADERS) > sizeOfHeaders)
+			return false;
+
+		std::vector<BYTE> headers(source, source + sizeOfHeaders);
+
+		PIMAGE_NT_HEADERS ntHeaders = (PIMAGE_NT_HEADERS)&headers[ntOffset];
+		PIMAGE_SECTION_HEADER sections = IMAGE_FIRST_SECTION(ntHeaders);
+		WORD sectionCount = ntHeaders->FileHeader.NumberOfSections;
+		size_t sectionTableEnd = (LPBYTE)(sections + sectionCount) - &headers[0];
+		if (sectionTableEnd > headers.size())
+			return false;
+
+		bool pe32Plus = pe.Is64Bit();
+		PIMAGE_DATA_DIRECTORY directories = (pe32Plus)
+			? ((PIMAGE_OPTIONAL_HEADER64)&ntHeaders->OptionalHeader)->DataDirectory
+			: ((PIMAGE_OPTIONAL_HEADER32)&ntHeaders->OptionalHeader)->DataDirectory;
+		DWORD directoryCount = (pe32Plus)
+			? ((PIMAGE_OPTIONAL_HEADER64)&ntHeaders->OptionalHeader)->NumberOfRvaAndSizes
+			: ((PIMAGE_OPTIONAL_HEADER32)&ntHeaders->OptionalHeader)->NumberOfRvaAndSizes;
+		if (directoryCount <= IMAGE_DIRECTORY_ENTRY_BASERELOC)
+		{
+			std::wcerr << L"Too few data directories." << std::endl;
+			return false;
+		}
+
+		// alignment, size and checksum fields are at the same offsets in 32 and 64 bit optional headers
+		DWORD fileAlignment = ntHeaders->OptionalHeader.FileAlignment;
+		DWORD sectionAlignment = ntHeaders->OptionalHeader.SectionAlignment;
+		DWORD entryPoint = ntHeaders->OptionalHeader.AddressOfEntryPoint;
+
+		std::vector<IMAGE_SECTION_HEADER> original(sections, sections + sectionCount);
+
+		DWORD firstRawData = MAXDWORD;
+		BlockOffset rawEnd = sizeOfHeaders;
+		for (auto& section : original)
+		{
+			if (!section.SizeOfRawData)
+				continue;
+
+			firstRawData = min(firstRawData, section.PointerToRawData);
+			rawEnd = max(rawEnd, (BlockOffset)section.PointerToRawData + section.SizeOfRawData);
+		}
+		if (firstRawData == MAXDWORD)
+			firstRawData = sizeOfHeaders;
+		rawEnd = min(rawEnd, pe.FileSize());
+
+		if (firstRawData < sizeOfHeaders)
+		{
+			std::wcerr << L"Section data overlaps headers." << std::endl;
+			return false;
+		}
+
+		DWORD size = (DWORD)SerializedSize();
+
+		// section that holds resources now, only reused if resources start right at its beginning
+		int resource = -1;
+		DWORD resourceRva = directories[IMAGE_DIRECTORY_ENTRY_RESOURCE].VirtualAddress;
+		for (WORD i = 0; i < sectionCount && resourceRva; ++i)
+			if (sections[i].VirtualAddress == resourceRva && sections[i].SizeOfRawData)
+				resource = i;
+
+		enum { InPlace, Grow, Append } placement = Append;
+
+		// linkers may merge resources with other data (relocations, merged sections), the rest of such section stays as is
+		DWORD oldSize = directories[IMAGE_DIRECTORY_ENTRY_RESOURCE].Size;
+		bool shared = resource >= 0 && oldSize < VirtualSize(sections[resource]);
+
+		if (resource >= 0)
+		{
+			// what is left up to the next section in memory
+			DWORD room = sections[resource].SizeOfRawData;
+			bool onlyRelocationsFollow = true;
+
+			for (WORD i = 0; i < sectionCount; ++i)
+			{
+				// growing in file must not run into a section that stays where it is
+				if (sections[i].VirtualAddress < resourceRva && sections[i].SizeOfRawData && sections[i].PointerToRawData > sections[resource].PointerToRawData)
+					onlyRelocationsFollow = false;
+
+				if (sections[i].VirtualAddress <= resourceRva)
+					continue;
+
+				room = min(room, sections[i].VirtualAddress - resourceRva);
+
+				// relocations are only referenced from the directory, such section can move
+				// anything else might be referenced from code
+				if (sections[i].SizeOfRawData && sections[i].PointerToRawData < sections[resource].PointerToRawData)
+					onlyRelocationsFollow = false;
+				if (SectionContains(sections[i], entryPoint))
+					onlyRelocationsFollow = false;
+
+				for (DWORD d = 0; d < directoryCount; ++d)
+					if (d != IMAGE_DIRECTORY_ENTRY_BASERELOC && d != IMAGE_DIRECTORY_ENTRY_SECURITY && directories[d].Size && SectionContains(sections[i], directories[d].VirtualAddress))
+						onlyRelocationsFollow = false;
+			}
+
+			if (shared)
+				room = min(room, oldSize);
+
+			if (size <= room)
+				placement = InPlace;
+			else if (onlyRelocationsFollow && !shared)
+				placement = Grow;
+		}
+
+		if (placement == Append)
+		{
+			if (!ClaimSectionHeaderSlot(headers, sectionTableEnd, directories, directoryCount))
+			{
+				std::wcerr << L"Resources don't fit into existing section and there is no room for a new section header." << std::endl;
+				return false;
+			}
+
+			DWORD virtualEnd = 0;
+			for (WORD i = 0; i < sectionCount; ++i)
+				virtualEnd = max(virtualEnd, sections[i].VirtualAddress + VirtualSize(sections[i]));
+
+			IMAGE_SECTION_HEADER& section = sections[sectionCount];
+			ZeroMemory(&section, sizeof(section));
+			memcpy(section.Name, ".rsrc", 5);
+			section.VirtualAddress = Align(virtualEnd, sectionAlignment);
+			section.PointerToRawData = Align((DWORD)rawEnd, fileAlignment);
+			section.Characteristics = (resource >= 0) ? sections[resource].Characteristics : IMAGE_SCN_CNT_INITIALIZED_DATA | IMAGE_SCN_MEM_READ;
+
+			resource = sectionCount++;
+			ntHeaders->FileHeader.NumberOfSections = sectionCount;
+			original.push_back(section);
+		}
+
+		IMAGE_SECTION_HEADER& rsrc = sections[resource];
+		DWORD oldRawSize = (placement == Append) ? 0 : rsrc.SizeOfRawData;
+		bool keepRest = placement == InPlace && shared;
+
+		if (!keepRest)
+			rsrc.Misc.VirtualSize = size;
+		if (placement != InPlace)
+			rsrc.SizeOfRawData = Align(size, fileAlignment);
+
+		if (placement == Grow)
+		{
+			// sections after resources move up in memory and in file, keeping their order
+			std::vector<WORD> following;
+			for (WORD i = 0; i < sectionCount; ++i)
+				if (sections[i].VirtualAddress > rsrc.VirtualAddress)
+					following.push_back(i);
+
+			std::sort(following.begin(), following.end(), [&](WORD i1, WORD i2) { return sections[i1].VirtualAddress < sections[i2].VirtualAddress; });
+
+			DWORD nextRva = Align(rsrc.VirtualAddress + size, sectionAlignment);
+			DWORD nextRaw = rsrc.PointerToRawData + rsrc.SizeOfRawData;
+			PIMAGE_DATA_DIRECTORY relocations = &directories[IMAGE_DIRECTORY_ENTRY_BASERELOC];
+
+			for (auto i : following)
+			{
+				IMAGE_SECTION_HEADER& section = sections[i];
+
+				if (relocations->Size && SectionContains(original[i], relocations->VirtualAddress))
+					relocations->VirtualAddress += nextRva - section.VirtualAddress;
+
+				section.VirtualAddress = nextRva;
+				if (section.SizeOfRawData)
+				{
+					section.PointerToRawData = nextRaw;
+					nextRaw += section.SizeOfRawData;
+				}
+
+				nextRva = Align(section.VirtualAddress + VirtualSize(section), sectionAlignment);
+			}
+		}
+
+		DWORD imageEnd = 0;
+		for (WORD i = 0; i < sectionCount; ++i)
+			imageEnd = max(imageEnd, sections[i].VirtualAddress + VirtualSize(sections[i]));
+
+		ntHeaders->OptionalHeader.SizeOfImage = Align(imageEnd, sectionAlignment);
+		ntHeaders->OptionalHeader.SizeOfInitializedData += rsrc.SizeOfRawData - oldRawSize;
+		ntHeaders->OptionalHeader.CheckSum = 0;
+
+		directories[IMAGE_DIRECTORY_ENTRY_RESOURCE].VirtualAddress = rsrc.VirtualAddress;
+		directories[IMAGE_DIRECTORY_ENTRY_RESOURCE].Size = size;
+
+		// certificate table is addressed by file offset and is dropped, signature would not be valid anyway
+		BlockOffset certificates = directories[IMAGE_DIRECTORY_ENTRY_SECURITY].VirtualAddress;
+		BlockOffset certificatesSize = directories[IMAGE_DIRECTORY_ENTRY_SECURITY].Size;
+		directories[IMAGE_DIRECTORY_ENTRY_SECURITY].VirtualAddress = 0;
+		directories[IMAGE_DIRECTORY_ENTRY_SECURITY].Size = 0;
+
+		std::vector<BYTE> resources = Serialize(rsrc.VirtualAddress);
+		if (keepRest)
+		{
+			// original section with the old directory cleared and the new one written over it
+			std::vector<BYTE> section(rsrc.SizeOfRawData, 0);
+			BlockOffset available = (rsrc.PointerToRawData < pe.FileSize()) ? min((BlockOffset)rsrc.SizeOfRawData, pe.FileSize() - rsrc.PointerToRawData) : 0;
+			if (available)
+			{
+				LPBYTE data = pe.Data(rsrc.PointerToRawData, (size_t)available);
+				if (!data)
+					return false;
+				memcpy(&section[0], data, (size_t)available);
+			}
+
+			memset(&section[0], 0, min(oldSize, rsrc.SizeOfRawData));
+			memcpy(&section[0], &resources[0], resources.size());
+			resources.swap(section);
+		}
+		else
+			resources.resize(rsrc.SizeOfRawData, 0);
+
+		ImageWriter writer(output);
+		if (!writer.IsOpen())
+		{
+			std::wcerr << L"Failed to create file: " << output << L". " << GetLastError() << std::endl;
+			return false;
+		}
+
+		// headers, then whatever was stored between headers and sections
+		if (!writer.Write(&headers[0], headers.size()) || !writer.Copy(pe, sizeOfHeaders, firstRawData - sizeOfHeaders))
+			return false;
+
+		std::vector<WORD> order;
+		for (WORD i = 0; i < sectionCount; ++i)
+			if (sections[i].SizeOfRawData)
+				order.push_back(i);
+
+		std::sort(order.begin(), order.end(), [&](WORD i1, WORD i2) { return sections[i1].PointerToRawData < sections[i2].PointerToRawData; });
+
+		for (auto i : order)
+		{
+			if (sections[i].PointerToRawData < writer.Position())
+			{
+				std::wcerr << L"Overlapping sections are not supported." << std::endl;
+				return false;
+			}
+
+			if (!writer.Pad(sections[i].PointerToRawData))
+				return false;
+
+			if (i == resource)
+			{
+				if (!writer.Write(&resources[0], resources.size()))
+					return false;
+				continue;
+			}
+
+			// last section may be truncated in the original file
+			BlockOffset available = (original[i].PointerToRawData < pe.FileSize()) ? min((BlockOffset)original[i].SizeOfRawData, pe.FileSize() - original[i].PointerToRawData) : 0;
+			if (!writer.Copy(pe, original[i].PointerToRawData, available) || !writer.Pad(writer.Position() + original[i].SizeOfRawData - available))
+				return false;
+		}
+
+		// overlay without certificates
+		BlockOffset overlay = rawEnd;
+		if (certificatesSize && certificates >= overlay && certificates < pe.FileSize())
+		{
+			if (!writer.Copy(pe, overlay, certificates - overlay))
+				return false;
+			overlay = min(certificates + certificatesSize, pe.FileSize());
+		}
+
+		if (!writer.Copy(pe, overlay, pe.FileSize() - overlay))
+			return false;
+
+		return writer.Finish((LPBYTE)&ntHeaders->OptionalHeader.CheckSum - &headers[0]);
+	}
+
+	bool ResourceSectionBuilder::Commit(PEParser& pe) const
+	{
+		std::wstring path = pe.FilePath();
+		std::wstring temporary = path + L".rsrc.tmp";
+
+		bool written = Write(pe, temporary);
+		pe.Close();
+
+		if (!written)
+		{
+			std::wcerr << L"Failed to write resources: " << path << std::endl;
+			DeleteFile(temporary.c_str());
+			return false;
+		}
+
+		if (!MoveFileEx(temporary.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+		{
+			std::wcerr << L"Failed to replace file: " << path << L". " << GetLastError() << std::endl;
+			DeleteFile(temporary.c_str());
+			return false;
+		}
+
+		return true;
+	}
+}
\ No newline at end of file
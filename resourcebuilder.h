@@ -0,0 +1,96 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <windows.h>
+
+#include "resourcetable.h"
+
+#include <string>
+#include <vector>
+#include <map>
+
+namespace peparser
+{
+	class PEParser;
+
+	// key of a resource directory entry, either a name or a numeric id
+	struct ResourceKey
+	{
+		std::wstring name;
+		WORD id = 0;
+
+		ResourceKey() {}
+		ResourceKey(WORD id) : id(id) {}
+		ResourceKey(const std::wstring& name) : name(name) {}
+
+		bool IsNamed() const { return !name.empty(); }
+
+		// "@NAME" or decimal id, same form ResourceEntry::Name() uses, false if component is neither
+		static bool Parse(const std::wstring& component, ResourceKey& key);
+
+		// order required by the format: named entries first (case insensitive), then ids ascending
+		bool operator <(const ResourceKey& k) const;
+	};
+
+	// in-memory copy of a resource tree that can be modified and written back as a new .rsrc section
+	// all edits are kept in memory until Commit(), which rewrites the file once: the section is written in place
+	// if it fits (into the old directory if the section holds other data too), grown if only relocations follow it,
+	// or appended as a new section otherwise,
+	// SizeOfImage, data directories and checksum are fixed up and the certificate table is dropped
+	// (any edit invalidates the signature anyway)
+	// unlike BeginUpdateResource() this doesn't go through the loader, section layout is produced here
+	class ResourceSectionBuilder
+	{
+	public:
+		// copies resource tree and data of an opened file
+		bool Load(const PEParser& pe);
+
+		bool IsEmpty() const { return m_root.children.empty(); }
+
+		// path is "type/name/language" in ResourceEntry::Name() form, missing directories are created
+		bool Set(const std::wstring& path, const void* data, size_t size);
+		// removes a data entry or a whole directory, directories left empty are removed too
+		// returns false if there is no such entry
+		bool Delete(const std::wstring& path);
+		bool Contains(const std::wstring& path) const;
+
+		// binary image of the section, data entries point to RVAs starting at sectionRva
+		std::vector<BYTE> Serialize(DWORD sectionRva) const;
+		size_t SerializedSize() const;
+
+		// writes the modified image to output, pe must be opened file the tree was loaded from
+		bool Write(const PEParser& pe, const std::wstring& output) const;
+		// writes to a temporary file next to the original, closes pe and replaces the original with it
+		bool Commit(PEParser& pe) const;
+
+	private:
+		struct Node
+		{
+			std::map<ResourceKey, Node> children;
+			std::vector<BYTE> data;
+			// kept from the source file, replacing data doesn't change it
+			DWORD codePage = 0;
+			bool isData = false;
+		};
+
+		Node m_root;
+
+		bool Load(const PEParser& pe, const ResourceEntryPtr& entry, Node& node);
+		static bool SplitPath(const std::wstring& path, std::vector<ResourceKey>& keys);
+		static bool Delete(Node& node, const std::vector<ResourceKey>& keys, size_t depth);
+
+		// sizes of the four parts of the section: directories, data entries, names and data
+		struct Layout
+		{
+			DWORD directories = 0;
+			DWORD dataEntries = 0;
+			DWORD names = 0;
+			DWORD data = 0;
+
+			DWORD Total() const { return directories + dataEntries + names + data; }
+		};
+		Layout Measure() const;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,329 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "resourcepatch.h"
+#include "peparser.h"
+
+#include <algorithm>
+#include <set>
+
+namespace peparser
+{
+	void ResourcePatch::PrintInfo(std::wostream& out) const
+	{
+		out << oldSize << L" -> " << newSize << L" bytes, available " << Available()
+			<< L" (padding " << padding << L", gap " << gap << L", section slack " << sectionSlack << L")";
+
+		if (fits)
+			out << ((newVirtualSize) ? L", section grows to " + std::to_wstring(newVirtualSize) : std::wstring());
+		else
+			out << L", " << reason;
+	}
+
+	ResourcePatcher::ResourcePatcher(const PEParser& pe)
+	{
+		if (ReadHeaders(pe))
+			Walk(pe);
+	}
+
+	bool ResourcePatcher::ReadHeaders(const PEParser& pe)
+	{
+		if (!pe.IsValidPE())
+		{
+			m_error = L"not a valid PE file";
+			return false;
+		}
+
+		LPBYTE dosHeader = pe.Data(0, sizeof(IMAGE_DOS_HEADER));
+		LONG ntOffset = (dosHeader) ? ((PIMAGE_DOS_HEADER)dosHeader)->e_lfanew : -1;
+		PIMAGE_NT_HEADERS ntHeaders = (ntOffset >= 0) ? (PIMAGE_NT_HEADERS)pe.Data(ntOffset, sizeof(IMAGE_NT_HEADERS)) : NULL;
+		if (!ntHeaders)
+		{
+			m_error = L"can't read headers";
+			return false;
+		}
+
+		PIMAGE_DATA_DIRECTORY directories = (pe.Is64Bit())
+			? ((PIMAGE_OPTIONAL_HEADER64)&ntHeaders->OptionalHeader)->DataDirectory
+			: ((PIMAGE_OPTIONAL_HEADER32)&ntHeaders->OptionalHeader)->DataDirectory;
+		DWORD directoryCount = (pe.Is64Bit())
+			? ((PIMAGE_OPTIONAL_HEADER64)&ntHeaders->OptionalHeader)->NumberOfRvaAndSizes
+			: ((PIMAGE_OPTIONAL_HEADER32)&ntHeaders->OptionalHeader)->NumberOfRvaAndSizes;
+
+		if (directoryCount <= IMAGE_DIRECTORY_ENTRY_RESOURCE || !directories[IMAGE_DIRECTORY_ENTRY_RESOURCE].VirtualAddress)
+		{
+			m_error = L"file has no resources";
+			return false;
+		}
+
+		m_directoryRva = directories[IMAGE_DIRECTORY_ENTRY_RESOURCE].VirtualAddress;
+		m_directorySize = directories[IMAGE_DIRECTORY_ENTRY_RESOURCE].Size;
+		m_directoryEntryOffset = ntOffset + (BlockOffset)((LPBYTE)&directories[IMAGE_DIRECTORY_ENTRY_RESOURCE] - (LPBYTE)ntHeaders);
+		m_sectionAlignment = ntHeaders->OptionalHeader.SectionAlignment;
+		m_sizeOfImageOffset = ntOffset + (BlockOffset)((LPBYTE)&ntHeaders->OptionalHeader.SizeOfImage - (LPBYTE)ntHeaders);
+
+		WORD sectionCount = ntHeaders->FileHeader.NumberOfSections;
+		BlockOffset sectionTable = ntOffset + (BlockOffset)((LPBYTE)IMAGE_FIRST_SECTION(ntHeaders) - (LPBYTE)ntHeaders);
+
+		LPBYTE table = pe.Data(sectionTable, sectionCount * sizeof(IMAGE_SECTION_HEADER));
+		if (!table)
+		{
+			m_error = L"can't read section table";
+			return false;
+		}
+
+		std::vector<IMAGE_SECTION_HEADER> sections((PIMAGE_SECTION_HEADER)table, (PIMAGE_SECTION_HEADER)table + sectionCount);
+
+		int resource = -1;
+		for (WORD i = 0; i < sectionCount; ++i)
+		{
+			DWORD virtualSize = (sections[i].Misc.VirtualSize) ? sections[i].Misc.VirtualSize : sections[i].SizeOfRawData;
+			if (m_directoryRva >= sections[i].VirtualAddress && m_directoryRva - sections[i].VirtualAddress < virtualSize)
+				resource = i;
+		}
+
+		if (resource < 0)
+		{
+			m_error = L"resources are not in a section";
+			return false;
+		}
+
+		m_sectionRva = sections[resource].VirtualAddress;
+		m_virtualSize = (sections[resource].Misc.VirtualSize) ? sections[resource].Misc.VirtualSize : sections[resource].SizeOfRawData;
+		m_rawSize = sections[resource].SizeOfRawData;
+		m_rawOffset = sections[resource].PointerToRawData;
+		m_sectionHeaderOffset = sectionTable + resource * sizeof(IMAGE_SECTION_HEADER);
+
+		// virtual size can only grow over alignment slack, up to the next section
+		m_maxVirtualSize = MAXDWORD;
+		for (auto& section : sections)
+			if (section.VirtualAddress > m_sectionRva)
+				m_maxVirtualSize = min(m_maxVirtualSize, section.VirtualAddress - m_sectionRva);
+
+		return true;
+	}
+
+	void ResourcePatcher::Walk(const PEParser& pe)
+	{
+		// type/name/language, anything much deeper is a loop in a corrupted table
+		const size_t maxDepth = 8;
+
+		std::vector<std::pair<DWORD, size_t>> pending(1, std::make_pair((DWORD)0, (size_t)0));
+		std::set<DWORD> visited;
+
+		while (!pending.empty())
+		{
+			DWORD offset = pending.back().first;
+			size_t depth = pending.back().second;
+			pending.pop_back();
+
+			if (depth > maxDepth || !visited.insert(offset).second)
+				continue;
+
+			DWORD rva = m_directoryRva + offset;
+			LPBYTE header = (InSection(rva, sizeof(IMAGE_RESOURCE_DIRECTORY))) ? pe.Data(FileOffset(rva), sizeof(IMAGE_RESOURCE_DIRECTORY)) : NULL;
+			if (!header)
+				continue;
+
+			DWORD count = ((PIMAGE_RESOURCE_DIRECTORY)header)->NumberOfNamedEntries + ((PIMAGE_RESOURCE_DIRECTORY)header)->NumberOfIdEntries;
+			DWORD size = sizeof(IMAGE_RESOURCE_DIRECTORY) + count * sizeof(IMAGE_RESOURCE_DIRECTORY_ENTRY);
+
+			LPBYTE directory = (InSection(rva, size)) ? pe.Data(FileOffset(rva), size) : NULL;
+			if (!directory)
+				continue;
+
+			m_occupied.push_back(Range(rva, size));
+
+			// name/offset pairs, copied because every Data() call may invalidate previous pointers
+			std::vector<DWORD> entries((DWORD*)(directory + sizeof(IMAGE_RESOURCE_DIRECTORY)), (DWORD*)(directory + size));
+
+			for (DWORD i = 0; i < count; ++i)
+			{
+				DWORD name = entries[2 * i];
+				DWORD target = entries[2 * i + 1];
+
+				if (name & IMAGE_RESOURCE_NAME_IS_STRING)
+				{
+					DWORD nameRva = m_directoryRva + (name & ~IMAGE_RESOURCE_NAME_IS_STRING);
+					LPBYTE length = (InSection(nameRva, sizeof(WORD))) ? pe.Data(FileOffset(nameRva), sizeof(WORD)) : NULL;
+					if (length)
+						m_occupied.push_back(Range(nameRva, sizeof(WORD) + *(WORD*)length * sizeof(WORD)));
+				}
+
+				if (target & IMAGE_RESOURCE_DATA_IS_DIRECTORY)
+				{
+					pending.push_back(std::make_pair(target & ~IMAGE_RESOURCE_DATA_IS_DIRECTORY, depth + 1));
+					continue;
+				}
+
+				DWORD entryRva = m_directoryRva + target;
+				LPBYTE entry = (InSection(entryRva, sizeof(IMAGE_RESOURCE_DATA_ENTRY))) ? pe.Data(FileOffset(entryRva), sizeof(IMAGE_RESOURCE_DATA_ENTRY)) : NULL;
+				if (!entry)
+					continue;
+
+				m_occupied.push_back(Range(entryRva, sizeof(IMAGE_RESOURCE_DATA_ENTRY)));
+
+				DataEntry dataEntry;
+				dataEntry.dataRva = ((PIMAGE_RESOURCE_DATA_ENTRY)entry)->OffsetToData;
+				dataEntry.fileOffset = FileOffset(entryRva);
+				m_dataEntries.push_back(dataEntry);
+
+				m_occupied.push_back(Range(dataEntry.dataRva, ((PIMAGE_RESOURCE_DATA_ENTRY)entry)->Size));
+			}
+		}
+
+		std::sort(m_occupied.begin(), m_occupied.end());
+	}
+
+	ResourcePatch ResourcePatcher::Plan(const ResourceEntryPtr& entry, size_t newSize) const
+	{
+		ResourcePatch patch;
+		patch.newSize = newSize;
+
+		if (!m_error.empty())
+		{
+			patch.reason = m_error;
+			return patch;
+		}
+
+		if (!entry || !entry->IsData())
+		{
+			patch.reason = L"not a data entry";
+			return patch;
+		}
+
+		patch.oldSize = entry->Size();
+		patch.dataOffset = entry->FileOffset();
+
+		if (patch.dataOffset < m_rawOffset || patch.dataOffset - m_rawOffset >= m_rawSize)
+		{
+			patch.reason = L"data is outside of resource section";
+			return patch;
+		}
+
+		patch.dataRva = m_sectionRva + (DWORD)(patch.dataOffset - m_rawOffset);
+
+		size_t users = 0;
+		for (auto& dataEntry : m_dataEntries)
+		{
+			if (dataEntry.dataRva != patch.dataRva)
+				continue;
+
+			patch.entryOffset = dataEntry.fileOffset;
+			++users;
+		}
+
+		if (users != 1)
+		{
+			patch.reason = (users) ? L"data is shared by several resource entries" : L"data entry not found";
+			return patch;
+		}
+
+		// VS_VERSIONINFO starts with its length, data entry may be bigger than that
+		if (patch.oldSize >= sizeof(WORD) && entry->Address())
+		{
+			WORD length = *(WORD*)entry->Address();
+			if (length && length < patch.oldSize)
+				patch.padding = patch.oldSize - length;
+		}
+
+		// usable space ends where the next structure starts, or at the end of section's raw data
+		DWORD dataEnd = patch.dataRva + (DWORD)patch.oldSize;
+		DWORD limit = m_sectionRva + m_rawSize;
+		if (m_maxVirtualSize != MAXDWORD)
+			limit = min(limit, m_sectionRva + m_maxVirtualSize);
+
+		// section holds other data after the resources (merged with relocations or other sections), only
+		// the resource directory's own space can be reused, same rule as ResourceSectionBuilder::Commit()
+		DWORD directoryEnd = m_directoryRva + m_directorySize;
+		if (directoryEnd < m_sectionRva + m_virtualSize)
+		{
+			if (dataEnd > directoryEnd)
+			{
+				patch.reason = L"data is outside of resource directory in a section shared with other data";
+				return patch;
+			}
+
+			limit = min(limit, directoryEnd);
+		}
+
+		for (auto& range : m_occupied)
+		{
+			if (range.rva > patch.dataRva)
+			{
+				limit = min(limit, range.rva);
+				break;
+			}
+		}
+
+		if (limit < dataEnd)
+		{
+			patch.reason = L"data overlaps other resource structures";
+			return patch;
+		}
+
+		// bytes past virtual size are in the file but not loaded, section has to grow to use them
+		DWORD virtualEnd = max(m_sectionRva + m_virtualSize, dataEnd);
+		patch.gap = min(limit, virtualEnd) - dataEnd;
+		patch.sectionSlack = (limit > virtualEnd) ? limit - virtualEnd : 0;
+
+		if (newSize > patch.Available())
+		{
+			patch.reason = L"needs " + std::to_wstring(newSize - patch.Available()) + L" more bytes than there is room for, resource section has to be rebuilt";
+			return patch;
+		}
+
+		if (patch.dataRva + newSize > m_sectionRva + m_virtualSize)
+			patch.newVirtualSize = patch.dataRva + (DWORD)newSize - m_sectionRva;
+
+		patch.fits = true;
+		return patch;
+	}
+
+	bool ResourcePatcher::Apply(PEParser& pe, const ResourcePatch& patch, const void* data) const
+	{
+		if (!patch.fits || !pe.IsOpenForWrite())
+			return false;
+
+		// old bytes past the new end are cleared, so the result doesn't depend on what was there
+		LPBYTE target = pe.Data(patch.dataOffset, max(patch.oldSize, patch.newSize));
+		if (!target)
+			return false;
+
+		// checksum is recomputed when the file is closed
+		pe.SetModified();
+
+		memcpy(target, data, patch.newSize);
+		if (patch.oldSize > patch.newSize)
+			memset(target + patch.newSize, 0, patch.oldSize - patch.newSize);
+
+		LPBYTE entry = pe.Data(patch.entryOffset, sizeof(IMAGE_RESOURCE_DATA_ENTRY));
+		if (!entry)
+			return false;
+
+		((PIMAGE_RESOURCE_DATA_ENTRY)entry)->Size = (DWORD)patch.newSize;
+
+		if (!patch.newVirtualSize)
+			return true;
+
+		LPBYTE section = pe.Data(m_sectionHeaderOffset, sizeof(IMAGE_SECTION_HEADER));
+		if (!section)
+			return false;
+
+		((PIMAGE_SECTION_HEADER)section)->Misc.VirtualSize = patch.newVirtualSize;
+
+		// resource directory size normally covers everything up to the end of data
+		DWORD dataEnd = patch.dataRva + (DWORD)patch.newSize;
+		LPBYTE directory = pe.Data(m_directoryEntryOffset, sizeof(IMAGE_DATA_DIRECTORY));
+		if (directory && dataEnd > m_directoryRva + m_directorySize)
+			((PIMAGE_DATA_DIRECTORY)directory)->Size = dataEnd - m_directoryRva;
+
+		// only the last section can grow past current image size
+		LPBYTE sizeOfImage = pe.Data(m_sizeOfImageOffset, sizeof(DWORD));
+		DWORD imageEnd = (m_sectionAlignment) ? (m_sectionRva + patch.newVirtualSize + m_sectionAlignment - 1) / m_sectionAlignment * m_sectionAlignment : m_sectionRva + patch.newVirtualSize;
+		if (sizeOfImage && imageEnd > *(DWORD*)sizeOfImage)
+			*(DWORD*)sizeOfImage = imageEnd;
+
+		return true;
+	}
+}
\ No newline at end of file
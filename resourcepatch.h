@@ -0,0 +1,105 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <windows.h>
+
+#include "block.h"
+#include "resourcetable.h"
+
+#include <string>
+#include <vector>
+#include <ostream>
+
+namespace peparser
+{
+	class PEParser;
+
+	// plan for writing new contents of a resource over the old ones without rebuilding the resource section
+	struct ResourcePatch
+	{
+		bool fits = false;
+		// why the new data can't be written in place
+		std::wstring reason;
+
+		// file offsets of the data and of the IMAGE_RESOURCE_DATA_ENTRY pointing to it
+		BlockOffset dataOffset = 0;
+		BlockOffset entryOffset = 0;
+		DWORD dataRva = 0;
+		size_t oldSize = 0;
+		size_t newSize = 0;
+
+		// where usable space comes from
+		// unused tail of the original data (VS_VERSIONINFO block shorter than its data entry), part of oldSize
+		size_t padding = 0;
+		// unused bytes up to the next resource structure, usually alignment of data blobs
+		size_t gap = 0;
+		// raw data past the end of section's virtual size, using it requires growing the virtual size
+		size_t sectionSlack = 0;
+
+		// new virtual size of the resource section, 0 if it doesn't change
+		DWORD newVirtualSize = 0;
+
+		size_t Available() const { return oldSize + gap + sectionSlack; }
+
+		void PrintInfo(std::wostream& out) const;
+	};
+
+	// plans and applies in-place edits of resource data
+	// space that can be taken by a resource is found by walking the raw resource directory and marking every
+	// structure in it (directories, names, data entries and data) as occupied
+	class ResourcePatcher
+	{
+	public:
+		explicit ResourcePatcher(const PEParser& pe);
+
+		ResourcePatch Plan(const ResourceEntryPtr& entry, size_t newSize) const;
+
+		// writes data and updates data entry size (and section size if needed)
+		// pe must be opened for writing, only pages holding the data and modified headers are touched
+		bool Apply(PEParser& pe, const ResourcePatch& patch, const void* data) const;
+
+	private:
+		struct Range
+		{
+			DWORD rva = 0;
+			DWORD size = 0;
+
+			Range(DWORD rva, DWORD size) : rva(rva), size(size) {}
+			bool operator <(const Range& r) const { return rva < r.rva; }
+		};
+
+		struct DataEntry
+		{
+			DWORD dataRva = 0;
+			BlockOffset fileOffset = 0;
+		};
+
+		std::wstring m_error;
+
+		// resource section
+		DWORD m_sectionRva = 0;
+		DWORD m_virtualSize = 0;
+		DWORD m_rawSize = 0;
+		DWORD m_rawOffset = 0;
+		// virtual size may grow up to this (next section or raw size)
+		DWORD m_maxVirtualSize = 0;
+		BlockOffset m_sectionHeaderOffset = 0;
+
+		DWORD m_directoryRva = 0;
+		DWORD m_directorySize = 0;
+		BlockOffset m_directoryEntryOffset = 0;
+		DWORD m_sectionAlignment = 0;
+		BlockOffset m_sizeOfImageOffset = 0;
+
+		std::vector<Range> m_occupied;
+		std::vector<DataEntry> m_dataEntries;
+
+		bool ReadHeaders(const PEParser& pe);
+		void Walk(const PEParser& pe);
+
+		BlockOffset FileOffset(DWORD rva) const { return (BlockOffset)m_rawOffset + (rva - m_sectionRva); }
+		bool InSection(DWORD rva, DWORD size) const { return rva >= m_sectionRva && rva - m_sectionRva <= m_rawSize && size <= m_rawSize - (rva - m_sectionRva); }
+	};
+}
\ No newline at end of file
@@ -11,6 +11,8 @@
 #include "peparser.h"
 
 #include <iostream>
+#include <algorithm>
+#include <cwctype>
 
 namespace peparser
 {
@@ -60,9 +62,9 @@ namespace peparser
 				if (node)
 					for (auto& entry : node->Entries())
 					{
-						if (!entry.second) continue;
-						if (entry.second->Name().size() > 0 && entry.second->Name()[0] != L'@')
-							lang_ids.push_back(std::stoi(entry.second->Name()));
+						if (!entry) continue;
+						if (!entry->Name().empty() && entry->Name()[0] != L'@')
+							lang_ids.push_back(std::stoi(entry->Name()));
 					}
 			}
 		}
@@ -74,4 +76,95 @@ namespace peparser
 
 		return true;
 	}
+
+	ResourcePattern::ResourcePattern(const std::wstring& pattern)
+	{
+		boost::split(m_components, pattern, boost::is_any_of(L"/"));
+
+		// "24/" and "/24" mean the same as "24"
+		m_components.erase(std::remove(m_components.begin(), m_components.end(), std::wstring()), m_components.end());
+	}
+
+	bool ResourcePattern::Matches(size_t depth, const std::wstring& name) const
+	{
+		if (depth == 0 || depth > m_components.size())
+			return false;
+
+		const std::wstring& component = m_components[depth - 1];
+		return Match(component.data(), component.data() + component.size(), name.data(), name.data() + name.size());
+	}
+
+	void ResourcePattern::Collect(const ResourceEntryPtr& root, std::vector<ResourceEntryPtr>& result) const
+	{
+		if (root)
+			Collect(root, 0, result);
+	}
+
+	void ResourcePattern::Collect(const ResourceEntryPtr& entry, size_t depth, std::vector<ResourceEntryPtr>& result) const
+	{
+		if (entry->IsData())
+		{
+			// data entry above the pattern depth doesn't match all of its components
+			if (depth >= m_components.size())
+				result.push_back(entry);
+			return;
+		}
+
+		for (auto& child : entry->Entries())
+		{
+			// past the end of the pattern everything below a matched directory is taken
+			if (depth < m_components.size() && !Matches(depth + 1, child->Name()))
+				continue;
+
+			Collect(child, depth + 1, result);
+		}
+	}
+
+	bool ResourcePattern::Match(const wchar_t* pattern, const wchar_t* patternEnd, const wchar_t* name, const wchar_t* nameEnd)
+	{
+		// position after the last '*' and the name position it was tried at, to backtrack to
+		const wchar_t* star = nullptr;
+		const wchar_t* retry = nullptr;
+
+		while (name != nameEnd)
+		{
+			if (pattern != patternEnd && *pattern == L'*')
+			{
+				star = ++pattern;
+				retry = name;
+			}
+			else if (pattern != patternEnd && (*pattern == L'?' || towupper(*pattern) == towupper(*name)))
+			{
+				++pattern;
+				++name;
+			}
+			else if (star)
+			{
+				pattern = star;
+				name = ++retry;
+			}
+			else
+				return false;
+		}
+
+		while (pattern != patternEnd && *pattern == L'*')
+			++pattern;
+
+		return pattern == patternEnd;
+	}
+
+	std::wstring ResourceFilePath(const std::wstring& resourcePath)
+	{
+		std::wstring result = resourcePath;
+
+		for (auto& c : result)
+		{
+			if (c == L'/')
+				c = L'\\';
+			else if (c < 32 || wcschr(L"<>:\"\\|?*", c))
+				c = L'_';
+		}
+
+		return result;
+	}
 }
\ No newline at end of file
@@ -7,6 +7,8 @@
 #include <string>
 #include <vector>
 
+#include "resourcetable.h"
+
 namespace peparser
 {
 	class ResourcePathElement
@@ -47,4 +49,31 @@ namespace peparser
 	// if allLanguages is set to true or resourcePath string didn't specify a language ("type/name"), lang_ids will contain a list of all available languages for the resource
 	// writes to std::cerr
 	bool ParsePath(const std::wstring& binaryPath, const std::wstring& resourcePath, ResourcePath& path, std::vector<WORD>& lang_ids, bool& allLanguages);
+
+	// glob pattern for resource paths ("24/*/*", "@TYPELIB/*", "16/1/10?3")
+	// '*' matches any part of a single path component, '?' matches one character, '/' separates components
+	// named components are compared case insensitively, same as ResourceEntry::AtPath
+	class ResourcePattern
+	{
+	public:
+		explicit ResourcePattern(const std::wstring& pattern);
+
+		size_t Depth() const { return m_components.size(); }
+
+		// checks name of an entry at given depth (1 for types, 2 for names, 3 for languages)
+		bool Matches(size_t depth, const std::wstring& name) const;
+
+		// data entries matching the pattern, directories that match contribute all data entries below them
+		void Collect(const ResourceEntryPtr& root, std::vector<ResourceEntryPtr>& result) const;
+
+	private:
+		std::vector<std::wstring> m_components;
+
+		void Collect(const ResourceEntryPtr& entry, size_t depth, std::vector<ResourceEntryPtr>& result) const;
+		static bool Match(const wchar_t* pattern, const wchar_t* patternEnd, const wchar_t* name, const wchar_t* nameEnd);
+	};
+
+	// turns resource path into a relative file path, one directory per component
+	// characters that are not allowed in file names are replaced with '_'
+	std::wstring ResourceFilePath(const std::wstring& resourcePath);
 }
\ No newline at end of file
@@ -0,0 +1,126 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "resourcestore.h"
+#include "peparser.h"
+#include "resourcepath.h"
+#include "widestring.h"
+#include "hash.h"
+
+#include <vector>
+
+namespace peparser
+{
+	namespace
+	{
+		bool CreateDirectoryIfMissing(const std::wstring& path)
+		{
+			return CreateDirectory(path.c_str(), NULL) || GetLastError() == ERROR_ALREADY_EXISTS;
+		}
+	}
+
+	bool ResourceStore::Create(std::wstring& error) const
+	{
+		if (!CreateDirectoryIfMissing(m_root) || !CreateDirectoryIfMissing(m_root + L"\\objects"))
+		{
+			error = L"Failed to create store directory: " + m_root;
+			return false;
+		}
+
+		return true;
+	}
+
+	std::wstring ResourceStore::ObjectPath(const std::wstring& hash) const
+	{
+		return m_root + L"\\objects\\" + hash.substr(0, 2) + L"\\" + hash.substr(2);
+	}
+
+	bool ResourceStore::Add(const PEParser& pe, std::string& index, size_t& added, std::wstring& error) const
+	{
+		index.clear();
+		added = 0;
+
+		// every data entry in the tree
+		std::vector<ResourceEntryPtr> entries;
+		ResourcePattern(L"*").Collect(pe.ResourceDirectory(), entries);
+
+		std::wstring lines;
+		for (auto& entry : entries)
+		{
+			// the same bounds checked buffer is hashed and stored
+			LPBYTE data = pe.Data(entry->FileOffset(), entry->Size());
+			if (!data)
+			{
+				error = L"Resource data is outside of the file: " + entry->FullPath();
+				return false;
+			}
+
+			Hash hash(HashAlgorithm::Sha256);
+			if (!hash.Update(data, entry->Size()))
+			{
+				error = L"Failed to hash " + entry->FullPath();
+				return false;
+			}
+
+			std::wstring digest = Hash::ToHex(hash.Finish());
+			if (digest.empty())
+			{
+				error = L"Failed to hash " + entry->FullPath();
+				return false;
+			}
+
+			bool isNew = false;
+			if (!Store(data, entry->Size(), digest, isNew, error))
+				return false;
+
+			if (isNew)
+				++added;
+
+			lines += digest + L"\t" + std::to_wstring(entry->Size()) + L"\t" + entry->FullPath() + L"\n";
+		}
+
+		index = WideStringToUtf8(lines);
+		return true;
+	}
+
+	bool ResourceStore::Store(const void* data, size_t size, const std::wstring& hash, bool& added, std::wstring& error) const
+	{
+		added = false;
+
+		std::wstring path = ObjectPath(hash);
+
+		// most objects are already there after the first build
+		if (GetFileAttributes(path.c_str()) != INVALID_FILE_ATTRIBUTES)
+			return true;
+
+		if (!CreateDirectoryIfMissing(m_root + L"\\objects\\" + hash.substr(0, 2)))
+		{
+			error = L"Failed to create directory for " + path;
+			return false;
+		}
+
+		// another thread or process may be storing the same object, whoever renames first wins
+		std::wstring temporary = path + L"." + std::to_wstring(GetCurrentProcessId()) + L"." + std::to_wstring(GetCurrentThreadId()) + L".tmp";
+		if (!SaveData(temporary, data, size))
+		{
+			DeleteFile(temporary.c_str());
+			error = L"Failed to write " + temporary;
+			return false;
+		}
+
+		if (!MoveFileEx(temporary.c_str(), path.c_str(), 0))
+		{
+			DWORD lastError = GetLastError();
+			DeleteFile(temporary.c_str());
+
+			if (lastError == ERROR_ALREADY_EXISTS || lastError == ERROR_FILE_EXISTS)
+				return true;
+
+			error = L"Failed to write " + path;
+			return false;
+		}
+
+		added = true;
+		return true;
+	}
+}
\ No newline at end of file
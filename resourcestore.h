@@ -0,0 +1,40 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <windows.h>
+
+#include <string>
+
+#include "resourcetable.h"
+
+namespace peparser
+{
+	class PEParser;
+
+	// content addressed store of resource data: every data entry is kept once as objects\<2 hex digits>\<rest of SHA-256>,
+	// no matter how many binaries or builds contain it
+	// a binary is described by an index: one UTF-8 line per data entry, "<SHA-256>\t<size>\t<resource path>",
+	// in resource directory order, so indexes of two builds can be diffed directly
+	// safe to use from several threads and processes at once, objects are written to a temporary file and renamed into place
+	class ResourceStore
+	{
+	public:
+		explicit ResourceStore(const std::wstring& root) : m_root(root) {}
+
+		// creates objects directory if needed
+		bool Create(std::wstring& error) const;
+
+		// stores all data entries of an open binary that are not in the store yet
+		// index receives the index of the binary, added the number of objects that were new
+		bool Add(const PEParser& pe, std::string& index, size_t& added, std::wstring& error) const;
+
+		std::wstring ObjectPath(const std::wstring& hash) const;
+
+	private:
+		std::wstring m_root;
+
+		bool Store(const void* data, size_t size, const std::wstring& hash, bool& added, std::wstring& error) const;
+	};
+}
\ No newline at end of file
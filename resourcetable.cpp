@@ -2,51 +2,227 @@
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 
 #include "resourcetable.h"
+#include "peparser.h"
 
 #include <iomanip>
+#include <algorithm>
+#include <cwctype>
 
 namespace peparser
 {
-	ResourceEntryPtr ResourceEntry::AtPath(const std::wstring& path) const
+	ResourceIndex::ResourceIndex()
 	{
-		if (IsData() || Entries().size() == 0) 
-			return ResourceEntryPtr();
+		// root node
+		m_nodes.resize(1);
+		m_nodes[0].pathHash = Hash(0, NULL, 0, false);
+	}
 
-		size_t pos = path.find_first_of(L"/");
+	size_t ResourceIndex::Hash(size_t hash, const wchar_t* component, size_t length, bool named)
+	{
+		// FNV-1a over normalized path, components are separated by '/'
+		if (!component)
+			return 2166136261u;
 
-		std::wstring current = path.substr(0, pos);
+		hash = (hash ^ L'/') * 16777619u;
+		for (size_t i = 0; i < length; ++i)
+			hash = (hash ^ (size_t)((named) ? towupper(component[i]) : component[i])) * 16777619u;
 
-		EntryList::const_iterator it = Entries().find(current);
-		if (it == Entries().end() || !it->second)
-			return ResourceEntryPtr();
+		return hash;
+	}
 
-		if (pos == std::wstring::npos)
-			return it->second;
+	DWORD ResourceIndex::AddChildren(DWORD parent, DWORD count)
+	{
+		DWORD first = (DWORD)m_nodes.size();
+
+		m_nodes[parent].firstChild = first;
+		m_nodes[parent].childCount = count;
 
-		std::wstring remaining = path.substr(pos + 1);
+		m_nodes.resize(m_nodes.size() + count);
+		for (DWORD i = first; i < first + count; ++i)
+			m_nodes[i].parent = parent;
 
-		return it->second->AtPath(remaining);
+		return first;
 	}
 
-	void ResourceEntry::PrintInfo(std::wostream& out, const std::wstring& prefix) const
+	void ResourceIndex::SetName(DWORD node, const wchar_t* name, size_t length)
+	{
+		length = min(length, (size_t)MAXWORD);
+
+		m_nodes[node].named = true;
+		m_nodes[node].nameOffset = (DWORD)m_names.size();
+		m_nodes[node].nameLength = (WORD)length;
+		m_names.insert(m_names.end(), name, name + length);
+
+		Register(node);
+	}
+
+	void ResourceIndex::SetId(DWORD node, int id)
 	{
-		out << prefix << FullPath() << L'\n';
+		m_nodes[node].named = false;
+		m_nodes[node].id = id;
 
-		for (auto& entry : Entries())
+		Register(node);
+	}
+
+	void ResourceIndex::SetData(DWORD node, LPBYTE address, size_t fileOffset, size_t size, DWORD codePage)
+	{
+		m_nodes[node].isData = true;
+		m_nodes[node].address = address;
+		m_nodes[node].fileOffset = fileOffset;
+		m_nodes[node].size = size;
+		m_nodes[node].codePage = codePage;
+	}
+
+	void ResourceIndex::Register(DWORD node)
+	{
+		Node& entry = m_nodes[node];
+		size_t parentHash = m_nodes[entry.parent].pathHash;
+
+		if (entry.named)
 		{
-			if (!entry.second)
-				continue;
+			std::wstring name = L"@" + std::wstring(&m_names[entry.nameOffset], entry.nameLength);
+			entry.pathHash = Hash(parentHash, name.data(), name.size(), true);
+		}
+		else
+		{
+			std::wstring name = std::to_wstring(entry.id);
+			entry.pathHash = Hash(parentHash, name.data(), name.size(), false);
+		}
+
+		m_lookup.insert(std::make_pair(entry.pathHash, node));
+	}
+
+	std::wstring ResourceIndex::Name(DWORD node) const
+	{
+		const Node& entry = m_nodes[node];
+		if (node == 0)
+			return std::wstring();
+
+		if (entry.named)
+			return L"@" + std::wstring((entry.nameLength) ? &m_names[entry.nameOffset] : L"", entry.nameLength);
+
+		return std::to_wstring(entry.id);
+	}
+
+	std::wstring ResourceIndex::FullPath(DWORD node) const
+	{
+		std::wstring path;
+		for (; node != 0 && node != None; node = m_nodes[node].parent)
+			path = (path.empty()) ? Name(node) : Name(node) + L"/" + path;
+
+		return path;
+	}
+
+	bool ResourceIndex::ComponentEquals(DWORD node, const Component& component) const
+	{
+		std::wstring name = Name(node);
+		if (name.size() != component.second)
+			return false;
+
+		if (!m_nodes[node].named)
+			return 0 == wmemcmp(name.data(), component.first, component.second);
+
+		for (size_t i = 0; i < name.size(); ++i)
+			if (towupper(name[i]) != towupper(component.first[i]))
+				return false;
+
+		return true;
+	}
+
+	DWORD ResourceIndex::Find(DWORD from, const std::wstring& path) const
+	{
+		if (from >= m_nodes.size())
+			return None;
+
+		std::vector<Component> components;
+		size_t hash = m_nodes[from].pathHash;
+
+		for (size_t start = 0; start < path.size();)
+		{
+			size_t end = path.find(L'/', start);
+			if (end == std::wstring::npos)
+				end = path.size();
+
+			if (end > start)
+			{
+				components.push_back(Component(&path[start], end - start));
+				hash = Hash(hash, &path[start], end - start, path[start] == L'@');
+			}
+
+			start = end + 1;
+		}
+
+		if (components.empty())
+			return None;
+
+		// hash collisions are resolved by walking up from the candidate and comparing names
+		auto range = m_lookup.equal_range(hash);
+		for (auto it = range.first; it != range.second; ++it)
+		{
+			DWORD node = it->second;
+			bool match = true;
+
+			for (size_t i = components.size(); i > 0 && match; --i)
+			{
+				if (node == 0 || node == None || !ComponentEquals(node, components[i - 1]))
+					match = false;
+				else
+					node = m_nodes[node].parent;
+			}
 
-			entry.second->PrintInfo(out, prefix);
+			if (match && node == from)
+				return it->second;
 		}
+
+		return None;
+	}
+
+	void ResourceIndex::Print(DWORD node, std::wostream& out, const std::wstring& prefix) const
+	{
+		out << prefix << FullPath(node) << L'\n';
+
+		const Node& entry = m_nodes[node];
+		for (DWORD child = entry.firstChild; child < entry.firstChild + entry.childCount; ++child)
+			Print(child, out, prefix);
+	}
+
+	// ================================================================================================
+
+	std::wstring ResourceEntry::Path() const
+	{
+		DWORD parent = Node().parent;
+		if (parent == ResourceIndex::None)
+			return std::wstring();
+
+		return m_index->FullPath(parent);
+	}
+
+	ResourceEntryPtr ResourceEntry::AtPath(const std::wstring& path) const
+	{
+		if (IsData() || Node().childCount == 0) 
+			return ResourceEntryPtr();
+
+		DWORD node = m_index->Find(m_node, path);
+		if (node == ResourceIndex::None)
+			return ResourceEntryPtr();
+
+		return ResourceEntryPtr(new ResourceEntry(m_index, node));
 	}
 
-	std::wstring ResourceEntry::FullPath() const
+	ResourceEntry::EntryList ResourceEntry::Entries() const
 	{
-		if (Path().empty()) 
-			return Name();
+		EntryList entries;
+		entries.reserve(Node().childCount);
+
+		for (DWORD child = Node().firstChild; child < Node().firstChild + Node().childCount; ++child)
+			entries.push_back(ResourceEntryPtr(new ResourceEntry(m_index, child)));
+
+		return entries;
+	}
 
-		return Path() + L"/" + Name();
+	void ResourceEntry::PrintInfo(std::wostream& out, const std::wstring& prefix) const
+	{
+		m_index->Print(m_node, out, prefix);
 	}
 
 	void ResourceEntry::Save(std::ostream& out) const
@@ -57,67 +233,127 @@ namespace peparser
 		out.write((const char*)Address(), Size());
 	}
 
-	ResourceDirectoryTable::ResourceDirectoryTable(LPVOID fileBase, PEDirInfo<IMAGE_RESOURCE_DIRECTORY> base, BlockList& interesting)
+	bool ResourceEntry::SaveTo(const PEParser& pe, const std::wstring& path) const
+	{
+		if (!IsData())
+			return false;
+
+		LPBYTE data = pe.Data(FileOffset(), Size());
+		if (!data)
+			return false;
+
+		return SaveData(path, data, Size());
+	}
+
+	bool SaveData(const std::wstring& path, const void* data, size_t size)
+	{
+		HANDLE file = CreateFile(path.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+
+		// large chunks keep the number of calls down, a single WriteFile is limited to 4GB anyway
+		const size_t ChunkSize = 16 * 1024 * 1024;
+
+		const BYTE* bytes = (const BYTE*)data;
+		size_t remaining = size;
+		bool result = true;
+
+		while (remaining && result)
+		{
+			DWORD written = 0;
+			DWORD chunk = (DWORD)std::min<size_t>(remaining, ChunkSize);
+
+			result = WriteFile(file, bytes, chunk, &written, NULL) && written == chunk;
+
+			bytes += written;
+			remaining -= written;
+		}
+
+		CloseHandle(file);
+
+		if (!result)
+			DeleteFile(path.c_str());
+
+		return result;
+	}
+
+	ResourceDirectoryTable::ResourceDirectoryTable(LPVOID fileBase, PEDirInfo<IMAGE_RESOURCE_DIRECTORY> base, BlockList& interesting, RangeReader* reader)
 		: m_base(base)
 		, m_fileBase(fileBase)
+		, m_reader(reader)
 		, m_interesting(interesting)
-		, m_root(new ResourceEntry())
+		, m_index(new ResourceIndex())
 	{
-		m_root->SetName(L"");
-		ParseDir(m_base[0], m_root);
+		ParseDir(m_base[0], 0, 0);
 	}
 
-	void ResourceDirectoryTable::ParseDir(PIMAGE_RESOURCE_DIRECTORY entry, const ResourceEntryPtr& parent)
+	void ResourceDirectoryTable::ParseDir(PIMAGE_RESOURCE_DIRECTORY entry, DWORD parent, size_t depth)
 	{
-		if (!entry) 
+		// type/name/language, anything much deeper is a loop in a corrupted table
+		const size_t maxDepth = 8;
+
+		if (!entry || depth > maxDepth || !Ensure(entry, sizeof(IMAGE_RESOURCE_DIRECTORY))) 
 			return;
 
 		size_t count = entry->NumberOfIdEntries + entry->NumberOfNamedEntries;
 		++entry;
+		if (!Ensure(entry, count * sizeof(IMAGE_RESOURCE_DIRECTORY_ENTRY)))
+			return;
+
+		// siblings are sorted by their names, same order the tree has always been printed in
+		std::vector<std::pair<std::wstring, PIMAGE_RESOURCE_DIRECTORY_ENTRY>> subEntries;
+		subEntries.reserve(count);
+
 		for (size_t i = 0; i < count; ++i)
 		{
 			PIMAGE_RESOURCE_DIRECTORY_ENTRY subEntry = (PIMAGE_RESOURCE_DIRECTORY_ENTRY)entry + i;
 
-			ResourceEntryPtr directory(new ResourceEntry());
-			if (parent->Path().empty())
-				directory->SetPath(parent->Name());
-			else
-				directory->SetPath(parent->Path() + L"/" + parent->Name());
-
 			if (subEntry->NameIsString)
 			{
 				PIMAGE_RESOURCE_DIR_STRING_U name = (PIMAGE_RESOURCE_DIR_STRING_U)((LPBYTE)m_base[0] + subEntry->NameOffset);
-				directory->SetName(L"@" + std::wstring(name->NameString, name->Length));
+				if (!Ensure(name, sizeof(WORD)) || !Ensure(name, sizeof(WORD) + name->Length * sizeof(WCHAR)))
+					continue;
+				subEntries.push_back(std::make_pair(L"@" + std::wstring(name->NameString, name->Length), subEntry));
 			}
 			else
-			{
-				directory->SetId(subEntry->Id);
-				directory->SetName(std::to_wstring(subEntry->Name));
-			}
+				subEntries.push_back(std::make_pair(std::to_wstring(subEntry->Name), subEntry));
+		}
 
+		std::sort(subEntries.begin(), subEntries.end(), [](const std::pair<std::wstring, PIMAGE_RESOURCE_DIRECTORY_ENTRY>& e1, const std::pair<std::wstring, PIMAGE_RESOURCE_DIRECTORY_ENTRY>& e2)
+		{
+			return e1.first < e2.first;
+		});
+
+		DWORD first = m_index->AddChildren(parent, (DWORD)subEntries.size());
+
+		for (size_t i = 0; i < subEntries.size(); ++i)
+		{
+			PIMAGE_RESOURCE_DIRECTORY_ENTRY subEntry = subEntries[i].second;
+			if (subEntry->NameIsString)
+				m_index->SetName(first + (DWORD)i, subEntries[i].first.data() + 1, subEntries[i].first.size() - 1);
+			else
+				m_index->SetId(first + (DWORD)i, subEntry->Id);
+		}
+
+		for (size_t i = 0; i < subEntries.size(); ++i)
+		{
+			PIMAGE_RESOURCE_DIRECTORY_ENTRY subEntry = subEntries[i].second;
 			if (subEntry->DataIsDirectory)
-			{
-				ParseDir((PIMAGE_RESOURCE_DIRECTORY)((LPBYTE)m_base[0] + subEntry->OffsetToDirectory), directory);
-				parent->AddChild(directory);
-			}
+				ParseDir((PIMAGE_RESOURCE_DIRECTORY)((LPBYTE)m_base[0] + subEntry->OffsetToDirectory), first + (DWORD)i, depth + 1);
 			else
-			{
-				ParseData((PIMAGE_RESOURCE_DATA_ENTRY)((LPBYTE)m_base[0] + subEntry->OffsetToData), directory);
-				parent->AddChild(directory);
-			}
+				ParseData((PIMAGE_RESOURCE_DATA_ENTRY)((LPBYTE)m_base[0] + subEntry->OffsetToData), first + (DWORD)i);
 		}
 	}
 
-	void ResourceDirectoryTable::ParseData(PIMAGE_RESOURCE_DATA_ENTRY entry, const ResourceEntryPtr& data)
+	void ResourceDirectoryTable::ParseData(PIMAGE_RESOURCE_DATA_ENTRY entry, DWORD data)
 	{
-		if (!entry || !data) 
+		if (!entry || !Ensure(entry, sizeof(IMAGE_RESOURCE_DATA_ENTRY))) 
 			return;
 
-		data->SetSize(entry->Size);
-		data->SetAddress((LPBYTE)(m_base[0]) + entry->OffsetToData - m_base.Rva());
-		data->SetFileOffset((size_t)data->Address() - (size_t)m_fileBase);
+		LPBYTE address = (LPBYTE)(m_base[0]) + entry->OffsetToData - m_base.Rva();
+		m_index->SetData(data, address, (size_t)address - (size_t)m_fileBase, entry->Size, entry->CodePage);
 
-		m_interesting.push_back(Block(L"Resource: " + data->FullPath(), data->FileOffset(), data->Size()));
+		m_interesting.push_back(Block(L"Resource: " + m_index->FullPath(data), m_index->At(data).fileOffset, entry->Size));
 	}
 
 	// ================================================================================================
@@ -156,6 +392,14 @@ namespace peparser
 		return ((LPBYTE)start) + size;
 	}
 
+	// zero fills alignment so the result doesn't depend on what the destination held before
+	void WriteAlignment(LPBYTE dest, size_t size, size_t& shift)
+	{
+		size_t alignment = Alignment(size);
+		memset(dest + shift, 0, alignment);
+		shift += alignment;
+	}
+
 	void WriteString(LPBYTE dest, const std::wstring& str, size_t addToAlign, size_t& shift, bool noAlign = false)
 	{
 		size_t size = str.size() * sizeof(wchar_t);
@@ -163,7 +407,28 @@ namespace peparser
 		shift += size;
 
 		if (!noAlign)
-			shift += Alignment(addToAlign + size);
+			WriteAlignment(dest, addToAlign + size, shift);
+	}
+
+	void WriteHeader(LPBYTE dest, WORD length, WORD valueLength, WORD type)
+	{
+		VersionInfoHeader header;
+		header.length = length;
+		header.valueLength = valueLength;
+		header.type = type;
+
+		memcpy(dest, &header, sizeof(VersionInfoHeader));
+	}
+
+	// one allocation of exactly the serialized size, Write() fills it in a single pass
+	template<class T>
+	std::shared_ptr<BYTE> Serialize(const T& block)
+	{
+		size_t size = block.NewSize();
+		std::shared_ptr<BYTE> data(new BYTE[size], std::default_delete<BYTE[]>());
+		block.Write(data.get());
+
+		return data;
 	}
 
 	// ================================================================================================
@@ -286,44 +551,38 @@ namespace peparser
 		return newSize;
 	}
 
-	std::shared_ptr<BYTE> StringTable::NewData()
+	std::shared_ptr<BYTE> StringTable::NewData() const
 	{
-		WORD size = (WORD)NewSize();
-		std::shared_ptr<BYTE> data((LPBYTE)operator new(size));
-		memset(data.get(), 0, size);
+		return Serialize(*this);
+	}
 
+	size_t StringTable::Write(LPBYTE dest) const
+	{
 		if (!IsWellFormed())
-			memcpy(data.get(), OriginalData(), size);
-		else
 		{
-			size_t shift = 0;
+			memcpy(dest, OriginalData(), OriginalSize());
+			return OriginalSize();
+		}
 
-			VersionInfoHeader header;
-			header.length = size;
-			header.type = 1;
-			header.valueLength = 0;
+		// header goes in last, when the length is known
+		size_t shift = sizeof(VersionInfoHeader);
 
-			memcpy(data.get() + shift, &header, sizeof(VersionInfoHeader));
-			shift += sizeof(VersionInfoHeader);
+		WriteString(dest, m_tableName, sizeof(VersionInfoHeader), shift);
 
-			WriteString(data.get(), m_tableName, sizeof(VersionInfoHeader), shift);
-
-			for (size_t i = 0; i < m_strings.size(); ++i)
-			{
-				VersionInfoHeader header;
-				header.valueLength = (WORD)m_strings[i].newValue.size(); // in chars
-				header.length = (WORD)(sizeof(VersionInfoHeader) + header.valueLength * sizeof(wchar_t) + m_strings[i].key.size() * sizeof(wchar_t) + Alignment(sizeof(VersionInfoHeader) + m_strings[i].key.size() * sizeof(wchar_t)));
-				header.type = 1;
+		for (size_t i = 0; i < m_strings.size(); ++i)
+		{
+			size_t start = shift;
+			shift += sizeof(VersionInfoHeader);
 
-				memcpy(data.get() + shift, &header, sizeof(VersionInfoHeader));
-				shift += sizeof(VersionInfoHeader);
+			WriteString(dest, m_strings[i].key, sizeof(VersionInfoHeader), shift);
+			WriteHeader(dest + start, (WORD)(shift - start + m_strings[i].newValue.size() * sizeof(wchar_t)), (WORD)m_strings[i].newValue.size(), 1);
 
-				WriteString(data.get(), m_strings[i].key, sizeof(VersionInfoHeader), shift);
-				WriteString(data.get(), m_strings[i].newValue, 0, shift, i == m_strings.size() - 1);
-			}
+			WriteString(dest, m_strings[i].newValue, 0, shift, i == m_strings.size() - 1);
 		}
 
-		return data;
+		WriteHeader(dest, (WORD)shift, 0, 1);
+
+		return shift;
 	}
 
 	void StringTable::SetField(Field field, const std::wstring& value)
@@ -414,41 +673,35 @@ namespace peparser
 		return newSize;
 	}
 
-	std::shared_ptr<BYTE> StringFileInfo::NewData()
+	std::shared_ptr<BYTE> StringFileInfo::NewData() const
 	{
-		size_t size = NewSize();
-		std::shared_ptr<BYTE> data((LPBYTE)operator new(size));
-		memset(data.get(), 0, size);
+		return Serialize(*this);
+	}
 
+	size_t StringFileInfo::Write(LPBYTE dest) const
+	{
 		if (!IsWellFormed())
-			memcpy(data.get(), OriginalData(), size);
-		else
 		{
-			size_t shift = 0;
-
-			VersionInfoHeader header;
-			header.length = (WORD)size;
-			header.type = 1;
-			header.valueLength = 0;
-
-			memcpy(data.get() + shift, &header, sizeof(VersionInfoHeader));
-			shift += sizeof(VersionInfoHeader);
+			memcpy(dest, OriginalData(), OriginalSize());
+			return OriginalSize();
+		}
 
-			WriteString(data.get(), m_key, sizeof(VersionInfoHeader), shift);
+		size_t shift = sizeof(VersionInfoHeader);
 
-			for (size_t i = 0; i < m_strings.size(); ++i)
-			{
-				size_t nextSize = m_strings[i]->NewSize();
+		WriteString(dest, m_key, sizeof(VersionInfoHeader), shift);
 
-				memcpy(data.get() + shift, m_strings[i]->NewData().get(), nextSize);
-				shift += nextSize;
+		for (size_t i = 0; i < m_strings.size(); ++i)
+		{
+			size_t blockSize = m_strings[i]->Write(dest + shift);
+			shift += blockSize;
 
-				if (i != m_strings.size() - 1)
-					shift += Alignment(nextSize);
-			}
+			if (i != m_strings.size() - 1)
+				WriteAlignment(dest, blockSize, shift);
 		}
 
-		return data;
+		WriteHeader(dest, (WORD)shift, 0, 1);
+
+		return shift;
 	}
 
 	void StringFileInfo::SetField(StringTable::Field field, const std::wstring& value)
@@ -509,41 +762,37 @@ namespace peparser
 		return newSize;
 	}
 
-	std::shared_ptr<BYTE> VS_VersionInfo::NewData()
+	std::shared_ptr<BYTE> VS_VersionInfo::NewData() const
 	{
-		WORD size = (WORD)NewSize();
-		std::shared_ptr<BYTE> data((LPBYTE)operator new(size));
-		memset(data.get(), 0, size);
+		return Serialize(*this);
+	}
 
+	size_t VS_VersionInfo::Write(LPBYTE dest) const
+	{
 		if (!IsWellFormed())
-			memcpy(data.get(), OriginalData(), size);
-		else
 		{
-			size_t shift = 0;
-
-			VersionInfoHeader header;
-			header.length = size;
-			header.type = 0;
-			header.valueLength = sizeof(VS_FIXEDFILEINFO);
+			memcpy(dest, OriginalData(), OriginalSize());
+			return OriginalSize();
+		}
 
-			memcpy(data.get() + shift, &header, sizeof(VersionInfoHeader));
-			shift += sizeof(VersionInfoHeader);
+		size_t shift = sizeof(VersionInfoHeader);
 
-			WriteString(data.get(), m_header, sizeof(VersionInfoHeader), shift);
+		WriteString(dest, m_header, sizeof(VersionInfoHeader), shift);
 
-			memcpy(data.get() + shift, &m_fixedFileInfo, sizeof(VS_FIXEDFILEINFO));
-			shift += sizeof(VS_FIXEDFILEINFO);
+		memcpy(dest + shift, &m_fixedFileInfo, sizeof(VS_FIXEDFILEINFO));
+		shift += sizeof(VS_FIXEDFILEINFO);
 
-			for (auto& entry : m_strings)
-			{
-				size_t nextSize = entry->NewSize();
+		for (auto& entry : m_strings)
+		{
+			size_t blockSize = entry->Write(dest + shift);
+			shift += blockSize;
 
-				memcpy(data.get() + shift, entry->NewData().get(), nextSize);
-				shift += nextSize + Alignment(nextSize);
-			}
+			WriteAlignment(dest, blockSize, shift);
 		}
 
-		return data;
+		WriteHeader(dest, (WORD)shift, sizeof(VS_FIXEDFILEINFO), 0);
+
+		return shift;
 	}
 
 	void VS_VersionInfo::SetField(StringTable::Field field, const VersionString& version)
@@ -4,11 +4,13 @@
 #pragma once
 
 #include <string>
-#include <map>
+#include <vector>
+#include <unordered_map>
 #include <memory>
 
 #include "pedirinfo.h"
 #include "block.h"
+#include "rangereader.h"
 #include "versionstring.h"
 
 // Helper classes for parsing Win32 binary resource formats. See format description here:
@@ -16,27 +18,97 @@
 
 namespace peparser
 {
+	class PEParser;
+
+	class ResourceIndex;
+	typedef std::shared_ptr<const ResourceIndex> ResourceIndexPtr;
+
 	class ResourceEntry;
 	typedef std::shared_ptr<ResourceEntry> ResourceEntryPtr;
 
+	// compact representation of the whole resource tree
+	// all nodes live in one array, children of a node are contiguous and sorted by name, names are kept in one buffer
+	// paths are not stored, every node has a hash of its normalized path instead which serves lookups by path
+	class ResourceIndex
+	{
+	public:
+		static const DWORD None = 0xFFFFFFFF;
+
+		struct Node
+		{
+			DWORD parent = None;
+			DWORD firstChild = 0;
+			DWORD childCount = 0;
+
+			// named entries have their name (without '@') in the names buffer, the rest only have an id
+			DWORD nameOffset = 0;
+			WORD nameLength = 0;
+			bool named = false;
+			bool isData = false;
+			int id = 0;
+
+			size_t pathHash = 0;
+
+			// data
+			LPBYTE address = nullptr;
+			size_t fileOffset = 0;
+			size_t size = 0;
+			DWORD codePage = 0;
+		};
+
+		ResourceIndex();
+
+		size_t Count() const { return m_nodes.size(); }
+		const Node& At(DWORD node) const { return m_nodes[node]; }
+
+		// "@NAME" for named entries, decimal id for the rest
+		std::wstring Name(DWORD node) const;
+		// path from the root, "type/name/language" for data entries
+		std::wstring FullPath(DWORD node) const;
+
+		// finds a node by path relative to another node, None if there is no such node
+		// names are compared case insensitively (as Windows does), empty path components are ignored
+		DWORD Find(DWORD from, const std::wstring& path) const;
+
+		void Print(DWORD node, std::wostream& out, const std::wstring& prefix) const;
+
+		// building, children have to be named in sorted order before they get children of their own
+		DWORD AddChildren(DWORD parent, DWORD count);
+		void SetName(DWORD node, const wchar_t* name, size_t length);
+		void SetId(DWORD node, int id);
+		void SetData(DWORD node, LPBYTE address, size_t fileOffset, size_t size, DWORD codePage);
+
+	private:
+		std::vector<Node> m_nodes;
+		std::vector<wchar_t> m_names;
+		std::unordered_multimap<size_t, DWORD> m_lookup;
+
+		typedef std::pair<const wchar_t*, size_t> Component;
+
+		void Register(DWORD node);
+		bool ComponentEquals(DWORD node, const Component& component) const;
+		static size_t Hash(size_t hash, const wchar_t* component, size_t length, bool named);
+	};
+
 	// describes a resource table entry, either a directory or a data node
+	// lightweight handle to a node of ResourceIndex
 	class ResourceEntry
 	{
 	public:
-		typedef std::map<std::wstring, ResourceEntryPtr> EntryList;
+		typedef std::vector<ResourceEntryPtr> EntryList;
 
-		ResourceEntry()	{}
+		ResourceEntry(const ResourceIndexPtr& index, DWORD node) : m_index(index), m_node(node) {}
 		virtual ~ResourceEntry() {}
 
 		// all
-		int Id() const { return m_id; }
-		const std::wstring& Name() const { return m_name; }
-		const std::wstring& Path() const { return m_path; }
-		std::wstring FullPath() const;
-		void SetId(int id) { m_id = id; }
-		void SetName(const std::wstring& name) { m_name = name; }
-		void SetPath(const std::wstring& path) { m_path = path; }
-		bool IsData() const { return m_isData; }
+		int Id() const { return Node().id; }
+		std::wstring Name() const { return m_index->Name(m_node); }
+		std::wstring Path() const;
+		std::wstring FullPath() const { return m_index->FullPath(m_node); }
+		bool IsData() const { return Node().isData; }
+
+		const ResourceIndexPtr& Index() const { return m_index; }
+		DWORD NodeIndex() const { return m_node; }
 
 		// retrieves ResourceEntry for a subdirectory specified by path
 		ResourceEntryPtr AtPath(const std::wstring& path) const;
@@ -46,48 +118,49 @@ namespace peparser
 
 		// writes contents (binary) to the stream, does nothing for directories
 		void Save(std::ostream& out) const;
+		// writes contents to a new file straight from the image (no intermediate buffers), false on failure
+		// data is taken through pe.Data(), so an entry reaching past the end of the file fails instead of faulting
+		bool SaveTo(const PEParser& pe, const std::wstring& path) const;
 
 		// directories
-		const EntryList& Entries() const { return m_entries; }
-		void AddChild(ResourceEntryPtr node) { m_entries[node->Name()] = node; }
+		EntryList Entries() const;
 
 		// data
-		void* Address() const { return m_address; }
-		size_t FileOffset() const { return m_fileOffset; }
-		size_t Size() const { return m_size; }
-		void SetAddress(void* address) { m_address = address; m_isData = true; }
-		void SetFileOffset(size_t fileOffset) { m_fileOffset = fileOffset; m_isData = true; }
-		void SetSize(size_t size) { m_size = size; m_isData = true; }
+		void* Address() const { return Node().address; }
+		size_t FileOffset() const { return Node().fileOffset; }
+		size_t Size() const { return Node().size; }
+		DWORD CodePage() const { return Node().codePage; }
 
 	private:
-		int m_id = 0;
-		std::wstring m_name;
-		std::wstring m_path;
-		EntryList m_entries;
-
-		void* m_address = nullptr;
-		size_t m_fileOffset = 0;
-		size_t m_size = 0;
+		ResourceIndexPtr m_index;
+		DWORD m_node = 0;
 
-		bool m_isData = false;
+		const ResourceIndex::Node& Node() const { return m_index->At(m_node); }
 	};
 
+	// writes a buffer to a new file in large chunks, the file is deleted if writing fails
+	bool SaveData(const std::wstring& path, const void* data, size_t size);
+
 	// describes resource table
 	class ResourceDirectoryTable
 	{
 	public:
-		ResourceDirectoryTable(LPVOID fileBase, PEDirInfo<IMAGE_RESOURCE_DIRECTORY> base, BlockList& interesting);
+		// reader is used to load directory entries as they are visited when the file is not mapped
+		ResourceDirectoryTable(LPVOID fileBase, PEDirInfo<IMAGE_RESOURCE_DIRECTORY> base, BlockList& interesting, RangeReader* reader = NULL);
 
-		ResourceEntryPtr Root() { return m_root; }
+		ResourceEntryPtr Root() { return ResourceEntryPtr(new ResourceEntry(m_index, 0)); }
 
 	private:
 		PEDirInfo<IMAGE_RESOURCE_DIRECTORY> m_base;
 		BlockList& m_interesting;
 		LPVOID m_fileBase = NULL;
-		ResourceEntryPtr m_root;
+		RangeReader* m_reader = NULL;
+		std::shared_ptr<ResourceIndex> m_index;
+
+		bool Ensure(const void* address, size_t size) { return !m_reader || m_reader->Ensure(address, size); }
 
-		void ParseDir(PIMAGE_RESOURCE_DIRECTORY entry, const ResourceEntryPtr& parent);
-		void ParseData(PIMAGE_RESOURCE_DATA_ENTRY entry, const ResourceEntryPtr& data);
+		void ParseDir(PIMAGE_RESOURCE_DIRECTORY entry, DWORD parent, size_t depth);
+		void ParseData(PIMAGE_RESOURCE_DATA_ENTRY entry, DWORD data);
 	};
 
 	class VS_Base
@@ -143,8 +216,13 @@ namespace peparser
 
 		std::wstring Name() const { return m_tableName; }
 
+		// key/value pairs in the order they are stored, keys and values may include terminating '\0'
+		const EntryList& Entries() const { return m_strings; }
+
 		size_t NewSize() const;
-		std::shared_ptr<BYTE> NewData();
+		std::shared_ptr<BYTE> NewData() const;
+		// writes NewSize() bytes to dest, returns number of bytes written
+		size_t Write(LPBYTE dest) const;
 
 		std::wstring Value(const std::wstring& key) const;
 		// sets value for a field by name
@@ -170,7 +248,9 @@ namespace peparser
 		EntryList& Entries() { return m_strings; }
 
 		size_t NewSize() const;
-		std::shared_ptr<BYTE> NewData();
+		std::shared_ptr<BYTE> NewData() const;
+		// writes NewSize() bytes to dest, returns number of bytes written
+		size_t Write(LPBYTE dest) const;
 
 		// replaces value for given field in all existing string tables
 		void SetField(StringTable::Field field, const std::wstring& value);
@@ -198,7 +278,11 @@ namespace peparser
 		// estimates size after modification, if the size is the same as it was, data can be directly written into PE file at appropriate offset without rebuilding resource table
 		size_t NewSize() const;
 		// returns binary representation of current state of VS_VERSION_INFO
-		std::shared_ptr<BYTE> NewData();
+		std::shared_ptr<BYTE> NewData() const;
+		// same as NewData() but into a caller provided buffer of at least NewSize() bytes, in one pass:
+		// every block is written in place and its header is filled in once its length is known
+		// dest must not overlap OriginalData(), blocks that failed to parse are copied from there
+		size_t Write(LPBYTE dest) const;
 
 		// field must be FileVersion or ProductVersion
 		void SetField(StringTable::Field field, const VersionString& version);
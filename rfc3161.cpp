@@ -0,0 +1,349 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "rfc3161.h"
+#include "asn1.h"
+#include "authenticode.h"
+#include "hash.h"
+#include "certificatetable.h"
+#include "timestampclient.h"
+
+#include <wincrypt.h>
+#include <wintrust.h>
+#include <bcrypt.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+
+#pragma comment(lib, "crypt32.lib")
+
+namespace peparser
+{
+	namespace
+	{
+		const char* Sha256Oid = "2.16.840.1.101.3.4.2.1";
+		const char* SignedDataOid = "1.2.840.113549.1.7.2";
+		const char* TstInfoOid = "1.2.840.113549.1.9.16.1.4";
+		// unauthenticated attributes of the signer that hold timestamps: RFC 3161 token and legacy countersignature
+		const char* Rfc3161CounterSignOid = "1.3.6.1.4.1.311.3.3.1";
+		const char* CounterSignOid = "1.2.840.113549.1.9.6";
+
+		const DWORD Encoding = X509_ASN_ENCODING | PKCS_7_ASN_ENCODING;
+
+		bool Malformed(std::wstring& error)
+		{
+			error = L"Malformed timestamp reply.";
+			return false;
+		}
+
+		bool GetParam(HCRYPTMSG message, DWORD type, DWORD index, std::vector<BYTE>& value)
+		{
+			DWORD size = 0;
+			if (!CryptMsgGetParam(message, type, index, NULL, &size))
+				return false;
+
+			value.resize(size);
+			if (!CryptMsgGetParam(message, type, index, value.data(), &size))
+				return false;
+
+			value.resize(size);
+			return true;
+		}
+
+		// drops timestamps the signer already has, so re-timestamping replaces them instead of piling up
+		bool RemoveTimestamps(HCRYPTMSG message)
+		{
+			std::vector<BYTE> buffer;
+			if (!GetParam(message, CMSG_SIGNER_UNAUTH_ATTR_PARAM, 0, buffer))
+				return GetLastError() == CRYPT_E_ATTRIBUTES_MISSING;
+
+			const CRYPT_ATTRIBUTES* attributes = (const CRYPT_ATTRIBUTES*)buffer.data();
+			for (DWORD i = attributes->cAttr; i--; )
+			{
+				const char* oid = attributes->rgAttr[i].pszObjId;
+				if (strcmp(oid, Rfc3161CounterSignOid) != 0 && strcmp(oid, CounterSignOid) != 0)
+					continue;
+
+				CMSG_CTRL_DEL_SIGNER_UNAUTH_ATTR_PARA remove = { sizeof(remove), 0, i };
+				if (!CryptMsgControl(message, 0, CMSG_CTRL_DEL_SIGNER_UNAUTH_ATTR, &remove))
+					return false;
+			}
+
+			return true;
+		}
+
+		// adds an RFC 3161 timestamp of the signature value to the signer of SignedData, replacing timestamps it had
+		bool AddTimestamp(TimestampClient& client, const BYTE* data, DWORD size, const std::wstring& url, std::vector<BYTE>& signedData, std::wstring& error)
+		{
+			HCRYPTMSG message = CryptMsgOpenToDecode(Encoding, 0, 0, NULL, NULL, NULL);
+			if (!message)
+			{
+				error = L"Failed to decode signature.";
+				return false;
+			}
+
+			std::shared_ptr<void> doomOfMessage(message, CryptMsgClose);
+
+			std::vector<BYTE> signature;
+			if (!CryptMsgUpdate(message, data, size, TRUE) || !GetParam(message, CMSG_ENCRYPTED_DIGEST, 0, signature))
+			{
+				error = L"Failed to decode signature.";
+				return false;
+			}
+
+			Hash hash(HashAlgorithm::Sha256);
+			hash.Update(signature.data(), signature.size());
+			std::vector<BYTE> digest = hash.Finish();
+
+			std::vector<BYTE> nonce(8);
+			if (digest.empty() || BCryptGenRandom(NULL, nonce.data(), (ULONG)nonce.size(), BCRYPT_USE_SYSTEM_PREFERRED_RNG) != 0)
+			{
+				error = L"Failed to hash signature.";
+				return false;
+			}
+
+			std::vector<BYTE> reply;
+			std::vector<BYTE> token;
+			if (!client.Post(url, L"application/timestamp-query", Rfc3161Request(digest, nonce), reply, error) || !Rfc3161Token(reply, digest, nonce, token, error))
+				return false;
+
+			CRYPT_ATTR_BLOB value = { (DWORD)token.size(), token.data() };
+			CRYPT_ATTRIBUTE attribute = { (LPSTR)Rfc3161CounterSignOid, 1, &value };
+
+			DWORD encodedSize = 0;
+			std::vector<BYTE> encoded;
+			bool ok = CryptEncodeObject(Encoding, PKCS_ATTRIBUTE, &attribute, NULL, &encodedSize);
+			if (ok)
+			{
+				encoded.resize(encodedSize);
+				ok = CryptEncodeObject(Encoding, PKCS_ATTRIBUTE, &attribute, encoded.data(), &encodedSize);
+			}
+
+			CMSG_CTRL_ADD_SIGNER_UNAUTH_ATTR_PARA add = { sizeof(add), 0, { encodedSize, encoded.data() } };
+			if (!ok || !RemoveTimestamps(message) || !CryptMsgControl(message, 0, CMSG_CTRL_ADD_SIGNER_UNAUTH_ATTR, &add) || !GetParam(message, CMSG_ENCODED_MESSAGE, 0, signedData))
+			{
+				error = L"Failed to add timestamp to signature.";
+				return false;
+			}
+
+			return true;
+		}
+
+		bool TimestampPE(HANDLE file, TimestampClient& client, const std::wstring& url, std::wstring& error)
+		{
+			CertificateTableInfo info;
+			if (!ReadCertificateTableInfo(file, info))
+			{
+				error = L"Invalid PE format.";
+				return false;
+			}
+
+			std::vector<BYTE> table;
+			if (!info.IsPresent() || !ReadCertificateTable(file, info, table))
+			{
+				error = L"File is not signed.";
+				return false;
+			}
+
+			const WIN_CERTIFICATE* certificate = (const WIN_CERTIFICATE*)table.data();
+			const DWORD headerSize = offsetof(WIN_CERTIFICATE, bCertificate);
+			if (table.size() < headerSize || certificate->dwLength < headerSize || certificate->dwLength > table.size() || certificate->wCertificateType != WIN_CERT_TYPE_PKCS_SIGNED_DATA)
+			{
+				error = L"Unsupported certificate table.";
+				return false;
+			}
+
+			std::vector<BYTE> signedData;
+			if (!AddTimestamp(client, certificate->bCertificate, certificate->dwLength - headerSize, url, signedData, error))
+				return false;
+
+			// first entry is replaced, whatever follows it is kept as is
+			DWORD oldEntrySize = (certificate->dwLength + 7) & ~7;
+
+			std::vector<BYTE> newTable = CertificateTableEntry(signedData);
+			if (oldEntrySize < table.size())
+				newTable.insert(newTable.end(), table.begin() + oldEntrySize, table.end());
+
+			return ReplaceCertificateTable(file, info, newTable, error);
+		}
+
+		// catalog file is SignedData as a whole
+		bool TimestampCatalog(HANDLE file, TimestampClient& client, const std::wstring& url, std::wstring& error)
+		{
+			LARGE_INTEGER fileSize;
+			if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart > MAXDWORD)
+			{
+				error = L"Failed to read catalog.";
+				return false;
+			}
+
+			std::vector<BYTE> data((size_t)fileSize.QuadPart);
+			DWORD read = 0;
+			if (!ReadFile(file, data.data(), (DWORD)data.size(), &read, NULL) || read != data.size())
+			{
+				error = L"Failed to read catalog.";
+				return false;
+			}
+
+			std::vector<BYTE> signedData;
+			if (!AddTimestamp(client, data.data(), (DWORD)data.size(), url, signedData, error))
+				return false;
+
+			LARGE_INTEGER start = {};
+			DWORD written = 0;
+			if (!SetFilePointerEx(file, start, NULL, FILE_BEGIN) || !WriteFile(file, signedData.data(), (DWORD)signedData.size(), &written, NULL) || written != signedData.size() || !SetEndOfFile(file))
+			{
+				error = L"Failed to write catalog.";
+				return false;
+			}
+
+			return true;
+		}
+
+		bool IsCatalog(const std::wstring& path)
+		{
+			return path.size() > 4 && _wcsicmp(path.c_str() + path.size() - 4, L".cat") == 0;
+		}
+	}
+
+	std::vector<BYTE> Rfc3161Request(const std::vector<BYTE>& digest, const std::vector<BYTE>& nonce)
+	{
+		using namespace asn1;
+
+		Bytes algorithm = Encode(Sequence, std::vector<Bytes>{ EncodeObjectId(Sha256Oid), EncodeNull() });
+		Bytes imprint = Encode(Sequence, std::vector<Bytes>{ algorithm, Encode(OctetString, digest) });
+
+		return Encode(Sequence, std::vector<Bytes>{ EncodeInteger(1), imprint, EncodeInteger(nonce), EncodeBoolean(true) });
+	}
+
+	bool ParseTimestampToken(const std::vector<BYTE>& token, TimestampTokenInfo& result)
+	{
+		using namespace asn1;
+
+		// ContentInfo { signedData, [0] SignedData { version, digestAlgorithms, encapContentInfo { tstInfo, [0] OCTET STRING } ... } }
+		Element contentInfo, type, explicitContent, signedData, version, algorithms, encapsulated, encapsulatedType, explicitInfo, infoString, tstInfo;
+		if (!Reader(token.data(), token.size()).Next(Sequence, contentInfo))
+			return false;
+
+		Reader content(contentInfo);
+		if (!content.Next(ObjectId, type) || !IsObjectId(type, SignedDataOid) || !content.Next(ContextConstructed, explicitContent))
+			return false;
+
+		Reader signedDataFields(explicitContent);
+		if (!signedDataFields.Next(Sequence, signedData))
+			return false;
+
+		Reader signedDataReader(signedData);
+		if (!signedDataReader.Next(Integer, version) || !signedDataReader.Next(Set, algorithms) || !signedDataReader.Next(Sequence, encapsulated))
+			return false;
+
+		Reader encapsulatedReader(encapsulated);
+		if (!encapsulatedReader.Next(ObjectId, encapsulatedType) || !IsObjectId(encapsulatedType, TstInfoOid) || !encapsulatedReader.Next(ContextConstructed, explicitInfo))
+			return false;
+
+		if (!Reader(explicitInfo).Next(OctetString, infoString) || !Reader(infoString).Next(Sequence, tstInfo))
+			return false;
+
+		// TSTInfo { version, policy, messageImprint { algorithm, digest }, serialNumber, genTime, accuracy?, ordering?, nonce? ... }
+		Element infoVersion, policy, imprint, imprintAlgorithm, imprintOid, imprintDigest, serial, time;
+		Reader info(tstInfo);
+		if (!info.Next(Integer, infoVersion) || !info.Next(ObjectId, policy) || !info.Next(Sequence, imprint))
+			return false;
+
+		Reader imprintReader(imprint);
+		if (!imprintReader.Next(Sequence, imprintAlgorithm) || !imprintReader.Next(OctetString, imprintDigest))
+			return false;
+
+		if (!Reader(imprintAlgorithm).Next(ObjectId, imprintOid) || !HashAlgorithmFromOid(ObjectIdString(imprintOid), result.imprintAlgorithm))
+			return false;
+
+		if (!info.Next(Integer, serial) || !info.Next(GeneralizedTime, time))
+			return false;
+
+		result.imprint = imprintDigest.Content();
+		result.time.assign((const char*)time.content, time.size);
+
+		// accuracy and ordering come before the nonce, they are not integers
+		Element optional;
+		result.hasNonce = false;
+		while (!info.AtEnd() && info.Next(optional))
+		{
+			if (optional.tag == Integer)
+			{
+				result.hasNonce = true;
+				result.nonce = IntegerMagnitude(optional);
+				break;
+			}
+		}
+
+		return true;
+	}
+
+	bool Rfc3161Token(const std::vector<BYTE>& reply, const std::vector<BYTE>& digest, const std::vector<BYTE>& nonce, std::vector<BYTE>& token, std::wstring& error)
+	{
+		using namespace asn1;
+
+		token.clear();
+
+		Element response, statusInfo, status;
+		Reader top(reply.data(), reply.size());
+		if (!top.Next(Sequence, response))
+			return Malformed(error);
+
+		Reader fields(response);
+		if (!fields.Next(Sequence, statusInfo) || !Reader(statusInfo).Next(Integer, status))
+			return Malformed(error);
+
+		// granted or grantedWithMods
+		Bytes statusValue = IntegerMagnitude(status);
+		if (statusValue.size() > 1 || (!statusValue.empty() && statusValue[0] > 1))
+		{
+			error = L"Server refused the request, status " + std::to_wstring(statusValue.empty() ? 0 : statusValue.back()) + L".";
+			return false;
+		}
+
+		Element contentInfo;
+		if (!fields.Next(Sequence, contentInfo))
+		{
+			error = L"Reply has no timestamp token.";
+			return false;
+		}
+
+		TimestampTokenInfo info;
+		if (!ParseTimestampToken(contentInfo.Encoded(), info))
+			return Malformed(error);
+
+		if (info.imprint != digest)
+		{
+			error = L"Timestamp token is for a different digest.";
+			return false;
+		}
+
+		auto first = std::find_if(nonce.begin(), nonce.end(), [](BYTE b) { return b != 0; });
+		if (!info.hasNonce || info.nonce != Bytes(first, nonce.end()))
+		{
+			error = L"Timestamp token doesn't match the nonce of the request.";
+			return false;
+		}
+
+		token = contentInfo.Encoded();
+		return true;
+	}
+
+	bool TimestampFile(TimestampClient& client, const std::wstring& path, const std::wstring& url, std::wstring& error)
+	{
+		HANDLE file = CreateFile(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			error = L"Failed to open file for writing.";
+			return false;
+		}
+
+		bool result = IsCatalog(path) ? TimestampCatalog(file, client, url, error) : TimestampPE(file, client, url, error);
+
+		CloseHandle(file);
+		return result;
+	}
+}
\ No newline at end of file
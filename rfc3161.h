@@ -0,0 +1,45 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <windows.h>
+
+#include <string>
+#include <vector>
+
+#include "hash.h"
+
+namespace peparser
+{
+	class TimestampClient;
+
+	// what a timestamp token says about the stamped data, from its TSTInfo
+	struct TimestampTokenInfo
+	{
+		HashAlgorithm imprintAlgorithm = HashAlgorithm::Sha256;
+		std::vector<BYTE> imprint;
+		// GeneralizedTime as sent by the server, e.g. "20160301120000Z" or "20160301120000.123Z"
+		std::string time;
+		bool hasNonce = false;
+		// big endian magnitude without leading zeros
+		std::vector<BYTE> nonce;
+	};
+
+	// picks the TSTInfo out of a token (CMS ContentInfo with SignedData), doesn't check the token's signature
+	// returns false if the token is malformed or its imprint algorithm is unknown
+	bool ParseTimestampToken(const std::vector<BYTE>& token, TimestampTokenInfo& info);
+
+	// TimeStampReq for a SHA-256 digest, asking for the TSA certificate to be included
+	std::vector<BYTE> Rfc3161Request(const std::vector<BYTE>& digest, const std::vector<BYTE>& nonce);
+
+	// checks TimeStampResp status and that the token inside stamps the digest with the nonce of the request
+	// returns the token (a CMS ContentInfo) or false with error set
+	bool Rfc3161Token(const std::vector<BYTE>& reply, const std::vector<BYTE>& digest, const std::vector<BYTE>& nonce, std::vector<BYTE>& token, std::wstring& error);
+
+	// timestamps a signed PE file natively: the signature value of its signer is sent to url as an RFC 3161 request and the
+	// token from the reply is added to the signer as an unauthenticated attribute, the way signtool /tr does
+	// catalog files (.cat) are timestamped the same way
+	// the file is held open exclusively for the round trip, safe to call for different files in parallel
+	bool TimestampFile(TimestampClient& client, const std::wstring& path, const std::wstring& url, std::wstring& error);
+}
\ No newline at end of file
@@ -0,0 +1,647 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "signatureverifier.h"
+#include "authenticode.h"
+#include "certificatetable.h"
+#include "rfc3161.h"
+#include "asn1.h"
+#include "widestring.h"
+
+#include <wintrust.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+
+#pragma comment(lib, "crypt32.lib")
+
+namespace peparser
+{
+	namespace
+	{
+		const char* SpcIndirectDataOid = "1.3.6.1.4.1.311.2.1.4";
+		// unauthenticated attributes of a signer: further signatures of a dual signed file and timestamps
+		const char* NestedSignatureOid = "1.3.6.1.4.1.311.2.4.1";
+		const char* Rfc3161CounterSignOid = "1.3.6.1.4.1.311.3.3.1";
+		const char* CounterSignOid = "1.2.840.113549.1.9.6";
+		const char* SigningTimeOid = "1.2.840.113549.1.9.5";
+		const char* CodeSigningOid = "1.3.6.1.5.5.7.3.3";
+		const char* TimeStampingOid = "1.3.6.1.5.5.7.3.8";
+
+		const DWORD Encoding = X509_ASN_ENCODING | PKCS_7_ASN_ENCODING;
+
+		typedef std::shared_ptr<void> MessagePtr;
+
+		bool GetParam(HCRYPTMSG message, DWORD type, DWORD index, std::vector<BYTE>& value)
+		{
+			DWORD size = 0;
+			if (!CryptMsgGetParam(message, type, index, NULL, &size))
+				return false;
+
+			value.resize(size);
+			if (!CryptMsgGetParam(message, type, index, value.data(), &size))
+				return false;
+
+			value.resize(size);
+			return true;
+		}
+
+		bool DecodeObject(LPCSTR type, const BYTE* data, DWORD size, std::vector<BYTE>& value)
+		{
+			DWORD decodedSize = 0;
+			if (!CryptDecodeObject(Encoding, type, data, size, 0, NULL, &decodedSize))
+				return false;
+
+			value.resize(decodedSize);
+			return CryptDecodeObject(Encoding, type, data, size, 0, value.data(), &decodedSize) != FALSE;
+		}
+
+		MessagePtr Decode(const BYTE* data, DWORD size)
+		{
+			HCRYPTMSG message = CryptMsgOpenToDecode(Encoding, 0, 0, NULL, NULL, NULL);
+			if (!message)
+				return MessagePtr();
+
+			MessagePtr result(message, CryptMsgClose);
+			if (!CryptMsgUpdate(message, data, size, TRUE))
+				return MessagePtr();
+
+			return result;
+		}
+
+		// digest algorithm and value from SpcIndirectDataContent { data, messageDigest DigestInfo { algorithm, digest } }
+		bool SignedDigest(HCRYPTMSG message, HashAlgorithm& algorithm, std::vector<BYTE>& digest)
+		{
+			std::vector<BYTE> type, content;
+			if (!GetParam(message, CMSG_INNER_CONTENT_TYPE_PARAM, 0, type) || std::string(type.begin(), std::find(type.begin(), type.end(), 0)) != SpcIndirectDataOid)
+				return false;
+
+			// for content other than data CryptMsg returns the whole encoded structure
+			if (!GetParam(message, CMSG_CONTENT_PARAM, 0, content))
+				return false;
+
+			using namespace asn1;
+
+			Element indirect, data, digestInfo, algorithmId, oid, value;
+			if (!Reader(content.data(), content.size()).Next(Sequence, indirect))
+				return false;
+
+			Reader fields(indirect);
+			if (!fields.Next(Sequence, data) || !fields.Next(Sequence, digestInfo))
+				return false;
+
+			Reader info(digestInfo);
+			if (!info.Next(Sequence, algorithmId) || !info.Next(OctetString, value) || !Reader(algorithmId).Next(ObjectId, oid))
+				return false;
+
+			if (!HashAlgorithmFromOid(ObjectIdString(oid), algorithm))
+				return false;
+
+			digest = value.Content();
+			return true;
+		}
+
+		// "YYYYMMDDHHMMSS[.fff]Z", fractions below a millisecond are dropped
+		bool ParseGeneralizedTime(const std::string& text, FILETIME& time)
+		{
+			if (text.size() < 15 || text.back() != 'Z' || (text.size() > 15 && text[14] != '.'))
+				return false;
+
+			std::string digits = text.substr(0, 14);
+			std::string fraction = (text.size() > 16) ? text.substr(15, text.size() - 16) : std::string();
+			fraction.resize(3, '0');
+
+			if ((digits + fraction).find_first_not_of("0123456789") != std::string::npos)
+				return false;
+
+			auto number = [&](size_t offset, size_t count) { return (WORD)std::stoi(digits.substr(offset, count)); };
+
+			SYSTEMTIME system = {};
+			system.wYear = number(0, 4);
+			system.wMonth = number(4, 2);
+			system.wDay = number(6, 2);
+			system.wHour = number(8, 2);
+			system.wMinute = number(10, 2);
+			system.wSecond = number(12, 2);
+			system.wMilliseconds = (WORD)std::stoi(fraction);
+
+			return SystemTimeToFileTime(&system, &time) != FALSE;
+		}
+
+		std::wstring FormatTime(const FILETIME& time)
+		{
+			SYSTEMTIME system = {};
+			if (!FileTimeToSystemTime(&time, &system))
+				return std::wstring();
+
+			wchar_t text[32];
+			swprintf_s(text, L"%04u-%02u-%02uT%02u:%02u:%02uZ", system.wYear, system.wMonth, system.wDay, system.wHour, system.wMinute, system.wSecond);
+			return text;
+		}
+
+		std::wstring CertificateName(PCCERT_CONTEXT certificate)
+		{
+			DWORD size = CertGetNameStringW(certificate, CERT_NAME_SIMPLE_DISPLAY_TYPE, 0, NULL, NULL, 0);
+			if (size <= 1)
+				return std::wstring();
+
+			std::wstring name(size, L'\0');
+			CertGetNameStringW(certificate, CERT_NAME_SIMPLE_DISPLAY_TYPE, 0, NULL, &name[0], size);
+			name.resize(size - 1);
+			return name;
+		}
+
+		std::wstring ChainProblem(DWORD status)
+		{
+			static const struct { DWORD flag; const wchar_t* text; } problems[] =
+			{
+				  { CERT_TRUST_IS_NOT_SIGNATURE_VALID, L"chain has an invalid signature." }
+				, { CERT_TRUST_IS_REVOKED, L"is revoked." }
+				, { CERT_TRUST_IS_PARTIAL_CHAIN, L"chain is incomplete." }
+				, { CERT_TRUST_IS_UNTRUSTED_ROOT, L"doesn't chain to a trusted root." }
+				, { CERT_TRUST_IS_NOT_TIME_VALID, L"is expired or not yet valid." }
+				, { CERT_TRUST_IS_NOT_VALID_FOR_USAGE, L"is not valid for this usage." }
+			};
+
+			for (auto& problem : problems)
+			{
+				if (status & problem.flag)
+					return problem.text;
+			}
+
+			wchar_t text[64];
+			swprintf_s(text, L"is not trusted, chain status 0x%08x.", status);
+			return text;
+		}
+
+		bool Fail(std::wstring& problem, const wchar_t* text)
+		{
+			problem = text;
+			return false;
+		}
+
+		// certificate of the only signer of a message and the store with all certificates the message carries
+		struct SignerCertificate
+		{
+			std::shared_ptr<void> store;
+			std::shared_ptr<const CERT_CONTEXT> certificate;
+		};
+
+		bool FindSigner(HCRYPTMSG message, SignerCertificate& signer, std::wstring& problem)
+		{
+			DWORD signers = 0;
+			DWORD size = sizeof(signers);
+			if (!CryptMsgGetParam(message, CMSG_SIGNER_COUNT_PARAM, 0, &signers, &size) || signers != 1)
+				return Fail(problem, L"must have exactly one signer.");
+
+			HCERTSTORE store = CertOpenStore(CERT_STORE_PROV_MSG, Encoding, NULL, 0, message);
+			if (!store)
+				return Fail(problem, L"certificates can't be read.");
+
+			signer.store.reset(store, [](void* store) { CertCloseStore(store, 0); });
+
+			std::vector<BYTE> certInfo;
+			PCCERT_CONTEXT certificate = NULL;
+			if (GetParam(message, CMSG_SIGNER_CERT_INFO_PARAM, 0, certInfo))
+				certificate = CertGetSubjectCertificateFromStore(store, Encoding, (PCERT_INFO)certInfo.data());
+
+			if (!certificate)
+				return Fail(problem, L"signer certificate is missing.");
+
+			signer.certificate.reset(certificate, CertFreeCertificateContext);
+			return true;
+		}
+
+		// RFC 3161 token must be signed correctly and stamp the signature value of the signer it is attached to
+		bool VerifyRfc3161Token(const CRYPT_ATTR_BLOB& token, const std::vector<BYTE>& signature, SignerCertificate& signer, FILETIME& time, std::wstring& problem)
+		{
+			TimestampTokenInfo info;
+			if (!ParseTimestampToken(std::vector<BYTE>(token.pbData, token.pbData + token.cbData), info) || !ParseGeneralizedTime(info.time, time))
+				return Fail(problem, L"Timestamp token is malformed.");
+
+			Hash hash(info.imprintAlgorithm);
+			hash.Update(signature.data(), signature.size());
+			if (hash.Finish() != info.imprint)
+				return Fail(problem, L"Timestamp is for a different signature.");
+
+			MessagePtr message = Decode(token.pbData, token.cbData);
+			if (!message)
+				return Fail(problem, L"Timestamp token is malformed.");
+
+			std::wstring signerProblem;
+			if (!FindSigner(message.get(), signer, signerProblem))
+			{
+				problem = L"Timestamp token " + signerProblem;
+				return false;
+			}
+
+			if (!CryptMsgControl(message.get(), 0, CMSG_CTRL_VERIFY_SIGNATURE, signer.certificate->pCertInfo))
+				return Fail(problem, L"Timestamp token signature is invalid.");
+
+			return true;
+		}
+
+		// legacy countersignature is a SignerInfo over the signature value, its certificate travels with the signature
+		bool VerifyCountersignature(HCRYPTMSG message, HCERTSTORE store, const CRYPT_ATTR_BLOB& countersignature, SignerCertificate& signer, FILETIME& time, std::wstring& problem)
+		{
+			std::vector<BYTE> encodedSigner, decoded;
+			if (!GetParam(message, CMSG_ENCODED_SIGNER, 0, encodedSigner) || !DecodeObject(PKCS7_SIGNER_INFO, countersignature.pbData, countersignature.cbData, decoded))
+				return Fail(problem, L"Timestamp countersignature is malformed.");
+
+			const CMSG_SIGNER_INFO* info = (const CMSG_SIGNER_INFO*)decoded.data();
+
+			CERT_INFO certInfo = {};
+			certInfo.Issuer = info->Issuer;
+			certInfo.SerialNumber = info->SerialNumber;
+
+			PCCERT_CONTEXT certificate = CertGetSubjectCertificateFromStore(store, Encoding, &certInfo);
+			if (!certificate)
+				return Fail(problem, L"Timestamp certificate is missing.");
+
+			signer.store.reset(CertDuplicateStore(store), [](void* store) { CertCloseStore(store, 0); });
+			signer.certificate.reset(certificate, CertFreeCertificateContext);
+
+			if (!CryptMsgVerifyCountersignatureEncodedEx(NULL, Encoding, encodedSigner.data(), (DWORD)encodedSigner.size(), countersignature.pbData, countersignature.cbData, CMSG_VERIFY_SIGNER_CERT, (void*)certificate, 0, NULL))
+				return Fail(problem, L"Timestamp countersignature is invalid.");
+
+			const CRYPT_ATTRIBUTE* signingTime = CertFindAttribute(SigningTimeOid, info->AuthAttrs.cAttr, info->AuthAttrs.rgAttr);
+			DWORD size = sizeof(time);
+			if (!signingTime || signingTime->cValue != 1 || !CryptDecodeObject(Encoding, PKCS_UTC_TIME, signingTime->rgValue[0].pbData, signingTime->rgValue[0].cbData, 0, &time, &size))
+				return Fail(problem, L"Timestamp countersignature has no signing time.");
+
+			return true;
+		}
+	}
+
+	bool FileSignatures::IsValid() const
+	{
+		if (signatures.empty())
+			return false;
+
+		for (auto& signature : signatures)
+		{
+			if (!signature.IsValid())
+				return false;
+		}
+
+		return true;
+	}
+
+	bool FileSignatures::IsSignedWith(const std::string& thumbprint, bool timestampRequired) const
+	{
+		if (signatures.empty())
+			return false;
+
+		const SignatureCheck& primary = signatures.front();
+
+		return primary.digestMatches
+			&& primary.signatureValid
+			&& (primary.timestampValid || !timestampRequired)
+			&& primary.signerThumbprint.size() == thumbprint.size()
+			&& std::equal(thumbprint.begin(), thumbprint.end(), primary.signerThumbprint.begin(), [](char a, BYTE b) { return (BYTE)a == b; });
+	}
+
+	SignatureVerifier::SignatureVerifier(const std::vector<std::vector<BYTE>>& trustedRoots)
+	{
+		CERT_CHAIN_ENGINE_CONFIG config = {};
+		config.cbSize = sizeof(config);
+		// offline: only what is cached locally is used for missing intermediates and revocation
+		config.dwFlags = CERT_CHAIN_CACHE_ONLY_URL_RETRIEVAL;
+
+		if (!trustedRoots.empty())
+		{
+			m_roots = CertOpenStore(CERT_STORE_PROV_MEMORY, 0, NULL, 0, NULL);
+			if (!m_roots)
+				return;
+
+			for (auto& root : trustedRoots)
+			{
+				if (!CertAddEncodedCertificateToStore(m_roots, X509_ASN_ENCODING, root.data(), (DWORD)root.size(), CERT_STORE_ADD_USE_EXISTING, NULL))
+					return;
+			}
+
+			// only the bundle is trusted and any certificate in it, root or CA, can end a chain
+			config.hExclusiveRoot = m_roots;
+			config.dwExclusiveFlags = CERT_CHAIN_EXCLUSIVE_ENABLE_CA_FLAG;
+		}
+
+		if (!CertCreateCertificateChainEngine(&config, &m_engine))
+			m_engine = NULL;
+	}
+
+	SignatureVerifier::~SignatureVerifier()
+	{
+		if (m_engine)
+			CertFreeCertificateChainEngine(m_engine);
+
+		if (m_roots)
+			CertCloseStore(m_roots, 0);
+	}
+
+	bool SignatureVerifier::Verify(const std::wstring& path, FileSignatures& result, std::wstring& error) const
+	{
+		result.signatures.clear();
+
+		HANDLE file = CreateFile(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			error = L"Can't open file for reading.";
+			return false;
+		}
+
+		std::shared_ptr<void> doomOfFile(file, CloseHandle);
+
+		CertificateTableInfo info;
+		if (!ReadCertificateTableInfo(file, info))
+		{
+			error = L"Invalid PE format.";
+			return false;
+		}
+
+		if (!info.IsPresent())
+			return true;
+
+		struct Signature
+		{
+			MessagePtr message;
+			HashAlgorithm algorithm = HashAlgorithm::Sha256;
+			std::vector<BYTE> digest;
+			std::wstring problem;
+		};
+
+		std::vector<Signature> signatures;
+
+		std::vector<BYTE> table;
+		if (!ReadCertificateTable(file, info, table))
+		{
+			signatures.push_back(Signature());
+			signatures.back().problem = L"Certificate table is outside of the file.";
+		}
+
+		const size_t headerSize = offsetof(WIN_CERTIFICATE, bCertificate);
+		for (size_t offset = 0; offset + headerSize <= table.size(); )
+		{
+			const WIN_CERTIFICATE* entry = (const WIN_CERTIFICATE*)(table.data() + offset);
+
+			signatures.push_back(Signature());
+			Signature& signature = signatures.back();
+
+			if (entry->dwLength < headerSize || entry->dwLength > table.size() - offset)
+			{
+				signature.problem = L"Certificate table entry is malformed.";
+				break;
+			}
+
+			if (entry->wCertificateType != WIN_CERT_TYPE_PKCS_SIGNED_DATA)
+				signature.problem = L"Certificate table entry is not a PKCS #7 signature.";
+			else if (!(signature.message = Decode(entry->bCertificate, entry->dwLength - (DWORD)headerSize)))
+				signature.problem = L"Signature is malformed.";
+
+			offset += (entry->dwLength + 7) & ~7;
+		}
+
+		// signatures are all decoded first, so the file is read once for every digest algorithm they use
+		// dual signed files keep further signatures in an unauthenticated attribute of the first signer
+		for (size_t i = 0; i < signatures.size(); ++i)
+		{
+			HCRYPTMSG message = signatures[i].message.get();
+			if (!message)
+				continue;
+
+			if (!SignedDigest(message, signatures[i].algorithm, signatures[i].digest))
+			{
+				signatures[i].problem = L"Signature is not Authenticode or its digest algorithm is not supported.";
+				continue;
+			}
+
+			std::vector<BYTE> buffer;
+			if (!GetParam(message, CMSG_SIGNER_UNAUTH_ATTR_PARAM, 0, buffer))
+				continue;
+
+			const CRYPT_ATTRIBUTES* attributes = (const CRYPT_ATTRIBUTES*)buffer.data();
+			const CRYPT_ATTRIBUTE* nested = CertFindAttribute(NestedSignatureOid, attributes->cAttr, attributes->rgAttr);
+			for (DWORD k = 0; nested && k < nested->cValue; ++k)
+			{
+				Signature signature;
+				if (!(signature.message = Decode(nested->rgValue[k].pbData, nested->rgValue[k].cbData)))
+					signature.problem = L"Nested signature is malformed.";
+
+				signatures.push_back(signature);
+			}
+		}
+
+		std::vector<HashAlgorithm> algorithms;
+		for (auto& signature : signatures)
+		{
+			if (signature.problem.empty() && std::find(algorithms.begin(), algorithms.end(), signature.algorithm) == algorithms.end())
+				algorithms.push_back(signature.algorithm);
+		}
+
+		std::vector<std::vector<BYTE>> digests;
+		if (!algorithms.empty() && !AuthenticodeDigest(file, algorithms, digests, error))
+			return false;
+
+		for (auto& signature : signatures)
+		{
+			SignatureCheck check;
+			check.digestAlgorithm = signature.algorithm;
+
+			if (!signature.problem.empty())
+			{
+				check.problems.push_back(signature.problem);
+				result.signatures.push_back(check);
+				continue;
+			}
+
+			size_t index = std::find(algorithms.begin(), algorithms.end(), signature.algorithm) - algorithms.begin();
+			check.digestMatches = digests[index] == signature.digest;
+			if (!check.digestMatches)
+				check.problems.push_back(L"Signed digest doesn't match the file.");
+
+			VerifySigner(signature.message.get(), check);
+			result.signatures.push_back(check);
+		}
+
+		return true;
+	}
+
+	void SignatureVerifier::VerifySigner(HCRYPTMSG message, SignatureCheck& check) const
+	{
+		SignerCertificate signer;
+		std::wstring problem;
+		if (!FindSigner(message, signer, problem))
+		{
+			check.problems.push_back(L"Signature " + problem);
+			return;
+		}
+
+		check.signer = CertificateName(signer.certificate.get());
+
+		Hash thumbprint(HashAlgorithm::Sha1);
+		thumbprint.Update(signer.certificate->pbCertEncoded, signer.certificate->cbCertEncoded);
+		check.signerThumbprint = thumbprint.Finish();
+
+		// checks the message digest attribute against the content too
+		check.signatureValid = CryptMsgControl(message, 0, CMSG_CTRL_VERIFY_SIGNATURE, signer.certificate->pCertInfo) != FALSE;
+		if (!check.signatureValid)
+			check.problems.push_back(L"Signature doesn't match the signer certificate.");
+
+		VerifyTimestamp(message, (HCERTSTORE)signer.store.get(), check);
+
+		check.chainTrusted = VerifyChain(signer.certificate.get(), (HCERTSTORE)signer.store.get(), CodeSigningOid, check.timestampValid ? &check.timestampTime : NULL, problem);
+		if (!check.chainTrusted)
+			check.problems.push_back(L"Signer certificate " + problem);
+	}
+
+	void SignatureVerifier::VerifyTimestamp(HCRYPTMSG message, HCERTSTORE store, SignatureCheck& check) const
+	{
+		std::vector<BYTE> buffer;
+		if (!GetParam(message, CMSG_SIGNER_UNAUTH_ATTR_PARAM, 0, buffer))
+			return;
+
+		const CRYPT_ATTRIBUTES* attributes = (const CRYPT_ATTRIBUTES*)buffer.data();
+		const CRYPT_ATTRIBUTE* rfc3161 = CertFindAttribute(Rfc3161CounterSignOid, attributes->cAttr, attributes->rgAttr);
+		const CRYPT_ATTRIBUTE* legacy = CertFindAttribute(CounterSignOid, attributes->cAttr, attributes->rgAttr);
+		if (!rfc3161 && !legacy)
+			return;
+
+		check.timestamp = rfc3161 ? SignatureCheck::Rfc3161Timestamp : SignatureCheck::LegacyTimestamp;
+		const CRYPT_ATTRIBUTE* attribute = rfc3161 ? rfc3161 : legacy;
+
+		std::vector<BYTE> signature;
+		if (attribute->cValue != 1 || !GetParam(message, CMSG_ENCRYPTED_DIGEST, 0, signature))
+		{
+			check.problems.push_back(L"Timestamp is malformed.");
+			return;
+		}
+
+		SignerCertificate signer;
+		FILETIME time = {};
+		std::wstring problem;
+
+		bool valid = rfc3161
+			? VerifyRfc3161Token(attribute->rgValue[0], signature, signer, time, problem)
+			: VerifyCountersignature(message, store, attribute->rgValue[0], signer, time, problem);
+
+		if (valid && !VerifyChain(signer.certificate.get(), (HCERTSTORE)signer.store.get(), TimeStampingOid, &time, problem))
+		{
+			problem = L"Timestamp certificate " + problem;
+			valid = false;
+		}
+
+		if (!valid)
+		{
+			check.problems.push_back(problem);
+			return;
+		}
+
+		check.timestampValid = true;
+		check.timestampTime = time;
+	}
+
+	bool SignatureVerifier::VerifyChain(PCCERT_CONTEXT certificate, HCERTSTORE store, const char* usage, const FILETIME* time, std::wstring& problem) const
+	{
+		CERT_CHAIN_PARA parameters = {};
+		parameters.cbSize = sizeof(parameters);
+		parameters.RequestedUsage.dwType = USAGE_MATCH_TYPE_AND;
+		parameters.RequestedUsage.Usage.cUsageIdentifier = 1;
+		parameters.RequestedUsage.Usage.rgpszUsageIdentifier = (LPSTR*)&usage;
+
+		PCCERT_CHAIN_CONTEXT chain = NULL;
+		if (!CertGetCertificateChain(m_engine, certificate, (LPFILETIME)time, store, &parameters, CERT_CHAIN_CACHE_ONLY_URL_RETRIEVAL | CERT_CHAIN_DISABLE_AUTH_ROOT_AUTO_UPDATE, NULL, &chain))
+		{
+			problem = L"chain can't be built.";
+			return false;
+		}
+
+		// revocation can't be checked offline
+		DWORD status = chain->TrustStatus.dwErrorStatus & ~(CERT_TRUST_REVOCATION_STATUS_UNKNOWN | CERT_TRUST_IS_OFFLINE_REVOCATION);
+		CertFreeCertificateChain(chain);
+
+		if (status == CERT_TRUST_NO_ERROR)
+			return true;
+
+		problem = ChainProblem(status);
+		return false;
+	}
+
+	std::string SignatureVerifier::Report(const std::wstring& path, const FileSignatures& result, bool json)
+	{
+		const wchar_t* status = !result.IsSigned() ? L"unsigned" : result.IsValid() ? L"valid" : L"invalid";
+
+		std::wstring out;
+		if (!json)
+		{
+			out = path + L": " + status + L"\n";
+			for (auto& check : result.signatures)
+			{
+				out += L"  ";
+				out += HashAlgorithmName(check.digestAlgorithm);
+				out += L" signature by " + (check.signer.empty() ? std::wstring(L"unknown signer") : L"\"" + check.signer + L"\"");
+
+				if (check.timestampValid)
+					out += L", timestamped " + FormatTime(check.timestampTime) + ((check.timestamp == SignatureCheck::Rfc3161Timestamp) ? L" (RFC 3161)" : L" (legacy)");
+				else if (check.timestamp != SignatureCheck::NoTimestamp)
+					out += L", invalid timestamp";
+				else
+					out += L", not timestamped";
+
+				for (size_t i = 0; i < check.problems.size(); ++i)
+					out += ((i == 0) ? L": " : L" ") + check.problems[i];
+
+				out += L"\n";
+			}
+
+			return WideStringToUtf8(out);
+		}
+
+		static const wchar_t* timestampTypes[] = { L"none", L"rfc3161", L"legacy" };
+
+		out = L"{\"file\":";
+		AppendJsonString(out, path);
+		out += L",\"status\":\"";
+		out += status;
+		out += L"\",\"signatures\":[";
+
+		for (size_t i = 0; i < result.signatures.size(); ++i)
+		{
+			const SignatureCheck& check = result.signatures[i];
+
+			out += (i == 0) ? L"{" : L",{";
+			out += L"\"digestAlgorithm\":\"";
+			out += HashAlgorithmName(check.digestAlgorithm);
+			out += L"\",\"digestMatches\":";
+			out += check.digestMatches ? L"true" : L"false";
+			out += L",\"signatureValid\":";
+			out += check.signatureValid ? L"true" : L"false";
+			out += L",\"chainTrusted\":";
+			out += check.chainTrusted ? L"true" : L"false";
+			out += L",\"signer\":";
+			AppendJsonString(out, check.signer);
+			out += L",\"timestamp\":\"";
+			out += timestampTypes[check.timestamp];
+			out += L"\",\"timestampValid\":";
+			out += check.timestampValid ? L"true" : L"false";
+
+			if (check.timestampValid)
+			{
+				out += L",\"timestampTime\":";
+				AppendJsonString(out, FormatTime(check.timestampTime));
+			}
+
+			out += L",\"problems\":[";
+			for (size_t k = 0; k < check.problems.size(); ++k)
+			{
+				if (k)
+					out += L',';
+				AppendJsonString(out, check.problems[k]);
+			}
+			out += L"]}";
+		}
+
+		out += L"]}\n";
+		return WideStringToUtf8(out);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,95 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <windows.h>
+#include <wincrypt.h>
+
+#include <string>
+#include <vector>
+
+#include "hash.h"
+
+namespace peparser
+{
+	// outcome of checking one Authenticode signature, every check is made even if an earlier one failed
+	struct SignatureCheck
+	{
+		enum TimestampType
+		{
+			  NoTimestamp
+			, Rfc3161Timestamp
+			, LegacyTimestamp
+		};
+
+		HashAlgorithm digestAlgorithm = HashAlgorithm::Sha256;
+		// digest in SpcIndirectDataContent equals the one computed from the file
+		bool digestMatches = false;
+		// signer's signature over authenticated attributes (and through them over the content) is correct
+		bool signatureValid = false;
+		// signer certificate chains up to a trusted root and is good for code signing at signing time
+		bool chainTrusted = false;
+		std::wstring signer;
+		// SHA-1 hash of the signer certificate (Details/Thumbprint)
+		std::vector<BYTE> signerThumbprint;
+
+		TimestampType timestamp = NoTimestamp;
+		bool timestampValid = false;
+		// UTC, only meaningful when the timestamp is valid
+		FILETIME timestampTime = {};
+
+		std::vector<std::wstring> problems;
+
+		bool IsValid() const { return problems.empty(); }
+	};
+
+	// signatures of one file: every WIN_CERTIFICATE entry and signatures nested in them (dual signing)
+	struct FileSignatures
+	{
+		std::vector<SignatureCheck> signatures;
+
+		bool IsSigned() const { return !signatures.empty(); }
+		bool IsValid() const;
+
+		// primary signature covers the current contents, is correct and made with the certificate with a given
+		// thumbprint (and timestamped if required), chain trust is not required: the certificate is the caller's choice
+		bool IsSignedWith(const std::string& thumbprint, bool timestampRequired) const;
+	};
+
+	// verifies Authenticode signatures of PE files offline: digests are recomputed from the file in one sequential read
+	// (for all digest algorithms used by its signatures at once), signatures are checked by CryptMsg and chains are
+	// built without touching the network, so revocation is not checked
+	// a signer chain is checked at the time of a valid timestamp, so signatures outlive expired certificates the same
+	// way they do for WinVerifyTrust, and at the current time otherwise
+	// one verifier is meant to be shared by worker threads, Verify() is thread safe
+	class SignatureVerifier
+	{
+	public:
+		// signer and timestamp chains must end in one of trustedRoots (DER), or in a root trusted by the system if empty
+		explicit SignatureVerifier(const std::vector<std::vector<BYTE>>& trustedRoots);
+		~SignatureVerifier();
+
+		SignatureVerifier(const SignatureVerifier&) = delete;
+		SignatureVerifier& operator=(const SignatureVerifier&) = delete;
+
+		// false if the chain engine could not be created
+		bool IsValid() const { return m_engine != NULL; }
+
+		// returns false and sets error only when the file can't be read or is not a PE image,
+		// an unsigned file has no signatures and a broken signature is reported in its problems
+		bool Verify(const std::wstring& path, FileSignatures& result, std::wstring& error) const;
+
+		// UTF-8 report of a file: a status line followed by a line per signature, or one JSON Lines object
+		static std::string Report(const std::wstring& path, const FileSignatures& result, bool json);
+
+	private:
+		// signer, its timestamp and both chains, the digest is compared by Verify()
+		void VerifySigner(HCRYPTMSG message, SignatureCheck& check) const;
+		void VerifyTimestamp(HCRYPTMSG message, HCERTSTORE store, SignatureCheck& check) const;
+		bool VerifyChain(PCCERT_CONTEXT certificate, HCERTSTORE store, const char* usage, const FILETIME* time, std::wstring& problem) const;
+
+		HCERTSTORE m_roots = NULL;
+		HCERTCHAINENGINE m_engine = NULL;
+	};
+}
\ No newline at end of file
@@ -3,19 +3,28 @@
 
 #include "signer.h"
 #include "peparser.h"
+#include "authenticode.h"
+#include "certificatetable.h"
+#include "rfc3161.h"
+#include "timestampclient.h"
 
 #include <windows.h>
 #include <wincrypt.h>
+#include <ncrypt.h>
 
 #pragma warning(push)
 #pragma warning(disable : 4091)
 #include <imagehlp.h>
 #pragma warning(pop)
 
+#include <algorithm>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <sstream>
 
 #pragma comment(lib, "crypt32.lib")
+#pragma comment(lib, "ncrypt.lib")
 #pragma comment(lib, "Imagehlp.lib")
 
 // The following hyperlinks have useful descriptions of the Microsoft Authenticode APIs used in this file:
@@ -220,16 +229,224 @@ namespace peparser
 			return true;
 		}
 
+		void UseRfc3161Timestamps()
+		{
+			rfc3161 = true;
+		}
+
+		// signs without timestamp, can be called for different files in parallel
+		bool Sign(const std::wstring& path, std::wstring& error)
+		{
+			return WithSubject(path, error, [&](SIGNER_SUBJECT_INFO& signerSubjectInfo)
+			{
+				SIGNER_CERT_STORE_INFO signerCertStoreInfo;
+				signerCertStoreInfo.cbSize = sizeof(SIGNER_CERT_STORE_INFO);
+				signerCertStoreInfo.pSigningCert = certContext;
+				signerCertStoreInfo.dwCertPolicy = 2; // SIGNER_CERT_POLICY_CHAIN
+				signerCertStoreInfo.hCertStore = NULL;
+
+				SIGNER_CERT signerCert;
+				signerCert.cbSize = sizeof(SIGNER_CERT);
+				signerCert.dwCertChoice = 2; // SIGNER_CERT_STORE
+				signerCert.pCertStoreInfo = &signerCertStoreInfo;
+				signerCert.hwnd = NULL;
+
+				SIGNER_SIGNATURE_INFO signerSignatureInfo;
+				signerSignatureInfo.cbSize = sizeof(SIGNER_SIGNATURE_INFO);
+				signerSignatureInfo.algidHash = CALG_SHA_256;
+				signerSignatureInfo.dwAttrChoice = 0; // SIGNER_NO_ATTR
+				signerSignatureInfo.pAttrAuthcode = NULL;
+				signerSignatureInfo.psAuthenticated = NULL;
+				signerSignatureInfo.psUnauthenticated = NULL;
+
+				HRESULT res = signerSignEx(0, &signerSubjectInfo, &signerCert, &signerSignatureInfo, NULL, NULL, NULL, NULL, NULL);
+				if (res != S_OK)
+					error = L"Failed to sign file. Error: " + HResult(res);
+
+				return res == S_OK;
+			});
+		}
+
+		// adds timestamp to a signed file, one request to one server
+		// RFC 3161 requests are made natively over kept alive connections, legacy ones go through Mssign32
+		bool Timestamp(const std::wstring& path, const std::wstring& url, std::wstring& error)
+		{
+			if (rfc3161)
+				return TimestampFile(client, path, url, error);
+
+			return WithSubject(path, error, [&](SIGNER_SUBJECT_INFO& signerSubjectInfo)
+			{
+				HRESULT res = signerTimestampEx(0, &signerSubjectInfo, url.c_str(), NULL, NULL, NULL);
+
+				if (res != S_OK)
+					error = L"Failed to timestamp file. Error: " + HResult(res);
+
+				return res == S_OK;
+			});
+		}
+
 		bool SignFile(const std::wstring& path, std::vector<std::wstring> timestampUrls)
 		{
-			if (!signerSignEx || !signerFreeSignerContext || !signerTimestampEx)
+			std::wstring error;
+			if (!Sign(path, error))
+			{
+				std::wcerr << error << L", File: " << path << std::endl;
+				return false;
+			}
+			else
+				std::wcerr << L"Signed: " << path << std::endl;
+
+			bool timestamped = false;
+			for (auto it = timestampUrls.begin(); it != timestampUrls.end() && !timestamped; ++it)
+			{
+				timestamped = Timestamp(path, *it, error);
+				if (timestamped)
+					std::wcerr << L"Timestamped: " << path << std::endl;
+				else
+					std::wcerr << error << L", Url: " << *it << std::endl;
+			}
+
+			return timestamped || timestampUrls.empty();
+		}
+
+		bool SignDigest(const std::vector<BYTE>& digest, std::vector<BYTE>& signedData, std::wstring& error)
+		{
+			if (!certContext)
+			{
+				error = L"Signer is not initialized.";
+				return false;
+			}
+
+			if (!LoadChain(error))
 				return false;
 
+			return AuthenticodeSignedData(digest, chain, [this](const std::vector<BYTE>& digestInfo, std::vector<BYTE>& signature, std::wstring& signError)
+			{
+				return SignDigestInfo(digestInfo, signature, signError);
+			}, signedData, error);
+		}
+
+	private:
+		// signer certificate followed by the rest of its chain without the root, built on first use
+		bool LoadChain(std::wstring& error)
+		{
+			std::lock_guard<std::mutex> guard(keyLock);
+
+			if (!chain.empty())
+				return true;
+
+			CERT_CHAIN_PARA chainPara = {};
+			chainPara.cbSize = sizeof(chainPara);
+
+			PCCERT_CHAIN_CONTEXT chainContext = NULL;
+			if (!CertGetCertificateChain(NULL, certContext, NULL, certStore, &chainPara, 0, NULL, &chainContext))
+			{
+				error = L"Failed to build certificate chain. Error: " + HResult(GetLastError());
+				return false;
+			}
+
+			const CERT_SIMPLE_CHAIN* simpleChain = chainContext->rgpChain[0];
+			for (DWORD i = 0; i < simpleChain->cElement; ++i)
+			{
+				PCCERT_CONTEXT element = simpleChain->rgpElement[i]->pCertContext;
+
+				// signtool leaves out the self-signed root as well
+				if (i && CertCompareCertificateName(X509_ASN_ENCODING, &element->pCertInfo->Subject, &element->pCertInfo->Issuer))
+					break;
+
+				chain.push_back(std::vector<BYTE>(element->pbCertEncoded, element->pbCertEncoded + element->cbCertEncoded));
+			}
+
+			CertFreeCertificateChain(chainContext);
+			return true;
+		}
+
+		// PKCS #1 v1.5 signature of a DigestInfo
+		bool SignDigestInfo(const std::vector<BYTE>& digestInfo, std::vector<BYTE>& signature, std::wstring& error)
+		{
+			std::lock_guard<std::mutex> guard(keyLock);
+
+			// key is cached with the certificate context and released with it
+			HCRYPTPROV_OR_NCRYPT_KEY_HANDLE key = 0;
+			DWORD keySpec = 0;
+			BOOL freeKey = FALSE;
+			if (!CryptAcquireCertificatePrivateKey(certContext, CRYPT_ACQUIRE_CACHE_FLAG | CRYPT_ACQUIRE_PREFER_NCRYPT_KEY_FLAG, NULL, &key, &keySpec, &freeKey))
+			{
+				error = L"Failed to acquire private key. Error: " + HResult(GetLastError());
+				return false;
+			}
+
+			if (keySpec == CERT_NCRYPT_KEY_SPEC)
+			{
+				// padding without an algorithm signs the DigestInfo as it is
+				BCRYPT_PKCS1_PADDING_INFO padding = { NULL };
+				DWORD size = 0;
+				SECURITY_STATUS status = NCryptSignHash(key, &padding, (PBYTE)digestInfo.data(), (DWORD)digestInfo.size(), NULL, 0, &size, BCRYPT_PAD_PKCS1);
+				if (status == ERROR_SUCCESS)
+				{
+					signature.resize(size);
+					status = NCryptSignHash(key, &padding, (PBYTE)digestInfo.data(), (DWORD)digestInfo.size(), signature.data(), size, &size, BCRYPT_PAD_PKCS1);
+					signature.resize(size);
+				}
+
+				if (status != ERROR_SUCCESS)
+				{
+					error = L"Failed to sign digest. Error: " + HResult(status);
+					return false;
+				}
+
+				return true;
+			}
+
+			// legacy CSP (SafeNet eToken) builds DigestInfo itself, so only the SHA-256 hash at its end is set
+			const DWORD hashSize = 32;
+			HCRYPTHASH hash = NULL;
+			DWORD size = 0;
+			bool ok = digestInfo.size() > hashSize
+				&& CryptCreateHash(key, CALG_SHA_256, 0, 0, &hash)
+				&& CryptSetHashParam(hash, HP_HASHVAL, digestInfo.data() + digestInfo.size() - hashSize, 0)
+				&& CryptSignHash(hash, keySpec, NULL, 0, NULL, &size);
+
+			if (ok)
+			{
+				signature.resize(size);
+				ok = CryptSignHash(hash, keySpec, NULL, 0, signature.data(), &size) != FALSE;
+				signature.resize(size);
+			}
+
+			if (!ok)
+				error = L"Failed to sign digest. Error: " + HResult(GetLastError());
+
+			if (hash)
+				CryptDestroyHash(hash);
+
+			// CryptoAPI returns signatures little endian
+			std::reverse(signature.begin(), signature.end());
+			return ok;
+		}
+
+		static std::wstring HResult(HRESULT res)
+		{
+			std::wostringstream out;
+			out << std::hex << (DWORD)res;
+			return out.str();
+		}
+
+		// opens file exclusively and calls action with subject info describing it
+		template<class Action>
+		bool WithSubject(const std::wstring& path, std::wstring& error, const Action& action)
+		{
+			if (!signerSignEx || !signerFreeSignerContext || !signerTimestampEx || !certContext)
+			{
+				error = L"Signer is not initialized.";
+				return false;
+			}
+
 			HANDLE file = CreateFile(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
 
 			if (file == INVALID_HANDLE_VALUE)
 			{
-				std::wcerr << L"Failed to open file. Error: " << std::hex << GetLastError() << ", File: " << path << std::endl;
+				error = L"Failed to open file. Error: " + HResult(GetLastError());
 				return false;
 			}
 
@@ -247,60 +464,23 @@ namespace peparser
 			signerSubjectInfo.dwSubjectChoice = 1; // SIGNER_SUBJECT_FILE
 			signerSubjectInfo.pSignerFileInfo = &signerFileInfo;
 
-			SIGNER_CERT_STORE_INFO signerCertStoreInfo;
-			signerCertStoreInfo.cbSize = sizeof(SIGNER_CERT_STORE_INFO);
-			signerCertStoreInfo.pSigningCert = certContext;
-			signerCertStoreInfo.dwCertPolicy = 2; // SIGNER_CERT_POLICY_CHAIN
-			signerCertStoreInfo.hCertStore = NULL;
-
-			SIGNER_CERT signerCert;
-			signerCert.cbSize = sizeof(SIGNER_CERT);
-			signerCert.dwCertChoice = 2; // SIGNER_CERT_STORE
-			signerCert.pCertStoreInfo = &signerCertStoreInfo;
-			signerCert.hwnd = NULL;
-
-			SIGNER_SIGNATURE_INFO signerSignatureInfo;
-			signerSignatureInfo.cbSize = sizeof(SIGNER_SIGNATURE_INFO);
-			signerSignatureInfo.algidHash = CALG_SHA_256;
-			signerSignatureInfo.dwAttrChoice = 0; // SIGNER_NO_ATTR
-			signerSignatureInfo.pAttrAuthcode = NULL;
-			signerSignatureInfo.psAuthenticated = NULL;
-			signerSignatureInfo.psUnauthenticated = NULL;
-
-			HRESULT res = signerSignEx(0, &signerSubjectInfo, &signerCert, &signerSignatureInfo, NULL, NULL, NULL, NULL, NULL);
-
-			if (res != S_OK)
-			{
-				std::wcerr << L"Failed to sign file. Error: " << res << ", File: " << path << std::endl;
-				return false;
-			}
-			else
-				std::wcerr << L"Signed: " << path << std::endl;
-
-			for (auto it = timestampUrls.begin(); it != timestampUrls.end(); ++it)
-			{
-				res = signerTimestampEx(0, &signerSubjectInfo, it->c_str(), NULL, NULL, NULL);
-				if (res == S_OK)
-				{
-					std::wcerr << L"Timestamped: " << path << std::endl;
-					break;
-				}
-				else
-					std::wcerr << L"Failed to timestamp file. Error: " << res << ", Url: " << *it << std::endl;
-			}
-
-			return res == S_OK;
+			return action(signerSubjectInfo);
 		}
 
-	private:
 		HMODULE dll = nullptr;
 
 		SignerSignExType signerSignEx = nullptr;
 		SignerFreeSignerContextType signerFreeSignerContext = nullptr;
 		SignerTimeStampExType signerTimestampEx = nullptr;
 
+		bool rfc3161 = false;
+		TimestampClient client;
+
 		HCERTSTORE certStore = nullptr;
 		PCCERT_CONTEXT certContext = nullptr;
+
+		std::vector<std::vector<BYTE>> chain;
+		std::mutex keyLock;
 	};
 
 	// ==========================================================================================================
@@ -320,52 +500,109 @@ namespace peparser
 		return _m->SelectCertificate(certStore, certHash);
 	}
 
+	void Signer::UseRfc3161Timestamps()
+	{
+		_m->UseRfc3161Timestamps();
+	}
+
 	bool Signer::SignFile(const std::wstring& path, std::vector<std::wstring> timestampUrls)
 	{
 		return _m->SignFile(path, timestampUrls);
 	}
 
+	bool Signer::SignDigest(const std::vector<BYTE>& digest, std::vector<BYTE>& signedData, std::wstring& error)
+	{
+		return _m->SignDigest(digest, signedData, error);
+	}
+
+	SigningPipeline::SignFunction Signer::SignStep()
+	{
+		return [this](const std::wstring& path, std::wstring& error) { return _m->Sign(path, error); };
+	}
+
+	SigningPipeline::TimestampFunction Signer::TimestampStep()
+	{
+		return [this](const std::wstring& path, const std::wstring& url, std::wstring& error) { return _m->Timestamp(path, url, error); };
+	}
+
+	bool Signer::SignFiles(const std::vector<std::wstring>& paths, const std::vector<std::wstring>& timestampUrls, const SigningPipeline::Options& options)
+	{
+		SigningPipeline pipeline(SignStep(), TimestampStep(), timestampUrls, options);
+		return pipeline.RunAndReport(paths);
+	}
+
 	// ==========================================================================================================
 
-	void StripSignature(const std::wstring& path, int& retcode)
+	bool StripSignature(const std::wstring& path, std::wstring& error)
 	{
+		switch (StripTrailingCertificates(path, error))
+		{
+		case StripResult::Stripped:
+		case StripResult::NotSigned:
+			return true;
+		case StripResult::Failed:
+			return false;
+		default:
+			break;
+		}
+
 		HANDLE file = CreateFile(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
 		if (file == INVALID_HANDLE_VALUE)
 		{
-			std::wcerr << "Failed to open file for writing." << std::endl;
-			retcode = GetLastError();
-			return;
+			error = L"Failed to open file for writing.";
+			return false;
 		}
 
 		bool enumerateFailed = false;
+		bool result = true;
 		DWORD count = 0;
 		if (!ImageEnumerateCertificates(file, CERT_SECTION_TYPE_ANY, &count, NULL, 0))
 		{
-			std::wcerr << "Failed to enumerate certificates. " << GetLastError() << std::endl;
 			enumerateFailed = true;
 		}
 		else
 		{
+			// indexes shift down as certificates are removed
 			for (DWORD k = 0; k < count; ++k)
 			{
-				if (!ImageRemoveCertificate(file, k))
+				if (!ImageRemoveCertificate(file, 0))
 				{
-					retcode = GetLastError();
-					std::wcerr << "Failed to remove certificate: " << k << L". " << retcode << std::endl;
+					error = L"Failed to remove certificate: " + std::to_wstring(k) + L". " + std::to_wstring(GetLastError());
+					result = false;
+					break;
 				}
 			}
 		}
 
 		CloseHandle(file);
 
+		// directory entry doesn't point at a valid table, it is cleared
 		if (enumerateFailed)
 		{
 			PEParser pe(path);
 			pe.Open(true);
+			if (!pe.IsValidPE())
+			{
+				error = L"Failed to enumerate certificates.";
+				return false;
+			}
+
 			if (pe.IsCorrupted())
 				std::wcerr << L"Fixing signature directory entry." << std::endl;
 
 			pe.EraseSignatureDirectory();
 		}
+
+		return result;
+	}
+
+	void StripSignature(const std::wstring& path, int& retcode)
+	{
+		std::wstring error;
+		if (!StripSignature(path, error))
+		{
+			std::wcerr << error << std::endl;
+			retcode = 1;
+		}
 	}
 }
\ No newline at end of file
@@ -3,9 +3,13 @@
 
 #pragma once
 
+#include <windows.h>
+
 #include <string>
 #include <vector>
 
+#include "signingpipeline.h"
+
 namespace peparser
 {
 	// helper class for signing binaries
@@ -25,11 +29,35 @@ namespace peparser
 		// writes to std::cerr
 		bool SignFile(const std::wstring& path, std::vector<std::wstring> timestampUrls);
 
+		// signs and timestamps many binaries through SigningPipeline: signing runs on options.signThreads threads
+		// while up to options.window timestamp requests per url are in flight, requests go to the fastest healthy server
+		// and failed files are retried
+		// writes to std::cerr as files finish and prints per server statistics at the end,
+		// returns true if all files were signed (and timestamped if urls are given)
+		bool SignFiles(const std::vector<std::wstring>& paths, const std::vector<std::wstring>& timestampUrls, const SigningPipeline::Options& options);
+
+		// sign and timestamp steps SignFiles runs, for a SigningPipeline kept across batches (see SigningAgentServer)
+		SigningPipeline::SignFunction SignStep();
+		SigningPipeline::TimestampFunction TimestampStep();
+
+		// timestamps with native RFC 3161 requests (SHA-256) instead of legacy Authenticode ones through Mssign32
+		void UseRfc3161Timestamps();
+
+		// builds Authenticode SignedData for a SHA-256 digest natively (see AuthenticodeSignedData) with the selected
+		// certificate's key (CNG or legacy CSP), its chain is taken from the store, for a remote signing agent
+		// safe to call from several threads, key operations are serialized
+		bool SignDigest(const std::vector<BYTE>& digest, std::vector<BYTE>& signedData, std::wstring& error);
+
 	private:
 		class Signer_pimpl* _m = nullptr;
 	};
 
 	// cleanly removes digital signature section and updates PE header appropriately
 	// if updated incorrectly (by EndUpdateResource() for example) binary becomes unsignable by some tools
+	// a table at the end of the file (where signing tools put it) is removed natively by truncating the file,
+	// anything else goes through ImageRemoveCertificate()
+	// returns false and sets error if signature could not be removed, safe to call for different files in parallel
+	bool StripSignature(const std::wstring& path, std::wstring& error);
+	// same, writes to std::wcerr and sets retcode on failure
 	void StripSignature(const std::wstring& path, int& retcode);
 }
\ No newline at end of file
@@ -0,0 +1,290 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "signingagent.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+namespace peparser
+{
+	namespace
+	{
+		const DWORD PipeBufferSize = 64 * 1024;
+		// how long a client waits for a free pipe instance
+		const DWORD ConnectTimeout = 30000;
+		// clients served at once (pipe instances and their threads), more wait for a free instance
+		const DWORD MaxClients = 64;
+
+		std::wstring PipePath(const std::wstring& name)
+		{
+			return L"\\\\.\\pipe\\" + name;
+		}
+
+		bool ReadMessage(HANDLE pipe, std::wstring& message)
+		{
+			std::vector<BYTE> data;
+			for (;;)
+			{
+				BYTE buffer[4096];
+				DWORD read = 0;
+				BOOL ok = ReadFile(pipe, buffer, sizeof(buffer), &read, NULL);
+				data.insert(data.end(), buffer, buffer + read);
+
+				if (ok)
+					break;
+
+				if (GetLastError() != ERROR_MORE_DATA)
+					return false;
+			}
+
+			message.assign((const wchar_t*)data.data(), data.size() / sizeof(wchar_t));
+			return true;
+		}
+
+		bool WriteMessage(HANDLE pipe, const std::wstring& message)
+		{
+			DWORD size = (DWORD)(message.size() * sizeof(wchar_t));
+			DWORD written = 0;
+			return WriteFile(pipe, message.data(), size, &written, NULL) && written == size;
+		}
+
+		std::wstring FullPath(const std::wstring& path)
+		{
+			DWORD size = GetFullPathName(path.c_str(), 0, NULL, NULL);
+			if (!size)
+				return path;
+
+			std::wstring result(size, 0);
+			size = GetFullPathName(path.c_str(), size, &result[0], NULL);
+			result.resize(size);
+			return result;
+		}
+	}
+
+	SigningAgentServer::SigningAgentServer(const SigningPipeline::SignFunction& sign, const SigningPipeline::TimestampFunction& timestamp, const std::vector<std::wstring>& timestampUrls, const SigningPipeline::Options& options)
+		: m_pipeline(sign, timestamp, timestampUrls, options)
+	{
+	}
+
+	bool SigningAgentServer::Serve(const std::wstring& pipeName)
+	{
+		std::wstring path = PipePath(pipeName);
+		bool first = true;
+
+		for (;;)
+		{
+			{
+				std::unique_lock<std::mutex> lock(m_lock);
+				m_released.wait(lock, [this]() { return m_clients < MaxClients; });
+			}
+
+			// first instance claims the name, so a second agent (or anyone else) can't take over its clients
+			HANDLE pipe = CreateNamedPipe(path.c_str()
+				, PIPE_ACCESS_DUPLEX | (first ? FILE_FLAG_FIRST_PIPE_INSTANCE : 0)
+				, PIPE_TYPE_MESSAGE | PIPE_READMODE_MESSAGE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS
+				, MaxClients, PipeBufferSize, PipeBufferSize, 0, NULL);
+
+			if (pipe == INVALID_HANDLE_VALUE)
+			{
+				if (first)
+				{
+					std::wcerr << L"Failed to create pipe. Error: " << GetLastError() << L", Pipe: " << path << std::endl;
+					return false;
+				}
+
+				Sleep(100);
+				continue;
+			}
+
+			if (first)
+			{
+				std::thread(&SigningAgentServer::Worker, this).detach();
+				std::wcerr << L"Signing agent listening on " << path << std::endl;
+				first = false;
+			}
+
+			if (!ConnectNamedPipe(pipe, NULL) && GetLastError() != ERROR_PIPE_CONNECTED)
+			{
+				CloseHandle(pipe);
+				continue;
+			}
+
+			{
+				std::lock_guard<std::mutex> guard(m_lock);
+				++m_clients;
+			}
+
+			std::thread([this, pipe]()
+			{
+				ServeClient(pipe);
+
+				{
+					std::lock_guard<std::mutex> guard(m_lock);
+					--m_clients;
+				}
+				m_released.notify_one();
+			}).detach();
+		}
+	}
+
+	void SigningAgentServer::ServeClient(HANDLE pipe)
+	{
+		std::wstring request;
+		if (!ReadMessage(pipe, request))
+		{
+			CloseHandle(pipe);
+			return;
+		}
+
+		auto job = std::make_shared<Job>();
+		for (size_t start = 0; start < request.size(); )
+		{
+			size_t end = request.find(L'\n', start);
+			if (end == std::wstring::npos)
+				end = request.size();
+
+			if (end > start)
+				job->paths.push_back(request.substr(start, end - start));
+
+			start = end + 1;
+		}
+
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			m_queue.push_back(job);
+		}
+		m_changed.notify_all();
+
+		// a client that went away doesn't stop its files, they are signed anyway
+		bool connected = true;
+		size_t sent = 0;
+		for (bool done = false; !done; )
+		{
+			std::vector<std::wstring> lines;
+			{
+				std::unique_lock<std::mutex> lock(m_lock);
+				m_changed.wait(lock, [&]() { return job->lines.size() > sent || job->done; });
+
+				lines.assign(job->lines.begin() + sent, job->lines.end());
+				sent = job->lines.size();
+				done = job->done;
+			}
+
+			for (auto& line : lines)
+				connected = connected && WriteMessage(pipe, L">" + line);
+		}
+
+		if (connected && WriteMessage(pipe, job->succeeded ? L"=0" : L"=1"))
+			FlushFileBuffers(pipe);
+
+		DisconnectNamedPipe(pipe);
+		CloseHandle(pipe);
+	}
+
+	void SigningAgentServer::Worker()
+	{
+		for (;;)
+		{
+			std::vector<std::shared_ptr<Job>> batch;
+			{
+				std::unique_lock<std::mutex> lock(m_lock);
+				m_changed.wait(lock, [&]() { return !m_queue.empty(); });
+
+				batch.assign(m_queue.begin(), m_queue.end());
+				m_queue.clear();
+			}
+
+			std::vector<std::wstring> paths;
+			std::vector<Job*> owners;
+			for (auto& job : batch)
+			{
+				paths.insert(paths.end(), job->paths.begin(), job->paths.end());
+				owners.insert(owners.end(), job->paths.size(), job.get());
+			}
+
+			m_pipeline.Run(paths, [&](size_t index, const SigningPipeline::Result& result)
+			{
+				std::wstring line = m_pipeline.Report(paths[index], result);
+				std::wcerr << line << std::endl;
+
+				{
+					std::lock_guard<std::mutex> guard(m_lock);
+					owners[index]->lines.push_back(line);
+					owners[index]->succeeded = result.Succeeded(m_pipeline.TimestampRequired()) && owners[index]->succeeded;
+				}
+				m_changed.notify_all();
+			});
+
+			{
+				std::lock_guard<std::mutex> guard(m_lock);
+				for (auto& job : batch)
+					job->done = true;
+			}
+			m_changed.notify_all();
+
+			if (m_pipeline.TimestampRequired() && !paths.empty())
+				m_pipeline.Scheduler().PrintStats(std::wcerr);
+		}
+	}
+
+	// ==========================================================================================================
+
+	int SubmitToSigningAgent(const std::wstring& pipeName, const std::vector<std::wstring>& paths)
+	{
+		std::wstring path = PipePath(pipeName);
+
+		HANDLE pipe = INVALID_HANDLE_VALUE;
+		for (;;)
+		{
+			pipe = CreateFile(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+			if (pipe != INVALID_HANDLE_VALUE)
+				break;
+
+			// every instance is taken, the agent creates the next one as soon as it accepts a client, or once one of
+			// MaxClients is done, a busy agent is waited for as long as it takes
+			if (GetLastError() != ERROR_PIPE_BUSY)
+			{
+				std::wcerr << L"Signing agent is not running. Error: " << GetLastError() << L", Pipe: " << path << std::endl;
+				return 1;
+			}
+
+			if (!WaitNamedPipe(path.c_str(), ConnectTimeout) && GetLastError() != ERROR_SEM_TIMEOUT)
+			{
+				std::wcerr << L"Signing agent is not running. Error: " << GetLastError() << L", Pipe: " << path << std::endl;
+				return 1;
+			}
+		}
+
+		DWORD mode = PIPE_READMODE_MESSAGE;
+		SetNamedPipeHandleState(pipe, &mode, NULL, NULL);
+
+		std::wstring request;
+		for (auto& file : paths)
+			request += FullPath(file) + L"\n";
+
+		int retcode = 1;
+		bool finished = false;
+
+		if (WriteMessage(pipe, request))
+		{
+			for (std::wstring message; !finished && ReadMessage(pipe, message); )
+			{
+				if (!message.empty() && message[0] == L'>')
+					std::wcerr << message.substr(1) << std::endl;
+				else if (!message.empty() && message[0] == L'=')
+				{
+					retcode = _wtoi(message.c_str() + 1);
+					finished = true;
+				}
+			}
+		}
+
+		if (!finished)
+			std::wcerr << L"Lost connection to signing agent." << std::endl;
+
+		CloseHandle(pipe);
+		return retcode;
+	}
+}
\ No newline at end of file
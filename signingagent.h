@@ -0,0 +1,64 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <windows.h>
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "signingpipeline.h"
+
+namespace peparser
+{
+	// long running signer for build graphs that call the tool many times: certificate selection and token login are
+	// paid once, clients on the same machine submit files over a named pipe (\\.\pipe\<name>, local clients only)
+	//
+	// a client sends one message with full paths separated by '\n' and gets a message per finished file (prefixed
+	// with '>') followed by "=<exit code>", all UTF-16
+	// requests are queued and everything queued is signed in one SigningPipeline run, so files of concurrent clients
+	// share signing threads and timestamp windows, and server statistics carry over between runs
+	class SigningAgentServer
+	{
+	public:
+		SigningAgentServer(const SigningPipeline::SignFunction& sign, const SigningPipeline::TimestampFunction& timestamp, const std::vector<std::wstring>& timestampUrls, const SigningPipeline::Options& options);
+
+		SigningAgentServer(const SigningAgentServer&) = delete;
+		SigningAgentServer& operator=(const SigningAgentServer&) = delete;
+
+		// serves until the process ends, returns false only if the pipe could not be created
+		// (another agent may own the name already), writes to std::wcerr
+		bool Serve(const std::wstring& pipeName);
+
+	private:
+		struct Job
+		{
+			std::vector<std::wstring> paths;
+			// progress of finished files, sent to the client as they come
+			std::vector<std::wstring> lines;
+			bool succeeded = true;
+			bool done = false;
+		};
+
+		void ServeClient(HANDLE pipe);
+		void Worker();
+
+		SigningPipeline m_pipeline;
+
+		std::mutex m_lock;
+		std::condition_variable m_changed;
+		std::deque<std::shared_ptr<Job>> m_queue;
+		// clients being served, Serve() waits on m_released for one to finish at the cap
+		std::condition_variable m_released;
+		size_t m_clients = 0;
+	};
+
+	// submits files (relative paths are resolved here) to an agent and waits for them, writes its progress to std::wcerr
+	// returns the exit code --sign would have, 1 if the agent can't be reached
+	int SubmitToSigningAgent(const std::wstring& pipeName, const std::vector<std::wstring>& paths);
+}
\ No newline at end of file
@@ -0,0 +1,243 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "signingpipeline.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+namespace peparser
+{
+	namespace
+	{
+		typedef std::chrono::steady_clock Clock;
+
+		// signed file waiting for a timestamp server
+		struct Pending
+		{
+			size_t index;
+			size_t failures;
+			// server that failed last, next attempt goes elsewhere if possible
+			size_t lastServer;
+			Clock::time_point notBefore;
+			// when the file first found every server backing off, zero until then
+			Clock::time_point unavailableSince;
+		};
+
+		TimestampScheduler::Options SchedulerOptions(const SigningPipeline::Options& options)
+		{
+			TimestampScheduler::Options schedulerOptions;
+			schedulerOptions.window = options.window;
+			return schedulerOptions;
+		}
+	}
+
+	SigningPipeline::SigningPipeline(const SignFunction& sign, const TimestampFunction& timestamp, const std::vector<std::wstring>& urls, const Options& options)
+		: m_sign(sign), m_timestamp(timestamp), m_urls(urls), m_options(options), m_scheduler(urls, SchedulerOptions(options))
+	{
+	}
+
+	std::vector<SigningPipeline::Result> SigningPipeline::Run(const std::vector<std::wstring>& paths, const DoneFunction& done)
+	{
+		std::vector<Result> results(paths.size());
+		if (paths.empty())
+			return results;
+
+		std::mutex lock;
+		std::condition_variable changed;
+		// guarded by lock
+		std::deque<Pending> queue;
+		size_t remaining = paths.size();
+
+		std::mutex reportLock;
+		auto finish = [&](size_t index)
+		{
+			{
+				std::lock_guard<std::mutex> guard(reportLock);
+				if (done)
+					done(index, results[index]);
+			}
+
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				--remaining;
+			}
+			changed.notify_all();
+		};
+
+		auto enqueue = [&](const Pending& pending)
+		{
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				queue.push_back(pending);
+			}
+			changed.notify_all();
+		};
+
+		std::atomic<size_t> next(0);
+		auto signWorker = [&]()
+		{
+			for (size_t i = next++; i < paths.size(); i = next++)
+			{
+				Result& result = results[i];
+
+				for (size_t attempt = 0; attempt <= m_options.retries && !result.signedFile; ++attempt)
+				{
+					if (attempt)
+						std::this_thread::sleep_for(std::chrono::milliseconds(m_options.retryDelay * attempt));
+
+					++result.attempts;
+					result.signedFile = m_sign(paths[i], result.error);
+				}
+
+				if (result.signedFile)
+					result.error.clear();
+
+				if (!result.signedFile || m_urls.empty())
+					finish(i);
+				else
+					enqueue(Pending{ i, 0, TimestampScheduler::NoServer, Clock::now() });
+			}
+		};
+
+		auto timestampWorker = [&]()
+		{
+			for (;;)
+			{
+				Pending pending;
+
+				{
+					std::unique_lock<std::mutex> guard(lock);
+
+					for (;;)
+					{
+						if (remaining == 0)
+							return;
+
+						auto now = Clock::now();
+						auto ready = std::find_if(queue.begin(), queue.end(), [now](const Pending& p) { return p.notBefore <= now; });
+						if (ready != queue.end())
+						{
+							pending = *ready;
+							queue.erase(ready);
+							break;
+						}
+
+						if (queue.empty())
+							changed.wait(guard);
+						else
+							changed.wait_until(guard, std::min_element(queue.begin(), queue.end(), [](const Pending& a, const Pending& b) { return a.notBefore < b.notBefore; })->notBefore);
+					}
+				}
+
+				Result& result = results[pending.index];
+
+				Pending retry = { pending.index, pending.failures + 1, TimestampScheduler::NoServer, Clock::now(), pending.unavailableSince };
+
+				size_t server = m_scheduler.Acquire(pending.lastServer);
+				if (server == TimestampScheduler::NoServer)
+				{
+					// not the servers failing this file, it waits for the first backoff to end without using up retries
+					result.error = L"All timestamp servers are unavailable.";
+
+					auto now = Clock::now();
+					Pending wait = pending;
+					if (wait.unavailableSince == Clock::time_point())
+						wait.unavailableSince = now;
+					wait.notBefore = m_scheduler.NextReopen();
+
+					if (now - wait.unavailableSince > std::chrono::milliseconds(SchedulerOptions(m_options).maxBackoff))
+						finish(pending.index);
+					else
+						enqueue(wait);
+					continue;
+				}
+
+				const std::wstring& url = m_urls[server];
+
+				++result.attempts;
+				std::wstring error;
+				auto start = Clock::now();
+				bool timestamped = m_timestamp(paths[pending.index], url, error);
+				m_scheduler.Release(server, timestamped, Clock::now() - start);
+
+				if (timestamped)
+				{
+					result.timestamped = true;
+					result.url = url;
+					result.error.clear();
+					finish(pending.index);
+					continue;
+				}
+
+				result.error = url + L": " + error;
+				retry.lastServer = server;
+
+				// a round is as many failures as there are servers, the file waits a bit longer after each one
+				size_t round = retry.failures / m_urls.size();
+				if (retry.failures % m_urls.size() == 0)
+					retry.notBefore += std::chrono::milliseconds(m_options.retryDelay * round);
+
+				if (round > m_options.retries)
+					finish(pending.index);
+				else
+					enqueue(retry);
+			}
+		};
+
+		std::vector<std::thread> pool;
+
+		// enough workers to fill the window of every server, the scheduler decides where each request goes
+		size_t timestampers = m_urls.empty() ? 0 : WorkerCount(max(m_options.window, (size_t)1) * m_urls.size(), paths.size());
+		for (size_t i = 0; i < timestampers; ++i)
+			pool.push_back(std::thread(timestampWorker));
+
+		size_t signers = WorkerCount(max(m_options.signThreads, (size_t)1), paths.size());
+		for (size_t i = 1; i < signers; ++i)
+			pool.push_back(std::thread(signWorker));
+
+		// calling thread signs too
+		signWorker();
+
+		for (auto& thread : pool)
+			thread.join();
+
+		return results;
+	}
+
+	std::wstring SigningPipeline::Report(const std::wstring& path, const Result& result) const
+	{
+		if (!result.signedFile)
+			return result.error + L", File: " + path;
+		else if (result.timestamped)
+			return L"Signed and timestamped: " + path + L", Url: " + result.url;
+		else if (m_urls.empty())
+			return L"Signed: " + path;
+		else
+			return L"Signed but not timestamped: " + path + L", " + result.error;
+	}
+
+	bool SigningPipeline::RunAndReport(const std::vector<std::wstring>& paths)
+	{
+		bool ret = true;
+		// reported as files finish, not in input order
+		Run(paths, [&](size_t index, const Result& result)
+		{
+			std::wcerr << Report(paths[index], result) << std::endl;
+
+			ret = result.Succeeded(!m_urls.empty()) && ret;
+		});
+
+		if (!m_urls.empty())
+			m_scheduler.PrintStats(std::wcerr);
+
+		return ret;
+	}
+}
\ No newline at end of file
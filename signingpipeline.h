@@ -0,0 +1,78 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <windows.h>
+
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "timestampscheduler.h"
+
+namespace peparser
+{
+	// signs many files with timestamp round trips overlapped: files are signed on a pool of signing threads
+	// and handed to timestamp workers as soon as they are signed
+	// TimestampScheduler picks the server for every request, with at most 'window' requests in flight per server;
+	// a failed request is retried on another server, after as many failures as there are servers the file waits
+	// for a delay, up to 'retries' such rounds
+	// while every server is backing off files wait for the first one to come back instead, that doesn't use up retries
+	// (the file gives up once the scheduler's longest backoff has passed since it first found them all backing off)
+	// signing and timestamping are callbacks, so the pipeline doesn't depend on how either is done
+	class SigningPipeline
+	{
+	public:
+		typedef std::function<bool(const std::wstring& path, std::wstring& error)> SignFunction;
+		typedef std::function<bool(const std::wstring& path, const std::wstring& url, std::wstring& error)> TimestampFunction;
+
+		struct Options
+		{
+			size_t signThreads = 1;
+			size_t window = 4;
+			size_t retries = 2;
+			// delay before a retry round, grows linearly with the round
+			DWORD retryDelay = 2000;
+		};
+
+		struct Result
+		{
+			bool signedFile = false;
+			bool timestamped = false;
+			// server that timestamped the file
+			std::wstring url;
+			size_t attempts = 0;
+			// last error, kept for files that were signed but could not be timestamped
+			std::wstring error;
+
+			bool Succeeded(bool timestampRequired) const { return signedFile && (timestamped || !timestampRequired); }
+		};
+
+		// called for every file once it is done (succeeded or ran out of retries), calls are serialized
+		typedef std::function<void(size_t index, const Result& result)> DoneFunction;
+
+		SigningPipeline(const SignFunction& sign, const TimestampFunction& timestamp, const std::vector<std::wstring>& urls, const Options& options);
+
+		// processes all files and returns their results in input order
+		std::vector<Result> Run(const std::vector<std::wstring>& paths, const DoneFunction& done);
+
+		// same, writes to std::wcerr as files finish and per server statistics at the end
+		// returns true if all files were signed (and timestamped if there are urls)
+		bool RunAndReport(const std::vector<std::wstring>& paths);
+
+		// progress line RunAndReport writes for a finished file
+		std::wstring Report(const std::wstring& path, const Result& result) const;
+		bool TimestampRequired() const { return !m_urls.empty(); }
+
+		// per server statistics of all runs so far
+		const TimestampScheduler& Scheduler() const { return m_scheduler; }
+
+	private:
+		SignFunction m_sign;
+		TimestampFunction m_timestamp;
+		std::vector<std::wstring> m_urls;
+		Options m_options;
+		TimestampScheduler m_scheduler;
+	};
+}
\ No newline at end of file
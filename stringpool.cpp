@@ -0,0 +1,93 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "stringpool.h"
+
+namespace peparser
+{
+	StringPool::StringPool()
+	{
+		m_buckets.resize(1024, None);
+		m_data.reserve(16 * 1024);
+	}
+
+	DWORD StringPool::Hash(const char* str, size_t length)
+	{
+		// FNV-1a
+		DWORD hash = 2166136261;
+		for (size_t i = 0; i < length; ++i)
+		{
+			hash ^= (BYTE)str[i];
+			hash *= 16777619;
+		}
+		return hash;
+	}
+
+	size_t StringPool::Length(Id id) const
+	{
+		if (id == None || id >= m_data.size())
+			return 0;
+		return strnlen(&m_data[id], m_data.size() - id);
+	}
+
+	bool StringPool::Equals(Id id, const char* str, size_t length) const
+	{
+		if (id + length >= m_data.size())
+			return false;
+		return m_data[id + length] == '\0' && memcmp(&m_data[id], str, length) == 0;
+	}
+
+	StringPool::Id StringPool::Find(const char* str, size_t length) const
+	{
+		size_t mask = m_buckets.size() - 1;
+		for (size_t i = Hash(str, length) & mask; m_buckets[i] != None; i = (i + 1) & mask)
+			if (Equals(m_buckets[i], str, length))
+				return m_buckets[i];
+
+		return None;
+	}
+
+	StringPool::Id StringPool::Add(const char* str, size_t length)
+	{
+		// strings are zero terminated in the pool, so embedded zeroes would make them unreachable
+		length = strnlen(str, length);
+
+		size_t mask = m_buckets.size() - 1;
+		size_t i = Hash(str, length) & mask;
+		for (; m_buckets[i] != None; i = (i + 1) & mask)
+			if (Equals(m_buckets[i], str, length))
+				return m_buckets[i];
+
+		Id id = (Id)m_data.size();
+		m_data.insert(m_data.end(), str, str + length);
+		m_data.push_back('\0');
+
+		m_buckets[i] = id;
+		++m_count;
+
+		// keeping load factor under 1/2
+		if (2 * m_count > m_buckets.size())
+			Grow();
+
+		return id;
+	}
+
+	void StringPool::Grow()
+	{
+		std::vector<Id> buckets(2 * m_buckets.size(), None);
+		size_t mask = buckets.size() - 1;
+
+		for (auto id : m_buckets)
+		{
+			if (id == None)
+				continue;
+
+			size_t i = Hash(&m_data[id], Length(id)) & mask;
+			while (buckets[i] != None)
+				i = (i + 1) & mask;
+			buckets[i] = id;
+		}
+
+		m_buckets.swap(buckets);
+	}
+}
\ No newline at end of file
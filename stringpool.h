@@ -0,0 +1,53 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <windows.h>
+
+#include <string>
+#include <vector>
+#include <memory>
+
+namespace peparser
+{
+	// append-only storage for interned narrow strings (symbol and module names)
+	// strings are kept back to back in one buffer and referenced by offset, adding a string that is already
+	// in the pool returns the existing id, so the pool can be shared by all files of a scan without allocating per symbol
+	// not thread safe, use one pool per worker when scanning in parallel
+	class StringPool
+	{
+	public:
+		typedef DWORD Id;
+		static const Id None = 0xFFFFFFFF;
+
+		StringPool();
+
+		// adds a string (not necessarily zero terminated) and returns its id
+		Id Add(const char* str, size_t length);
+		Id Add(const std::string& str) { return Add(str.data(), str.size()); }
+
+		// looks up a string without adding it, returns None if it is not in the pool
+		Id Find(const char* str, size_t length) const;
+
+		// returns zero terminated string, pointer is invalidated by subsequent Add()
+		const char* Get(Id id) const { return (id == None || id >= m_data.size()) ? "" : &m_data[id]; }
+		size_t Length(Id id) const;
+
+		size_t Count() const { return m_count; }
+		size_t Bytes() const { return m_data.size(); }
+
+		static DWORD Hash(const char* str, size_t length);
+
+	private:
+		std::vector<char> m_data;
+		// open addressing table of ids, size is always a power of 2
+		std::vector<Id> m_buckets;
+		size_t m_count = 0;
+
+		bool Equals(Id id, const char* str, size_t length) const;
+		void Grow();
+	};
+
+	typedef std::shared_ptr<StringPool> StringPoolPtr;
+}
\ No newline at end of file
@@ -0,0 +1,83 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <functional>
+
+namespace peparser
+{
+	// number of workers to use when user asked for 'threads' (0 means one per logical processor)
+	inline size_t WorkerCount(size_t threads, size_t items)
+	{
+		if (threads == 0)
+			threads = std::thread::hardware_concurrency();
+
+		if (threads == 0)
+			threads = 1;
+
+		return (threads < items) ? threads : items;
+	}
+
+	// calls work(i) for every i in [0, count) on up to 'threads' workers, items are handed out one at a time
+	// so a few big inputs don't hold back the rest, returns when all items are done
+	// work must not throw and must only touch state that belongs to item i (or synchronize itself)
+	inline void ParallelForEach(size_t count, size_t threads, const std::function<void(size_t)>& work)
+	{
+		size_t workers = WorkerCount(threads, count);
+
+		if (workers <= 1)
+		{
+			for (size_t i = 0; i < count; ++i)
+				work(i);
+			return;
+		}
+
+		std::atomic<size_t> next(0);
+		auto worker = [&]()
+		{
+			for (size_t i = next++; i < count; i = next++)
+				work(i);
+		};
+
+		std::vector<std::thread> pool;
+		pool.reserve(workers - 1);
+		for (size_t i = 1; i < workers; ++i)
+			pool.push_back(std::thread(worker));
+
+		// calling thread is a worker too
+		worker();
+
+		for (auto& thread : pool)
+			thread.join();
+	}
+
+	// for reports over long input lists: items are done in batches, work(i, result) runs on the workers and
+	// emit(i, result) on the calling thread in input order once its batch is done, out is flushed after every
+	// batch, so output is streamed without holding results of all items
+	template <class Result, class Stream, class Work, class Emit>
+	void OrderedParallelForEach(size_t count, size_t threads, Stream& out, Work work, Emit emit)
+	{
+		const size_t batchSize = 256;
+		std::vector<Result> results;
+
+		for (size_t start = 0; start < count; start += batchSize)
+		{
+			size_t batch = (count - start < batchSize) ? count - start : batchSize;
+			results.assign(batch, Result());
+
+			ParallelForEach(batch, threads, [&](size_t i)
+			{
+				work(start + i, results[i]);
+			});
+
+			for (size_t i = 0; i < batch; ++i)
+				emit(start + i, results[i]);
+
+			out.flush();
+		}
+	}
+}
\ No newline at end of file
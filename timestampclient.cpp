@@ -0,0 +1,140 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "timestampclient.h"
+
+#include <sstream>
+
+#pragma comment(lib, "winhttp.lib")
+
+namespace peparser
+{
+	namespace
+	{
+		std::wstring LastError(const wchar_t* message)
+		{
+			std::wostringstream out;
+			out << message << L" Error: " << GetLastError();
+			return out.str();
+		}
+	}
+
+	TimestampClient::TimestampClient(DWORD timeout)
+	{
+		m_session = WinHttpOpen(L"peparser", WINHTTP_ACCESS_TYPE_DEFAULT_PROXY, WINHTTP_NO_PROXY_NAME, WINHTTP_NO_PROXY_BYPASS, 0);
+
+		if (m_session)
+			WinHttpSetTimeouts(m_session, timeout, timeout, timeout, timeout);
+	}
+
+	TimestampClient::~TimestampClient()
+	{
+		for (auto& connection : m_connections)
+			WinHttpCloseHandle(connection.second);
+
+		if (m_session)
+			WinHttpCloseHandle(m_session);
+	}
+
+	HINTERNET TimestampClient::Connect(const std::wstring& host, INTERNET_PORT port)
+	{
+		std::wstring key = host + L":" + std::to_wstring(port);
+
+		std::lock_guard<std::mutex> guard(m_lock);
+
+		auto found = m_connections.find(key);
+		if (found != m_connections.end())
+			return found->second;
+
+		HINTERNET connection = WinHttpConnect(m_session, host.c_str(), port, 0);
+		if (connection)
+			m_connections[key] = connection;
+
+		return connection;
+	}
+
+	bool TimestampClient::Post(const std::wstring& url, const std::wstring& contentType, const std::vector<BYTE>& body, std::vector<BYTE>& reply, std::wstring& error, const std::wstring& headers)
+	{
+		reply.clear();
+
+		if (!m_session)
+		{
+			error = L"Failed to initialize WinHTTP.";
+			return false;
+		}
+
+		URL_COMPONENTS components = {};
+		components.dwStructSize = sizeof(components);
+		components.dwHostNameLength = (DWORD)-1;
+		components.dwUrlPathLength = (DWORD)-1;
+		components.dwExtraInfoLength = (DWORD)-1;
+
+		if (!WinHttpCrackUrl(url.c_str(), (DWORD)url.size(), 0, &components))
+		{
+			error = L"Malformed URL.";
+			return false;
+		}
+
+		std::wstring host(components.lpszHostName, components.dwHostNameLength);
+		std::wstring path(components.lpszUrlPath, components.dwUrlPathLength);
+		path.append(components.lpszExtraInfo, components.dwExtraInfoLength);
+		if (path.empty())
+			path = L"/";
+
+		HINTERNET connection = Connect(host, components.nPort);
+		if (!connection)
+		{
+			error = LastError(L"Failed to connect.");
+			return false;
+		}
+
+		DWORD flags = (components.nScheme == INTERNET_SCHEME_HTTPS) ? WINHTTP_FLAG_SECURE : 0;
+		HINTERNET request = WinHttpOpenRequest(connection, L"POST", path.c_str(), NULL, WINHTTP_NO_REFERER, WINHTTP_DEFAULT_ACCEPT_TYPES, flags);
+		if (!request)
+		{
+			error = LastError(L"Failed to open request.");
+			return false;
+		}
+
+		std::wstring allHeaders = L"Content-Type: " + contentType + L"\r\n" + headers;
+
+		bool ok = WinHttpSendRequest(request, allHeaders.c_str(), (DWORD)allHeaders.size(), (LPVOID)body.data(), (DWORD)body.size(), (DWORD)body.size(), 0)
+			&& WinHttpReceiveResponse(request, NULL);
+
+		if (!ok)
+			error = LastError(L"Request failed.");
+
+		DWORD status = 0;
+		DWORD statusSize = sizeof(status);
+		if (ok && !WinHttpQueryHeaders(request, WINHTTP_QUERY_STATUS_CODE | WINHTTP_QUERY_FLAG_NUMBER, WINHTTP_HEADER_NAME_BY_INDEX, &status, &statusSize, WINHTTP_NO_HEADER_INDEX))
+		{
+			error = LastError(L"Failed to read reply status.");
+			ok = false;
+		}
+
+		// reading the reply to the end lets WinHTTP return the connection to its pool
+		for (DWORD available = 0; ok && WinHttpQueryDataAvailable(request, &available) && available; )
+		{
+			size_t size = reply.size();
+			reply.resize(size + available);
+
+			DWORD read = 0;
+			if (!WinHttpReadData(request, reply.data() + size, available, &read))
+			{
+				error = LastError(L"Failed to read reply.");
+				ok = false;
+			}
+
+			reply.resize(size + read);
+		}
+
+		if (ok && status != 200)
+		{
+			error = L"Server replied with HTTP status " + std::to_wstring(status) + L".";
+			ok = false;
+		}
+
+		WinHttpCloseHandle(request);
+		return ok;
+	}
+}
\ No newline at end of file
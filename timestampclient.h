@@ -0,0 +1,41 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <windows.h>
+#include <winhttp.h>
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace peparser
+{
+	// HTTP client for timestamp servers and remote signing agents
+	// one WinHTTP session is shared by all requests and connections are cached per server, so connections are kept alive
+	// and reused instead of paying a TCP (and TLS) handshake for every file, safe to use from several threads
+	class TimestampClient
+	{
+	public:
+		// timeout in milliseconds applies to resolving, connecting, sending and receiving separately
+		explicit TimestampClient(DWORD timeout = 30000);
+		~TimestampClient();
+
+		// posts body to url and reads the whole reply, fails on anything but HTTP 200 (reply then holds the error body)
+		// headers are added to the request, each ending with CRLF
+		bool Post(const std::wstring& url, const std::wstring& contentType, const std::vector<BYTE>& body, std::vector<BYTE>& reply, std::wstring& error, const std::wstring& headers = std::wstring());
+
+	private:
+		TimestampClient(const TimestampClient&);
+		TimestampClient& operator=(const TimestampClient&);
+
+		HINTERNET Connect(const std::wstring& host, INTERNET_PORT port);
+
+		HINTERNET m_session = nullptr;
+
+		std::mutex m_lock;
+		std::map<std::wstring, HINTERNET> m_connections;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,188 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "timestampscheduler.h"
+
+#include <ostream>
+
+namespace peparser
+{
+	namespace
+	{
+		// weight of the latest request in moving averages
+		const double Smoothing = 0.3;
+		// how much a server's error rate inflates its latency when servers are compared
+		const double ErrorPenalty = 10;
+	}
+
+	TimestampScheduler::TimestampScheduler(const std::vector<std::wstring>& urls, const Options& options)
+		: m_options(options), m_servers(urls.size())
+	{
+		if (m_options.window == 0)
+			m_options.window = 1;
+
+		for (size_t i = 0; i < urls.size(); ++i)
+			m_servers[i].stats.url = urls[i];
+	}
+
+	double TimestampScheduler::Score(const Server& server) const
+	{
+		// unmeasured servers and servers due for a probe go first
+		if (!server.measured || server.circuit == Circuit::Open)
+			return -1;
+
+		return server.stats.latency * (1 + ErrorPenalty * server.stats.errorRate);
+	}
+
+	size_t TimestampScheduler::Pick(size_t avoid, Clock::time_point now, Clock::time_point& wake)
+	{
+		size_t best = NoServer;
+		size_t fallback = NoServer;
+
+		for (size_t i = 0; i < m_servers.size(); ++i)
+		{
+			Server& server = m_servers[i];
+
+			if (server.circuit == Circuit::Open && now < server.reopen)
+			{
+				if (server.reopen < wake)
+					wake = server.reopen;
+				continue;
+			}
+
+			// one probe at a time, and nothing else until it comes back
+			if (server.circuit == Circuit::Probing || (server.circuit == Circuit::Open && server.inFlight))
+				continue;
+
+			if (server.inFlight >= m_options.window)
+				continue;
+
+			size_t& candidate = (i == avoid) ? fallback : best;
+			if (candidate == NoServer || Score(server) < Score(m_servers[candidate]))
+				candidate = i;
+		}
+
+		return (best != NoServer) ? best : fallback;
+	}
+
+	size_t TimestampScheduler::Acquire(size_t avoid)
+	{
+		if (m_servers.empty())
+			return NoServer;
+
+		std::unique_lock<std::mutex> guard(m_lock);
+
+		for (;;)
+		{
+			Clock::time_point wake = (Clock::time_point::max)();
+			size_t picked = Pick(avoid, Clock::now(), wake);
+
+			if (picked != NoServer)
+			{
+				Server& server = m_servers[picked];
+				++server.inFlight;
+				if (server.circuit == Circuit::Open)
+					server.circuit = Circuit::Probing;
+
+				return picked;
+			}
+
+			// every server is backing off and nothing will come back, waiting here could take minutes
+			bool inFlight = false;
+			for (auto& server : m_servers)
+				inFlight = inFlight || server.inFlight;
+
+			if (!inFlight)
+				return NoServer;
+
+			if (wake == (Clock::time_point::max)())
+				m_released.wait(guard);
+			else
+				m_released.wait_until(guard, wake);
+		}
+	}
+
+	TimestampScheduler::Clock::time_point TimestampScheduler::NextReopen() const
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+
+		Clock::time_point next = (Clock::time_point::max)();
+		for (auto& server : m_servers)
+			if (server.circuit == Circuit::Open && server.reopen < next)
+				next = server.reopen;
+
+		return (next == (Clock::time_point::max)()) ? Clock::now() : next;
+	}
+
+	void TimestampScheduler::Release(size_t server, bool succeeded, Clock::duration latency)
+	{
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			Server& s = m_servers[server];
+
+			--s.inFlight;
+
+			double milliseconds = std::chrono::duration<double, std::milli>(latency).count();
+			s.stats.requests++;
+			s.stats.totalLatency += milliseconds;
+			s.stats.latency = s.measured ? s.stats.latency + Smoothing * (milliseconds - s.stats.latency) : milliseconds;
+			s.stats.errorRate = s.measured ? s.stats.errorRate + Smoothing * ((succeeded ? 0 : 1) - s.stats.errorRate) : (succeeded ? 0 : 1);
+			s.measured = true;
+
+			if (succeeded)
+			{
+				s.failuresInRow = 0;
+				s.failedProbes = 0;
+				s.circuit = Circuit::Closed;
+			}
+			else
+			{
+				s.stats.failures++;
+				s.failuresInRow++;
+
+				bool probeFailed = s.circuit == Circuit::Probing;
+				if (probeFailed)
+					s.failedProbes++;
+
+				if (probeFailed || (s.circuit == Circuit::Closed && s.failuresInRow >= m_options.failureThreshold))
+				{
+					unsigned __int64 backoff = (unsigned __int64)m_options.backoff << min(s.failedProbes, (size_t)16);
+					if (backoff > m_options.maxBackoff)
+						backoff = m_options.maxBackoff;
+
+					s.circuit = Circuit::Open;
+					s.reopen = Clock::now() + std::chrono::milliseconds(backoff);
+					s.stats.trips++;
+				}
+			}
+
+			s.stats.open = s.circuit != Circuit::Closed;
+		}
+
+		m_released.notify_all();
+	}
+
+	std::vector<TimestampScheduler::Stats> TimestampScheduler::GetStats() const
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+
+		std::vector<Stats> stats;
+		for (auto& server : m_servers)
+			stats.push_back(server.stats);
+
+		return stats;
+	}
+
+	void TimestampScheduler::PrintStats(std::wostream& out) const
+	{
+		for (auto& stats : GetStats())
+		{
+			out << L"Timestamp server: " << stats.url
+				<< L", Requests: " << stats.requests
+				<< L", Failed: " << stats.failures
+				<< L", Average latency: " << (stats.requests ? (size_t)(stats.totalLatency / stats.requests) : 0) << L" ms"
+				<< L", Circuit opened: " << stats.trips
+				<< (stats.open ? L" (open)" : L"") << std::endl;
+		}
+	}
+}
\ No newline at end of file
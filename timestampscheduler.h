@@ -0,0 +1,97 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <windows.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <iosfwd>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace peparser
+{
+	// routes timestamp requests to servers by how they have been doing so far
+	// every server has a moving average of its latency and error rate and a circuit breaker: after a few failures in a row
+	// the server is skipped for a backoff period, then a single probe request decides whether it is used again
+	// (backoff doubles every time a probe fails)
+	// a server never has more than 'window' requests in flight, safe to use from several threads
+	class TimestampScheduler
+	{
+	public:
+		typedef std::chrono::steady_clock Clock;
+
+		struct Options
+		{
+			size_t window = 4;
+			// failures in a row that open the circuit
+			size_t failureThreshold = 3;
+			DWORD backoff = 5000;
+			DWORD maxBackoff = 120000;
+		};
+
+		struct Stats
+		{
+			std::wstring url;
+			size_t requests = 0;
+			size_t failures = 0;
+			// times the circuit was opened
+			size_t trips = 0;
+			double totalLatency = 0;
+			// moving averages, latency in milliseconds
+			double latency = 0;
+			double errorRate = 0;
+			bool open = false;
+		};
+
+		static const size_t NoServer = (size_t)-1;
+
+		TimestampScheduler(const std::vector<std::wstring>& urls, const Options& options);
+
+		// waits until some server can take a request and returns it: the one with lowest latency weighted by error rate,
+		// servers without measurements yet come first so every server is tried
+		// 'avoid' (usually the server that just failed for the same file) is only picked if nothing else is available
+		// returns NoServer right away if all servers are backing off and no request is in flight
+		size_t Acquire(size_t avoid = NoServer);
+		// reports how a request acquired before went
+		void Release(size_t server, bool succeeded, Clock::duration latency);
+		// earliest end of a backoff, now if no server is backing off
+		Clock::time_point NextReopen() const;
+
+		std::vector<Stats> GetStats() const;
+		void PrintStats(std::wostream& out) const;
+
+	private:
+		enum class Circuit
+		{
+			  Closed
+			, Open
+			// backoff is over and a probe request is in flight
+			, Probing
+		};
+
+		struct Server
+		{
+			Stats stats;
+			Circuit circuit = Circuit::Closed;
+			Clock::time_point reopen;
+			size_t failuresInRow = 0;
+			size_t failedProbes = 0;
+			size_t inFlight = 0;
+			bool measured = false;
+		};
+
+		// returns NoServer and sets wake to when a backoff ends if none can take a request now
+		size_t Pick(size_t avoid, Clock::time_point now, Clock::time_point& wake);
+		double Score(const Server& server) const;
+
+		Options m_options;
+		std::vector<Server> m_servers;
+
+		mutable std::mutex m_lock;
+		std::condition_variable m_released;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,240 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "typelibrary.h"
+
+#include <cstddef>
+
+namespace peparser
+{
+	namespace
+	{
+		// MSFT type library layout, as far as it is needed to reach library level custom data
+		// names are ours, the layout is what oleaut32 reads and MIDL writes
+
+		#pragma pack(push, 1)
+
+		struct MsftHeader
+		{
+			DWORD magic1; // "MSFT"
+			DWORD magic2; // 0x00010002
+			LONG guidOffset;
+			DWORD lcid;
+			DWORD lcid2;
+			DWORD varFlags; // HelpDllFlag means an extra helpstringdll offset follows the header
+			DWORD version;
+			DWORD flags;
+			DWORD typeInfoCount; // an offset per type info follows the header
+			LONG helpString;
+			DWORD helpStringContext;
+			DWORD helpContext;
+			DWORD nameTableCount;
+			DWORD nameTableChars;
+			LONG nameOffset;
+			LONG helpFile;
+			LONG customDataOffset; // first entry of library custom data list in CustomDataGuids segment, -1 if none
+			DWORD reserved1;
+			DWORD reserved2;
+			LONG dispatchPosition;
+			DWORD importInfoCount;
+		};
+
+		// position of a table in the library
+		struct MsftSegment
+		{
+			LONG offset;
+			LONG length;
+			LONG reserved1;
+			LONG reserved2;
+		};
+
+		enum MsftSegmentIndex
+		{
+			  TypeInfoTable
+			, ImportInfo
+			, ImportFiles
+			, References
+			, GuidHashTable
+			, GuidTable
+			, NameHashTable
+			, NameTable
+			, StringTable
+			, TypeDescriptions
+			, ArrayDescriptions
+			, CustomData
+			, CustomDataGuids
+			, Reserved1
+			, Reserved2
+			, SegmentCount
+		};
+
+		// entry of a custom data list
+		struct MsftCustomDataGuid
+		{
+			LONG guidOffset; // into GuidTable
+			LONG dataOffset; // into CustomData, negative values hold small values inline
+			LONG next; // into CustomDataGuids, -1 terminates the list
+		};
+
+		struct MsftGuidEntry
+		{
+			GUID guid;
+			LONG hrefType;
+			LONG nextHash;
+		};
+
+		#pragma pack(pop)
+
+		const DWORD MsftMagic = 0x5446534D; // "MSFT"
+		const DWORD SltgMagic = 0x47544C53; // "SLTG"
+		const DWORD HelpDllFlag = 0x100;
+
+		// custom data ids MIDL uses: {DE77BA63-517C-11D1-A2DA-0000F8773CE9} generation time,
+		// {DE77BA64-...} MIDL version, {DE77BA65-...} vanity string
+		const GUID MidlTimestamp = { 0xDE77BA63, 0x517C, 0x11D1, { 0xA2, 0xDA, 0x00, 0x00, 0xF8, 0x77, 0x3C, 0xE9 } };
+		const GUID MidlVanityString = { 0xDE77BA65, 0x517C, 0x11D1, { 0xA2, 0xDA, 0x00, 0x00, 0xF8, 0x77, 0x3C, 0xE9 } };
+
+		// bounds checked view of the library
+		class Reader
+		{
+		public:
+			Reader(const BYTE* data, size_t size, const std::function<bool(const void*, size_t)>& ensure) : m_data(data), m_size(size), m_ensure(ensure) {}
+
+			template<class T> const T* At(size_t offset, size_t count = 1) const
+			{
+				size_t size = sizeof(T) * count;
+				if (offset > m_size || size > m_size - offset || (count && size / count != sizeof(T)))
+					return nullptr;
+
+				if (m_ensure && !m_ensure(m_data + offset, size))
+					return nullptr;
+
+				return (const T*)(m_data + offset);
+			}
+
+			// offset of an entry inside a segment, if the entry fits in it
+			bool InSegment(const MsftSegment& segment, LONG offset, size_t size, size_t& result) const
+			{
+				if (segment.offset < 0 || segment.length < 0 || offset < 0)
+					return false;
+
+				if ((size_t)offset > (size_t)segment.length || size > (size_t)segment.length - offset)
+					return false;
+
+				result = (size_t)segment.offset + offset;
+				return true;
+			}
+
+		private:
+			const BYTE* m_data;
+			size_t m_size;
+			const std::function<bool(const void*, size_t)>& m_ensure;
+		};
+	}
+
+	bool FindMidlSegments(const BYTE* data, size_t size, const std::function<bool(const void*, size_t)>& ensure, std::vector<TypeLibrarySegment>& segments)
+	{
+		segments.clear();
+
+		Reader reader(data, size, ensure);
+
+		const DWORD* magic = reader.At<DWORD>(0);
+		if (!magic)
+			return false;
+
+		// SLTG libraries come from mktyplib and don't have MIDL custom data
+		if (*magic == SltgMagic)
+			return true;
+
+		const MsftHeader* header = reader.At<MsftHeader>(0);
+		if (!header || header->magic1 != MsftMagic)
+			return false;
+
+		size_t position = sizeof(MsftHeader);
+		if (header->varFlags & HelpDllFlag)
+			position += sizeof(LONG);
+
+		// count comes from the file, checked before multiplying so it can't wrap around in 32 bit builds
+		if (position > size || header->typeInfoCount > (size - position) / sizeof(LONG))
+			return false;
+		position += header->typeInfoCount * sizeof(LONG);
+
+		const MsftSegment* directory = reader.At<MsftSegment>(position, SegmentCount);
+		if (!directory)
+			return false;
+
+		const MsftSegment& guids = directory[GuidTable];
+		const MsftSegment& customData = directory[CustomData];
+		const MsftSegment& customDataGuids = directory[CustomDataGuids];
+
+		// list is bounded by the segment size, protects from loops in corrupted files
+		size_t maxEntries = (customDataGuids.length > 0) ? (size_t)customDataGuids.length / sizeof(MsftCustomDataGuid) : 0;
+
+		LONG next = header->customDataOffset;
+		for (size_t i = 0; next >= 0 && i < maxEntries; ++i)
+		{
+			size_t offset = 0;
+			const MsftCustomDataGuid* entry = (reader.InSegment(customDataGuids, next, sizeof(MsftCustomDataGuid), offset)) ? reader.At<MsftCustomDataGuid>(offset) : nullptr;
+			if (!entry)
+				return false;
+
+			size_t entryOffset = offset;
+			next = entry->next;
+
+			const MsftGuidEntry* guid = (reader.InSegment(guids, entry->guidOffset, sizeof(MsftGuidEntry), offset)) ? reader.At<MsftGuidEntry>(offset) : nullptr;
+			if (!guid)
+				return false;
+
+			if (!IsEqualGUID(guid->guid, MidlTimestamp) && !IsEqualGUID(guid->guid, MidlVanityString))
+				continue;
+
+			// told apart by type of the value, time is a number, vanity string is a string
+			TypeLibrarySegment segment;
+			segment.description = L"MIDL timestamp";
+
+			// small values are packed into the offset itself
+			if (entry->dataOffset < 0)
+			{
+				segment.offset = entryOffset + offsetof(MsftCustomDataGuid, dataOffset);
+				segment.size = sizeof(LONG);
+				segments.push_back(segment);
+				continue;
+			}
+
+			// VARTYPE followed by the value, strings are a length followed by narrow chars
+			const VARTYPE* type = (reader.InSegment(customData, entry->dataOffset, sizeof(VARTYPE), offset)) ? reader.At<VARTYPE>(offset) : nullptr;
+			if (!type)
+				return false;
+
+			size_t valueOffset = offset + sizeof(VARTYPE);
+
+			if (*type == VT_BSTR)
+			{
+				const LONG* length = reader.At<LONG>(valueOffset);
+				if (!length || *length < 0 || !reader.At<char>(valueOffset + sizeof(LONG), *length))
+					return false;
+
+				// from the VARTYPE on, so the string itself isn't the first byte of the block and the length is covered too
+				segment.offset = offset;
+				segment.size = sizeof(VARTYPE) + sizeof(LONG) + *length;
+				segment.description = L"MIDL vanity string";
+				segment.vanityString = true;
+			}
+			else if (*type == VT_I4 || *type == VT_UI4 || *type == VT_INT || *type == VT_UINT)
+			{
+				if (!reader.At<DWORD>(valueOffset))
+					return false;
+
+				segment.offset = valueOffset;
+				segment.size = sizeof(DWORD);
+			}
+			else
+				continue;
+
+			if (segment.size)
+				segments.push_back(segment);
+		}
+
+		return true;
+	}
+}
\ No newline at end of file
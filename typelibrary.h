@@ -0,0 +1,30 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <windows.h>
+
+#include <string>
+#include <vector>
+#include <functional>
+
+namespace peparser
+{
+	// part of a type library, offset is relative to the start of the library
+	struct TypeLibrarySegment
+	{
+		size_t offset = 0;
+		size_t size = 0;
+		std::wstring description;
+		// "Created by MIDL version ... at ..." string, segment starts at its VARTYPE and length
+		bool vanityString = false;
+	};
+
+	// finds custom data MIDL attaches to every type library it generates and that changes with each build:
+	// generation time and the "Created by MIDL version ... at ..." vanity string
+	// only MSFT type libraries (what MIDL produces) carry them, SLTG ones are recognized and have no segments
+	// ensure is called for every range before it is read, so only the header and custom data tables are loaded
+	// returns false if data is not a type library or is malformed
+	bool FindMidlSegments(const BYTE* data, size_t size, const std::function<bool(const void*, size_t)>& ensure, std::vector<TypeLibrarySegment>& segments);
+}
\ No newline at end of file
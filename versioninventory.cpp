@@ -0,0 +1,191 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "versioninventory.h"
+#include "peparser.h"
+#include "resourcepath.h"
+#include "widestring.h"
+
+#include <vector>
+#include <sstream>
+#include <iomanip>
+
+namespace peparser
+{
+	namespace
+	{
+		std::wstring FormatVersion(DWORD ms, DWORD ls)
+		{
+			std::wstringstream ss; ss
+				<< (ms >> 8 * sizeof(WORD)) << L"."
+				<< (ms & 0x0000FFFF) << L"."
+				<< (ls >> 8 * sizeof(WORD)) << L"."
+				<< (ls & 0x0000FFFF)
+			;
+			return ss.str();
+		}
+
+		std::wstring FormatHex(DWORD value)
+		{
+			std::wstringstream ss;
+			ss << L"0x" << std::hex << std::setw(8) << std::setfill(L'0') << value;
+			return ss.str();
+		}
+
+		// flags that are set and valid according to the mask, with names of the known ones
+		std::wstring FormatFlags(DWORD flags, DWORD mask)
+		{
+			static const struct { DWORD flag; const wchar_t* name; } names[] =
+			{
+				  { VS_FF_DEBUG, L"DEBUG" }
+				, { VS_FF_PRERELEASE, L"PRERELEASE" }
+				, { VS_FF_PATCHED, L"PATCHED" }
+				, { VS_FF_PRIVATEBUILD, L"PRIVATEBUILD" }
+				, { VS_FF_INFOINFERRED, L"INFOINFERRED" }
+				, { VS_FF_SPECIALBUILD, L"SPECIALBUILD" }
+			};
+
+			flags &= mask;
+
+			std::wstring result = FormatHex(flags);
+			std::wstring separator = L" ";
+			for (auto& name : names)
+			{
+				if (!(flags & name.flag))
+					continue;
+
+				result += separator + name.name;
+				separator = L"|";
+			}
+
+			return result;
+		}
+
+		std::wstring TrimNulls(const std::wstring& str)
+		{
+			size_t end = str.find(L'\0');
+			return (end == std::wstring::npos) ? str : str.substr(0, end);
+		}
+	}
+
+	std::string VersionInventory::Header() const
+	{
+		return (m_format == Csv) ? "file,resource,table,field,value\r\n" : "";
+	}
+
+	bool VersionInventory::Rows(const std::wstring& path, std::string& rows, std::wstring& error) const
+	{
+		rows.clear();
+
+		PEParser pe(path);
+		pe.OpenMetadata();
+		if (!pe.IsValidPE())
+		{
+			error = L"Can't open file for reading or invalid format.";
+			return false;
+		}
+
+		std::vector<ResourceEntryPtr> leaves;
+		ResourcePattern(L"16/*/*").Collect(pe.ResourceDirectory(), leaves);
+
+		std::wstring out;
+		for (auto& leaf : leaves)
+		{
+			// only the version blocks are read from the file
+			LPBYTE address = pe.Data(leaf->FileOffset(), leaf->Size());
+			if (!address)
+				continue;
+
+			std::vector<BYTE> data(address, address + leaf->Size());
+
+			VS_VersionInfo info(data.data(), data.size());
+			if (!info.IsWellFormed())
+				continue;
+
+			std::wstring resource = leaf->FullPath();
+
+			const VS_FIXEDFILEINFO* fixed = info.FixedFileInfo();
+			AppendRow(out, path, resource, L"fixed", L"FileVersion", FormatVersion(fixed->dwFileVersionMS, fixed->dwFileVersionLS));
+			AppendRow(out, path, resource, L"fixed", L"ProductVersion", FormatVersion(fixed->dwProductVersionMS, fixed->dwProductVersionLS));
+			AppendRow(out, path, resource, L"fixed", L"FileFlags", FormatFlags(fixed->dwFileFlags, fixed->dwFileFlagsMask));
+			AppendRow(out, path, resource, L"fixed", L"FileOS", FormatHex(fixed->dwFileOS));
+			AppendRow(out, path, resource, L"fixed", L"FileType", FormatHex(fixed->dwFileType));
+			AppendRow(out, path, resource, L"fixed", L"FileSubtype", FormatHex(fixed->dwFileSubtype));
+
+			for (auto& entry : info.Entries())
+			{
+				if (!entry || !entry->IsWellFormed())
+					continue;
+
+				for (auto& table : entry->Entries())
+				{
+					if (!table || !table->IsWellFormed())
+						continue;
+
+					std::wstring name = TrimNulls(table->Name());
+					for (auto& value : table->Entries())
+						AppendRow(out, path, resource, name, TrimNulls(value.key), TrimNulls(value.newValue));
+				}
+			}
+		}
+
+		rows = WideStringToUtf8(out);
+		return true;
+	}
+
+	void VersionInventory::AppendRow(std::wstring& out, const std::wstring& path, const std::wstring& resource, const std::wstring& table, const std::wstring& field, const std::wstring& value) const
+	{
+		if (m_format == Csv)
+		{
+			AppendValue(out, path);
+			out += L',';
+			AppendValue(out, resource);
+			out += L',';
+			AppendValue(out, table);
+			out += L',';
+			AppendValue(out, field);
+			out += L',';
+			AppendValue(out, value);
+			out += L"\r\n";
+		}
+		else
+		{
+			out += L"{\"file\":";
+			AppendValue(out, path);
+			out += L",\"resource\":";
+			AppendValue(out, resource);
+			out += L",\"table\":";
+			AppendValue(out, table);
+			out += L",\"field\":";
+			AppendValue(out, field);
+			out += L",\"value\":";
+			AppendValue(out, value);
+			out += L"}\n";
+		}
+	}
+
+	void VersionInventory::AppendValue(std::wstring& out, const std::wstring& value) const
+	{
+		if (m_format == Csv)
+		{
+			// RFC 4180: quoted only when needed, quotes doubled
+			if (value.find_first_of(L",\"\r\n") == std::wstring::npos)
+			{
+				out += value;
+				return;
+			}
+
+			out += L'"';
+			for (wchar_t c : value)
+			{
+				if (c == L'"')
+					out += L'"';
+				out += c;
+			}
+			out += L'"';
+			return;
+		}
+
+		AppendJsonString(out, value);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,39 @@
+// Copyright (c) 2016 SMART Technologies. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <windows.h>
+
+#include <string>
+
+namespace peparser
+{
+	// turns version resources (16/*/*) of a file into report rows, one row per StringTable value
+	// or VS_FIXEDFILEINFO field: file, resource path, table ("040904b0", "fixed" for VS_FIXEDFILEINFO), field, value
+	// rows of a file are built as one wide string and converted to UTF-8 in one go
+	class VersionInventory
+	{
+	public:
+		enum Format
+		{
+			  Csv
+			, JsonLines
+		};
+
+		explicit VersionInventory(Format format) : m_format(format) {}
+
+		// column names line for CSV, empty for JSON Lines
+		std::string Header() const;
+
+		// opens the file for metadata only, so only headers, resource directory and version resources are read
+		// returns false and sets error if the file is not a valid PE, a file without version info has no rows
+		bool Rows(const std::wstring& path, std::string& rows, std::wstring& error) const;
+
+	private:
+		Format m_format;
+
+		void AppendRow(std::wstring& out, const std::wstring& path, const std::wstring& resource, const std::wstring& table, const std::wstring& field, const std::wstring& value) const;
+		void AppendValue(std::wstring& out, const std::wstring& value) const;
+	};
+}
\ No newline at end of file
@@ -3,6 +3,8 @@
 
 #pragma once
 
+#include <windows.h>
+
 #include <string>
 
 namespace peparser
@@ -27,6 +29,20 @@ namespace peparser
 		return result;
 	}
 
+	// for text that leaves the tool (reports), unlike WideStringToMultiByte doesn't depend on current locale
+	inline std::string WideStringToUtf8(const std::wstring& in)
+	{
+		if (in.empty()) return std::string();
+
+		int size = WideCharToMultiByte(CP_UTF8, 0, in.data(), (int)in.size(), NULL, 0, NULL, NULL);
+		if (size <= 0) return std::string();
+
+		std::string result(size, 0);
+		WideCharToMultiByte(CP_UTF8, 0, in.data(), (int)in.size(), &result[0], size, NULL, NULL);
+
+		return result;
+	}
+
 	inline std::wstring MultiByteToWideString(const std::string& in)
 	{
 		size_t size = 0;
@@ -44,6 +60,47 @@ namespace peparser
 		return result;
 	}
 
+	// for text that comes from outside (protocol messages), counterpart of WideStringToUtf8
+	inline std::wstring Utf8ToWideString(const std::string& in)
+	{
+		if (in.empty()) return std::wstring();
+
+		int size = MultiByteToWideChar(CP_UTF8, 0, in.data(), (int)in.size(), NULL, 0);
+		if (size <= 0) return std::wstring();
+
+		std::wstring result(size, 0);
+		MultiByteToWideChar(CP_UTF8, 0, in.data(), (int)in.size(), &result[0], size);
+
+		return result;
+	}
+
+	// appends value as a quoted JSON string (for JSON Lines reports)
+	inline void AppendJsonString(std::wstring& out, const std::wstring& value)
+	{
+		out += L'"';
+		for (wchar_t c : value)
+		{
+			switch (c)
+			{
+			case L'"': out += L"\\\""; break;
+			case L'\\': out += L"\\\\"; break;
+			case L'\n': out += L"\\n"; break;
+			case L'\r': out += L"\\r"; break;
+			case L'\t': out += L"\\t"; break;
+			default:
+				if (c < 0x20)
+				{
+					wchar_t escape[8];
+					swprintf_s(escape, L"\\u%04x", (unsigned)c);
+					out += escape;
+				}
+				else
+					out += c;
+			}
+		}
+		out += L'"';
+	}
+
 	// ====================================================================================
 	// searching for strings in PE files
 